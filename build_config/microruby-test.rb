@@ -3,6 +3,8 @@ MRuby::Build.new do |conf|
 
   conf.cc.defines << "MRB_TICK_UNIT=4"
   conf.cc.defines << "MRB_TIMESLICE_TICK_COUNT=3"
+  conf.cc.defines << "MRB_TICK_PROFILE"
+  conf.cc.defines << "MRB_TASK_PROFILE"
 
   conf.cc.defines << "PICORB_ALLOC_ALIGN=8"
   conf.cc.defines << "PICORB_ALLOC_ESTALLOC"
@@ -16,6 +16,7 @@ MRuby::CrossBuild.new("r2p2-microruby-pico2") do |conf|
   conf.cc.defines << "PICORB_ALLOC_ALIGN=8"
   conf.cc.defines << "ESTALLOC_DEBUG"
   conf.cc.defines << "USE_FAT_FLASH_DISK=1"
+  conf.cc.defines << "FAT_DISK_CACHE_SIZE=8192"
   conf.cc.defines << "MRB_USE_CUSTOM_RO_DATA_P"
   conf.cc.defines << "MRB_LINK_TIME_RO_DATA_P"
 
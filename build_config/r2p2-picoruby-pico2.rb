@@ -41,6 +41,7 @@ MRuby::CrossBuild.new("r2p2-picoruby-pico2") do |conf|
   conf.cc.defines << "MRBC_TICK_UNIT=1"
   conf.cc.defines << "MRBC_TIMESLICE_TICK_COUNT=10"
   conf.cc.defines << "USE_FAT_FLASH_DISK=1"
+  conf.cc.defines << "FAT_DISK_CACHE_SIZE=8192"
   conf.cc.defines << "NO_CLOCK_GETTIME=1"
   conf.cc.defines << "USE_FAT_SD_DISK=1"
   conf.cc.defines << "MAX_SYMBOLS_COUNT=2000"
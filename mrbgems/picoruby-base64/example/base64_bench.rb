@@ -0,0 +1,50 @@
+# Throughput of Base64 and Base16 encoding and decoding, and of the
+# streaming encoder fed in file-sized chunks.
+#
+#   bin/picoruby mrbgems/picoruby-base64/example/base64_bench.rb
+
+SIZE = 48 * 1024
+ROUNDS = 16
+CHUNK = 3072
+
+def bench(name, bytes)
+  started = Time.now.to_f
+  i = 0
+  while i < ROUNDS
+    yield
+    i += 1
+  end
+  elapsed = Time.now.to_f - started
+  kbps = elapsed == 0 ? '-' : (bytes * ROUNDS / elapsed / 1024).to_i
+  puts "#{name.ljust(18, " ")} #{kbps} KB/s"
+end
+
+data = ""
+i = 0
+while i < SIZE
+  data << ((i * 7 + 3) % 256).chr
+  i += 1
+end
+encoded = Base64.encode64(data)
+urlsafe = Base64.urlsafe_encode64(data)
+hex = Base16.encode16(data)
+
+bench("encode64", SIZE) { Base64.encode64(data) }
+bench("decode64", SIZE) { Base64.decode64(encoded) }
+bench("strict_decode64", SIZE) { Base64.strict_decode64(encoded) }
+bench("urlsafe_encode64", SIZE) { Base64.urlsafe_encode64(data) }
+bench("urlsafe_decode64", SIZE) { Base64.urlsafe_decode64(urlsafe) }
+bench("encode16", SIZE) { Base16.encode16(data) }
+bench("decode16", SIZE) { Base16.decode16(hex) }
+
+chunks = []
+i = 0
+while i < SIZE
+  chunks << data[i, CHUNK].to_s
+  i += CHUNK
+end
+bench("Encoder", SIZE) do
+  encoder = Base64::Encoder.new
+  chunks.each { |chunk| encoder.update(chunk) }
+  encoder.finish
+end
@@ -1,9 +1,61 @@
 class Base64
-  def self.urlsafe_encode64(string)
-    Base64.encode64(string).tr('+/', '-_').tr('=', '')
+  # Padding is left out unless asked for, as JWT and most URLs want it.
+  # urlsafe_decode64 accepts both.
+  def self.urlsafe_encode64(bin, padding: false)
+    Base64._urlsafe_encode64(bin, padding)
   end
 
-  def self.urlsafe_decode64(string)
-    Base64.decode64(string.tr('-_', '+/').ljust((string.length + 3) & ~3, '='))
+  # Encodes data given in pieces, such as a file read chunk by chunk:
+  #
+  #   encoder = Base64::Encoder.new
+  #   out = encoder.update(chunk1) + encoder.update(chunk2) + encoder.finish
+  #
+  # Chunks whose size is a multiple of 3 are encoded without copying.
+  # padding: applies to the URL-safe alphabet as in urlsafe_encode64;
+  # the standard one is always padded.
+  class Encoder
+    def initialize(urlsafe: false, padding: false)
+      @urlsafe = urlsafe
+      @padding = padding
+      @rest = ""
+    end
+
+    # Returns the characters of every complete 3-byte group so far
+    def update(data)
+      data = @rest + data unless @rest.empty?
+      tail = data.size % 3
+      if 0 < tail
+        @rest = data[data.size - tail, tail].to_s
+        data = data[0, data.size - tail].to_s
+      else
+        @rest = ""
+      end
+      _encode(data, false)
+    end
+
+    # Reads io (anything with read(length)) to the end and yields the
+    # encoded pieces, the last one included
+    def update_io(io, chunk_size = 3072)
+      while chunk = io.read(chunk_size)
+        yield update(chunk)
+      end
+      yield finish
+      self
+    end
+
+    # Returns the characters of the remaining bytes and starts over
+    def finish
+      rest = @rest
+      @rest = ""
+      _encode(rest, @padding)
+    end
+
+    def _encode(data, padding)
+      if @urlsafe
+        Base64._urlsafe_encode64(data, padding)
+      else
+        Base64.encode64(data)
+      end
+    end
   end
 end
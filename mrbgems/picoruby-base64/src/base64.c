@@ -1,21 +1,338 @@
-const char base64chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-static unsigned char
-base64_convert(unsigned char n)
-{
-  if (n >= 0x30 && n <= 0x39) {
-    return n + 4;  // 0x30(0) = 48 should return 52
-  } else if (n >= 0x41 && n <= 0x5a) {
-    return n - 65; // 0x41(A) = 65 should return 0
-  } else if (n >= 0x61 && n <= 0x7a) {
-    return n - 71; // 0x61(a) = 97 should return 26
-  } else if (n == 0x2b) {
-    return 62; // +
-  } else if (n == 0x2f) {
-    return 63; // slash
-  } else {
-    return 0;
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Base64 (RFC 4648 standard and URL-safe alphabets) and Base16
+ *
+ * Everything is table driven and writes into a buffer the caller has
+ * sized with base64_encoded_size() and friends, so a String is allocated
+ * once per call. Encoding packs three bytes into one word and emits four
+ * characters from it; decoding looks up four characters, checks them
+ * with a single test and stores three bytes.
+ *
+ * With __SSSE3__ both alphabets are encoded, and the standard one is
+ * decoded, sixteen characters at a time. Define PICORB_BASE64_NO_SIMD to
+ * ignore it.
+ */
+
+#if !defined(PICORB_BASE64_NO_SIMD) && defined(__SSSE3__)
+#include <tmmintrin.h>
+#define BASE64_SSSE3
+#endif
+
+#define BASE64_INVALID 0xFF
+#define BASE64_PAD     0xFE
+#define BASE64_ERROR   ((size_t)-1)
+
+static const char base64_std_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char base64_url_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/* character -> 6-bit value, BASE64_PAD for '=' and BASE64_INVALID otherwise */
+static const uint8_t base64_std_dec[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFE, 0xFF, 0xFF,
+  0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+  0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static const uint8_t base64_url_dec[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFE, 0xFF, 0xFF,
+  0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+  0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+  0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static const uint8_t base16_dec[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/* byte -> two lowercase hex digits */
+static const char base16_chars[] =
+  "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+  "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+  "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+  "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+  "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+  "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+  "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+  "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+#ifdef BASE64_SSSE3
+
+/* 12 bytes from in (16 readable) -> 16 characters */
+static void
+base64_encode_ssse3(char *out, const uint8_t *in, int urlsafe)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *)in);
+  /* each 32-bit lane gets bytes b1 b0 b2 b1 of its group */
+  v = _mm_shuffle_epi8(v, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+  __m128i hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+  __m128i lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+  __m128i idx = _mm_or_si128(hi, lo);
+  /* 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12 */
+  __m128i range = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+  range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+  __m128i shift = urlsafe
+    ? _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0)
+    : _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  _mm_storeu_si128((__m128i *)out, _mm_add_epi8(idx, _mm_shuffle_epi8(shift, range)));
+}
+
+/*
+ * 16 characters of the standard alphabet -> 12 bytes.
+ * Returns 0 without writing if any of them is something else.
+ */
+static int
+base64_decode_ssse3(uint8_t *out, const char *in)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *)in);
+  __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0F));
+  __m128i lo_nibbles = _mm_and_si128(v, _mm_set1_epi8(0x0F));
+  /* a character is valid when its two nibble classes share no bit */
+  __m128i lo_class = _mm_shuffle_epi8(
+    _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A),
+    lo_nibbles);
+  __m128i hi_class = _mm_shuffle_epi8(
+    _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10),
+    hi_nibbles);
+  __m128i bad = _mm_cmpeq_epi8(_mm_and_si128(lo_class, hi_class), _mm_setzero_si128());
+  if (_mm_movemask_epi8(bad) != 0xFFFF) return 0;
+  /* '/' shares the high nibble of '+' but needs another offset */
+  __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+  __m128i roll = _mm_shuffle_epi8(
+    _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0),
+    _mm_add_epi8(slash, hi_nibbles));
+  v = _mm_add_epi8(v, roll);
+  /* four 6-bit values -> 24 bits per lane, then drop the top byte of each */
+  v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+  v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+  v = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  _mm_storel_epi64((__m128i *)out, v);
+  uint32_t last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+  memcpy(out + 8, &last, 4);
+  return 1;
+}
+
+#endif /* BASE64_SSSE3 */
+
+static size_t
+base64_encoded_size(size_t len)
+{
+  return (len + 2) / 3 * 4;
+}
+
+/* Upper bound of the decoded size of len characters */
+static size_t
+base64_decoded_size(size_t len)
+{
+  return len / 4 * 3 + 2;
+}
+
+static size_t
+base64_encode(char *out, const uint8_t *in, size_t len, int urlsafe, int padding)
+{
+  const char *chars = urlsafe ? base64_url_chars : base64_std_chars;
+  size_t i = 0;
+  char *p = out;
+#ifdef BASE64_SSSE3
+  for (; i + 16 <= len; i += 12, p += 16) {
+    base64_encode_ssse3(p, in + i, urlsafe);
+  }
+#endif
+  for (; i + 3 <= len; i += 3, p += 4) {
+    uint32_t n = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+    p[0] = chars[n >> 18];
+    p[1] = chars[(n >> 12) & 63];
+    p[2] = chars[(n >> 6) & 63];
+    p[3] = chars[n & 63];
+  }
+  if (i < len) {
+    uint32_t n = (uint32_t)in[i] << 16;
+    if (i + 1 < len) n |= (uint32_t)in[i + 1] << 8;
+    *p++ = chars[n >> 18];
+    *p++ = chars[(n >> 12) & 63];
+    if (i + 1 < len) {
+      *p++ = chars[(n >> 6) & 63];
+    } else if (padding) {
+      *p++ = '=';
+    }
+    if (padding) *p++ = '=';
+  }
+  return (size_t)(p - out);
+}
+
+/*
+ * Decodes whole groups of four characters from in[*pos] while they are
+ * all in the alphabet. Returns the number of bytes written.
+ */
+static size_t
+base64_decode_groups(uint8_t *out, const char *in, size_t len, size_t *pos, const uint8_t *table)
+{
+  const uint8_t *s = (const uint8_t *)in;
+  size_t i = *pos;
+  uint8_t *p = out;
+#ifdef BASE64_SSSE3
+  if (table == base64_std_dec) {
+    for (; i + 16 <= len; i += 16, p += 12) {
+      if (!base64_decode_ssse3(p, in + i)) break;
+    }
+  }
+#endif
+  for (; i + 4 <= len; i += 4, p += 3) {
+    uint8_t a = table[s[i]];
+    uint8_t b = table[s[i + 1]];
+    uint8_t c = table[s[i + 2]];
+    uint8_t d = table[s[i + 3]];
+    if ((a | b | c | d) & 0x80) break;
+    uint32_t n = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+    p[0] = (uint8_t)(n >> 16);
+    p[1] = (uint8_t)(n >> 8);
+    p[2] = (uint8_t)n;
+  }
+  *pos = i;
+  return (size_t)(p - out);
+}
+
+/*
+ * Like Ruby's unpack("m"): characters outside the alphabet (such as line
+ * breaks) are skipped and decoding stops at the first '='.
+ */
+static size_t
+base64_decode(uint8_t *out, const char *in, size_t len)
+{
+  const uint8_t *s = (const uint8_t *)in;
+  size_t i = 0;
+  uint8_t *p = out;
+  uint32_t n = 0;
+  int count = 0;
+  while (i < len) {
+    if (count == 0) {
+      p += base64_decode_groups(p, in, len, &i, base64_std_dec);
+      if (len <= i) break;
+    }
+    uint8_t c = base64_std_dec[s[i++]];
+    if (c == BASE64_PAD) break;
+    if (c == BASE64_INVALID) continue;
+    n = n << 6 | c;
+    if (++count == 4) {
+      *p++ = (uint8_t)(n >> 16);
+      *p++ = (uint8_t)(n >> 8);
+      *p++ = (uint8_t)n;
+      n = 0;
+      count = 0;
+    }
+  }
+  if (count == 3) {
+    *p++ = (uint8_t)(n >> 10);
+    *p++ = (uint8_t)(n >> 2);
+  } else if (count == 2) {
+    *p++ = (uint8_t)(n >> 4);
+  }
+  return (size_t)(p - out);
+}
+
+/*
+ * Like Ruby's unpack("m0"): every character must be in the alphabet,
+ * padding must be right and the unused bits must be zero.
+ * The URL-safe alphabet may also leave the padding out.
+ * Returns BASE64_ERROR for anything else.
+ */
+static size_t
+base64_strict_decode(uint8_t *out, const char *in, size_t len, int urlsafe)
+{
+  const uint8_t *table = urlsafe ? base64_url_dec : base64_std_dec;
+  const uint8_t *s = (const uint8_t *)in;
+  size_t body = len;
+  if (len % 4 == 0) {
+    if (0 < len && in[len - 1] == '=') body--;
+    if (body < len && in[len - 2] == '=') body--;
+  } else if (!urlsafe) {
+    return BASE64_ERROR;
+  }
+  size_t rest = body % 4;
+  if (rest == 1) return BASE64_ERROR;
+  size_t i = 0;
+  size_t written = base64_decode_groups(out, in, body - rest, &i, table);
+  if (i != body - rest) return BASE64_ERROR;
+  uint8_t *p = out + written;
+  if (rest) {
+    uint8_t a = table[s[i]];
+    uint8_t b = table[s[i + 1]];
+    uint8_t c = (rest == 3) ? table[s[i + 2]] : 0;
+    if ((a | b | c) & 0x80) return BASE64_ERROR;
+    uint32_t n = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6;
+    if (rest == 2 && (n & 0xFFFF)) return BASE64_ERROR;
+    if (rest == 3 && (n & 0xFF)) return BASE64_ERROR;
+    *p++ = (uint8_t)(n >> 16);
+    if (rest == 3) *p++ = (uint8_t)(n >> 8);
+  }
+  return (size_t)(p - out);
+}
+
+static size_t
+base16_encode(char *out, const uint8_t *in, size_t len)
+{
+  for (size_t i = 0; i < len; i++) {
+    memcpy(out + i * 2, base16_chars + in[i] * 2, 2);
+  }
+  return len * 2;
+}
+
+/* Either case. Returns BASE64_ERROR for an odd length or a non-hex digit */
+static size_t
+base16_decode(uint8_t *out, const char *in, size_t len)
+{
+  const uint8_t *s = (const uint8_t *)in;
+  if (len % 2) return BASE64_ERROR;
+  for (size_t i = 0; i < len; i += 2) {
+    uint8_t hi = base16_dec[s[i]];
+    uint8_t lo = base16_dec[s[i + 1]];
+    if ((hi | lo) & 0x80) return BASE64_ERROR;
+    *out++ = (uint8_t)(hi << 4 | lo);
   }
+  return len / 2;
 }
 
 #if defined(PICORB_VM_MRUBY)
@@ -3,103 +3,89 @@
 #include "mruby/string.h"
 
 static mrb_value
-mrb_base64_s_encode(mrb_state *mrb, mrb_value klass)
+base64_encode_value(mrb_state *mrb, mrb_value input, int urlsafe, int padding)
 {
-  size_t index = 0;
-  size_t in_size, out_size;
-  uint32_t n = 0;
-  uint8_t n0, n1, n2, n3;
-  const uint8_t *data;
+  size_t in_size = RSTRING_LEN(input);
+  mrb_value output = mrb_str_new(mrb, NULL, (mrb_int)base64_encoded_size(in_size));
+  size_t out_size = base64_encode(RSTRING_PTR(output), (const uint8_t *)RSTRING_PTR(input), in_size, urlsafe, padding);
+  return mrb_str_resize(mrb, output, (mrb_int)out_size);
+}
 
+static mrb_value
+mrb_base64_s_encode(mrb_state *mrb, mrb_value klass)
+{
   mrb_value input;
   mrb_get_args(mrb, "S", &input);
-  data = (uint8_t *)RSTRING_PTR(input);
-
-  in_size  = RSTRING_LEN(input);
-  out_size = (in_size + 2) / 3 * 4 + 1;
-  mrb_value output = mrb_str_new_capa(mrb, out_size);
-
-  // create the main encoding
-  for (index = 0; index < in_size; index += 3) {
-    n = ((uint32_t)data[index]) << 16;
- 
-    if ((index + 1) < in_size)
-      n += ((uint32_t)data[index + 1]) << 8;
- 
-    if ((index + 2) < in_size)
-      n += data[index + 2];
- 
-    n0 = (uint8_t)(n >> 18) & 63;
-    n1 = (uint8_t)(n >> 12) & 63;
-    n2 = (uint8_t)(n >> 6)  & 63;
-    n3 = (uint8_t)n         & 63;
- 
-    // generate encoded characters
-    char encoded[5] = {
-      base64chars[n0],
-      base64chars[n1],
-      (index + 1 < in_size) ? base64chars[n2] : '=',
-      (index + 2 < in_size) ? base64chars[n3] : '=',
-      '\0'
-    };
-    mrb_str_cat_cstr(mrb, output, encoded);
-  }
+  return base64_encode_value(mrb, input, 0, 1);
+}
 
-  return output;
+static mrb_value
+mrb_base64_s__urlsafe_encode(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value input;
+  mrb_bool padding;
+  mrb_get_args(mrb, "Sb", &input, &padding);
+  return base64_encode_value(mrb, input, 1, padding);
 }
 
 static mrb_value
 mrb_base64_s_decode(mrb_state *mrb, mrb_value klass)
 {
-  size_t index = 0;
-  size_t in_size, out_size;
-  uint32_t buf = 0;
-  int iter = 0;
-
-  const uint8_t *data;
+  mrb_value input;
+  mrb_get_args(mrb, "S", &input);
+  size_t in_size = RSTRING_LEN(input);
+  mrb_value output = mrb_str_new(mrb, NULL, (mrb_int)base64_decoded_size(in_size));
+  size_t out_size = base64_decode((uint8_t *)RSTRING_PTR(output), RSTRING_PTR(input), in_size);
+  return mrb_str_resize(mrb, output, (mrb_int)out_size);
+}
 
+static mrb_value
+base64_strict_decode_value(mrb_state *mrb, int urlsafe)
+{
   mrb_value input;
   mrb_get_args(mrb, "S", &input);
-  data = (uint8_t *)RSTRING_PTR(input);
+  size_t in_size = RSTRING_LEN(input);
+  mrb_value output = mrb_str_new(mrb, NULL, (mrb_int)base64_decoded_size(in_size));
+  size_t out_size = base64_strict_decode((uint8_t *)RSTRING_PTR(output), RSTRING_PTR(input), in_size, urlsafe);
+  if (out_size == BASE64_ERROR) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid base64");
+  }
+  return mrb_str_resize(mrb, output, (mrb_int)out_size);
+}
 
-  in_size  = RSTRING_LEN(input);
-  out_size = (in_size + 3) / 4 * 3 + 1;
-  mrb_value output = mrb_str_new_capa(mrb, out_size);
+static mrb_value
+mrb_base64_s_strict_decode(mrb_state *mrb, mrb_value klass)
+{
+  return base64_strict_decode_value(mrb, 0);
+}
 
-  for (; index < in_size; index++) {
-    if (data[index] == '=')
-      break;
-    unsigned char c = base64_convert(data[index]);
-    if (c == 255) { // Invalid character handling
-      mrb_raise(mrb, E_ARGUMENT_ERROR, "Invalid base64 character");
-    }
-    buf = buf << 6 | c;
-    iter++;
-    if (iter == 4) {
-      char decoded[3] = {
-        (buf >> 16) & 0xFF,
-        (buf >> 8) & 0xFF,
-        buf & 0xFF
-      };
-      mrb_str_cat(mrb, output, decoded, 3);
-      buf = 0;
-      iter = 0;
-    }
-  }
+static mrb_value
+mrb_base64_s_urlsafe_decode(mrb_state *mrb, mrb_value klass)
+{
+  return base64_strict_decode_value(mrb, 1);
+}
 
-  if (iter == 3) {
-    char decoded[2] = {
-      (buf >> 10) & 0xFF,
-      (buf >> 2) & 0xFF
-    };
-    mrb_str_cat(mrb, output, decoded, 2);
-  } else if (iter == 2) {
-    char decoded[1] = {
-      (buf >> 4) & 0xFF
-    };
-    mrb_str_cat(mrb, output, decoded, 1);
-  }
+static mrb_value
+mrb_base16_s_encode(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value input;
+  mrb_get_args(mrb, "S", &input);
+  size_t in_size = RSTRING_LEN(input);
+  mrb_value output = mrb_str_new(mrb, NULL, (mrb_int)in_size * 2);
+  base16_encode(RSTRING_PTR(output), (const uint8_t *)RSTRING_PTR(input), in_size);
+  return output;
+}
 
+static mrb_value
+mrb_base16_s_decode(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value input;
+  mrb_get_args(mrb, "S", &input);
+  size_t in_size = RSTRING_LEN(input);
+  mrb_value output = mrb_str_new(mrb, NULL, (mrb_int)in_size / 2);
+  if (base16_decode((uint8_t *)RSTRING_PTR(output), RSTRING_PTR(input), in_size) == BASE64_ERROR) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid base16");
+  }
   return output;
 }
 
@@ -110,7 +96,16 @@ mrb_picoruby_base64_gem_init(mrb_state* mrb)
   struct RClass *class_Base64 = mrb_define_class_id(mrb, MRB_SYM(Base64), mrb->object_class);
 
   mrb_define_class_method_id(mrb, class_Base64, MRB_SYM(encode64), mrb_base64_s_encode, MRB_ARGS_REQ(1));
+  mrb_define_class_method_id(mrb, class_Base64, MRB_SYM(strict_encode64), mrb_base64_s_encode, MRB_ARGS_REQ(1));
+  mrb_define_class_method_id(mrb, class_Base64, MRB_SYM(_urlsafe_encode64), mrb_base64_s__urlsafe_encode, MRB_ARGS_REQ(2));
   mrb_define_class_method_id(mrb, class_Base64, MRB_SYM(decode64), mrb_base64_s_decode, MRB_ARGS_REQ(1));
+  mrb_define_class_method_id(mrb, class_Base64, MRB_SYM(strict_decode64), mrb_base64_s_strict_decode, MRB_ARGS_REQ(1));
+  mrb_define_class_method_id(mrb, class_Base64, MRB_SYM(urlsafe_decode64), mrb_base64_s_urlsafe_decode, MRB_ARGS_REQ(1));
+
+  struct RClass *class_Base16 = mrb_define_class_id(mrb, MRB_SYM(Base16), mrb->object_class);
+
+  mrb_define_class_method_id(mrb, class_Base16, MRB_SYM(encode16), mrb_base16_s_encode, MRB_ARGS_REQ(1));
+  mrb_define_class_method_id(mrb, class_Base16, MRB_SYM(decode16), mrb_base16_s_decode, MRB_ARGS_REQ(1));
 }
 
 void
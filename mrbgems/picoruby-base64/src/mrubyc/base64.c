@@ -1,111 +1,126 @@
 #include <mrubyc.h>
 
-static void
-c_base64_encode(mrbc_vm *vm, mrbc_value *v, int argc)
+static mrbc_value *
+base64_string_arg(mrbc_vm *vm, mrbc_value *v, int argc)
 {
-  size_t index = 0;
-  size_t out_index = 0;
-  size_t in_size, out_size;
-  uint32_t n = 0;
-  uint8_t n0, n1, n2, n3;
-
-  mrbc_value input = GET_ARG(1);
-  if (input.tt != MRBC_TT_STRING) {
+  if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
     mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
-    return;
-  }
-
-  in_size  = input.string->size;
-  out_size = (in_size + 2) / 3 * 4 + 1;
-  uint8_t* output = mrbc_alloc(vm, out_size);
-  uint8_t* data   = input.string->data;
-
-  // create the main encoding
-  for (index = 0; index < in_size; index += 3) {
-    n = ((uint32_t)data[index]) << 16;
-
-    if ((index + 1) < in_size)
-      n += ((uint32_t)data[index + 1]) << 8;
-
-    if ((index + 2) < in_size)
-      n += data[index + 2];
-
-    n0 = (uint8_t)(n >> 18) & 63;
-    n1 = (uint8_t)(n >> 12) & 63;
-    n2 = (uint8_t)(n >> 6)  & 63;
-    n3 = (uint8_t)n         & 63;
-
-    // generate 2 chars from 1 byte
-    output[out_index++] = base64chars[n0];
-    output[out_index++] = base64chars[n1];
-    // if 2nd byte, generate 3rd char
-    if(index + 1 < in_size)
-      output[out_index++] = base64chars[n2];
-    // if 3rd byte, generate 4th char
-    if(index + 2 < in_size)
-      output[out_index++] = base64chars[n3];
+    return NULL;
   }
+  return &v[1];
+}
 
-  // create padding
-  int padding = in_size % 3;
-  if (padding > 0) {
-    for (; padding < 3; padding++) {
-      output[out_index++] = '=';
-    }
+/* The buffer is handed over to the String, so it needs room for '\0' */
+static uint8_t *
+base64_output(mrbc_vm *vm, size_t size)
+{
+  uint8_t *output = mrbc_alloc(vm, size + 1);
+  if (output == NULL) {
+    mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "can't allocate output buffer");
   }
+  return output;
+}
 
-  mrbc_value ret = mrbc_string_new_alloc(vm, output, out_size - 1); // remove the termination byte at the end
+static void
+base64_return(mrbc_vm *vm, mrbc_value *v, uint8_t *output, size_t size)
+{
+  output[size] = '\0';
+  mrbc_value ret = mrbc_string_new_alloc(vm, output, size);
   SET_RETURN(ret);
 }
 
+static void
+base64_encode_method(mrbc_vm *vm, mrbc_value *v, int argc, int urlsafe, int padding)
+{
+  mrbc_value *input = base64_string_arg(vm, v, argc);
+  if (input == NULL) return;
+  size_t in_size = input->string->size;
+  uint8_t *output = base64_output(vm, base64_encoded_size(in_size));
+  if (output == NULL) return;
+  size_t out_size = base64_encode((char *)output, input->string->data, in_size, urlsafe, padding);
+  base64_return(vm, v, output, out_size);
+}
+
+static void
+c_base64_encode(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  base64_encode_method(vm, v, argc, 0, 1);
+}
+
+static void
+c_base64__urlsafe_encode(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  base64_encode_method(vm, v, argc, 1, (1 < argc && v[2].tt == MRBC_TT_TRUE));
+}
+
 static void
 c_base64_decode(mrbc_vm *vm, mrbc_value *v, int argc)
 {
-  size_t index = 0;
-  size_t out_index = 0;
-  size_t in_size, out_size;
-  size_t actual_out_size = 0;
-  uint32_t buf = 0;
-  int iter = 0;
-
-  mrbc_value input = GET_ARG(1);
-  if (input.tt != MRBC_TT_STRING) {
-    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
+  mrbc_value *input = base64_string_arg(vm, v, argc);
+  if (input == NULL) return;
+  size_t in_size = input->string->size;
+  uint8_t *output = base64_output(vm, base64_decoded_size(in_size));
+  if (output == NULL) return;
+  size_t out_size = base64_decode(output, (const char *)input->string->data, in_size);
+  base64_return(vm, v, output, out_size);
+}
+
+static void
+base64_strict_decode_method(mrbc_vm *vm, mrbc_value *v, int argc, int urlsafe)
+{
+  mrbc_value *input = base64_string_arg(vm, v, argc);
+  if (input == NULL) return;
+  size_t in_size = input->string->size;
+  uint8_t *output = base64_output(vm, base64_decoded_size(in_size));
+  if (output == NULL) return;
+  size_t out_size = base64_strict_decode(output, (const char *)input->string->data, in_size, urlsafe);
+  if (out_size == BASE64_ERROR) {
+    mrbc_free(vm, output);
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "invalid base64");
     return;
   }
+  base64_return(vm, v, output, out_size);
+}
 
-  in_size  = input.string->size;
-  out_size = (in_size + 3) / 4 * 3 + 1;
-  uint8_t* data   = input.string->data;
-  uint8_t* output = mrbc_alloc(vm, out_size);
-
-  for (; index < in_size; index++) {
-    if (data[index] == '=')
-      break;
-    unsigned char c = base64_convert(data[index]);
-    buf = buf << 6 | c;
-    iter++;
-    if (iter == 4) {
-      output[out_index++] = (buf >> 16) & 255;
-      output[out_index++] = (buf >> 8)  & 255;
-      output[out_index++] = buf         & 255;
-      actual_out_size += 3;
-      buf = 0;
-      iter = 0;
-    }
-  }
+static void
+c_base64_strict_decode(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  base64_strict_decode_method(vm, v, argc, 0);
+}
 
-  if (iter == 3) {
-    output[out_index++] = (buf >> 10) & 255;
-    output[out_index++] = (buf >>  2) & 255;
-    actual_out_size += 2;
-  } else if (iter == 2) {
-    output[out_index++] = (buf >> 4) & 255;
-    actual_out_size += 1;
-  }
+static void
+c_base64_urlsafe_decode(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  base64_strict_decode_method(vm, v, argc, 1);
+}
 
-  mrbc_value ret = mrbc_string_new_alloc(vm, output, actual_out_size);
-  SET_RETURN(ret);
+static void
+c_base16_encode(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  mrbc_value *input = base64_string_arg(vm, v, argc);
+  if (input == NULL) return;
+  size_t in_size = input->string->size;
+  uint8_t *output = base64_output(vm, in_size * 2);
+  if (output == NULL) return;
+  size_t out_size = base16_encode((char *)output, input->string->data, in_size);
+  base64_return(vm, v, output, out_size);
+}
+
+static void
+c_base16_decode(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  mrbc_value *input = base64_string_arg(vm, v, argc);
+  if (input == NULL) return;
+  size_t in_size = input->string->size;
+  uint8_t *output = base64_output(vm, in_size / 2);
+  if (output == NULL) return;
+  size_t out_size = base16_decode(output, (const char *)input->string->data, in_size);
+  if (out_size == BASE64_ERROR) {
+    mrbc_free(vm, output);
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "invalid base16");
+    return;
+  }
+  base64_return(vm, v, output, out_size);
 }
 
 void
@@ -114,6 +129,14 @@ mrbc_base64_init(mrbc_vm *vm)
   mrbc_class *class_Base64 = mrbc_define_class(vm, "Base64", mrbc_class_object);
 
   mrbc_define_method(vm, class_Base64, "encode64", c_base64_encode);
+  mrbc_define_method(vm, class_Base64, "strict_encode64", c_base64_encode);
+  mrbc_define_method(vm, class_Base64, "_urlsafe_encode64", c_base64__urlsafe_encode);
   mrbc_define_method(vm, class_Base64, "decode64", c_base64_decode);
-}
+  mrbc_define_method(vm, class_Base64, "strict_decode64", c_base64_strict_decode);
+  mrbc_define_method(vm, class_Base64, "urlsafe_decode64", c_base64_urlsafe_decode);
+
+  mrbc_class *class_Base16 = mrbc_define_class(vm, "Base16", mrbc_class_object);
 
+  mrbc_define_method(vm, class_Base16, "encode16", c_base16_encode);
+  mrbc_define_method(vm, class_Base16, "decode16", c_base16_decode);
+}
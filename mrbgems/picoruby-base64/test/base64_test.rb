@@ -18,5 +18,52 @@ class Base64Test < Picotest::Test
     decoded = Base64.decode64(encoded)
     assert_equal long_string, decoded
   end
-end
 
+  def test_padding
+    assert_equal "", Base64.encode64("")
+    assert_equal "cA==", Base64.encode64("p")
+    assert_equal "cGk=", Base64.encode64("pi")
+    assert_equal "cGlj", Base64.encode64("pic")
+    assert_equal "p", Base64.decode64("cA==")
+    assert_equal "pi", Base64.decode64("cGk")
+  end
+
+  def test_decode_skips_line_breaks
+    encoded = "VGhlIHF1aWNrIGJyb3duIGZveCBqdW1wcyBvdmVy\nIHRoZSBsYXp5IGRvZw==\n"
+    assert_equal "The quick brown fox jumps over the lazy dog", Base64.decode64(encoded)
+  end
+
+  def test_strict_decode
+    assert_equal "picoruby", Base64.strict_decode64("cGljb3J1Ynk=")
+    assert_raise(ArgumentError) { Base64.strict_decode64("cGljb3J1Ynk") }
+    assert_raise(ArgumentError) { Base64.strict_decode64("cGljb3J1\nYnk=") }
+    assert_raise(ArgumentError) { Base64.strict_decode64("cGljb3J1Ynl=") }
+  end
+
+  def test_urlsafe
+    binary = "\xFB\xFF\xFE?>"
+    assert_equal "+//+Pz4=", Base64.encode64(binary)
+    assert_equal "-__-Pz4", Base64.urlsafe_encode64(binary)
+    assert_equal "-__-Pz4=", Base64.urlsafe_encode64(binary, padding: true)
+    assert_equal binary, Base64.urlsafe_decode64("-__-Pz4")
+    assert_equal binary, Base64.urlsafe_decode64("-__-Pz4=")
+    assert_raise(ArgumentError) { Base64.urlsafe_decode64("+//+Pz4=") }
+  end
+
+  def test_encoder
+    encoder = Base64::Encoder.new
+    encoded = encoder.update("pic") + encoder.update("or") + encoder.update("ub") + encoder.update("y")
+    assert_equal "cGljb3J1Ynk=", encoded + encoder.finish
+    encoder = Base64::Encoder.new(urlsafe: true)
+    encoded = encoder.update("\xFB\xFF") + encoder.update("\xFE?>")
+    assert_equal "-__-Pz4", encoded + encoder.finish
+  end
+
+  def test_base16
+    assert_equal "00ff7f70", Base16.encode16("\x00\xFF\x7Fp")
+    assert_equal "\x00\xFF\x7Fp", Base16.decode16("00FF7f70")
+    assert_equal "", Base16.decode16("")
+    assert_raise(ArgumentError) { Base16.decode16("abc") }
+    assert_raise(ArgumentError) { Base16.decode16("zz") }
+  end
+end
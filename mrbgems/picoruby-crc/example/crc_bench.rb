@@ -0,0 +1,27 @@
+# Throughput of each CRC. Compare builds with
+# `conf.cc.defines << "PICORB_CRC_SLICES=0"` (bitwise), 1 and 8 (default).
+#
+#   bin/picoruby mrbgems/picoruby-crc/example/crc_bench.rb
+
+SIZE = 64 * 1024
+ROUNDS = 16
+
+data = "0123456789abcdef" * (SIZE / 16)
+
+[
+  ["crc32", CRC::CRC32],
+  ["crc32c", CRC::CRC32C],
+  ["crc16", CRC::CRC16],
+  ["crc8", CRC::CRC8]
+].each do |name, klass|
+  crc = klass.new
+  started = Time.now.to_f
+  i = 0
+  while i < ROUNDS
+    crc.update(data)
+    i += 1
+  end
+  elapsed = Time.now.to_f - started
+  kbps = elapsed == 0 ? '-' : (SIZE * ROUNDS / elapsed / 1024).to_i
+  puts "#{name}: #{crc.digest.to_s(16)}  #{kbps} KB/s"
+end
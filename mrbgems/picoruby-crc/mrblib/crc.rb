@@ -1,2 +1,75 @@
 module CRC
+  # Checksum over data given in pieces, such as a file read chunk by chunk:
+  #
+  #   crc = CRC::CRC32.new
+  #   crc.update(chunk1).update(chunk2)
+  #   crc.digest
+  class Checksum
+    def initialize(initial)
+      @initial = initial
+      @crc = initial
+    end
+
+    def update(data)
+      @crc = _calc(data, @crc)
+      self
+    end
+
+    # Reads io (anything with read(length)) to the end
+    def update_io(io, chunk_size = 4096)
+      while chunk = io.read(chunk_size)
+        update(chunk)
+      end
+      self
+    end
+
+    def digest
+      @crc
+    end
+
+    def reset
+      @crc = @initial
+      self
+    end
+  end
+
+  class CRC32 < Checksum
+    def initialize(crc = 0)
+      super(crc)
+    end
+
+    def _calc(data, crc)
+      CRC.crc32(data, crc)
+    end
+  end
+
+  class CRC32C < Checksum
+    def initialize(crc = 0)
+      super(crc)
+    end
+
+    def _calc(data, crc)
+      CRC.crc32c(data, crc)
+    end
+  end
+
+  class CRC16 < Checksum
+    def initialize(crc = 0xFFFF)
+      super(crc)
+    end
+
+    def _calc(data, crc)
+      CRC.crc16(data, crc)
+    end
+  end
+
+  class CRC8 < Checksum
+    def initialize(crc = 0xFF)
+      super(crc)
+    end
+
+    def _calc(data, crc)
+      CRC.crc8(data, crc)
+    end
+  end
 end
@@ -1,21 +1,348 @@
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+
+/*
+ * CRC32 (zlib), CRC32C (Castagnoli), CRC16-CCITT and CRC8 (Sensirion)
+ *
+ * The implementation is chosen at build time:
+ *   - ARMv8 CRC instructions for CRC32 and CRC32C (__ARM_FEATURE_CRC32)
+ *   - SSE4.2 crc32 instruction for CRC32C (__SSE4_2__)
+ *   - otherwise lookup tables; PICORB_CRC_SLICES=8 (default) processes
+ *     eight bytes per step with 8 KB of tables per polynomial,
+ *     PICORB_CRC_SLICES=1 uses 1 KB, and PICORB_CRC_SLICES=0 falls back
+ *     to the bit-at-a-time loop without tables.
+ * Define PICORB_CRC_NO_HW to ignore the instructions.
+ * Tables are const, generated by the compiler, so they take flash but
+ * no RAM.
+ */
+
+#ifndef PICORB_CRC_SLICES
+#define PICORB_CRC_SLICES 8
+#endif
+
+#if PICORB_CRC_SLICES != 0 && PICORB_CRC_SLICES != 1 && PICORB_CRC_SLICES != 8
+#error "PICORB_CRC_SLICES must be 0, 1 or 8"
+#endif
+
+#if !defined(PICORB_CRC_NO_HW) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC_HW_ARM
+#elif !defined(PICORB_CRC_NO_HW) && defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define CRC_HW_SSE42
+#endif
+
+#define CRC32_POLY  0xEDB88320  /* reflected 0x04C11DB7 */
+#define CRC32C_POLY 0x82F63B78  /* reflected 0x1EDC6F41 */
+#define CRC16_POLY  0x1021
+#define CRC8_POLY   0x31
+
+enum {
+  CRC_KIND_CRC32,
+  CRC_KIND_CRC32C,
+  CRC_KIND_CRC16,
+  CRC_KIND_CRC8,
+};
+
+/* 32-bit reflected CRC in software */
+
+#if PICORB_CRC_SLICES == 0
 
 static uint32_t
-generate_crc32(uint8_t *str, size_t len, uint32_t crc)
+crc32_soft(const uint8_t *p, size_t len, uint32_t crc, uint32_t poly)
 {
-  uint32_t crc_value = ~crc;
   for (size_t i = 0; i < len; i++) {
-    crc_value ^= str[i];
+    crc ^= p[i];
     for (int j = 0; j < 8; j++) {
-      if (crc_value & 1) {
-        crc_value = (crc_value >> 1) ^ 0xEDB88320;
+      if (crc & 1) {
+        crc = (crc >> 1) ^ poly;
       } else {
-        crc_value >>= 1;
+        crc >>= 1;
       }
     }
   }
-  return ~crc_value;
+  return crc;
+}
+
+#else
+
+/*
+ * A CRC table is linear: the entry for a byte is the XOR of the entries
+ * for its bits. CRC*_K(i) give those of the bytes 1, 2, 4 ... 0x80, and
+ * CRC_TABLE() expands them to the 256 entries.
+ */
+#define CRC_ENTRY(i, k0, k1, k2, k3, k4, k5, k6, k7) \
+  ((((i) & 0x01) ? (k0) : 0) ^ (((i) & 0x02) ? (k1) : 0) ^ \
+   (((i) & 0x04) ? (k2) : 0) ^ (((i) & 0x08) ? (k3) : 0) ^ \
+   (((i) & 0x10) ? (k4) : 0) ^ (((i) & 0x20) ? (k5) : 0) ^ \
+   (((i) & 0x40) ? (k6) : 0) ^ (((i) & 0x80) ? (k7) : 0))
+#define CRC_R4(k, i)  k(i), k((i) + 1), k((i) + 2), k((i) + 3)
+#define CRC_R16(k, i) CRC_R4(k, i), CRC_R4(k, (i) + 4), CRC_R4(k, (i) + 8), CRC_R4(k, (i) + 12)
+#define CRC_R64(k, i) CRC_R16(k, i), CRC_R16(k, (i) + 16), CRC_R16(k, (i) + 32), CRC_R16(k, (i) + 48)
+#define CRC_TABLE(k)  CRC_R64(k, 0), CRC_R64(k, 64), CRC_R64(k, 128), CRC_R64(k, 192)
+
+/* Slice n is the CRC of the byte followed by n zero bytes */
+#define CRC32_K0(i) CRC_ENTRY(i, 0x77073096, 0xEE0E612C, 0x076DC419, 0x0EDB8832, 0x1DB71064, 0x3B6E20C8, 0x76DC4190, 0xEDB88320)
+#define CRC32_K1(i) CRC_ENTRY(i, 0x191B3141, 0x32366282, 0x646CC504, 0xC8D98A08, 0x4AC21251, 0x958424A2, 0xF0794F05, 0x3B83984B)
+#define CRC32_K2(i) CRC_ENTRY(i, 0x01C26A37, 0x0384D46E, 0x0709A8DC, 0x0E1351B8, 0x1C26A370, 0x384D46E0, 0x709A8DC0, 0xE1351B80)
+#define CRC32_K3(i) CRC_ENTRY(i, 0xB8BC6765, 0xAA09C88B, 0x8F629757, 0xC5B428EF, 0x5019579F, 0xA032AF3E, 0x9B14583D, 0xED59B63B)
+#define CRC32_K4(i) CRC_ENTRY(i, 0x3D6029B0, 0x7AC05360, 0xF580A6C0, 0x30704BC1, 0x60E09782, 0xC1C12F04, 0x58F35849, 0xB1E6B092)
+#define CRC32_K5(i) CRC_ENTRY(i, 0xCB5CD3A5, 0x4DC8A10B, 0x9B914216, 0xEC53826D, 0x03D6029B, 0x07AC0536, 0x0F580A6C, 0x1EB014D8)
+#define CRC32_K6(i) CRC_ENTRY(i, 0xA6770BB4, 0x979F1129, 0xF44F2413, 0x33EF4E67, 0x67DE9CCE, 0xCFBD399C, 0x440B7579, 0x8816EAF2)
+#define CRC32_K7(i) CRC_ENTRY(i, 0xCCAA009E, 0x4225077D, 0x844A0EFA, 0xD3E51BB5, 0x7CBB312B, 0xF9766256, 0x299DC2ED, 0x533B85DA)
+
+#define CRC32C_K0(i) CRC_ENTRY(i, 0xF26B8303, 0xE13B70F7, 0xC79A971F, 0x8AD958CF, 0x105EC76F, 0x20BD8EDE, 0x417B1DBC, 0x82F63B78)
+#define CRC32C_K1(i) CRC_ENTRY(i, 0x13A29877, 0x274530EE, 0x4E8A61DC, 0x9D14C3B8, 0x3FC5F181, 0x7F8BE302, 0xFF17C604, 0xFBC3FAF9)
+#define CRC32C_K2(i) CRC_ENTRY(i, 0xA541927E, 0x4F6F520D, 0x9EDEA41A, 0x38513EC5, 0x70A27D8A, 0xE144FB14, 0xC76580D9, 0x8B277743)
+#define CRC32C_K3(i) CRC_ENTRY(i, 0xDD45AAB8, 0xBF672381, 0x7B2231F3, 0xF64463E6, 0xE964B13D, 0xD725148B, 0xABA65FE7, 0x52A0C93F)
+#define CRC32C_K4(i) CRC_ENTRY(i, 0x38116FAC, 0x7022DF58, 0xE045BEB0, 0xC5670B91, 0x8F2261D3, 0x1BA8B557, 0x37516AAE, 0x6EA2D55C)
+#define CRC32C_K5(i) CRC_ENTRY(i, 0xEF306B19, 0xDB8CA0C3, 0xB2F53777, 0x6006181F, 0xC00C303E, 0x85F4168D, 0x0E045BEB, 0x1C08B7D6)
+#define CRC32C_K6(i) CRC_ENTRY(i, 0x68032CC8, 0xD0065990, 0xA5E0C5D1, 0x4E2DFD53, 0x9C5BFAA6, 0x3D5B83BD, 0x7AB7077A, 0xF56E0EF4)
+#define CRC32C_K7(i) CRC_ENTRY(i, 0x493C7D27, 0x9278FA4E, 0x211D826D, 0x423B04DA, 0x847609B4, 0x0D006599, 0x1A00CB32, 0x34019664)
+
+#define CRC16_K(i) CRC_ENTRY(i, 0x1021, 0x2042, 0x4084, 0x8108, 0x1231, 0x2462, 0x48C4, 0x9188)
+#define CRC8_K(i)  CRC_ENTRY(i, 0x31, 0x62, 0xC4, 0xB9, 0x43, 0x86, 0x3D, 0x7A)
+
+typedef uint32_t crc32_table_t[PICORB_CRC_SLICES][256];
+
+static inline uint32_t
+read_le32(const uint8_t *p)
+{
+  /* byte by byte: Cortex-M0+ can't load unaligned words */
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t
+crc32_soft(const uint8_t *p, size_t len, uint32_t crc, const crc32_table_t table)
+{
+#if PICORB_CRC_SLICES == 8
+  while (8 <= len) {
+    uint32_t lo = read_le32(p) ^ crc;
+    uint32_t hi = read_le32(p + 4);
+    crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^
+          table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+          table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^
+          table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+#endif
+  while (len--) {
+    crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#endif /* PICORB_CRC_SLICES */
+
+/* CRC32 */
+
+#if defined(CRC_HW_ARM)
+
+static uint32_t
+crc32_update(const uint8_t *p, size_t len, uint32_t crc)
+{
+  while (len && ((uintptr_t)p & 7)) {
+    crc = __crc32b(crc, *p++);
+    len--;
+  }
+  while (8 <= len) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc = __crc32d(crc, v);
+    p += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = __crc32b(crc, *p++);
+  }
+  return crc;
+}
+
+#elif PICORB_CRC_SLICES == 0
+
+static uint32_t
+crc32_update(const uint8_t *p, size_t len, uint32_t crc)
+{
+  return crc32_soft(p, len, crc, CRC32_POLY);
+}
+
+#else
+
+static const crc32_table_t crc32_table = {
+  { CRC_TABLE(CRC32_K0) },
+#if PICORB_CRC_SLICES == 8
+  { CRC_TABLE(CRC32_K1) }, { CRC_TABLE(CRC32_K2) }, { CRC_TABLE(CRC32_K3) },
+  { CRC_TABLE(CRC32_K4) }, { CRC_TABLE(CRC32_K5) }, { CRC_TABLE(CRC32_K6) },
+  { CRC_TABLE(CRC32_K7) },
+#endif
+};
+
+static uint32_t
+crc32_update(const uint8_t *p, size_t len, uint32_t crc)
+{
+  return crc32_soft(p, len, crc, crc32_table);
+}
+
+#endif
+
+/* CRC32C */
+
+#if defined(CRC_HW_ARM)
+
+static uint32_t
+crc32c_update(const uint8_t *p, size_t len, uint32_t crc)
+{
+  while (len && ((uintptr_t)p & 7)) {
+    crc = __crc32cb(crc, *p++);
+    len--;
+  }
+  while (8 <= len) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc = __crc32cd(crc, v);
+    p += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = __crc32cb(crc, *p++);
+  }
+  return crc;
+}
+
+#elif defined(CRC_HW_SSE42)
+
+static uint32_t
+crc32c_update(const uint8_t *p, size_t len, uint32_t crc)
+{
+#if defined(__x86_64__)
+  uint64_t c = crc;
+  while (8 <= len) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = _mm_crc32_u64(c, v);
+    p += 8;
+    len -= 8;
+  }
+  crc = (uint32_t)c;
+#endif
+  while (4 <= len) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    crc = _mm_crc32_u32(crc, v);
+    p += 4;
+    len -= 4;
+  }
+  while (len--) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+
+#elif PICORB_CRC_SLICES == 0
+
+static uint32_t
+crc32c_update(const uint8_t *p, size_t len, uint32_t crc)
+{
+  return crc32_soft(p, len, crc, CRC32C_POLY);
+}
+
+#else
+
+static const crc32_table_t crc32c_table = {
+  { CRC_TABLE(CRC32C_K0) },
+#if PICORB_CRC_SLICES == 8
+  { CRC_TABLE(CRC32C_K1) }, { CRC_TABLE(CRC32C_K2) }, { CRC_TABLE(CRC32C_K3) },
+  { CRC_TABLE(CRC32C_K4) }, { CRC_TABLE(CRC32C_K5) }, { CRC_TABLE(CRC32C_K6) },
+  { CRC_TABLE(CRC32C_K7) },
+#endif
+};
+
+static uint32_t
+crc32c_update(const uint8_t *p, size_t len, uint32_t crc)
+{
+  return crc32_soft(p, len, crc, crc32c_table);
+}
+
+#endif
+
+/* CRC16-CCITT and CRC8: MSB first, no final XOR */
+
+#if PICORB_CRC_SLICES == 0
+
+static uint16_t
+crc16_update(const uint8_t *p, size_t len, uint16_t crc)
+{
+  while (len--) {
+    crc ^= (uint16_t)(*p++) << 8;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ CRC16_POLY) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+static uint8_t
+crc8_update(const uint8_t *p, size_t len, uint8_t crc)
+{
+  while (len--) {
+    crc ^= *p++;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ CRC8_POLY) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+#else
+
+static const uint16_t crc16_table[256] = { CRC_TABLE(CRC16_K) };
+static const uint8_t crc8_table[256] = { CRC_TABLE(CRC8_K) };
+
+static uint16_t
+crc16_update(const uint8_t *p, size_t len, uint16_t crc)
+{
+  while (len--) {
+    crc = (uint16_t)(crc << 8) ^ crc16_table[((crc >> 8) ^ *p++) & 0xFF];
+  }
+  return crc;
+}
+
+static uint8_t
+crc8_update(const uint8_t *p, size_t len, uint8_t crc)
+{
+  while (len--) {
+    crc = crc8_table[crc ^ *p++];
+  }
+  return crc;
+}
+
+#endif
+
+/*
+ * crc is the value returned for the preceding data (or the initial
+ * value), so a checksum can be computed piece by piece.
+ */
+static uint32_t
+generate_crc(int kind, const uint8_t *str, size_t len, uint32_t crc)
+{
+  switch (kind) {
+    case CRC_KIND_CRC32:
+      return ~crc32_update(str, len, ~crc);
+    case CRC_KIND_CRC32C:
+      return ~crc32c_update(str, len, ~crc);
+    case CRC_KIND_CRC16:
+      return crc16_update(str, len, (uint16_t)crc);
+    default:
+      return crc8_update(str, len, (uint8_t)crc);
+  }
+}
+
+static uint32_t
+generate_crc32(const uint8_t *str, size_t len, uint32_t crc)
+{
+  return generate_crc(CRC_KIND_CRC32, str, len, crc);
 }
 
 #if defined(PICORB_VM_MRUBY)
@@ -27,4 +354,3 @@ generate_crc32(uint8_t *str, size_t len, uint32_t crc)
 #include "mrubyc/crc.c"
 
 #endif
-
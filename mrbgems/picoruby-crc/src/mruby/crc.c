@@ -3,23 +3,58 @@
 #include "mruby/class.h"
 #include "mruby/string.h"
 
-/*
- * CRC.crc32(string = nil, crc = nil) -> Integer
- * when string is nil, returns the initial checksum value
- */
 static mrb_value
-mrb_crc_s_crc32(mrb_state *mrb, mrb_value klass)
+crc_common(mrb_state *mrb, int kind, mrb_int initial)
 {
   mrb_value string = mrb_nil_value();
-  mrb_int crc = 0;
-  mrb_get_args(mrb, "|Si", &string, &crc);
+  mrb_int crc = initial;
+  mrb_get_args(mrb, "|S!i", &string, &crc);
   if (mrb_nil_p(string)) {
-    return mrb_fixnum_value(0);
+    return mrb_fixnum_value(initial);
   }
-  uint32_t crc_value = generate_crc32((uint8_t *)RSTRING_PTR(string), (size_t)RSTRING_LEN(string), (uint32_t)crc);
+  uint32_t crc_value = generate_crc(kind, (uint8_t *)RSTRING_PTR(string), (size_t)RSTRING_LEN(string), (uint32_t)crc);
   return mrb_int_value(mrb, crc_value);
 }
 
+/*
+ * CRC.crc32(string = nil, crc = 0) -> Integer
+ * when string is nil, returns the initial checksum value
+ */
+static mrb_value
+mrb_crc_s_crc32(mrb_state *mrb, mrb_value klass)
+{
+  return crc_common(mrb, CRC_KIND_CRC32, 0);
+}
+
+/*
+ * CRC.crc32c(string = nil, crc = 0) -> Integer
+ */
+static mrb_value
+mrb_crc_s_crc32c(mrb_state *mrb, mrb_value klass)
+{
+  return crc_common(mrb, CRC_KIND_CRC32C, 0);
+}
+
+/*
+ * CRC.crc16(string = nil, crc = 0xFFFF) -> Integer
+ * CRC16-CCITT (poly 0x1021, initial 0xFFFF)
+ */
+static mrb_value
+mrb_crc_s_crc16(mrb_state *mrb, mrb_value klass)
+{
+  return crc_common(mrb, CRC_KIND_CRC16, 0xFFFF);
+}
+
+/*
+ * CRC.crc8(string = nil, crc = 0xFF) -> Integer
+ * poly 0x31, initial 0xFF, as used by Sensirion and AHT sensors
+ */
+static mrb_value
+mrb_crc_s_crc8(mrb_state *mrb, mrb_value klass)
+{
+  return crc_common(mrb, CRC_KIND_CRC8, 0xFF);
+}
+
 /*
  * CRC.crc32_from_address(address, length, crc = nil) -> Integer
  */
@@ -45,6 +80,9 @@ mrb_picoruby_crc_gem_init(mrb_state* mrb)
 
   mrb_define_class_method_id(mrb, module_CRC, MRB_SYM(crc32), mrb_crc_s_crc32, MRB_ARGS_OPT(2));
   mrb_define_class_method_id(mrb, module_CRC, MRB_SYM(crc32_from_address), mrb_crc_s_crc32_from_address, MRB_ARGS_ARG(2,1));
+  mrb_define_class_method_id(mrb, module_CRC, MRB_SYM(crc32c), mrb_crc_s_crc32c, MRB_ARGS_OPT(2));
+  mrb_define_class_method_id(mrb, module_CRC, MRB_SYM(crc16), mrb_crc_s_crc16, MRB_ARGS_OPT(2));
+  mrb_define_class_method_id(mrb, module_CRC, MRB_SYM(crc8), mrb_crc_s_crc8, MRB_ARGS_OPT(2));
 }
 
 void
@@ -25,6 +25,51 @@ c_crc_crc32(mrbc_vm *vm, mrbc_value v[], int argc)
   SET_INT_RETURN(crc_value);
 }
 
+static void
+crc_common(mrbc_vm *vm, mrbc_value v[], int argc, int kind, uint32_t initial)
+{
+  mrbc_value string = GET_ARG(1);
+  uint32_t crc = (argc < 2) ? initial : (uint32_t)GET_INT_ARG(2);
+  if (argc < 1 || string.tt == MRBC_TT_NIL) {
+    SET_INT_RETURN(initial);
+    return;
+  } else if (string.tt != MRBC_TT_STRING) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "Expected a String type for the first argument");
+    return;
+  }
+  uint32_t crc_value = generate_crc(kind, (uint8_t *)string.string->data, (size_t)string.string->size, crc);
+  SET_INT_RETURN(crc_value);
+}
+
+/*
+ * CRC.crc32c(string = nil, crc = 0) -> Integer
+ */
+static void
+c_crc_crc32c(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  crc_common(vm, v, argc, CRC_KIND_CRC32C, 0);
+}
+
+/*
+ * CRC.crc16(string = nil, crc = 0xFFFF) -> Integer
+ * CRC16-CCITT (poly 0x1021, initial 0xFFFF)
+ */
+static void
+c_crc_crc16(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  crc_common(vm, v, argc, CRC_KIND_CRC16, 0xFFFF);
+}
+
+/*
+ * CRC.crc8(string = nil, crc = 0xFF) -> Integer
+ * poly 0x31, initial 0xFF, as used by Sensirion and AHT sensors
+ */
+static void
+c_crc_crc8(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  crc_common(vm, v, argc, CRC_KIND_CRC8, 0xFF);
+}
+
 /*
  * CRC.crc32_from_address(address, length, crc = nil) -> Integer
  */
@@ -54,4 +99,7 @@ mrbc_crc_init(mrbc_vm *vm)
 
   mrbc_define_method(vm, module_CRC, "crc32", c_crc_crc32);
   mrbc_define_method(vm, module_CRC, "crc32_from_address", c_crc_crc32_from_address);
+  mrbc_define_method(vm, module_CRC, "crc32c", c_crc_crc32c);
+  mrbc_define_method(vm, module_CRC, "crc16", c_crc_crc16);
+  mrbc_define_method(vm, module_CRC, "crc8", c_crc_crc8);
 }
@@ -0,0 +1,41 @@
+class CRCTest < Picotest::Test
+  CHECK = "123456789"
+
+  def test_check_values
+    assert_equal 0xCBF43926, CRC.crc32(CHECK)
+    assert_equal 0xE3069283, CRC.crc32c(CHECK)
+    assert_equal 0x29B1, CRC.crc16(CHECK)
+    assert_equal 0xF7, CRC.crc8(CHECK)
+  end
+
+  def test_initial_values
+    assert_equal 0, CRC.crc32(nil)
+    assert_equal 0, CRC.crc32c(nil)
+    assert_equal 0xFFFF, CRC.crc16(nil)
+    assert_equal 0xFF, CRC.crc8(nil)
+  end
+
+  def test_chained
+    assert_equal CRC.crc32(CHECK), CRC.crc32("6789", CRC.crc32("12345"))
+    assert_equal CRC.crc32c(CHECK), CRC.crc32c("6789", CRC.crc32c("12345"))
+    assert_equal CRC.crc16(CHECK), CRC.crc16("6789", CRC.crc16("12345"))
+    assert_equal CRC.crc8(CHECK), CRC.crc8("6789", CRC.crc8("12345"))
+  end
+
+  def test_longer_than_a_slice
+    data = "The quick brown fox jumps over the lazy dog"
+    assert_equal 0x414FA339, CRC.crc32(data)
+    assert_equal 0x22620404, CRC.crc32c(data)
+  end
+
+  def test_streaming
+    crc = CRC::CRC32.new
+    crc.update("1234").update("5").update("6789")
+    assert_equal 0xCBF43926, crc.digest
+    crc.reset
+    assert_equal 0, crc.digest
+    assert_equal 0xF7, CRC::CRC8.new.update("123").update("456789").digest
+    assert_equal 0x29B1, CRC::CRC16.new.update(CHECK).digest
+    assert_equal 0xE3069283, CRC::CRC32C.new.update(CHECK).digest
+  end
+end
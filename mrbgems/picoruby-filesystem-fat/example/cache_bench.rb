@@ -0,0 +1,41 @@
+# Sector cache counters while creating files and listing a directory on
+# the FAT RAM disk. Listing again should be served from the cache.
+#
+#   bin/picoruby mrbgems/picoruby-filesystem-fat/example/cache_bench.rb
+
+FILES = 24
+
+def report(label, ram, before)
+  stats = ram.cache_stats
+  hit = stats[:hit] - before[:hit]
+  miss = stats[:miss] - before[:miss]
+  write = stats[:write] - before[:write]
+  ratio = (hit + miss) == 0 ? 0 : hit * 100 / (hit + miss)
+  puts "#{label.ljust(10, " ")} hit: #{hit}, miss: #{miss}, written: #{write} (#{ratio}% hits)"
+  stats
+end
+
+ram = FAT.new(:ram, label: "RAMDISK")
+ram.mkfs
+VFS.mount(ram, "/ram")
+Dir.mkdir("/ram/logs")
+
+stats = ram.cache_stats
+i = 0
+while i < FILES
+  File.open("/ram/logs/log#{i}.txt", "w") { |f| f.write("entry #{i}\n") }
+  i += 1
+end
+stats = report("create", ram, stats)
+
+3.times do |n|
+  count = 0
+  Dir.open("/ram/logs") do |dir|
+    while dir.read
+      count += 1
+    end
+  end
+  stats = report("list #{n + 1}", ram, stats)
+end
+
+VFS.unmount(ram)
@@ -0,0 +1,44 @@
+# Random-seek latency against file size on a FAT RAM disk, with and
+# without the cluster link map (File.open(path, mode, fastseek: true)).
+# Without it, every backward seek follows the FAT chain from the top.
+#
+#   bin/picoruby mrbgems/picoruby-filesystem-fat/example/fastseek_bench.rb
+
+# The RAM disk holds about 47 KB
+SIZES = [4 * 1024, 8 * 1024, 16 * 1024, 32 * 1024]
+SEEKS = 500
+PATH = "/ram/seek.bin"
+
+ram = FAT.new(:ram, label: "RAMDISK")
+ram.mkfs
+VFS.mount(ram, "/ram")
+
+chunk = "0123456789abcdef" * 64
+
+SIZES.each do |size|
+  File.open(PATH, "w") do |f|
+    written = 0
+    while written < size
+      written += f.write(chunk)
+    end
+  end
+  [false, true].each do |fastseek|
+    seed = 1
+    started = Time.now.to_f
+    File.open(PATH, "r", fastseek: fastseek) do |f|
+      i = 0
+      while i < SEEKS
+        seed = (seed * 75 + 74) % 65537
+        f.seek(seed % (size - 16))
+        f.read(16)
+        i += 1
+      end
+    end
+    elapsed = Time.now.to_f - started
+    usec = (elapsed * 1_000_000 / SEEKS).to_i
+    puts "#{size / 1024} KB, fastseek #{fastseek ? "on " : "off"}: #{usec} us/seek"
+  end
+  File.unlink(PATH)
+end
+
+VFS.unmount(ram)
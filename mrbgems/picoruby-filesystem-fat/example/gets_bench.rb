@@ -0,0 +1,57 @@
+# Line reading throughput of File#gets, #each_line and #read(nil) on a
+# FAT RAM disk. Point PATH at an SD card for the real thing.
+#
+#   bin/picoruby mrbgems/picoruby-filesystem-fat/example/gets_bench.rb
+
+LINES = 2000
+PATH = "/ram/bench.csv"
+
+def rate(bytes, elapsed)
+  elapsed == 0 ? '-' : (bytes / elapsed / 1024).to_i
+end
+
+ram = FAT.new(:ram, label: "RAMDISK")
+ram.mkfs
+VFS.mount(ram, "/ram")
+
+File.open(PATH, "w") do |f|
+  row = ""
+  i = 0
+  while i < LINES
+    row << "#{i},sensor#{i % 8},#{i * 7 % 1000}\n"
+    if 1024 < row.size
+      f.write(row)
+      row = ""
+    end
+    i += 1
+  end
+  f.write(row)
+end
+size = File::Stat.new(PATH).size
+puts "file: #{size} bytes, #{LINES} lines"
+
+started = Time.now.to_f
+count = 0
+File.open(PATH, "r") do |f|
+  while line = f.gets
+    count += 1
+  end
+end
+elapsed = Time.now.to_f - started
+puts "gets:          #{count} lines, #{rate(size, elapsed)} KB/s"
+
+started = Time.now.to_f
+count = 0
+File.open(PATH, "r") do |f|
+  f.each_line(chomp: true) { |line| count += 1 }
+end
+elapsed = Time.now.to_f - started
+puts "each_line:     #{count} lines, #{rate(size, elapsed)} KB/s"
+
+started = Time.now.to_f
+data = File.open(PATH, "r") { |f| f.read }
+elapsed = Time.now.to_f - started
+puts "read(nil):     #{data.size} bytes, #{rate(size, elapsed)} KB/s"
+
+File.unlink(PATH)
+VFS.unmount(ram)
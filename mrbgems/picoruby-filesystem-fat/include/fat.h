@@ -7,6 +7,7 @@
   #include <mrubyc.h>
 #endif
 
+#include <stdbool.h>
 #include "../lib/ff14b/source/ff.h"
 
 #ifdef __cplusplus
@@ -17,8 +18,51 @@ extern "C" {
 #define SEEK_CUR 1
 #define SEEK_END 2
 
+#define FAT_FILE_RBUF_SIZE 512
+
+/* A read-only file at least this large gets a link map on open */
+#define FAT_FILE_FASTSEEK_THRESHOLD (64 * 1024)
+/* Link map size in DWORDs: 2 per fragment plus 3 */
+#define FAT_FILE_CLMT_MIN  33
+#define FAT_FILE_CLMT_MAX  513
+
+/*
+ * Instance data of FAT::File.
+ * fil comes first so that the instance data can also be used as a FIL*.
+ * The file position seen from Ruby is f_tell(&fil) minus the unread
+ * bytes of rbuf, which gets() fills ahead.
+ */
+typedef struct FATFile
+{
+  FIL fil;
+  uint8_t *rbuf;  /* FAT_FILE_RBUF_SIZE bytes, allocated by the first gets() */
+  UINT rpos;
+  UINT rlen;
+  bool fastseek;  /* keep a cluster link map in fil.cltbl */
+#if defined(PICORB_VM_MRUBY)
+  mrb_state *mrb; /* allocates the link map */
+#endif
+} FATFile;
+
+FRESULT FILE_open(FATFile *ff, const TCHAR *path, BYTE mode, int fastseek);
+void FILE_fastseek_free(FATFile *ff);
+FSIZE_t FILE_tell(FATFile *ff);
+int FILE_eof(FATFile *ff);
+FRESULT FILE_lseek(FATFile *ff, FSIZE_t ofs);
+FRESULT FILE_unread(FATFile *ff);
+FRESULT FILE_read(FATFile *ff, void *buf, UINT len, UINT *br);
+FRESULT FILE_write(FATFile *ff, const void *buf, UINT len, UINT *bw);
+FRESULT FILE_fill(FATFile *ff);
+FRESULT FILE_skip_newlines(FATFile *ff);
+long FILE_find_separator(const char *line, size_t len, size_t appended, const char *rs, size_t rslen);
 void FILE_physical_address(FIL *fp, uint8_t **addr);
 int FILE_sector_size(void);
+int FILE_pread(void *file, void *buf, size_t len, int64_t offset);
+int FILE_pwrite(void *file, const void *buf, size_t len, int64_t offset);
+int FILE_device_info(void *file, int *sector_size, int *block_size, int *flags);
+
+/* flags of FILE_device_info() */
+#define FILE_DEVICE_VOLATILE    0x01  /* RAM disk: nothing survives power loss */
 
 #if defined(PICORB_VM_MRUBY)
 
@@ -39,6 +83,15 @@ typedef struct prb_vfs_methods
   mrb_value (*file_exist_q)(mrb_state *mrb, mrb_value self);
   mrb_value (*file_unlink)(mrb_state *mrb, mrb_value self);
   mrb_value (*file_stat)(mrb_state *mrb, mrb_value self);
+  /*
+   * Optional positioned I/O on the instance data of a file object.
+   * They return the number of bytes transferred or -1, and are meant for
+   * callers like SQLite3 that shouldn't go through Ruby objects per page.
+   */
+  int (*file_pread)(void *file, void *buf, size_t len, int64_t offset);
+  int (*file_pwrite)(void *file, const void *buf, size_t len, int64_t offset);
+  /* sector and erase block size in bytes, FILE_DEVICE_* flags. 0 on success */
+  int (*file_device_info)(void *file, int *sector_size, int *block_size, int *flags);
 } prb_vfs_methods;
 
 void mrb_raise_iff_f_error(mrb_state *mrb, FRESULT res, const char *func);
@@ -64,6 +117,15 @@ typedef struct prb_vfs_methods
   void (*file_exist_q)(mrbc_vm *vm, mrbc_value *v, int argc);
   void (*file_unlink)(mrbc_vm *vm, mrbc_value *v, int argc);
   void (*file_stat)(mrbc_vm *vm, mrbc_value *v, int argc);
+  /*
+   * Optional positioned I/O on the instance data of a file object.
+   * They return the number of bytes transferred or -1, and are meant for
+   * callers like SQLite3 that shouldn't go through Ruby objects per page.
+   */
+  int (*file_pread)(void *file, void *buf, size_t len, int64_t offset);
+  int (*file_pwrite)(void *file, const void *buf, size_t len, int64_t offset);
+  /* sector and erase block size in bytes, FILE_DEVICE_* flags. 0 on success */
+  int (*file_device_info)(void *file, int *sector_size, int *block_size, int *flags);
 } prb_vfs_methods;
 
 void mrbc_raise_iff_f_error(mrbc_vm *vm, FRESULT res, const char *func);
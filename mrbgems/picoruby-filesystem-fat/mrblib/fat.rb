@@ -104,6 +104,11 @@ class FAT
     {total: (res >> 16), free: (res & 0b1111111111111111) }
   end
 
+  # Sector cache counters of the drive since it was initialized
+  def cache_stats
+    self._cache_stats(@prefix)
+  end
+
   def mount(mountpoint)
     @mountpoint = mountpoint
     @fatfs = self._mount("#{@prefix}#{mountpoint}")
@@ -118,8 +123,8 @@ class FAT
     FAT::Dir.new("#{@prefix}#{path}")
   end
 
-  def open_file(path, mode)
-    FAT::File.new("#{@prefix}#{path}", mode)
+  def open_file(path, mode, fastseek = nil)
+    FAT::File.new("#{@prefix}#{path}", mode, fastseek)
   end
 
   def chdir(path)
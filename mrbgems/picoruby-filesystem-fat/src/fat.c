@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <time.h>
+#include <string.h>
 
 #include "../include/fat.h"
 
@@ -14,9 +15,21 @@ static const char* const VolumeStr[FF_VOLUMES] = {FF_VOLUME_STRS};	/* Pre-define
 #endif
 
 #include "hal/diskio.h"
+#include "hal/disk_cache.h"
 
 static time_t unixtime_offset = 0;
 
+/* Drive number of a prefix like "ram:", or -1 */
+static int
+volume_number(const char *prefix)
+{
+  size_t len = strcspn(prefix, ":");
+  for (int i = 0; i < FF_VOLUMES; i++) {
+    if (strlen(VolumeStr[i]) == len && strncmp(VolumeStr[i], prefix, len) == 0) return i;
+  }
+  return -1;
+}
+
 DWORD
 get_fattime(void)
 {
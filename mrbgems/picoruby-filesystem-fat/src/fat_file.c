@@ -1,10 +1,348 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "../include/fat.h"
 
 #include "../lib/ff14b/source/ff.h"
+#include "hal/diskio.h"
 
+/* The link map comes from the VM heap, and its absence is not an error */
+#if defined(PICORB_VM_MRUBY)
+#define fat_raw_alloc(ff, size) mrb_malloc_simple((ff)->mrb, size)
+#define fat_raw_free(ff, ptr)   mrb_free((ff)->mrb, ptr)
+#elif defined(PICORB_VM_MRUBYC)
+#define fat_raw_alloc(ff, size) mrbc_raw_alloc(size)
+#define fat_raw_free(ff, ptr)   mrbc_raw_free(ptr)
+#endif
+
+#if FF_MAX_SS == FF_MIN_SS
+#define FAT_SS(fs) ((UINT)FF_MAX_SS)
+#else
+#define FAT_SS(fs) ((UINT)(fs)->ssize)
+#endif
+
+/*
+ * Fast seek
+ *
+ * A cluster link map (CLMT) lists the contiguous fragments of the
+ * cluster chain, so f_lseek() doesn't walk the FAT from the top of the
+ * file. In fast seek mode FatFs can't grow the file, so the map is
+ * dropped before anything that does and built again on the next seek.
+ */
+
+static void
+fastseek_build(FATFile *ff)
+{
+  FIL *fp = &ff->fil;
+  DWORD size = FAT_FILE_CLMT_MIN;
+  for (;;) {
+    DWORD *tbl = (DWORD *)fat_raw_alloc(ff, size * sizeof(DWORD));
+    if (tbl == NULL) return;
+    tbl[0] = size;
+    fp->cltbl = tbl;
+    FRESULT res = f_lseek(fp, CREATE_LINKMAP);
+    if (res == FR_OK) return;
+    /* tbl[0] is the size needed */
+    DWORD need = tbl[0];
+    FILE_fastseek_free(ff);
+    if (res != FR_NOT_ENOUGH_CORE || FAT_FILE_CLMT_MAX < need) {
+      /* too fragmented: just seek the slow way */
+      return;
+    }
+    size = need;
+  }
+}
+
+void
+FILE_fastseek_free(FATFile *ff)
+{
+  if (ff->fil.cltbl) {
+    fat_raw_free(ff, ff->fil.cltbl);
+    ff->fil.cltbl = NULL;
+  }
+}
+
+/*
+ * fastseek: 1 to keep a link map, 0 not to, -1 to decide by mode and size
+ */
+FRESULT
+FILE_open(FATFile *ff, const TCHAR *path, BYTE mode, int fastseek)
+{
+  ff->rbuf = NULL;
+  ff->rpos = ff->rlen = 0;
+  ff->fastseek = false;
+  FRESULT res = f_open(&ff->fil, path, mode);
+  if (res != FR_OK) return res;
+  if (fastseek < 0) {
+    fastseek = (mode == FA_READ && FAT_FILE_FASTSEEK_THRESHOLD <= f_size(&ff->fil));
+  }
+  if (fastseek) {
+    ff->fastseek = true;
+    fastseek_build(ff);
+  }
+  return FR_OK;
+}
+
+/* Seeking past the end grows the file in write mode */
+FRESULT
+FILE_lseek(FATFile *ff, FSIZE_t ofs)
+{
+  if (f_size(&ff->fil) < ofs) {
+    FILE_fastseek_free(ff);
+  } else if (ff->fastseek && ff->fil.cltbl == NULL) {
+    fastseek_build(ff);
+  }
+  return f_lseek(&ff->fil, ofs);
+}
+
+/*
+ * Multi-sector transfers
+ *
+ * f_read() and f_write() move whole sectors without the sector buffer,
+ * but stop at every cluster boundary. The link map tells where clusters
+ * are contiguous, so a large aligned transfer takes one disk_read() or
+ * disk_write() per fragment. Only sectors inside the file size are done
+ * here; f_read() and f_write() take care of the rest.
+ */
+
+/* Number of whole sectors from fptr to the end of the fragment, and the first of them */
+static UINT
+fragment_sectors(FIL *fp, UINT len, LBA_t *sect)
+{
+  FATFS *fs = fp->obj.fs;
+  UINT ss = FAT_SS(fs);
+  if (fp->cltbl == NULL || fp->fptr % ss) return 0;
+  FSIZE_t rest = f_size(fp) - fp->fptr;
+  if (len < rest) rest = len;
+  DWORD n = (DWORD)(rest / ss);
+  if (n == 0) return 0;
+  DWORD csect = (DWORD)(fp->fptr / ss);
+  DWORD cl = csect / fs->csize;
+  csect &= fs->csize - 1;
+  DWORD *tbl = fp->cltbl + 1;
+  while (tbl[0] && tbl[0] <= cl) {
+    cl -= tbl[0];
+    tbl += 2;
+  }
+  if (tbl[0] == 0) return 0;
+  DWORD avail = (tbl[0] - cl) * fs->csize - csect;
+  *sect = fs->database + (LBA_t)fs->csize * (tbl[1] + cl - 2) + csect;
+  return (UINT)(n < avail ? n : avail);
+}
+
+static FRESULT
+read_fragments(FIL *fp, BYTE *buf, UINT len, UINT *br)
+{
+  FATFS *fs = fp->obj.fs;
+  UINT ss = FAT_SS(fs);
+  LBA_t sect;
+  UINT cc;
+  *br = 0;
+  while (0 < (cc = fragment_sectors(fp, len - *br, &sect))) {
+    if (disk_read(fs->pdrv, buf + *br, sect, cc) != RES_OK) return FR_DISK_ERR;
+    /* the sector buffer may hold data not written back yet */
+    if (fp->sect - sect < cc) {
+      memcpy(buf + *br + (fp->sect - sect) * ss, fp->buf, ss);
+    }
+    *br += cc * ss;
+    FRESULT res = f_lseek(fp, fp->fptr + (FSIZE_t)cc * ss);
+    if (res != FR_OK) return res;
+  }
+  return FR_OK;
+}
+
+static FRESULT
+write_fragments(FIL *fp, const BYTE *buf, UINT len, UINT *bw)
+{
+  FATFS *fs = fp->obj.fs;
+  UINT ss = FAT_SS(fs);
+  LBA_t sect;
+  UINT cc;
+  *bw = 0;
+  if (!(fp->flag & FA_WRITE)) return FR_DENIED;
+  while (0 < (cc = fragment_sectors(fp, len - *bw, &sect))) {
+    if (disk_write(fs->pdrv, buf + *bw, sect, cc) != RES_OK) return FR_DISK_ERR;
+    /* keep the sector buffer in step so a later write-back stays right */
+    if (fp->sect - sect < cc) {
+      memcpy(fp->buf, buf + *bw + (fp->sect - sect) * ss, ss);
+    }
+    *bw += cc * ss;
+    FRESULT res = f_lseek(fp, fp->fptr + (FSIZE_t)cc * ss);
+    if (res != FR_OK) return res;
+  }
+  if (0 < *bw) {
+    /* a zero-length f_write() only marks the file modified */
+    UINT zero;
+    return f_write(fp, buf, 0, &zero);
+  }
+  return FR_OK;
+}
+
+/*
+ * Read-ahead for gets()
+ *
+ * Lines are cut out of rbuf, so reading line by line never seeks
+ * backward. Anything else that moves the position calls FILE_unread()
+ * first, which gives the unread bytes back with one f_lseek().
+ */
+
+FSIZE_t
+FILE_tell(FATFile *ff)
+{
+  return f_tell(&ff->fil) - (ff->rlen - ff->rpos);
+}
+
+int
+FILE_eof(FATFile *ff)
+{
+  return (ff->rpos == ff->rlen) && f_eof(&ff->fil);
+}
+
+FRESULT
+FILE_unread(FATFile *ff)
+{
+  UINT unread = ff->rlen - ff->rpos;
+  ff->rpos = ff->rlen = 0;
+  if (unread == 0) return FR_OK;
+  return f_lseek(&ff->fil, f_tell(&ff->fil) - unread);
+}
+
+/* Takes from the read-ahead first. A large rest goes straight to the disk */
+FRESULT
+FILE_read(FATFile *ff, void *buf, UINT len, UINT *br)
+{
+  UINT n = ff->rlen - ff->rpos;
+  if (len < n) n = len;
+  if (0 < n) {
+    memcpy(buf, ff->rbuf + ff->rpos, n);
+    ff->rpos += n;
+  }
+  *br = n;
+  if (n == len) return FR_OK;
+  UINT rest;
+  FRESULT res = read_fragments(&ff->fil, (uint8_t *)buf + *br, len - *br, &rest);
+  *br += rest;
+  if (res != FR_OK || *br == len) return res;
+  res = f_read(&ff->fil, (uint8_t *)buf + *br, len - *br, &rest);
+  *br += rest;
+  return res;
+}
+
+/* Doesn't f_sync() */
+FRESULT
+FILE_write(FATFile *ff, const void *buf, UINT len, UINT *bw)
+{
+  FRESULT res = FILE_unread(ff);
+  *bw = 0;
+  if (res != FR_OK) return res;
+  if (f_size(&ff->fil) < f_tell(&ff->fil) + len) {
+    FILE_fastseek_free(ff);
+  }
+  UINT n;
+  res = write_fragments(&ff->fil, (const uint8_t *)buf, len, &n);
+  *bw = n;
+  if (res != FR_OK || n == len) return res;
+  res = f_write(&ff->fil, (const uint8_t *)buf + n, len - n, &n);
+  *bw += n;
+  return res;
+}
+
+/* Refills rbuf when it is used up. rlen stays 0 at the end of file */
+FRESULT
+FILE_fill(FATFile *ff)
+{
+  if (ff->rpos < ff->rlen) return FR_OK;
+  ff->rpos = ff->rlen = 0;
+  return f_read(&ff->fil, ff->rbuf, FAT_FILE_RBUF_SIZE, &ff->rlen);
+}
+
+/* Paragraph mode of gets(): drops the newlines ahead */
+FRESULT
+FILE_skip_newlines(FATFile *ff)
+{
+  for (;;) {
+    FRESULT res = FILE_fill(ff);
+    if (res != FR_OK || ff->rlen == 0) return res;
+    while (ff->rpos < ff->rlen && ff->rbuf[ff->rpos] == '\n') ff->rpos++;
+    if (ff->rpos < ff->rlen) return FR_OK;
+  }
+}
+
+/*
+ * Returns the length of line up to and including rs, or -1.
+ * Only the last `appended` bytes are new, so the search starts where
+ * a separator could end in them.
+ */
+long
+FILE_find_separator(const char *line, size_t len, size_t appended, const char *rs, size_t rslen)
+{
+  size_t start = len - appended;
+  start = (rslen - 1 < start) ? start - (rslen - 1) : 0;
+  if (rslen == 1) {
+    const char *p = memchr(line + start, rs[0], len - start);
+    return p ? (long)(p - line + 1) : -1;
+  }
+  for (size_t i = start; i + rslen <= len; i++) {
+    if (line[i] == rs[0] && memcmp(line + i, rs, rslen) == 0) {
+      return (long)(i + rslen);
+    }
+  }
+  return -1;
+}
+
+/*
+ * Unlike File#write, these don't f_sync() after writing.
+ * The caller syncs when it needs durability (SQLite does in xSync).
+ */
+
+int
+FILE_pread(void *file, void *buf, size_t len, int64_t offset)
+{
+  FATFile *ff = (FATFile *)file;
+  /* positioned: any read-ahead is simply dropped */
+  ff->rpos = ff->rlen = 0;
+  FRESULT res = FR_OK;
+  UINT br;
+  if (f_tell(&ff->fil) != (FSIZE_t)offset) {
+    res = FILE_lseek(ff, (FSIZE_t)offset);
+  }
+  if (res == FR_OK) res = FILE_read(ff, buf, (UINT)len, &br);
+  return (res == FR_OK) ? (int)br : -1;
+}
+
+int
+FILE_pwrite(void *file, const void *buf, size_t len, int64_t offset)
+{
+  FATFile *ff = (FATFile *)file;
+  ff->rpos = ff->rlen = 0;
+  FRESULT res = FR_OK;
+  UINT bw;
+  if (f_tell(&ff->fil) != (FSIZE_t)offset) {
+    /* in write mode, seeking past the end extends the file */
+    res = FILE_lseek(ff, (FSIZE_t)offset);
+  }
+  if (res == FR_OK) res = FILE_write(ff, buf, (UINT)len, &bw);
+  return (res == FR_OK) ? (int)bw : -1;
+}
+
+
+int
+FILE_device_info(void *file, int *sector_size, int *block_size, int *flags)
+{
+  FIL *fp = (FIL *)file;
+  BYTE pdrv = fp->obj.fs->pdrv;
+  WORD ss;
+  DWORD bs;
+  if (disk_ioctl(pdrv, GET_SECTOR_SIZE, &ss) != RES_OK) return -1;
+  /* in sectors. Some drivers report 1 for "unknown" */
+  if (disk_ioctl(pdrv, GET_BLOCK_SIZE, &bs) != RES_OK || bs == 0) bs = 1;
+  *sector_size = (int)ss;
+  *block_size = (int)(ss * bs);
+  DWORD c = disk_characteristics(pdrv);
+  *flags = (c & DISK_VOLATILE) ? FILE_DEVICE_VOLATILE : 0;
+  return 0;
+}
 
 #if defined(PICORB_VM_MRUBY)
 
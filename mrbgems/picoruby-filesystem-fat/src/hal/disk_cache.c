@@ -0,0 +1,324 @@
+#include <string.h>
+
+#include "disk_cache.h"
+
+/*
+ * Sector cache
+ *
+ * Sector n goes to set n % sets and takes the least recently used way.
+ * Set i of way w lives at data + (w * sets + i) * ss, so consecutive
+ * sectors in the same way are consecutive in memory too. A run of them
+ * is written back with one multi-sector disk write.
+ *
+ * Single-sector reads and writes (FAT, directory entries and partial
+ * data sectors) go through the cache. Multi-sector transfers go to the
+ * drive. Reads take dirty lines from the cache, and writes update the
+ * lines they cover.
+ *
+ * Dirty lines are written back on CTRL_SYNC, which FatFs issues at the
+ * end of every f_sync(), f_close() and directory change, or when they
+ * are evicted. An evicted line takes the other dirty lines of its erase
+ * block with it, so flash programs a block once rather than per sector.
+ */
+
+typedef struct {
+  LBA_t sector;
+  uint32_t used;    /* tick of the last access */
+  uint8_t valid;
+  uint8_t dirty;
+} cache_line;
+
+typedef struct {
+  BYTE *data;
+  cache_line *line;
+  UINT ss;          /* sector size */
+  UINT sets;
+  UINT ways;
+  DWORD block;      /* erase block size in sectors */
+  uint32_t tick;
+  disk_cache_stat stat;
+} disk_cache;
+
+/* The most lines a drive can have: all of them FF_MIN_SS bytes */
+#define DISK_CACHE_LINES (FAT_DISK_CACHE_SIZE / FF_MIN_SS)
+
+/* A slot for each cached drive that is compiled in */
+#if 0 < DISK_CACHE_LINES && defined(USE_FAT_FLASH_DISK)
+#define CACHE_FLASH 1
+#else
+#define CACHE_FLASH 0
+#endif
+#if 0 < DISK_CACHE_LINES && defined(USE_FAT_SD_DISK)
+#define CACHE_SD 1
+#else
+#define CACHE_SD 0
+#endif
+#define SLOT_COUNT (CACHE_FLASH + CACHE_SD)
+
+#if 0 < SLOT_COUNT
+static disk_cache caches[SLOT_COUNT];
+static BYTE cache_data[SLOT_COUNT][FAT_DISK_CACHE_SIZE] __attribute__((aligned(4)));
+static cache_line cache_lines[SLOT_COUNT][DISK_CACHE_LINES];
+
+static disk_cache *
+slot_of(BYTE pdrv)
+{
+  switch (pdrv) {
+#if CACHE_FLASH
+  case DEV_FLASH:
+    return &caches[0];
+#endif
+#if CACHE_SD
+  case DEV_SD:
+    return &caches[CACHE_FLASH];
+#endif
+  }
+  return NULL;
+}
+#else
+#define slot_of(pdrv) ((void)(pdrv), (disk_cache *)NULL)
+#endif
+
+static disk_cache *
+cache_of(BYTE pdrv)
+{
+  disk_cache *c = slot_of(pdrv);
+  if (c == NULL || c->data == NULL) return NULL;
+  return c;
+}
+
+static BYTE *
+line_data(disk_cache *c, UINT i)
+{
+  return c->data + (size_t)i * c->ss;
+}
+
+static UINT
+line_index(disk_cache *c, UINT set, UINT way)
+{
+  return way * c->sets + set;
+}
+
+static cache_line *
+lookup(disk_cache *c, LBA_t sector, UINT *index)
+{
+  UINT set = (UINT)(sector % c->sets);
+  for (UINT w = 0; w < c->ways; w++) {
+    UINT i = line_index(c, set, w);
+    if (c->line[i].valid && c->line[i].sector == sector) {
+      c->line[i].used = ++c->tick;
+      *index = i;
+      return &c->line[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Writes back the dirty lines of sectors [from, to) in runs of
+ * consecutive sectors that are also consecutive in memory.
+ */
+static DRESULT
+write_back(disk_cache *c, BYTE pdrv, LBA_t from, LBA_t to)
+{
+  UINT lines = c->sets * c->ways;
+  for (;;) {
+    /* the lowest dirty sector in range starts the next run */
+    UINT first = lines;
+    for (UINT i = 0; i < lines; i++) {
+      cache_line *l = &c->line[i];
+      if (l->dirty && from <= l->sector && l->sector < to &&
+          (first == lines || l->sector < c->line[first].sector)) {
+        first = i;
+      }
+    }
+    if (first == lines) return RES_OK;
+    UINT count = 1;
+    UINT last = first;
+    for (;;) {
+      LBA_t next = c->line[last].sector + 1;
+      UINT i = last + 1; /* next set, same way */
+      if (next < to && i < lines && c->line[i].dirty && c->line[i].sector == next) {
+        last = i;
+        count++;
+      } else {
+        break;
+      }
+    }
+    DRESULT res = disk_device_write(pdrv, line_data(c, first), c->line[first].sector, count);
+    if (res != RES_OK) return res;
+    c->stat.write += count;
+    for (UINT i = first; i <= last; i++) c->line[i].dirty = 0;
+  }
+}
+
+/* Frees a way in the set of sector. Returns the line index or -1 */
+static int
+evict(disk_cache *c, BYTE pdrv, LBA_t sector)
+{
+  UINT set = (UINT)(sector % c->sets);
+  UINT victim = line_index(c, set, 0);
+  UINT w;
+  /* a way right after the previous sector keeps a run contiguous */
+  for (w = 0; w < c->ways; w++) {
+    UINT i = line_index(c, set, w);
+    if (0 < i && !c->line[i].dirty && c->line[i - 1].valid && c->line[i - 1].sector == sector - 1) {
+      victim = i;
+      break;
+    }
+  }
+  /* otherwise an empty way, or the least recently used */
+  for (w = (w < c->ways) ? c->ways : 0; w < c->ways; w++) {
+    UINT i = line_index(c, set, w);
+    if (!c->line[i].valid) {
+      victim = i;
+      break;
+    }
+    if (c->line[i].used < c->line[victim].used) victim = i;
+  }
+  cache_line *l = &c->line[victim];
+  if (l->valid && l->dirty) {
+    LBA_t from = l->sector - l->sector % c->block;
+    if (write_back(c, pdrv, from, from + c->block) != RES_OK) return -1;
+  }
+  l->valid = 0;
+  return (int)victim;
+}
+
+void
+disk_cache_close(BYTE pdrv)
+{
+  disk_cache *c = slot_of(pdrv);
+  if (c) memset(c, 0, sizeof(disk_cache));
+}
+
+/*
+ * Called when the drive is initialized. Anything dirty is written back
+ * and the cache starts empty.
+ */
+void
+disk_cache_open(BYTE pdrv)
+{
+#if 0 < SLOT_COUNT
+  disk_cache *c = slot_of(pdrv);
+  if (c == NULL) return;
+  WORD ss = FF_MIN_SS;
+  DWORD block = 1;
+  disk_device_ioctl(pdrv, GET_SECTOR_SIZE, &ss);
+  if (disk_device_ioctl(pdrv, GET_BLOCK_SIZE, &block) != RES_OK || block == 0) block = 1;
+  if (c->data && c->ss == ss) {
+    disk_cache_flush(pdrv);
+    memset(c->line, 0, sizeof(cache_line) * c->sets * c->ways);
+    c->block = block;
+    return;
+  }
+  disk_cache_flush(pdrv);
+  disk_cache_close(pdrv);
+  UINT lines = FAT_DISK_CACHE_SIZE / ss;
+  if (lines == 0 || DISK_CACHE_LINES < lines) return;
+  UINT ways = (FAT_DISK_CACHE_WAYS < lines) ? FAT_DISK_CACHE_WAYS : lines;
+  UINT sets = lines / ways;
+  lines = sets * ways;
+  c->data = cache_data[c - caches];
+  c->line = cache_lines[c - caches];
+  memset(c->line, 0, sizeof(cache_line) * lines);
+  c->ss = ss;
+  c->sets = sets;
+  c->ways = ways;
+  c->block = block;
+#else
+  (void)pdrv;
+#endif
+}
+
+DRESULT
+disk_cache_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+  disk_cache *c = cache_of(pdrv);
+  if (c == NULL) return disk_device_read(pdrv, buff, sector, count);
+  UINT i;
+  if (count == 1) {
+    if (lookup(c, sector, &i)) {
+      c->stat.hit++;
+      memcpy(buff, line_data(c, i), c->ss);
+      return RES_OK;
+    }
+    c->stat.miss++;
+    int v = evict(c, pdrv, sector);
+    if (v < 0) return disk_device_read(pdrv, buff, sector, count);
+    DRESULT res = disk_device_read(pdrv, line_data(c, v), sector, 1);
+    if (res != RES_OK) return res;
+    c->line[v].sector = sector;
+    c->line[v].valid = 1;
+    c->line[v].dirty = 0;
+    c->line[v].used = ++c->tick;
+    memcpy(buff, line_data(c, v), c->ss);
+    return RES_OK;
+  }
+  c->stat.miss += count;
+  DRESULT res = disk_device_read(pdrv, buff, sector, count);
+  if (res != RES_OK) return res;
+  UINT lines = c->sets * c->ways;
+  for (i = 0; i < lines; i++) {
+    cache_line *l = &c->line[i];
+    if (l->dirty && sector <= l->sector && l->sector - sector < count) {
+      memcpy(buff + (size_t)(l->sector - sector) * c->ss, line_data(c, i), c->ss);
+    }
+  }
+  return RES_OK;
+}
+
+DRESULT
+disk_cache_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+{
+  disk_cache *c = cache_of(pdrv);
+  if (c == NULL) return disk_device_write(pdrv, buff, sector, count);
+  UINT i;
+  if (count == 1) {
+    if (lookup(c, sector, &i)) {
+      c->stat.hit++;
+    } else {
+      c->stat.miss++;
+      int v = evict(c, pdrv, sector);
+      if (v < 0) return disk_device_write(pdrv, buff, sector, count);
+      i = (UINT)v;
+      c->line[i].sector = sector;
+      c->line[i].valid = 1;
+      c->line[i].used = ++c->tick;
+    }
+    memcpy(line_data(c, i), buff, c->ss);
+    c->line[i].dirty = 1;
+    return RES_OK;
+  }
+  DRESULT res = disk_device_write(pdrv, buff, sector, count);
+  if (res != RES_OK) return res;
+  c->stat.write += count;
+  UINT lines = c->sets * c->ways;
+  for (i = 0; i < lines; i++) {
+    cache_line *l = &c->line[i];
+    if (l->valid && sector <= l->sector && l->sector - sector < count) {
+      memcpy(line_data(c, i), buff + (size_t)(l->sector - sector) * c->ss, c->ss);
+      l->dirty = 0;
+    }
+  }
+  return RES_OK;
+}
+
+DRESULT
+disk_cache_flush(BYTE pdrv)
+{
+  disk_cache *c = cache_of(pdrv);
+  if (c == NULL) return RES_OK;
+  return write_back(c, pdrv, 0, (LBA_t)0 - 1);
+}
+
+void
+disk_cache_stats(BYTE pdrv, disk_cache_stat *stat)
+{
+  disk_cache *c = slot_of(pdrv);
+  if (c == NULL) {
+    memset(stat, 0, sizeof(disk_cache_stat));
+    return;
+  }
+  *stat = c->stat;
+}
@@ -0,0 +1,53 @@
+#ifndef DISK_CACHE_DEFINED
+#define DISK_CACHE_DEFINED
+
+#include <stdint.h>
+#include "../../lib/ff14b/source/ff.h"
+#include "diskio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Write-back sector cache between FatFs and the drivers. Opt-in:
+ * define FAT_DISK_CACHE_SIZE and the flash and SD drives that are
+ * compiled in each get a static buffer of that many bytes, split into
+ * sector-sized lines, FAT_DISK_CACHE_WAYS lines per set. The RAM disk
+ * is never cached.
+ */
+#ifndef FAT_DISK_CACHE_SIZE
+#define FAT_DISK_CACHE_SIZE 0
+#endif
+#ifndef FAT_DISK_CACHE_WAYS
+#define FAT_DISK_CACHE_WAYS 2
+#endif
+
+/* Physical drive numbers */
+#define DEV_RAM     0
+#define DEV_FLASH   1
+#define DEV_SD      2
+
+typedef struct {
+  uint32_t hit;     /* sectors found in the cache */
+  uint32_t miss;    /* sectors that went to the drive */
+  uint32_t write;   /* sectors written to the drive */
+} disk_cache_stat;
+
+void disk_cache_open(BYTE pdrv);
+void disk_cache_close(BYTE pdrv);
+DRESULT disk_cache_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count);
+DRESULT disk_cache_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count);
+DRESULT disk_cache_flush(BYTE pdrv);
+void disk_cache_stats(BYTE pdrv, disk_cache_stat *stat);
+
+/* The drivers themselves, in diskio.c */
+DRESULT disk_device_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count);
+DRESULT disk_device_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count);
+DRESULT disk_device_ioctl(BYTE pdrv, BYTE cmd, void *buff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_DEFINED */
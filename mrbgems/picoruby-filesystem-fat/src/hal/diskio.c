@@ -10,18 +10,16 @@
 
 #include "../../lib/ff14b/source/ff.h"
 #include "diskio.h"
+#include "disk_cache.h"
 
 #include "ram_disk.h"
-#define DEV_RAM     0
 
 #ifdef USE_FAT_FLASH_DISK
 #include "flash_disk.h"
-#define DEV_FLASH   1
 #endif
 
 #ifdef USE_FAT_SD_DISK
 #include "sd_disk.h"
-#define DEV_SD      2
 #endif
 
 /*-----------------------------------------------------------------------*/
@@ -33,6 +31,7 @@ DSTATUS disk_erase (
 )
 {
   DSTATUS stat;
+  disk_cache_close(pdrv);
   switch (pdrv) {
   case DEV_RAM :
     stat = RAM_disk_erase();
@@ -52,6 +51,26 @@ DSTATUS disk_erase (
 }
 
 
+/*-----------------------------------------------------------------------*/
+/* Get Drive Characteristics                                             */
+/*-----------------------------------------------------------------------*/
+
+DWORD disk_characteristics (
+  BYTE pdrv    /* Physical drive nmuber to identify the drive */
+)
+{
+  /*
+   * Flash and SD keep their contents, and an interrupted erase-program
+   * cycle can damage a whole block, so they report nothing.
+   */
+  switch (pdrv) {
+  case DEV_RAM :
+    return DISK_VOLATILE;
+  }
+  return 0;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
@@ -88,19 +107,22 @@ DSTATUS disk_initialize (
   switch (pdrv) {
   case DEV_RAM :
     stat = RAM_disk_initialize();
-    return stat;
+    break;
 #ifdef USE_FAT_FLASH_DISK
   case DEV_FLASH :
     stat = FLASH_disk_initialize();
-    return stat;
+    break;
 #endif
 #ifdef USE_FAT_SD_DISK
   case DEV_SD :
     stat = SD_disk_initialize();
-    return stat;
+    break;
 #endif
+  default :
+    return STA_NOINIT;
   }
-  return STA_NOINIT;
+  if (!(stat & STA_NOINIT)) disk_cache_open(pdrv);
+  return stat;
 }
 
 
@@ -114,6 +136,16 @@ DRESULT disk_read (
   LBA_t sector,  /* Start sector in LBA */
   UINT count    /* Number of sectors to read */
 )
+{
+  return disk_cache_read(pdrv, buff, sector, count);
+}
+
+DRESULT disk_device_read (
+  BYTE pdrv,
+  BYTE *buff,
+  LBA_t sector,
+  UINT count
+)
 {
   DRESULT res = RES_NOTRDY;
   switch (pdrv) {
@@ -147,6 +179,16 @@ DRESULT disk_write (
   LBA_t sector,    /* Start sector in LBA */
   UINT count      /* Number of sectors to write */
 )
+{
+  return disk_cache_write(pdrv, buff, sector, count);
+}
+
+DRESULT disk_device_write (
+  BYTE pdrv,
+  const BYTE *buff,
+  LBA_t sector,
+  UINT count
+)
 {
   DRESULT res = RES_NOTRDY;
   switch (pdrv) {
@@ -179,6 +221,19 @@ DRESULT disk_ioctl (
   BYTE cmd,    /* Control code */
   void *buff    /* Buffer to send/receive control data */
 )
+{
+  if (cmd == CTRL_SYNC) {
+    DRESULT res = disk_cache_flush(pdrv);
+    if (res != RES_OK) return res;
+  }
+  return disk_device_ioctl(pdrv, cmd, buff);
+}
+
+DRESULT disk_device_ioctl (
+  BYTE pdrv,
+  BYTE cmd,
+  void *buff
+)
 {
   DRESULT res = RES_NOTRDY;
   switch (pdrv) {
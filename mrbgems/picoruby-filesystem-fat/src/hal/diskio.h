@@ -32,6 +32,12 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+DWORD disk_characteristics (BYTE pdrv);
+
+
+/* Drive characteristics (disk_characteristics) */
+
+#define DISK_VOLATILE		0x01	/* Contents don't survive power loss (RAM) */
 
 
 /* Disk Status Bits (DSTATUS) */
@@ -132,7 +132,11 @@ mrb__unmount(mrb_state *mrb, mrb_value self)
 {
   const char *prefix;
   mrb_get_args(mrb, "z", &prefix);
-  (void)prefix;
+  int pdrv = volume_number(prefix);
+  /* the sector cache may still hold what f_write() left without f_sync() */
+  if (0 <= pdrv && disk_ioctl((BYTE)pdrv, CTRL_SYNC, NULL) != RES_OK) {
+    mrb_raise_iff_f_error(mrb, FR_DISK_ERR, "f_unmount");
+  }
   fatfs_t *mrb_fs = (fatfs_t *)mrb_data_get_ptr(mrb, self, &mrb_fatfs_type);
   mrb_fatfs_free(mrb, mrb_fs);
   return mrb_fixnum_value(0);
@@ -215,6 +219,40 @@ mrb__stat(mrb_state *mrb, mrb_value self)
   return stat;
 }
 
+/*
+ * Usage: FAT#_cache_stats(prefix)
+ * Counters of the sector cache of the drive: hit, miss and write
+ */
+static mrb_value
+mrb__cache_stats(mrb_state *mrb, mrb_value self)
+{
+  const char *prefix;
+  mrb_get_args(mrb, "z", &prefix);
+  int pdrv = volume_number(prefix);
+  if (pdrv < 0) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "Volume not found in cache_stats");
+  }
+  disk_cache_stat st;
+  disk_cache_stats((BYTE)pdrv, &st);
+  mrb_value stats = mrb_hash_new_capa(mrb, 3);
+  mrb_hash_set(mrb,
+    stats,
+    mrb_symbol_value(MRB_SYM(hit)),
+    mrb_fixnum_value((mrb_int)st.hit)
+  );
+  mrb_hash_set(mrb,
+    stats,
+    mrb_symbol_value(MRB_SYM(miss)),
+    mrb_fixnum_value((mrb_int)st.miss)
+  );
+  mrb_hash_set(mrb,
+    stats,
+    mrb_symbol_value(MRB_SYM(write)),
+    mrb_fixnum_value((mrb_int)st.write)
+  );
+  return stats;
+}
+
 static mrb_value
 mrb__directory_p(mrb_state *mrb, mrb_value self)
 {
@@ -345,6 +383,7 @@ mrb_picoruby_filesystem_fat_gem_init(mrb_state* mrb)
   mrb_define_method_id(mrb, class_FAT, MRB_SYM(_setlabel), mrb__setlabel, MRB_ARGS_REQ(1));
   mrb_define_method_id(mrb, class_FAT, MRB_SYM(_getlabel), mrb__getlabel, MRB_ARGS_REQ(1));
   mrb_define_method_id(mrb, class_FAT, MRB_SYM_Q(_contiguous), mrb__contiguous_p, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, class_FAT, MRB_SYM(_cache_stats), mrb__cache_stats, MRB_ARGS_REQ(1));
   mrb_init_class_FAT_Dir(mrb, class_FAT);
   mrb_init_class_FAT_File(mrb, class_FAT);
 
@@ -6,8 +6,11 @@
 
 static void
 mrb_fat_file_free(mrb_state *mrb, void *ptr) {
-  f_close((FIL *)ptr);
-  mrb_free(mrb, ptr);
+  FATFile *ff = (FATFile *)ptr;
+  f_close(&ff->fil);
+  FILE_fastseek_free(ff);
+  mrb_free(mrb, ff->rbuf);
+  mrb_free(mrb, ff);
 }
 
 struct mrb_data_type mrb_fat_file_type = {
@@ -21,9 +24,13 @@ mrb_s_new(mrb_state *mrb, mrb_value klass)
   FRESULT res;
   const char *path;
   const char *mode_str;
-  mrb_get_args(mrb, "zz", &path, &mode_str);
-  FIL *fp = (FIL *)mrb_malloc(mrb, sizeof(FIL));
-  mrb_value file = mrb_obj_value(Data_Wrap_Struct(mrb, mrb_class_ptr(klass), &mrb_fat_file_type, fp));
+  mrb_value fastseek_opt = mrb_nil_value();
+  mrb_get_args(mrb, "zz|o", &path, &mode_str, &fastseek_opt);
+  FATFile *ff = (FATFile *)mrb_malloc(mrb, sizeof(FATFile));
+  ff->mrb = mrb;
+  ff->rbuf = NULL;
+  ff->fil.cltbl = NULL;
+  mrb_value file = mrb_obj_value(Data_Wrap_Struct(mrb, mrb_class_ptr(klass), &mrb_fat_file_type, ff));
   BYTE mode = 0;
   if (strcmp(mode_str, "r") == 0) {
     mode = FA_READ;
@@ -44,7 +51,9 @@ mrb_s_new(mrb_state *mrb, mrb_value klass)
   } else {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "Unknown file open mode");
   }
-  res = f_open(fp, (const TCHAR *)path, mode);
+  /* fastseek: true, false or nil (decided by mode and size) */
+  int fastseek = mrb_nil_p(fastseek_opt) ? -1 : mrb_test(fastseek_opt);
+  res = FILE_open(ff, (const TCHAR *)path, mode, fastseek);
   mrb_raise_iff_f_error(mrb, res, path);
   return file;
 }
@@ -78,18 +87,20 @@ mrb_physical_address(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_tell(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
-  FSIZE_t pos = f_tell(fp);
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FSIZE_t pos = FILE_tell(ff);
   return mrb_fixnum_value(pos);
 }
 
 static mrb_value
 mrb_seek(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FIL *fp = &ff->fil;
   mrb_int ofs;
   mrb_int whence;
   mrb_get_args(mrb, "ii", &ofs, &whence);
+  mrb_raise_iff_f_error(mrb, FILE_unread(ff), "f_lseek");
   FSIZE_t size = f_size(fp);
   FSIZE_t new_pos;
 
@@ -107,12 +118,13 @@ mrb_seek(mrb_state *mrb, mrb_value self)
     mrb_raise(mrb, E_ARGUMENT_ERROR, "Invalid offset");
   } else if (size < new_pos) {
     FRESULT res;
+    FILE_fastseek_free(ff);
     res = f_expand(fp, new_pos, 1);
     if (res == FR_OK) res = f_sync(fp);
     mrb_raise_iff_f_error(mrb, res, "f_lseek|f_expand|f_sync");
   }
   FRESULT res;
-  res = f_lseek(fp, new_pos);
+  res = FILE_lseek(ff, new_pos);
   mrb_raise_iff_f_error(mrb, res, "f_lseek");
   return mrb_fixnum_value(0);
 }
@@ -128,39 +140,123 @@ mrb_size(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_eof_p(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
-  if (f_eof(fp) == 0) {
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  if (FILE_eof(ff) == 0) {
     return mrb_false_value();
   } else {
     return mrb_true_value();
   }
 }
 
+/*
+ * read(length) -> String | nil
+ * read(nil)    -> String | nil  reads up to the end of file
+ * The String is allocated once, sized from what is left in the file.
+ */
 static mrb_value
 mrb_read(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
-  mrb_int btr;
-  mrb_get_args(mrb, "i", &btr);
-  char buff[btr];
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  mrb_value length;
+  mrb_get_args(mrb, "o", &length);
+  FSIZE_t pos = FILE_tell(ff);
+  FSIZE_t rest = (pos < f_size(&ff->fil)) ? f_size(&ff->fil) - pos : 0;
+  mrb_int btr = mrb_nil_p(length) ? (mrb_int)rest : mrb_integer(mrb_ensure_int_type(mrb, length));
+  if (btr < 0) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "negative length %i given", btr);
+  }
+  if (rest < (FSIZE_t)btr) btr = (mrb_int)rest;
+  if (btr <= 0) {
+    return mrb_nil_value();
+  }
+  mrb_value value = mrb_str_new(mrb, NULL, btr);
   UINT br;
-  FRESULT res = f_read(fp, buff, (UINT)btr, &br);
+  FRESULT res = FILE_read(ff, RSTRING_PTR(value), (UINT)btr, &br);
   mrb_raise_iff_f_error(mrb, res, "f_read");
-  if (0 < br) {
-    mrb_value value = mrb_str_new(mrb, (const void *)buff, br);
-    return value;
-  } else {
+  if (br == 0) {
+    return mrb_nil_value();
+  }
+  return mrb_str_resize(mrb, value, br);
+}
+
+/*
+ * gets(rs, limit, chomp) -> String | nil
+ *   rs:    separator String, "" for paragraphs, nil for the rest of file
+ *   limit: maximum bytes or nil
+ * Lines are cut out of the read-ahead buffer without seeking back.
+ * A paragraph ends with "\n\n", and the newlines around it are skipped.
+ */
+static mrb_value
+mrb_gets(mrb_state *mrb, mrb_value self)
+{
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  const char *rs;
+  mrb_int rslen;
+  mrb_value limit_v;
+  mrb_bool chomp;
+  mrb_get_args(mrb, "s!ob", &rs, &rslen, &limit_v, &chomp);
+  mrb_bool paragraph = (rs && rslen == 0);
+  if (paragraph) {
+    rs = "\n\n";
+    rslen = 2;
+  }
+  mrb_int limit = mrb_nil_p(limit_v) ? -1 : mrb_integer(mrb_ensure_int_type(mrb, limit_v));
+  if (limit == 0) {
+    return mrb_str_new_lit(mrb, "");
+  }
+  if (ff->rbuf == NULL) {
+    ff->rbuf = (uint8_t *)mrb_malloc(mrb, FAT_FILE_RBUF_SIZE);
+  }
+  if (paragraph) {
+    mrb_raise_iff_f_error(mrb, FILE_skip_newlines(ff), "f_read");
+  }
+  mrb_value line = mrb_str_new_capa(mrb, FAT_FILE_RBUF_SIZE);
+  mrb_bool found = FALSE;
+  for (;;) {
+    FRESULT res = FILE_fill(ff);
+    mrb_raise_iff_f_error(mrb, res, "f_read");
+    if (ff->rlen == 0) break; /* end of file */
+    UINT n = ff->rlen - ff->rpos;
+    if (0 < limit && limit - RSTRING_LEN(line) < (mrb_int)n) {
+      n = (UINT)(limit - RSTRING_LEN(line));
+    }
+    mrb_str_cat(mrb, line, (const char *)ff->rbuf + ff->rpos, n);
+    ff->rpos += n;
+    if (rs) {
+      long end = FILE_find_separator(RSTRING_PTR(line), RSTRING_LEN(line), n, rs, rslen);
+      if (0 <= end) {
+        /* give back what follows the separator */
+        ff->rpos -= RSTRING_LEN(line) - end;
+        mrb_str_resize(mrb, line, end);
+        found = TRUE;
+        break;
+      }
+    }
+    if (0 < limit && RSTRING_LEN(line) == limit) break;
+  }
+  if (RSTRING_LEN(line) == 0) {
     return mrb_nil_value();
   }
+  if (paragraph && found) {
+    mrb_raise_iff_f_error(mrb, FILE_skip_newlines(ff), "f_read");
+  }
+  if (chomp && found) {
+    mrb_int size = RSTRING_LEN(line) - rslen;
+    if (rslen == 1 && rs[0] == '\n' && 0 < size && RSTRING_PTR(line)[size - 1] == '\r') {
+      size--;
+    }
+    mrb_str_resize(mrb, line, size);
+  }
+  return line;
 }
 
 static mrb_value
 mrb_getbyte(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
   char buff[1];
   UINT br;
-  FRESULT res = f_read(fp, buff, 1, &br);
+  FRESULT res = FILE_read(ff, buff, 1, &br);
   mrb_raise_iff_f_error(mrb, res, "f_read");
   if (br == 1) {
     return mrb_fixnum_value((unsigned char)buff[0]);
@@ -172,13 +268,13 @@ mrb_getbyte(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_write(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
   mrb_value str;
   mrb_get_args(mrb, "S", &str);
   UINT bw;
   FRESULT res;
-  res = f_write(fp, RSTRING_PTR(str), RSTRING_LEN(str), &bw);
-  if (res == FR_OK) res = f_sync(fp);
+  res = FILE_write(ff, RSTRING_PTR(str), RSTRING_LEN(str), &bw);
+  if (res == FR_OK) res = f_sync(&ff->fil);
   mrb_raise_iff_f_error(mrb, res, "f_write|f_sync");
   return mrb_fixnum_value(bw);
 }
@@ -186,9 +282,13 @@ mrb_write(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_File_close(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
   FRESULT res;
-  res = f_close(fp);
+  mrb_free(mrb, ff->rbuf);
+  ff->rbuf = NULL;
+  ff->rpos = ff->rlen = 0;
+  FILE_fastseek_free(ff);
+  res = f_close(&ff->fil);
   mrb_raise_iff_f_error(mrb, res, "f_close");
   return mrb_nil_value();
 }
@@ -196,11 +296,14 @@ mrb_File_close(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_expand(mrb_state *mrb, mrb_value self)
 {
-  FIL *fp = (FIL *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FATFile *ff = (FATFile *)mrb_data_get_ptr(mrb, self, &mrb_fat_file_type);
+  FIL *fp = &ff->fil;
   FRESULT res;
   mrb_int size;
   mrb_get_args(mrb, "i", &size);
-  res = f_expand(fp, (FSIZE_t)size, 1);
+  res = FILE_unread(ff);
+  FILE_fastseek_free(ff);
+  if (res == FR_OK) res = f_expand(fp, (FSIZE_t)size, 1);
   if (res == FR_OK) res = f_sync(fp);
   mrb_raise_iff_f_error(mrb, res, "f_expand|f_sync");
   return mrb_fixnum_value(size);
@@ -229,17 +332,19 @@ static mrb_value
 mrb_s_vfs_methods(mrb_state *mrb, mrb_value klass)
 {
   prb_vfs_methods m = {
-    mrb_s_new,
-    mrb_File_close,
-    mrb_read,
-    mrb_getbyte,
-    mrb_write,
-    mrb_seek,
-    mrb_tell,
-    mrb_size,
-    mrb_fsync,
-    mrb__exist_p,
-    mrb__unlink
+    .file_new = mrb_s_new,
+    .file_close = mrb_File_close,
+    .file_read = mrb_read,
+    .file_write = mrb_write,
+    .file_seek = mrb_seek,
+    .file_tell = mrb_tell,
+    .file_size = mrb_size,
+    .file_fsync = mrb_fsync,
+    .file_exist_q = mrb__exist_p,
+    .file_unlink = mrb__unlink,
+    .file_pread = FILE_pread,
+    .file_pwrite = FILE_pwrite,
+    .file_device_info = FILE_device_info
   };
   prb_vfs_methods *mm = (prb_vfs_methods *)mrb_malloc(mrb, sizeof(prb_vfs_methods));
   memcpy(mm, &m, sizeof(prb_vfs_methods));
@@ -257,12 +362,13 @@ mrb_init_class_FAT_File(mrb_state *mrb ,struct RClass *class_FAT)
   struct RClass *class_FAT_VFSMethods = mrb_define_class_under_id(mrb, class_FAT, MRB_SYM(VFSMethods), mrb->object_class);
   MRB_SET_INSTANCE_TT(class_FAT_VFSMethods, MRB_TT_CDATA);
 
-  mrb_define_class_method_id(mrb, class_FAT_File, MRB_SYM(new), mrb_s_new, MRB_ARGS_REQ(2));
-  mrb_define_class_method_id(mrb, class_FAT_File, MRB_SYM(open), mrb_s_new, MRB_ARGS_REQ(2));
+  mrb_define_class_method_id(mrb, class_FAT_File, MRB_SYM(new), mrb_s_new, MRB_ARGS_ARG(2, 1));
+  mrb_define_class_method_id(mrb, class_FAT_File, MRB_SYM(open), mrb_s_new, MRB_ARGS_ARG(2, 1));
   mrb_define_method_id(mrb, class_FAT_File, MRB_SYM(tell), mrb_tell, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_FAT_File, MRB_SYM(seek), mrb_seek, MRB_ARGS_REQ(2));
   mrb_define_method_id(mrb, class_FAT_File, MRB_SYM_Q(eof), mrb_eof_p, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_FAT_File, MRB_SYM(read), mrb_read, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, class_FAT_File, MRB_SYM(gets), mrb_gets, MRB_ARGS_REQ(3));
   mrb_define_method_id(mrb, class_FAT_File, MRB_SYM(getbyte), mrb_getbyte, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_FAT_File, MRB_SYM(write), mrb_write, MRB_ARGS_REQ(1));
   mrb_define_method_id(mrb, class_FAT_File, MRB_SYM(close), mrb_File_close, MRB_ARGS_NONE());
@@ -72,6 +72,12 @@ static void
 c__unmount(struct VM *vm, mrbc_value v[], int argc)
 {
   FRESULT res;
+  int pdrv = volume_number((const char *)GET_STRING_ARG(1));
+  /* the sector cache may still hold what f_write() left without f_sync() */
+  if (0 <= pdrv && disk_ioctl((BYTE)pdrv, CTRL_SYNC, NULL) != RES_OK) {
+    mrbc_raise_iff_f_error(vm, FR_DISK_ERR, "f_unmount");
+    return;
+  }
   res = f_mount(0, (const TCHAR *)GET_STRING_ARG(1), 0);
   mrbc_raise_iff_f_error(vm, res, "f_unmount");
   SET_INT_RETURN(0);
@@ -144,6 +150,39 @@ c__stat(mrbc_vm *vm, mrbc_value v[], int argc)
   SET_RETURN(stat);
 }
 
+/*
+ * Usage: FAT#_cache_stats(prefix)
+ * Counters of the sector cache of the drive: hit, miss and write
+ */
+static void
+c__cache_stats(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  int pdrv = volume_number((const char *)GET_STRING_ARG(1));
+  if (pdrv < 0) {
+    mrbc_raise(vm, MRBC_CLASS(RuntimeError), "Volume not found in cache_stats");
+    return;
+  }
+  disk_cache_stat st;
+  disk_cache_stats((BYTE)pdrv, &st);
+  mrbc_value stats = mrbc_hash_new(vm, 3);
+  mrbc_hash_set(
+    &stats,
+    &mrbc_symbol_value(mrbc_str_to_symid("hit")),
+    &mrbc_integer_value((mrbc_int_t)st.hit)
+  );
+  mrbc_hash_set(
+    &stats,
+    &mrbc_symbol_value(mrbc_str_to_symid("miss")),
+    &mrbc_integer_value((mrbc_int_t)st.miss)
+  );
+  mrbc_hash_set(
+    &stats,
+    &mrbc_symbol_value(mrbc_str_to_symid("write")),
+    &mrbc_integer_value((mrbc_int_t)st.write)
+  );
+  SET_RETURN(stats);
+}
+
 static void
 c__directory_q(mrbc_vm *vm, mrbc_value v[], int argc)
 {
@@ -278,6 +317,7 @@ mrbc_filesystem_fat_init(mrbc_vm *vm)
   mrbc_define_method(vm, class_FAT, "_setlabel", c__setlabel);
   mrbc_define_method(vm, class_FAT, "_getlabel", c__getlabel);
   mrbc_define_method(vm, class_FAT, "_contiguous?", c__contiguous_q);
+  mrbc_define_method(vm, class_FAT, "_cache_stats", c__cache_stats);
   mrbc_init_class_FAT_Dir(vm, class_FAT);
   mrbc_init_class_FAT_File(vm, class_FAT);
 
@@ -6,8 +6,10 @@ c_new(mrbc_vm *vm, mrbc_value v[], int argc)
 {
   FRESULT res;
   const TCHAR *path = (const TCHAR *)GET_STRING_ARG(1);
-  mrbc_value _file = mrbc_instance_new(vm, v->cls, sizeof(FIL));
-  FIL *fp = (FIL *)_file.instance->data;
+  mrbc_value _file = mrbc_instance_new(vm, v->cls, sizeof(FATFile));
+  FATFile *ff = (FATFile *)_file.instance->data;
+  ff->rbuf = NULL;
+  ff->fil.cltbl = NULL;
   BYTE mode = 0;
   const char *mode_str = (const char *)GET_STRING_ARG(2);
   if (strcmp(mode_str, "r") == 0) {
@@ -29,7 +31,12 @@ c_new(mrbc_vm *vm, mrbc_value v[], int argc)
   } else {
     mrbc_raise(vm, MRBC_CLASS(ArgumentError), "Unknown file open mode");
   }
-  res = f_open(fp, path, mode);
+  /* fastseek: true, false or nil (decided by mode and size) */
+  int fastseek = -1;
+  if (3 <= argc && v[3].tt != MRBC_TT_NIL) {
+    fastseek = (v[3].tt != MRBC_TT_FALSE);
+  }
+  res = FILE_open(ff, path, mode, fastseek);
   mrbc_raise_iff_f_error(vm, res, path);
   _file.instance->cls = class_FAT_File;
   SET_RETURN(_file);
@@ -66,17 +73,19 @@ c_physical_address(mrbc_vm *vm, mrbc_value v[], int argc)
 static void
 c_tell(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
-  FSIZE_t pos = f_tell(fp);
+  FATFile *ff = (FATFile *)v->instance->data;
+  FSIZE_t pos = FILE_tell(ff);
   SET_INT_RETURN(pos);
 }
 
 static void
 c_seek(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
+  FATFile *ff = (FATFile *)v->instance->data;
+  FIL *fp = &ff->fil;
   int ofs = GET_INT_ARG(1);
   int whence = GET_INT_ARG(2);
+  mrbc_raise_iff_f_error(vm, FILE_unread(ff), "f_lseek");
   FSIZE_t size = f_size(fp);
   FSIZE_t new_pos;
 
@@ -96,12 +105,13 @@ c_seek(mrbc_vm *vm, mrbc_value v[], int argc)
     return;
   } else if (size < new_pos) {
     FRESULT res;
+    FILE_fastseek_free(ff);
     res = f_expand(fp, new_pos, 1);
     if (res == FR_OK) res = f_sync(fp);
     mrbc_raise_iff_f_error(vm, res, "f_lseek|f_expand|f_sync");
   }
   FRESULT res;
-  res = f_lseek(fp, new_pos);
+  res = FILE_lseek(ff, new_pos);
   mrbc_raise_iff_f_error(vm, res, "f_lseek");
   SET_INT_RETURN(0);
 }
@@ -117,38 +127,173 @@ c_size(mrbc_vm *vm, mrbc_value v[], int argc)
 static void
 c_eof_q(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
-  if (f_eof(fp) == 0) {
+  FATFile *ff = (FATFile *)v->instance->data;
+  if (FILE_eof(ff) == 0) {
     SET_FALSE_RETURN();
   } else {
     SET_TRUE_RETURN();
   }
 }
 
+/*
+ * read(length) -> String | nil
+ * read(nil)    -> String | nil  reads up to the end of file
+ * The String is allocated once, sized from what is left in the file.
+ */
 static void
 c_read(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
-  UINT btr = GET_INT_ARG(1);
-  char buff[btr];
+  FATFile *ff = (FATFile *)v->instance->data;
+  FSIZE_t pos = FILE_tell(ff);
+  FSIZE_t rest = (pos < f_size(&ff->fil)) ? f_size(&ff->fil) - pos : 0;
+  FSIZE_t btr = rest;
+  if (v[1].tt != MRBC_TT_NIL) {
+    mrbc_int_t length = GET_INT_ARG(1);
+    if (length < 0) {
+      mrbc_raisef(vm, MRBC_CLASS(ArgumentError), "negative length %d given", (int)length);
+      return;
+    }
+    btr = (FSIZE_t)length;
+    if (rest < btr) btr = rest;
+  }
+  if (btr == 0) {
+    SET_NIL_RETURN();
+    return;
+  }
+  char *buff = mrbc_alloc(vm, btr + 1);
+  if (buff == NULL) {
+    mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "can't allocate read buffer");
+    return;
+  }
   UINT br;
-  FRESULT res = f_read(fp, buff, btr, &br);
-  mrbc_raise_iff_f_error(vm, res, "f_read");
+  FRESULT res = FILE_read(ff, buff, (UINT)btr, &br);
+  if (res != FR_OK) {
+    mrbc_free(vm, buff);
+    mrbc_raise_iff_f_error(vm, res, "f_read");
+    return;
+  }
   if (0 < br) {
-    mrbc_value value = mrbc_string_new(vm, (const void *)buff, br);
+    buff[br] = '\0';
+    mrbc_value value = mrbc_string_new_alloc(vm, buff, br);
     SET_RETURN(value);
   } else {
+    mrbc_free(vm, buff);
+    SET_NIL_RETURN();
+  }
+}
+
+/*
+ * gets(rs, limit, chomp) -> String | nil
+ *   rs:    separator String, "" for paragraphs, nil for the rest of file
+ *   limit: maximum bytes or nil
+ * Lines are cut out of the read-ahead buffer without seeking back.
+ * A paragraph ends with "\n\n", and the newlines around it are skipped.
+ */
+static void
+c_gets(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  FATFile *ff = (FATFile *)v->instance->data;
+  const char *rs = NULL;
+  size_t rslen = 0;
+  bool paragraph = false;
+  if (v[1].tt == MRBC_TT_STRING) {
+    rs = (const char *)v[1].string->data;
+    rslen = v[1].string->size;
+    if (rslen == 0) {
+      paragraph = true;
+      rs = "\n\n";
+      rslen = 2;
+    }
+  } else if (v[1].tt != MRBC_TT_NIL) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong argument type (expected String)");
+    return;
+  }
+  mrbc_int_t limit = -1;
+  if (v[2].tt == MRBC_TT_INTEGER) {
+    limit = v[2].i;
+  } else if (v[2].tt != MRBC_TT_NIL) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong argument type (expected Integer)");
+    return;
+  }
+  bool chomp = (v[3].tt == MRBC_TT_TRUE);
+  if (limit == 0) {
+    SET_RETURN(mrbc_string_new(vm, "", 0));
+    return;
+  }
+  if (ff->rbuf == NULL) {
+    ff->rbuf = mrbc_raw_alloc(FAT_FILE_RBUF_SIZE);
+    if (ff->rbuf == NULL) {
+      mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "can't allocate read buffer");
+      return;
+    }
+  }
+  if (paragraph) {
+    FRESULT res = FILE_skip_newlines(ff);
+    if (res != FR_OK) {
+      mrbc_raise_iff_f_error(vm, res, "f_read");
+      return;
+    }
+  }
+  mrbc_value line = mrbc_string_new(vm, "", 0);
+  bool found = false;
+  for (;;) {
+    FRESULT res = FILE_fill(ff);
+    if (res != FR_OK) {
+      mrbc_decref(&line);
+      mrbc_raise_iff_f_error(vm, res, "f_read");
+      return;
+    }
+    if (ff->rlen == 0) break; /* end of file */
+    UINT n = ff->rlen - ff->rpos;
+    if (0 < limit && (mrbc_int_t)(limit - line.string->size) < (mrbc_int_t)n) {
+      n = (UINT)(limit - line.string->size);
+    }
+    mrbc_string_append_cbuf(&line, ff->rbuf + ff->rpos, n);
+    ff->rpos += n;
+    if (rs) {
+      long end = FILE_find_separator((const char *)line.string->data, line.string->size, n, rs, rslen);
+      if (0 <= end) {
+        /* give back what follows the separator */
+        ff->rpos -= line.string->size - end;
+        line.string->size = end;
+        line.string->data[end] = '\0';
+        found = true;
+        break;
+      }
+    }
+    if (0 < limit && line.string->size == limit) break;
+  }
+  if (line.string->size == 0) {
+    mrbc_decref(&line);
     SET_NIL_RETURN();
+    return;
+  }
+  if (paragraph && found) {
+    FRESULT res = FILE_skip_newlines(ff);
+    if (res != FR_OK) {
+      mrbc_decref(&line);
+      mrbc_raise_iff_f_error(vm, res, "f_read");
+      return;
+    }
+  }
+  if (chomp && found) {
+    size_t size = line.string->size - rslen;
+    if (rslen == 1 && rs[0] == '\n' && 0 < size && line.string->data[size - 1] == '\r') {
+      size--;
+    }
+    line.string->size = size;
+    line.string->data[size] = '\0';
   }
+  SET_RETURN(line);
 }
 
 static void
 c_getbyte(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
-  char c;
+  FATFile *ff = (FATFile *)v->instance->data;
+  unsigned char c;
   UINT br;
-  FRESULT res = f_read(fp, &c, 1, &br);
+  FRESULT res = FILE_read(ff, &c, 1, &br);
   mrbc_raise_iff_f_error(vm, res, "f_read");
   if (br == 0) {
     SET_NIL_RETURN();
@@ -161,22 +306,35 @@ c_getbyte(mrbc_vm *vm, mrbc_value v[], int argc)
 static void
 c_write(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
+  FATFile *ff = (FATFile *)v->instance->data;
   mrbc_value str = v[1];
   UINT bw;
   FRESULT res;
-  res = f_write(fp, str.string->data, str.string->size, &bw);
-  if (res == FR_OK) res = f_sync(fp);
+  res = FILE_write(ff, str.string->data, str.string->size, &bw);
+  if (res == FR_OK) res = f_sync(&ff->fil);
   mrbc_raise_iff_f_error(vm, res, "f_write|f_sync");
   SET_INT_RETURN(bw);
 }
 
+static void
+fat_file_free(mrbc_value *self)
+{
+  FATFile *ff = (FATFile *)self->instance->data;
+  if (ff->rbuf) {
+    mrbc_raw_free(ff->rbuf);
+    ff->rbuf = NULL;
+  }
+  ff->rpos = ff->rlen = 0;
+  FILE_fastseek_free(ff);
+}
+
 static void
 c_close(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
+  FATFile *ff = (FATFile *)v->instance->data;
   FRESULT res;
-  res = f_close(fp);
+  fat_file_free(&v[0]);
+  res = f_close(&ff->fil);
   mrbc_raise_iff_f_error(vm, res, "f_close");
   SET_NIL_RETURN();
 }
@@ -184,10 +342,13 @@ c_close(mrbc_vm *vm, mrbc_value v[], int argc)
 static void
 c_expand(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  FIL *fp = (FIL *)v->instance->data;
+  FATFile *ff = (FATFile *)v->instance->data;
+  FIL *fp = &ff->fil;
   FRESULT res;
   FSIZE_t size = GET_INT_ARG(1);
-  res = f_expand(fp, size, 1);
+  res = FILE_unread(ff);
+  FILE_fastseek_free(ff);
+  if (res == FR_OK) res = f_expand(fp, size, 1);
   if (res == FR_OK) res = f_sync(fp);
   mrbc_raise_iff_f_error(vm, res, "f_expand|f_sync");
   SET_INT_RETURN(size);
@@ -207,16 +368,19 @@ static void
 c_vfs_methods(mrbc_vm *vm, mrbc_value v[], int argc)
 {
   prb_vfs_methods m = {
-    c_new,
-    c_close,
-    c_read,
-    c_write,
-    c_seek,
-    c_tell,
-    c_size,
-    c_fsync,
-    c__exist_q,
-    c__unlink
+    .file_new = c_new,
+    .file_close = c_close,
+    .file_read = c_read,
+    .file_write = c_write,
+    .file_seek = c_seek,
+    .file_tell = c_tell,
+    .file_size = c_size,
+    .file_fsync = c_fsync,
+    .file_exist_q = c__exist_q,
+    .file_unlink = c__unlink,
+    .file_pread = FILE_pread,
+    .file_pwrite = FILE_pwrite,
+    .file_device_info = FILE_device_info
   };
   mrbc_value methods = mrbc_instance_new(vm, class_FAT_VFSMethods, sizeof(prb_vfs_methods));
   memcpy(methods.instance->data, &m, sizeof(prb_vfs_methods));
@@ -229,6 +393,7 @@ mrbc_init_class_FAT_File(mrbc_vm *vm ,mrbc_class *class_FAT)
 
   class_FAT_File = mrbc_define_class_under(vm, class_FAT, "File", mrbc_class_object);
   class_FAT_VFSMethods = mrbc_define_class_under(vm, class_FAT, "VFSMethods", mrbc_class_object);
+  mrbc_define_destructor(class_FAT_File, fat_file_free);
 
   mrbc_define_method(vm, class_FAT_File, "new", c_new);
   mrbc_define_method(vm, class_FAT_File, "open", c_new);
@@ -236,6 +401,7 @@ mrbc_init_class_FAT_File(mrbc_vm *vm ,mrbc_class *class_FAT)
   mrbc_define_method(vm, class_FAT_File, "seek", c_seek);
   mrbc_define_method(vm, class_FAT_File, "eof?", c_eof_q);
   mrbc_define_method(vm, class_FAT_File, "read", c_read);
+  mrbc_define_method(vm, class_FAT_File, "gets", c_gets);
   mrbc_define_method(vm, class_FAT_File, "getbyte", c_getbyte);
   mrbc_define_method(vm, class_FAT_File, "write", c_write);
   mrbc_define_method(vm, class_FAT_File, "close", c_close);
@@ -0,0 +1,51 @@
+# Parses a 20 KB API response (the smart meter device list of the
+# JSON::Digger example, repeated) with the native JSON.parse and with
+# JSON::Parser, the Ruby implementation it replaced.
+#
+#   bin/picoruby mrbgems/picoruby-json/example/json_bench.rb
+
+SIZE = 20 * 1024
+ROUNDS = 4
+
+def bench(name, bytes)
+  result = nil
+  started = Time.now.to_f
+  i = 0
+  while i < ROUNDS
+    result = yield
+    i += 1
+  end
+  elapsed = Time.now.to_f - started
+  kbps = elapsed == 0 ? '-' : (bytes * ROUNDS / elapsed / 1024).to_i
+  ms = (elapsed * 1000 / ROUNDS).to_i
+  puts "#{name.ljust(24, " ")} #{ms} ms #{kbps} KB/s"
+  result
+end
+
+def device(n)
+  '{"id":"02e548eb-900d-4de4-93d8-' + n.to_s.rjust(12, "0") + '",' +
+    '"device":{"name":"Meter ' + n.to_s + '","created_at":"2024-09-19T01:08:25Z",' +
+    '"mac_address":"f0:08:d1:ea:da:00","firmware_version":"Remo-E-lite/1.10.0",' +
+    '"temperature_offset":0,"humidity_offset":-' + (n % 10).to_s + '},' +
+    '"model":{"manufacturer":"","name":"Smart Meter","image":"ico_smartmeter"},' +
+    '"type":"EL_SMART_METER","nickname":"Line\\t' + n.to_s + '\\n","settings":null,' +
+    '"aircon":null,"signals":[],"online":true,"smart_meter":{"echonetlite_properties":[' +
+    '{"name":"coefficient","epc":211,"val":"1"},' +
+    '{"name":"normal_direction_cumulative_electric_energy","epc":224,"val":"' + (80481 + n).to_s + '"},' +
+    '{"name":"measured_instantaneous","epc":231,"val":"' + (599 + n).to_s + '"}]}}'
+end
+
+json = "["
+n = 0
+while json.length < SIZE
+  json << "," if 0 < n
+  json << device(n)
+  n += 1
+end
+json << "]"
+puts "#{json.length} bytes, #{n} devices"
+
+native = bench("JSON.parse", json.length) { JSON.parse(json) }
+bench("symbolize_names: true", json.length) { JSON.parse(json, symbolize_names: true) }
+ruby = bench("JSON::Parser (Ruby)", json.length) { JSON::Parser.new(json).parse }
+puts "same result: #{native == ruby ? "yes" : "NO"}"
@@ -2,6 +2,8 @@
 # JSON library for PicoRuby
 # This is a simple JSON parser and generator for PicoRuby.
 # It is designed to be small and simple, not to be fast or complete.
+# JSON.parse is written in C (src/json.c) as it has to deal with
+# large API responses; JSON::Parser is the Ruby version it replaced.
 #
 # Author: Hitoshi HASUMI
 # License: MIT
@@ -12,6 +14,7 @@ module JSON
 
   class JSONError < StandardError; end
   class ParserError < JSONError; end
+  class NestingError < ParserError; end
   class GeneratorError < JSONError; end
   class DiggerError < JSONError; end
 
@@ -51,8 +54,13 @@ module JSON
     end
   end
 
-  def self.parse(json)
-    JSON::Parser.new(json).parse
+  MAX_NESTING = 100
+
+  # symbolize_names: true returns Symbol keys.
+  # max_nesting: false (or 0) lifts the limit of nested arrays and
+  # objects, which is otherwise only bounded by the C stack.
+  def self.parse(json, symbolize_names: false, max_nesting: MAX_NESTING)
+    JSON._parse(json, symbolize_names, max_nesting || 0, false)
   end
 
   def self.generate(obj)
@@ -120,8 +128,9 @@ module JSON
       return self
     end
 
+    # The dug part may still end with the ',' or ']' after it
     def parse
-      JSON.parse(@json)
+      JSON._parse(@json, false, JSON::MAX_NESTING, true)
     end
 
     # private
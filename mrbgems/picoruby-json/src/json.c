@@ -0,0 +1,498 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Single-pass JSON parser
+ *
+ * The input is read once from left to right. A string is scanned up to
+ * its closing quote while its decoded size is counted, so the String is
+ * allocated with exactly that capacity and either copied as is or
+ * filled by json_decode_string(), which expands escapes and \uXXXX
+ * (with surrogate pairs) into UTF-8. Numbers are validated against the
+ * JSON grammar as they are scanned; integers are accumulated on the way
+ * and only floats go through strtod().
+ *
+ * Building values is left to mruby/json.c and mrubyc/json.c, which walk
+ * the grammar recursively with the helpers below. parser->depth is
+ * checked against max_nesting when an array or object is entered.
+ */
+
+#define JSON_ERROR      ((size_t)-1)
+#define JSON_FLOAT_MAX  64    // longest float at the end of the input
+
+typedef enum {
+  JSON_OK = 0,
+  JSON_UNEXPECTED_CHAR,
+  JSON_UNEXPECTED_END,
+  JSON_UNTERMINATED_STRING,
+  JSON_INVALID_ESCAPE,
+  JSON_INVALID_UNICODE,
+  JSON_INVALID_NUMBER,
+  JSON_INTEGER_TOO_BIG,
+  JSON_FLOAT_UNSUPPORTED,
+  JSON_TOO_DEEP,
+} json_error_t;
+
+typedef enum {
+  JSON_NUMBER_ERROR = 0,
+  JSON_NUMBER_INTEGER,
+  JSON_NUMBER_FLOAT,
+} json_number_t;
+
+typedef struct {
+  const char *start;
+  const char *p;
+  const char *end;
+  uint32_t depth;
+  uint32_t max_nesting;   // 0 for no limit
+  bool symbolize_names;
+  bool allow_trailing;    // stop after the first value, for JSON::Digger
+  json_error_t error;
+  const char *error_at;
+} json_parser_t;
+
+static void
+json_parser_init(json_parser_t *parser, const char *json, size_t len)
+{
+  memset(parser, 0, sizeof(json_parser_t));
+  parser->start = parser->p = json;
+  parser->end = json + len;
+}
+
+static bool
+json_fail(json_parser_t *parser, json_error_t error, const char *at)
+{
+  if (parser->error == JSON_OK) {
+    parser->error = error;
+    parser->error_at = at;
+  }
+  return false;
+}
+
+/* The character under the cursor, or a mismatch for any token at the end */
+static bool
+json_fail_here(json_parser_t *parser)
+{
+  if (parser->end <= parser->p) {
+    return json_fail(parser, JSON_UNEXPECTED_END, parser->p);
+  }
+  return json_fail(parser, JSON_UNEXPECTED_CHAR, parser->p);
+}
+
+static void
+json_error_message(const json_parser_t *parser, char *buf, size_t size)
+{
+  int index = (int)(parser->error_at - parser->start);
+  unsigned char c = (parser->error_at < parser->end) ? (unsigned char)*parser->error_at : 0;
+  switch (parser->error) {
+    case JSON_UNEXPECTED_CHAR:
+      if (0x20 <= c && c < 0x7F) {
+        snprintf(buf, size, "Unexpected character '%c' at index %d", c, index);
+      } else {
+        snprintf(buf, size, "Unexpected character 0x%02X at index %d", c, index);
+      }
+      break;
+    case JSON_UNEXPECTED_END:
+      snprintf(buf, size, "Unexpected end of input at index %d", index);
+      break;
+    case JSON_UNTERMINATED_STRING:
+      snprintf(buf, size, "Unterminated string at index %d", index);
+      break;
+    case JSON_INVALID_ESCAPE:
+      snprintf(buf, size, "Unknown escape sequence at index %d", index);
+      break;
+    case JSON_INVALID_UNICODE:
+      snprintf(buf, size, "Invalid \\u escape at index %d", index);
+      break;
+    case JSON_INVALID_NUMBER:
+      snprintf(buf, size, "Invalid number at index %d", index);
+      break;
+    case JSON_INTEGER_TOO_BIG:
+      snprintf(buf, size, "Integer too big at index %d", index);
+      break;
+    case JSON_FLOAT_UNSUPPORTED:
+      snprintf(buf, size, "Float is not supported at index %d", index);
+      break;
+    case JSON_TOO_DEEP:
+      snprintf(buf, size, "Nesting of %d is too deep", (int)parser->max_nesting + 1);
+      break;
+    default:
+      snprintf(buf, size, "Parse error at index %d", index);
+      break;
+  }
+}
+
+static void
+json_skip_whitespace(json_parser_t *parser)
+{
+  const char *p = parser->p;
+  while (p < parser->end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+    p++;
+  }
+  parser->p = p;
+}
+
+/* The character under the cursor, -1 at the end */
+static int
+json_peek(const json_parser_t *parser)
+{
+  return (parser->p < parser->end) ? (unsigned char)*parser->p : -1;
+}
+
+static bool
+json_literal(json_parser_t *parser, const char *word, size_t len)
+{
+  if ((size_t)(parser->end - parser->p) < len || memcmp(parser->p, word, len) != 0) {
+    const char *p = parser->p;
+    while (p < parser->end && *p == *word) {
+      p++;
+      word++;
+    }
+    parser->p = p;
+    return json_fail_here(parser);
+  }
+  parser->p += len;
+  return true;
+}
+
+static bool
+json_enter(json_parser_t *parser)
+{
+  parser->depth++;
+  if (parser->max_nesting && parser->max_nesting < parser->depth) {
+    return json_fail(parser, JSON_TOO_DEEP, parser->p);
+  }
+  parser->p++;  // '[' or '{'
+  json_skip_whitespace(parser);
+  return true;
+}
+
+/* Right after json_enter(): skips the closing bracket of [] or {} */
+static bool
+json_empty(json_parser_t *parser, char close)
+{
+  if (json_peek(parser) != close) return false;
+  parser->p++;
+  parser->depth--;
+  return true;
+}
+
+/*
+ * After an element or a member: skips the ',' and the whitespace after
+ * it and returns ',', or skips the closing bracket and returns it.
+ * Returns 0 on error.
+ */
+static int
+json_separator(json_parser_t *parser, char close)
+{
+  json_skip_whitespace(parser);
+  int c = json_peek(parser);
+  if (c == ',') {
+    parser->p++;
+    json_skip_whitespace(parser);
+    return c;
+  }
+  if (c == close) {
+    parser->p++;
+    parser->depth--;
+    return c;
+  }
+  json_fail_here(parser);
+  return 0;
+}
+
+/* The key of a member must be followed by ':' */
+static bool
+json_colon(json_parser_t *parser)
+{
+  json_skip_whitespace(parser);
+  if (json_peek(parser) != ':') {
+    return json_fail_here(parser);
+  }
+  parser->p++;
+  json_skip_whitespace(parser);
+  return true;
+}
+
+static int
+json_hex_value(char c)
+{
+  if ('0' <= c && c <= '9') return c - '0';
+  if ('a' <= c && c <= 'f') return c - 'a' + 10;
+  if ('A' <= c && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* Four hex digits after "\u" at p, -1 if there are none */
+static int32_t
+json_hex4(const char *p, const char *end)
+{
+  if (end - p < 6 || p[0] != '\\' || p[1] != 'u') return -1;
+  int32_t code = 0;
+  for (int i = 2; i < 6; i++) {
+    int v = json_hex_value(p[i]);
+    if (v < 0) return -1;
+    code = code << 4 | v;
+  }
+  return code;
+}
+
+/*
+ * The code point of the \u escape at p, joining a surrogate pair into
+ * one. A lone surrogate stands for itself. Sets *len to the escape
+ * length (6 or 12), returns -1 if it is malformed.
+ */
+static int32_t
+json_unicode_escape(const char *p, const char *end, size_t *len)
+{
+  int32_t code = json_hex4(p, end);
+  *len = 6;
+  if (0xD800 <= code && code <= 0xDBFF) {
+    int32_t low = json_hex4(p + 6, end);
+    if (0xDC00 <= low && low <= 0xDFFF) {
+      code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+      *len = 12;
+    }
+  }
+  return code;
+}
+
+static size_t
+json_utf8_size(int32_t code)
+{
+  if (code < 0x80) return 1;
+  if (code < 0x800) return 2;
+  if (code < 0x10000) return 3;
+  return 4;
+}
+
+static char *
+json_utf8_encode(char *dst, int32_t code)
+{
+  if (code < 0x80) {
+    *dst++ = (char)code;
+  } else if (code < 0x800) {
+    *dst++ = (char)(0xC0 | code >> 6);
+    *dst++ = (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    *dst++ = (char)(0xE0 | code >> 12);
+    *dst++ = (char)(0x80 | (code >> 6 & 0x3F));
+    *dst++ = (char)(0x80 | (code & 0x3F));
+  } else {
+    *dst++ = (char)(0xF0 | code >> 18);
+    *dst++ = (char)(0x80 | (code >> 12 & 0x3F));
+    *dst++ = (char)(0x80 | (code >> 6 & 0x3F));
+    *dst++ = (char)(0x80 | (code & 0x3F));
+  }
+  return dst;
+}
+
+/*
+ * Scans the string whose opening quote is under the cursor and leaves
+ * the cursor past its closing quote. *src and *src_end delimit the raw
+ * contents; *escaped tells if they need json_decode_string(). Returns
+ * the decoded size, JSON_ERROR if the string is malformed.
+ */
+static size_t
+json_scan_string(json_parser_t *parser, const char **src, const char **src_end, bool *escaped)
+{
+  const char *p = parser->p + 1;
+  const char *end = parser->end;
+  size_t size = 0;
+  *src = p;
+  *escaped = false;
+  for (;;) {
+    const char *run = p;
+    while (p < end && *p != '"' && *p != '\\') {
+      p++;
+    }
+    size += p - run;
+    if (end <= p) {
+      json_fail(parser, JSON_UNTERMINATED_STRING, parser->p);
+      return JSON_ERROR;
+    }
+    if (*p == '"') break;
+    *escaped = true;
+    if (end - p < 2) {
+      json_fail(parser, JSON_UNTERMINATED_STRING, parser->p);
+      return JSON_ERROR;
+    }
+    switch (p[1]) {
+      case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+        size++;
+        p += 2;
+        break;
+      case 'u': {
+        size_t len;
+        int32_t code = json_unicode_escape(p, end, &len);
+        if (code < 0) {
+          json_fail(parser, JSON_INVALID_UNICODE, p);
+          return JSON_ERROR;
+        }
+        size += json_utf8_size(code);
+        p += len;
+        break;
+      }
+      default:
+        json_fail(parser, JSON_INVALID_ESCAPE, p);
+        return JSON_ERROR;
+    }
+  }
+  *src_end = p;
+  parser->p = p + 1;
+  return size;
+}
+
+/* Expands the escapes of contents json_scan_string() has accepted */
+static void
+json_decode_string(char *dst, const char *src, const char *src_end)
+{
+  while (src < src_end) {
+    const char *run = src;
+    while (src < src_end && *src != '\\') {
+      src++;
+    }
+    memcpy(dst, run, src - run);
+    dst += src - run;
+    if (src_end <= src) break;
+    switch (src[1]) {
+      case 'b': *dst++ = '\b'; break;
+      case 'f': *dst++ = '\f'; break;
+      case 'n': *dst++ = '\n'; break;
+      case 'r': *dst++ = '\r'; break;
+      case 't': *dst++ = '\t'; break;
+      case 'u': {
+        size_t len;
+        dst = json_utf8_encode(dst, json_unicode_escape(src, src_end, &len));
+        src += len;
+        continue;
+      }
+      default: *dst++ = src[1]; break;  // '"', '\\' and '/'
+    }
+    src += 2;
+  }
+}
+
+static const char *
+json_skip_digits(const char *p, const char *end)
+{
+  while (p < end && '0' <= *p && *p <= '9') {
+    p++;
+  }
+  return p;
+}
+
+/*
+ * Scans the number under the cursor. An integer that fits in int_max
+ * goes to *integer; anything else, including bigger integers, to *real
+ * unless use_float is false.
+ */
+static json_number_t
+json_scan_number(json_parser_t *parser, int64_t int_max, bool use_float, int64_t *integer, double *real)
+{
+  const char *start = parser->p;
+  const char *end = parser->end;
+  const char *p = start;
+  bool negative = false;
+  if (*p == '-') {
+    negative = true;
+    p++;
+  }
+  const char *digits = p;
+  if (p < end && *p == '0') {
+    p++;
+  } else {
+    p = json_skip_digits(p, end);
+  }
+  if (p == digits) goto invalid;
+  const char *int_end = p;
+  bool is_float = false;
+  bool overflow = false;
+  if (p < end && *p == '.') {
+    const char *frac = ++p;
+    p = json_skip_digits(p, end);
+    if (p == frac) goto invalid;
+    is_float = true;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) p++;
+    const char *exp = p;
+    p = json_skip_digits(p, end);
+    if (p == exp) goto invalid;
+    is_float = true;
+  }
+  parser->p = p;
+
+  if (!is_float) {
+    uint64_t limit = (uint64_t)int_max + (negative ? 1 : 0);
+    uint64_t value = 0;
+    for (const char *d = digits; d < int_end; d++) {
+      uint32_t digit = *d - '0';
+      if ((limit - digit) / 10 < value) {
+        overflow = true;  // a Float stands in for a Bignum
+        break;
+      }
+      value = value * 10 + digit;
+    }
+    if (!overflow) {
+      *integer = negative ? (int64_t)(0 - value) : (int64_t)value;
+      return JSON_NUMBER_INTEGER;
+    }
+  }
+
+  if (!use_float) {
+    json_fail(parser, overflow ? JSON_INTEGER_TOO_BIG : JSON_FLOAT_UNSUPPORTED, start);
+    return JSON_NUMBER_ERROR;
+  }
+  /*
+   * strtod() stops at the character after the number, which is not part
+   * of one since the grammar has been checked. Only a number that ends
+   * the input is copied, as there may be no terminator after it.
+   */
+  if (p < end) {
+    *real = strtod(start, NULL);
+  } else {
+    char buf[JSON_FLOAT_MAX];
+    size_t len = p - start;
+    if (sizeof(buf) <= len) {
+      json_fail(parser, JSON_INVALID_NUMBER, start);
+      return JSON_NUMBER_ERROR;
+    }
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    *real = strtod(buf, NULL);
+  }
+  return JSON_NUMBER_FLOAT;
+
+invalid:
+  parser->p = p;
+  json_fail(parser, JSON_INVALID_NUMBER, start);
+  return JSON_NUMBER_ERROR;
+}
+
+/* After the top level value only whitespace may follow */
+static bool
+json_finish(json_parser_t *parser)
+{
+  if (parser->allow_trailing) return true;
+  json_skip_whitespace(parser);
+  if (parser->p < parser->end) {
+    return json_fail(parser, JSON_UNEXPECTED_CHAR, parser->p);
+  }
+  return true;
+}
+
+#if defined(PICORB_VM_MRUBY)
+
+#include "mruby/json.c"
+
+#elif defined(PICORB_VM_MRUBYC)
+
+#include "mrubyc/json.c"
+
+#endif
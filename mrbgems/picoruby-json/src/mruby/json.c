@@ -0,0 +1,188 @@
+#include "mruby.h"
+#include "mruby/presym.h"
+#include "mruby/string.h"
+#include "mruby/array.h"
+#include "mruby/hash.h"
+
+#if defined(MRB_NO_FLOAT)
+#define JSON_USE_FLOAT false
+#else
+#define JSON_USE_FLOAT true
+#endif
+
+static struct RClass *class_JSON_ParserError;
+static struct RClass *class_JSON_NestingError;
+
+static void
+json_raise(mrb_state *mrb, json_parser_t *parser)
+{
+  char message[64];
+  json_error_message(parser, message, sizeof(message));
+  if (parser->error == JSON_TOO_DEEP) {
+    mrb_raise(mrb, class_JSON_NestingError, message);
+  }
+  mrb_raise(mrb, class_JSON_ParserError, message);
+}
+
+static mrb_value json_parse_value(mrb_state *mrb, json_parser_t *parser);
+
+static mrb_value
+json_parse_string(mrb_state *mrb, json_parser_t *parser, bool key)
+{
+  const char *src, *src_end;
+  bool escaped;
+  size_t size = json_scan_string(parser, &src, &src_end, &escaped);
+  if (size == JSON_ERROR) {
+    json_raise(mrb, parser);
+  }
+  if (key && parser->symbolize_names && !escaped) {
+    return mrb_symbol_value(mrb_intern(mrb, src, size));
+  }
+  mrb_value str;
+  if (escaped) {
+    str = mrb_str_new(mrb, NULL, (mrb_int)size);
+    json_decode_string(RSTRING_PTR(str), src, src_end);
+  } else {
+    str = mrb_str_new(mrb, src, (mrb_int)size);
+  }
+  if (key && parser->symbolize_names) {
+    return mrb_symbol_value(mrb_intern_str(mrb, str));
+  }
+  return str;
+}
+
+static mrb_value
+json_parse_number(mrb_state *mrb, json_parser_t *parser)
+{
+  int64_t integer;
+  double real;
+  switch (json_scan_number(parser, MRB_INT_MAX, JSON_USE_FLOAT, &integer, &real)) {
+    case JSON_NUMBER_INTEGER:
+      return mrb_int_value(mrb, (mrb_int)integer);
+#if !defined(MRB_NO_FLOAT)
+    case JSON_NUMBER_FLOAT:
+      return mrb_float_value(mrb, (mrb_float)real);
+#endif
+    default:
+      json_raise(mrb, parser);
+      return mrb_nil_value();
+  }
+}
+
+static mrb_value
+json_parse_array(mrb_state *mrb, json_parser_t *parser)
+{
+  if (!json_enter(parser)) {
+    json_raise(mrb, parser);
+  }
+  mrb_value ary = mrb_ary_new(mrb);
+  if (json_empty(parser, ']')) return ary;
+  int ai = mrb_gc_arena_save(mrb);
+  int c;
+  do {
+    mrb_ary_push(mrb, ary, json_parse_value(mrb, parser));
+    mrb_gc_arena_restore(mrb, ai);
+  } while ((c = json_separator(parser, ']')) == ',');
+  if (c == 0) {
+    json_raise(mrb, parser);
+  }
+  return ary;
+}
+
+static mrb_value
+json_parse_object(mrb_state *mrb, json_parser_t *parser)
+{
+  if (!json_enter(parser)) {
+    json_raise(mrb, parser);
+  }
+  mrb_value hash = mrb_hash_new(mrb);
+  if (json_empty(parser, '}')) return hash;
+  int ai = mrb_gc_arena_save(mrb);
+  int c;
+  do {
+    if (json_peek(parser) != '"') {
+      json_fail_here(parser);
+      json_raise(mrb, parser);
+    }
+    mrb_value key = json_parse_string(mrb, parser, true);
+    if (!json_colon(parser)) {
+      json_raise(mrb, parser);
+    }
+    mrb_hash_set(mrb, hash, key, json_parse_value(mrb, parser));
+    mrb_gc_arena_restore(mrb, ai);
+  } while ((c = json_separator(parser, '}')) == ',');
+  if (c == 0) {
+    json_raise(mrb, parser);
+  }
+  return hash;
+}
+
+static mrb_value
+json_parse_value(mrb_state *mrb, json_parser_t *parser)
+{
+  switch (json_peek(parser)) {
+    case '{':
+      return json_parse_object(mrb, parser);
+    case '[':
+      return json_parse_array(mrb, parser);
+    case '"':
+      return json_parse_string(mrb, parser, false);
+    case '-': case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      return json_parse_number(mrb, parser);
+    case 't':
+      if (json_literal(parser, "true", 4)) return mrb_true_value();
+      break;
+    case 'f':
+      if (json_literal(parser, "false", 5)) return mrb_false_value();
+      break;
+    case 'n':
+      if (json_literal(parser, "null", 4)) return mrb_nil_value();
+      break;
+    default:
+      json_fail_here(parser);
+      break;
+  }
+  json_raise(mrb, parser);
+  return mrb_nil_value();
+}
+
+static mrb_value
+mrb_json_s__parse(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value json;
+  mrb_bool symbolize_names, allow_trailing;
+  mrb_int max_nesting;
+  mrb_get_args(mrb, "Sbib", &json, &symbolize_names, &max_nesting, &allow_trailing);
+  if (max_nesting < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative max_nesting");
+  }
+
+  json_parser_t parser;
+  json_parser_init(&parser, RSTRING_PTR(json), RSTRING_LEN(json));
+  parser.symbolize_names = symbolize_names;
+  parser.max_nesting = (uint32_t)max_nesting;
+  parser.allow_trailing = allow_trailing;
+  json_skip_whitespace(&parser);
+  mrb_value result = json_parse_value(mrb, &parser);
+  if (!json_finish(&parser)) {
+    json_raise(mrb, &parser);
+  }
+  return result;
+}
+
+void
+mrb_picoruby_json_gem_init(mrb_state* mrb)
+{
+  struct RClass *module_JSON = mrb_define_module_id(mrb, MRB_SYM(JSON));
+  struct RClass *class_JSON_JSONError = mrb_define_class_under_id(mrb, module_JSON, MRB_SYM(JSONError), E_STANDARD_ERROR);
+  class_JSON_ParserError = mrb_define_class_under_id(mrb, module_JSON, MRB_SYM(ParserError), class_JSON_JSONError);
+  class_JSON_NestingError = mrb_define_class_under_id(mrb, module_JSON, MRB_SYM(NestingError), class_JSON_ParserError);
+
+  mrb_define_class_method_id(mrb, module_JSON, MRB_SYM(_parse), mrb_json_s__parse, MRB_ARGS_REQ(4));
+}
+
+void
+mrb_picoruby_json_gem_final(mrb_state* mrb)
+{
+}
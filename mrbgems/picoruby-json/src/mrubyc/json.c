@@ -0,0 +1,252 @@
+#include <mrubyc.h>
+
+#if defined(MRBC_USE_FLOAT)
+#define JSON_USE_FLOAT true
+#else
+#define JSON_USE_FLOAT false
+#endif
+
+#define JSON_INT_MAX ((int64_t)(UINT64_MAX >> (65 - sizeof(mrbc_int_t) * 8)))
+
+static mrbc_class *class_JSON_ParserError;
+static mrbc_class *class_JSON_NestingError;
+
+/*
+ * Unlike mruby, mrbc_raise() returns, so every function below returns
+ * false once an exception is set and releases what it has built.
+ */
+static bool
+json_raise(mrbc_vm *vm, json_parser_t *parser)
+{
+  char message[64];
+  json_error_message(parser, message, sizeof(message));
+  if (parser->error == JSON_TOO_DEEP) {
+    mrbc_raise(vm, class_JSON_NestingError, message);
+  } else {
+    mrbc_raise(vm, class_JSON_ParserError, message);
+  }
+  return false;
+}
+
+static bool
+json_no_memory(mrbc_vm *vm)
+{
+  mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "can't allocate JSON value");
+  return false;
+}
+
+static bool json_parse_value(mrbc_vm *vm, json_parser_t *parser, mrbc_value *result);
+
+static bool
+json_parse_string(mrbc_vm *vm, json_parser_t *parser, bool key, mrbc_value *result)
+{
+  const char *src, *src_end;
+  bool escaped;
+  size_t size = json_scan_string(parser, &src, &src_end, &escaped);
+  if (size == JSON_ERROR) {
+    return json_raise(vm, parser);
+  }
+  /* The buffer is handed over to the String, so it needs room for '\0' */
+  char *buf = mrbc_alloc(vm, size + 1);
+  if (buf == NULL) {
+    return json_no_memory(vm);
+  }
+  if (escaped) {
+    json_decode_string(buf, src, src_end);
+  } else {
+    memcpy(buf, src, size);
+  }
+  buf[size] = '\0';
+  if (key && parser->symbolize_names) {
+    *result = mrbc_symbol_new(vm, buf);
+    mrbc_free(vm, buf);
+  } else {
+    *result = mrbc_string_new_alloc(vm, buf, size);
+    if (result->string == NULL) {
+      mrbc_free(vm, buf);
+      return json_no_memory(vm);
+    }
+  }
+  return true;
+}
+
+static bool
+json_parse_number(mrbc_vm *vm, json_parser_t *parser, mrbc_value *result)
+{
+  int64_t integer;
+  double real;
+  switch (json_scan_number(parser, JSON_INT_MAX, JSON_USE_FLOAT, &integer, &real)) {
+    case JSON_NUMBER_INTEGER:
+      *result = mrbc_integer_value((mrbc_int_t)integer);
+      return true;
+#if defined(MRBC_USE_FLOAT)
+    case JSON_NUMBER_FLOAT:
+      *result = mrbc_float_value(vm, (mrbc_float_t)real);
+      return true;
+#endif
+    default:
+      return json_raise(vm, parser);
+  }
+}
+
+static bool
+json_parse_array(mrbc_vm *vm, json_parser_t *parser, mrbc_value *result)
+{
+  if (!json_enter(parser)) {
+    return json_raise(vm, parser);
+  }
+  mrbc_value ary = mrbc_array_new(vm, 0);
+  if (ary.array == NULL) {
+    return json_no_memory(vm);
+  }
+  if (json_empty(parser, ']')) {
+    *result = ary;
+    return true;
+  }
+  int c;
+  do {
+    mrbc_value value;
+    if (!json_parse_value(vm, parser, &value)) {
+      mrbc_decref(&ary);
+      return false;
+    }
+    if (mrbc_array_push(&ary, &value) != 0) {
+      mrbc_decref(&value);
+      mrbc_decref(&ary);
+      return json_no_memory(vm);
+    }
+  } while ((c = json_separator(parser, ']')) == ',');
+  if (c == 0) {
+    mrbc_decref(&ary);
+    return json_raise(vm, parser);
+  }
+  *result = ary;
+  return true;
+}
+
+static bool
+json_parse_object(mrbc_vm *vm, json_parser_t *parser, mrbc_value *result)
+{
+  if (!json_enter(parser)) {
+    return json_raise(vm, parser);
+  }
+  mrbc_value hash = mrbc_hash_new(vm, 0);
+  if (hash.hash == NULL) {
+    return json_no_memory(vm);
+  }
+  if (json_empty(parser, '}')) {
+    *result = hash;
+    return true;
+  }
+  int c;
+  do {
+    mrbc_value key, value;
+    if (json_peek(parser) != '"') {
+      json_fail_here(parser);
+      mrbc_decref(&hash);
+      return json_raise(vm, parser);
+    }
+    if (!json_parse_string(vm, parser, true, &key)) {
+      mrbc_decref(&hash);
+      return false;
+    }
+    if (!json_colon(parser)) {
+      mrbc_decref(&key);
+      mrbc_decref(&hash);
+      return json_raise(vm, parser);
+    }
+    if (!json_parse_value(vm, parser, &value)) {
+      mrbc_decref(&key);
+      mrbc_decref(&hash);
+      return false;
+    }
+    if (mrbc_hash_set(&hash, &key, &value) != 0) {
+      mrbc_decref(&key);
+      mrbc_decref(&value);
+      mrbc_decref(&hash);
+      return json_no_memory(vm);
+    }
+  } while ((c = json_separator(parser, '}')) == ',');
+  if (c == 0) {
+    mrbc_decref(&hash);
+    return json_raise(vm, parser);
+  }
+  *result = hash;
+  return true;
+}
+
+static bool
+json_parse_value(mrbc_vm *vm, json_parser_t *parser, mrbc_value *result)
+{
+  switch (json_peek(parser)) {
+    case '{':
+      return json_parse_object(vm, parser, result);
+    case '[':
+      return json_parse_array(vm, parser, result);
+    case '"':
+      return json_parse_string(vm, parser, false, result);
+    case '-': case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      return json_parse_number(vm, parser, result);
+    case 't':
+      if (!json_literal(parser, "true", 4)) break;
+      *result = mrbc_true_value();
+      return true;
+    case 'f':
+      if (!json_literal(parser, "false", 5)) break;
+      *result = mrbc_false_value();
+      return true;
+    case 'n':
+      if (!json_literal(parser, "null", 4)) break;
+      *result = mrbc_nil_value();
+      return true;
+    default:
+      json_fail_here(parser);
+      break;
+  }
+  return json_raise(vm, parser);
+}
+
+/*
+ * JSON._parse(json, symbolize_names, max_nesting, allow_trailing)
+ */
+static void
+c_json__parse(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  if (argc < 4 || v[1].tt != MRBC_TT_STRING || v[3].tt != MRBC_TT_INTEGER) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
+    return;
+  }
+  if (v[3].i < 0) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "negative max_nesting");
+    return;
+  }
+
+  json_parser_t parser;
+  json_parser_init(&parser, (const char *)v[1].string->data, v[1].string->size);
+  parser.symbolize_names = (v[2].tt == MRBC_TT_TRUE);
+  parser.max_nesting = (uint32_t)v[3].i;
+  parser.allow_trailing = (v[4].tt == MRBC_TT_TRUE);
+  json_skip_whitespace(&parser);
+  mrbc_value result;
+  if (!json_parse_value(vm, &parser, &result)) {
+    return;
+  }
+  if (!json_finish(&parser)) {
+    mrbc_decref(&result);
+    json_raise(vm, &parser);
+    return;
+  }
+  SET_RETURN(result);
+}
+
+void
+mrbc_json_init(mrbc_vm *vm)
+{
+  mrbc_class *module_JSON = mrbc_define_module(vm, "JSON");
+  mrbc_class *class_JSON_JSONError = mrbc_define_class_under(vm, module_JSON, "JSONError", MRBC_CLASS(StandardError));
+  class_JSON_ParserError = mrbc_define_class_under(vm, module_JSON, "ParserError", class_JSON_JSONError);
+  class_JSON_NestingError = mrbc_define_class_under(vm, module_JSON, "NestingError", class_JSON_ParserError);
+
+  mrbc_define_method(vm, module_JSON, "_parse", c_json__parse);
+}
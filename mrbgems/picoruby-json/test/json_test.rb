@@ -32,4 +32,65 @@ class JsonTest < Picotest::Test
     assert_equal("\r", JSON.parse('"\\r"'))
     assert_equal("\t", JSON.parse('"\\t"'))
   end
+
+  def test_parse_with_unicode_escapes
+    assert_equal("A", JSON.parse('"\\u0041"'))
+    assert_equal("é", JSON.parse('"\\u00e9"'))
+    assert_equal("あ", JSON.parse('"\\u3042"'))
+    assert_equal("😀", JSON.parse('"\\uD83D\\uDE00"'))
+    assert_equal("Pico é Ruby\n", JSON.parse('"Pico \\u00E9 Ruby\\n"'))
+    assert_equal("あいう", JSON.parse('"あいう"'))
+    assert_raise(JSON::ParserError) { JSON.parse('"\\u00g0"') }
+    assert_raise(JSON::ParserError) { JSON.parse('"\\x"') }
+  end
+
+  def test_parse_numbers
+    assert_equal([0, -1, 1234567], JSON.parse('[0,-1,1234567]'))
+    assert_equal(1.5, JSON.parse('1.5'))
+    assert_equal(-0.25, JSON.parse('-2.5e-1'))
+    assert_equal(300.0, JSON.parse('3E2'))
+    assert_raise(JSON::ParserError) { JSON.parse('01') }
+    assert_raise(JSON::ParserError) { JSON.parse('1.') }
+    assert_raise(JSON::ParserError) { JSON.parse('-') }
+    assert_raise(JSON::ParserError) { JSON.parse('1e+') }
+  end
+
+  def test_parse_whitespace_and_literals
+    assert_equal({"a" => [true, false, nil]}, JSON.parse(" \n{ \"a\" : [ true , false , null ] }\r\n\t"))
+    assert_equal([], JSON.parse('[]'))
+    assert_equal({}, JSON.parse('{ }'))
+    assert_equal("", JSON.parse('""'))
+  end
+
+  def test_parse_with_symbolize_names
+    assert_equal({a: 1, b: {c: [{d: "e"}]}}, JSON.parse('{"a":1,"b":{"c":[{"d":"e"}]}}', symbolize_names: true))
+    assert_equal({"a\tb".to_sym => 1}, JSON.parse('{"a\\tb":1}', symbolize_names: true))
+    assert_equal({"a" => "b"}, JSON.parse('{"a":"b"}', symbolize_names: false))
+  end
+
+  def test_parse_with_max_nesting
+    assert_equal([[[1]]], JSON.parse('[[[1]]]', max_nesting: 3))
+    assert_raise(JSON::NestingError) { JSON.parse('[[[1]]]', max_nesting: 2) }
+    assert_raise(JSON::NestingError) { JSON.parse('{"a":{"b":{}}}', max_nesting: 2) }
+    deep = "[" * 101 + "]" * 101
+    assert_raise(JSON::NestingError) { JSON.parse(deep) }
+    assert_equal(1, JSON.parse(deep, max_nesting: false).size)
+  end
+
+  def test_parse_errors
+    assert_raise(JSON::ParserError) { JSON.parse('') }
+    assert_raise(JSON::ParserError) { JSON.parse('{"a":1') }
+    assert_raise(JSON::ParserError) { JSON.parse('{"a" 1}') }
+    assert_raise(JSON::ParserError) { JSON.parse('{a:1}') }
+    assert_raise(JSON::ParserError) { JSON.parse('[1,]') }
+    assert_raise(JSON::ParserError) { JSON.parse('[1 2]') }
+    assert_raise(JSON::ParserError) { JSON.parse('"abc') }
+    assert_raise(JSON::ParserError) { JSON.parse('tru') }
+    assert_raise(JSON::ParserError) { JSON.parse('[1] x') }
+  end
+
+  def test_parse_as_ruby_parser
+    json = '{"id":"02e5","device":{"name":"Remo","offset":-15,"tags":["a","b\\"c"]},"signals":[],"settings":null}'
+    assert_equal(JSON::Parser.new(json).parse, JSON.parse(json))
+  end
 end
@@ -0,0 +1,35 @@
+# Tick ISR cost with many sleeping tasks.
+# Build with `conf.cc.defines << "MRB_TICK_PROFILE"` (see build_config/microruby-test.rb)
+#
+#   bin/microruby mrbgems/picoruby-mruby/example/tick_bench.rb
+
+TASK_COUNT = 128
+DURATION_MS = 5000
+
+TASK_COUNT.times do |i|
+  Task.new(name: "sleeper#{i}") do
+    interval = 4 + (i % 16) * 4
+    while true
+      sleep_ms interval
+    end
+  end
+end
+
+before = Task.stat[:tick_profile]
+sleep_ms DURATION_MS
+after = Task.stat[:tick_profile]
+
+if before.nil?
+  puts "MRB_TICK_PROFILE is not defined"
+else
+  count = after[:count] - before[:count]
+  total = after[:total_ns] - before[:total_ns]
+  puts "tasks: #{TASK_COUNT}"
+  puts "ticks: #{count}"
+  puts "average tick ISR: #{count == 0 ? 0 : total / count} ns"
+  puts "max tick ISR: #{after[:max_ns]} ns"
+end
+
+Task.list.each do |task|
+  task.terminate unless task == Task.current
+end
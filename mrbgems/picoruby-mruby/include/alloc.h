@@ -8,6 +8,13 @@ MRB_BEGIN_DECL
 mrb_state *mrb_open_with_custom_alloc(void* mem, size_t bytes);
 mrb_value mrb_alloc_statistics(mrb_state *mrb);
 
+#if defined(PICORB_ALLOC_PROFILE)
+void picorb_alloc_profile_start(mrb_state *mrb);
+void picorb_alloc_profile_stop(mrb_state *mrb);
+mrb_value picorb_alloc_profile_result(mrb_state *mrb);
+mrb_value picorb_alloc_profile_dump(mrb_state *mrb);
+#endif
+
 MRB_END_DECL
 
 #endif
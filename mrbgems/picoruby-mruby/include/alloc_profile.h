@@ -0,0 +1,25 @@
+#ifndef ALLOC_PROFILE_H
+#define ALLOC_PROFILE_H
+
+#include "picoruby.h"
+
+MRB_BEGIN_DECL
+
+#if defined(PICORB_ALLOC_PROFILE)
+typedef struct picorb_alloc_profile picorb_alloc_profile;
+
+picorb_alloc_profile *picorb_alloc_profile_init(mrb_allocf next, void *ud, size_t heap_bytes);
+void *picorb_alloc_profile_allocf(mrb_state *mrb, void *p, size_t size, void *ud);
+void *picorb_alloc_profile_next_ud(picorb_alloc_profile *profile);
+
+/* Implemented by the backend in alloc.c */
+picorb_alloc_profile *picorb_alloc_profile_of(mrb_state *mrb);
+#define PICORB_ALLOC_LARGEST_FREE_UNKNOWN ((size_t)-1)
+size_t picorb_alloc_largest_free(mrb_state *mrb);
+/* Calls f for each free block. FALSE if the backend can't list them */
+mrb_bool picorb_alloc_each_free(mrb_state *mrb, void (*f)(size_t size, void *ud), void *ud);
+#endif
+
+MRB_END_DECL
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ALLOC_SLAB_H
+#define ALLOC_SLAB_H
+
+#include "picoruby.h"
+
+MRB_BEGIN_DECL
+
+#if defined(PICORB_ALLOC_SLAB)
+typedef struct picorb_slab picorb_slab;
+
+picorb_slab *picorb_slab_init(mrb_allocf backend, void *ud, size_t heap_bytes);
+void *picorb_slab_allocf(mrb_state *mrb, void *p, size_t size, void *ud);
+void *picorb_slab_backend_ud(picorb_slab *slab);
+void picorb_slab_statistics(mrb_state *mrb, picorb_slab *slab, mrb_value hash);
+#endif
+
+MRB_END_DECL
+
+#endif
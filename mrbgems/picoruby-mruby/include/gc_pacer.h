@@ -0,0 +1,39 @@
+#ifndef GC_PACER_H
+#define GC_PACER_H
+
+#include <picoruby.h>
+
+MRB_BEGIN_DECL
+
+//================================================
+/*!@brief
+  GC pacing of a VM. Part of mrb_task_scheduler.
+*/
+typedef struct RGCPacer {
+  /* settings */
+  int min_steps;
+  int max_steps;
+  int objs_per_step;
+  mrb_bool idle;
+  /* state */
+  size_t last_live;
+  size_t live_after_cycle;
+  /* counters */
+  uint32_t cycles;
+  uint32_t steps;
+  uint32_t idle_steps;
+  uint32_t slices;
+  uint32_t max_steps_per_slice;
+  uint32_t pauses;
+  uint32_t last_pause_us;
+  uint32_t max_pause_us;
+  uint64_t total_pause_us;
+} mrb_gc_pacer;
+
+void mrb_gc_pacer_init(mrb_state *mrb);
+void mrb_gc_pacer_step(mrb_state *mrb);
+mrb_bool mrb_gc_pacer_idle(mrb_state *mrb);
+
+MRB_END_DECL
+
+#endif /* GC_PACER_H */
@@ -14,6 +14,7 @@
 typedef struct RTcb mrb_tcb;
 
 #include <picoruby.h>
+#include "gc_pacer.h"
 
 MRB_BEGIN_DECL
 
@@ -49,7 +50,42 @@ static const int MRB_TASK_DEFAULT_STATUS = TASKSTATUS_READY;
 
 
 /***** Macros ***************************************************************/
+// Sleeping tasks are kept in a hierarchical timer wheel.
+// Each level has (1 << MRB_TIMER_WHEEL_BITS) slots (must be 1 to 5).
+#ifndef MRB_TIMER_WHEEL_BITS
+#define MRB_TIMER_WHEEL_BITS 4
+#endif
+#if MRB_TIMER_WHEEL_BITS < 1 || 5 < MRB_TIMER_WHEEL_BITS
+#error "MRB_TIMER_WHEEL_BITS must be from 1 to 5"
+#endif
+
+#define TIMER_WHEEL_SLOTS   (1 << MRB_TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS  ((32 + MRB_TIMER_WHEEL_BITS - 1) / MRB_TIMER_WHEEL_BITS)
+
+#define READY_PRIORITY_LEVELS 256
+
+// Define MRB_TASK_PROFILE to count CPU time, dispatches and
+// wakeup latency of each task. (See Task#stat)
+
 /***** Typedefs *************************************************************/
+#if defined(MRB_TASK_PROFILE)
+//================================================
+/*!@brief
+  Task accounting. All durations are in tick.
+*/
+typedef struct RTcbProfile {
+  uint32_t ticks;               //!< ticks consumed while running.
+  uint32_t dispatches;          //!< number of times dispatched.
+  uint32_t preemptions;         //!< number of timeslice expirations.
+  uint32_t wakeups;             //!< number of wakeups from sleep.
+  uint32_t lateness_max;        //!< max delay from wakeup_tick to dispatch.
+  uint32_t lateness_total;      //!< sum of the delay above.
+  uint32_t blocked_ticks;       //!< ticks spent waiting for mutex or join.
+  uint32_t since;               //!< tick_ when started waiting or woken up.
+  uint8_t woken;                //!< woken up and not dispatched yet.
+} mrb_tcb_profile;
+#endif
+
 
 struct RMutex;
 
@@ -62,8 +98,12 @@ typedef struct RTcb {
   uint8_t type[4];              //!< set "TCB\0" for debug.
 #endif
   struct RTcb *next;            //!< daisy chain in task queue.
+  struct RTcb *prev;            //!< back link in task queue.
+  struct RTcb *timer_next;      //!< daisy chain in timer wheel slot.
+  struct RTcb **timer_pprev;    //!< back link in timer wheel slot. NULL if not in the wheel.
   uint8_t priority;             //!< task priority. initial value.
   uint8_t priority_preemption;  //!< task priority. effective value.
+  uint8_t queued_priority;      //!< priority_preemption when put in ready queue.
   volatile uint8_t timeslice;   //!< time slice counter.
   uint8_t status;               //!< task status. defined in TASKSTATUS
   uint8_t reason;               //!< sub status. defined in TASKREASON
@@ -80,6 +120,9 @@ typedef struct RTcb {
   mrb_value task;
   mrb_value value;
   struct mrb_context c; // Each TCB has its own context
+#if defined(MRB_TASK_PROFILE)
+  mrb_tcb_profile profile;
+#endif
 
 } mrb_tcb;
 
@@ -96,6 +139,50 @@ typedef struct RMutex {
 #define MRB_MUTEX_INITIALIZER { 0 }
 
 
+//================================================
+/*!@brief
+  Scheduler state of a VM other than mrb->task.
+  The task queues and tick are in mrb->task of the mruby fork,
+  so this is allocated by mrb_picoruby_mruby_gem_init() and kept
+  in mrb->ud. Embedding applications must not use mrb->ud.
+*/
+typedef struct RTaskScheduler {
+  /*
+    Sleeping tasks. A task that wakes up at tick `t` is linked into
+    slot[level][(t >> SHIFT(level)) & MASK] where `level` is the smallest
+    one that can hold the distance from the current tick.
+    The slots of upper levels are cascaded into lower levels as tick goes.
+  */
+  struct {
+    mrb_tcb *slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint32_t occupied[TIMER_WHEEL_LEVELS];
+  } timer_wheel;
+
+  /*
+    Ready queue index. The ready queue is still a single list sorted by
+    priority_preemption, and tail[p] points to its last TCB of priority p.
+    map (and summary for each word of map) tells which tail is in use.
+  */
+  struct {
+    mrb_tcb *tail[READY_PRIORITY_LEVELS];
+    uint32_t map[READY_PRIORITY_LEVELS / 32];
+    uint32_t summary;
+  } ready_index;
+
+  mrb_tcb *running_tcb;
+#if defined(MRB_TICK_PROFILE)
+  struct {
+    uint32_t count;
+    uint32_t max_ns;
+    uint64_t total_ns;
+  } tick_profile;
+#endif
+  mrb_gc_pacer gc_pacer;
+} mrb_task_scheduler;
+
+#define MRB_TASK_SCHEDULER(mrb) ((mrb_task_scheduler *)(mrb)->ud)
+
+
 /***** Global variables *****************************************************/
 /***** Function prototypes **************************************************/
 void mrb_tick(mrb_state *mrb);
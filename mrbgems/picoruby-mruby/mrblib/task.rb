@@ -1,6 +1,41 @@
 class Task
   attr_accessor :name
 
+  # Runs the block and returns what each task consumed meanwhile.
+  # Needs MRB_TASK_PROFILE. CPU time is sampled by the tick timer.
+  #   Task.profile { sleep 3 }
+  #   #=> { #<Task:... main:RUNNING> => { ticks: 12, dispatches: 4, ... }, ... }
+  def self.profile
+    before = {}
+    Task.list.each do |task|
+      before[task] = task.stat
+      # lateness_max is not a counter. Start it over for the block
+      task.reset_lateness_max
+    end
+    yield
+    result = {}
+    Task.list.each do |task|
+      now = task.stat
+      prev = before[task]
+      if prev
+        wakeups = now[:wakeups] - prev[:wakeups]
+        lateness_total = now[:lateness_total] - prev[:lateness_total]
+        now = {
+          ticks: now[:ticks] - prev[:ticks],
+          dispatches: now[:dispatches] - prev[:dispatches],
+          preemptions: now[:preemptions] - prev[:preemptions],
+          wakeups: wakeups,
+          lateness_max: now[:lateness_max],
+          lateness_total: lateness_total,
+          lateness_avg: (wakeups == 0 ? 0 : lateness_total / wakeups),
+          blocked_ticks: now[:blocked_ticks] - prev[:blocked_ticks]
+        }
+      end
+      result[task] = now
+    end
+    result
+  end
+
   class Stat
     def [](key)
       @data[key]
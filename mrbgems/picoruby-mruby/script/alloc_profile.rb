@@ -0,0 +1,89 @@
+#!/usr/bin/env ruby
+# Renders the allocation profile saved by PicoRubyVM.alloc_profile_save
+#
+#   ruby mrbgems/picoruby-mruby/script/alloc_profile.rb alloc.prof
+#
+# See mrbgems/picoruby-mruby/src/alloc_profile.c for the format.
+
+BAR_WIDTH = 40
+
+def human(n)
+  if 1024 * 1024 <= n
+    format("%.1fM", n / 1024.0 / 1024)
+  elsif 1024 <= n
+    format("%.1fK", n / 1024.0)
+  else
+    n.to_s
+  end
+end
+
+path = ARGV[0] or abort "usage: #{$0} PROFILE"
+data = File.binread(path)
+abort "#{path}: not an allocation profile" unless data[0, 4] == "PRAP"
+
+version, bucket_count, flags = data[4, 4].unpack("CCv")
+abort "#{path}: unsupported version #{version}" unless version == 1 || version == 2
+flags = 0 if version == 1
+pos = 8
+heap_bytes, largest_free, allocs, reallocs, frees, failures = data[pos, 24].unpack("V6")
+pos += 24
+buckets = bucket_count.times.map do |b|
+  a, r, bytes = data[pos, 12].unpack("V3")
+  pos += 12
+  { size: 1 << (b + 3), allocs: a, reallocs: r, bytes: bytes }
+end
+free_blocks = nil
+if flags & 1 != 0
+  free_blocks = data[pos, bucket_count * 4].unpack("V*")
+  pos += bucket_count * 4
+end
+site_count, sites_dropped = data[pos, 6].unpack("vV")
+pos += 6
+sites = site_count.times.map do
+  count, bytes, irep, len = data[pos, 13].unpack("V3C")
+  pos += 13
+  name = data[pos, len]
+  pos += len
+  { count: count, bytes: bytes, irep: irep, name: name }
+end
+
+puts "heap:         #{human(heap_bytes)}"
+puts "largest free: #{largest_free == 0xffffffff ? "unknown" : human(largest_free)}"
+puts "allocs: #{allocs}  reallocs: #{reallocs}  frees: #{frees}  failures: #{failures}"
+puts
+
+puts "size             allocs   reallocs      bytes"
+max = buckets.map { |b| b[:allocs] + b[:reallocs] }.max.to_i
+lower = 1
+buckets.each_with_index do |b, i|
+  count = b[:allocs] + b[:reallocs]
+  label = (i == bucket_count - 1) ? "#{human(lower)}-" : "#{human(lower)}-#{human(b[:size])}"
+  lower = b[:size] + 1
+  next if count == 0
+  bar = "#" * (max == 0 ? 0 : (count * BAR_WIDTH + max - 1) / max)
+  printf("%-14s %8d %10d %10s %s\n", label, b[:allocs], b[:reallocs], human(b[:bytes]), bar)
+end
+
+if free_blocks
+  puts
+  puts "free blocks"
+  max = free_blocks.max.to_i
+  lower = 1
+  free_blocks.each_with_index do |count, i|
+    size = 1 << (i + 3)
+    label = (i == bucket_count - 1) ? "#{human(lower)}-" : "#{human(lower)}-#{human(size)}"
+    lower = size + 1
+    next if count == 0
+    bar = "#" * (max == 0 ? 0 : (count * BAR_WIDTH + max - 1) / max)
+    printf("%-14s %8d %s\n", label, count, bar)
+  end
+end
+
+unless sites.empty?
+  puts
+  puts "sites (by bytes)#{sites_dropped == 0 ? '' : "  #{sites_dropped} requests not recorded"}"
+  puts "     count      bytes  irep        method"
+  sites.sort_by { |s| -s[:bytes] }.each do |s|
+    printf("%10d %10s  0x%08x  %s\n", s[:count], human(s[:bytes]), s[:irep], s[:name].empty? ? "(top)" : s[:name])
+  end
+end
@@ -4,6 +4,120 @@
 #include "mruby/presym.h"
 #include "mruby/hash.h"
 
+#if defined(PICORB_ALLOC_SLAB)
+#include "alloc_slab.h"
+#endif
+#if defined(PICORB_ALLOC_PROFILE)
+#include "alloc_profile.h"
+#endif
+
+/*
+  Put the optional layers in front of the backend allocf.
+  mrb -> [profile] -> [slab] -> backend
+  Each layer keeps its state in the heap, takes it as ud, and
+  passes the ud of the next one. *ud becomes the ud of the top.
+*/
+static mrb_allocf
+alloc_chain_init(mrb_allocf backend, void **ud, size_t bytes)
+{
+  mrb_allocf allocf = backend;
+#if defined(PICORB_ALLOC_SLAB)
+  *ud = picorb_slab_init(allocf, *ud, bytes);
+  if (*ud == NULL) return NULL;
+  allocf = picorb_slab_allocf;
+#endif
+#if defined(PICORB_ALLOC_PROFILE)
+  *ud = picorb_alloc_profile_init(allocf, *ud, bytes);
+  if (*ud == NULL) return NULL;
+  allocf = picorb_alloc_profile_allocf;
+#endif
+  (void)ud;
+  (void)bytes;
+  return allocf;
+}
+
+/* ud of the top of the chain. Defined for each backend below */
+static inline void *alloc_chain_ud(mrb_state *mrb);
+
+#if defined(PICORB_ALLOC_SLAB)
+static picorb_slab *
+alloc_slab_ud(mrb_state *mrb)
+{
+  void *ud = alloc_chain_ud(mrb);
+#if defined(PICORB_ALLOC_PROFILE)
+  ud = picorb_alloc_profile_next_ud((picorb_alloc_profile *)ud);
+#endif
+  return (picorb_slab *)ud;
+}
+#define ALLOC_STATISTICS_SLAB(mrb, hash) picorb_slab_statistics(mrb, alloc_slab_ud(mrb), hash)
+#else
+#define ALLOC_STATISTICS_SLAB(mrb, hash) ((void)0)
+#endif
+
+#if defined(PICORB_ALLOC_TLSF) || defined(PICORB_ALLOC_O1HEAP)
+static void *
+alloc_backend_ud(mrb_state *mrb)
+{
+#if defined(PICORB_ALLOC_SLAB)
+  return picorb_slab_backend_ud(alloc_slab_ud(mrb));
+#elif defined(PICORB_ALLOC_PROFILE)
+  return picorb_alloc_profile_next_ud((picorb_alloc_profile *)alloc_chain_ud(mrb));
+#else
+  return alloc_chain_ud(mrb);
+#endif
+}
+#endif
+
+#if defined(PICORB_ALLOC_PROFILE)
+picorb_alloc_profile *
+picorb_alloc_profile_of(mrb_state *mrb)
+{
+  return (picorb_alloc_profile *)alloc_chain_ud(mrb);
+}
+#endif
+
+#if !defined(PICORB_ALLOC_ESTALLOC)
+static inline void *
+alloc_chain_ud(mrb_state *mrb)
+{
+  return mrb->allocf_ud;
+}
+
+static mrb_state *
+alloc_open(mrb_allocf backend, void *ud, size_t bytes)
+{
+  mrb_allocf allocf = alloc_chain_init(backend, &ud, bytes);
+  if (allocf == NULL) return NULL;
+  return mrb_open_allocf(allocf, ud);
+}
+#endif
+
+#if defined(PICORB_ALLOC_PROFILE) && (defined(PICORB_ALLOC_TINYALLOC) || defined(PICORB_ALLOC_ESTALLOC))
+/*
+  The largest block the backend can hand out, by binary search up to
+  `limit`. Only for tinyalloc and estalloc: their walk and statistics
+  report totals alone, and a failed allocation leaves no trace in them
+  (unlike the OOM count of o1heap).
+*/
+static size_t
+alloc_probe_largest(mrb_allocf backend, size_t limit)
+{
+  size_t lo = 0;
+  size_t hi = limit;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo + 1) / 2;
+    void *p = backend(NULL, NULL, mid, NULL);
+    if (p) {
+      backend(NULL, p, 0, NULL);
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+#endif
+
 #if defined(PICORB_ALLOC_TLSF)
 
 #include "../lib/tlsf/tlsf.h"
@@ -19,6 +133,7 @@ struct walker_data {
   size_t free;
   size_t fragment;
   void *last_free_block;
+  size_t largest;
 };
 
 static void
@@ -30,6 +145,7 @@ mrb_tlsf_walker(void *ptr, size_t size, int used, void *user)
     data->used += size_with_padding;
   } else if (size > 0) {
     data->free += size;
+    if (data->largest < size) data->largest = size;
     // Check if this free block is contiguous with the last one
     if (data->last_free_block == NULL || (char *)data->last_free_block + tlsf_block_size(data->last_free_block) != (char *)ptr) {
       data->fragment++;
@@ -75,7 +191,7 @@ mrb_value
 mrb_alloc_statistics(mrb_state *mrb)
 {
   struct walker_data data = { 0, 0, 0, 0, NULL };
-  tlsf_t tlsf = (tlsf_t)mrb->allocf_ud;
+  tlsf_t tlsf = (tlsf_t)alloc_backend_ud(mrb);
   tlsf_walk_pool(tlsf_get_pool(tlsf), mrb_tlsf_walker, &data);
 #if defined(PICORUBY_DEBUG)
   mrb_value hash = mrb_hash_new_capa(mrb, 6);
@@ -90,16 +206,50 @@ mrb_alloc_statistics(mrb_state *mrb)
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(used)), mrb_fixnum_value(data.used));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(free)), mrb_fixnum_value(data.free));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(fragment)), mrb_fixnum_value(data.fragment));
+  ALLOC_STATISTICS_SLAB(mrb, hash);
   return hash;
 }
 
+#if defined(PICORB_ALLOC_PROFILE)
+size_t
+picorb_alloc_largest_free(mrb_state *mrb)
+{
+  struct walker_data data = { 0, 0, 0, 0, NULL, 0 };
+  tlsf_t tlsf = (tlsf_t)alloc_backend_ud(mrb);
+  tlsf_walk_pool(tlsf_get_pool(tlsf), mrb_tlsf_walker, &data);
+  return data.largest;
+}
+
+struct free_walker_data {
+  void (*f)(size_t size, void *ud);
+  void *ud;
+};
+
+static void
+mrb_tlsf_free_walker(void *ptr, size_t size, int used, void *user)
+{
+  struct free_walker_data *data = (struct free_walker_data *)user;
+  (void)ptr;
+  if (!used && 0 < size) data->f(size, data->ud);
+}
+
+mrb_bool
+picorb_alloc_each_free(mrb_state *mrb, void (*f)(size_t size, void *ud), void *ud)
+{
+  struct free_walker_data data = { f, ud };
+  tlsf_t tlsf = (tlsf_t)alloc_backend_ud(mrb);
+  tlsf_walk_pool(tlsf_get_pool(tlsf), mrb_tlsf_free_walker, &data);
+  return TRUE;
+}
+#endif
+
 static tlsf_t tlsf __attribute__((aligned(8)));
 
 mrb_state *
 mrb_open_with_custom_alloc(void* mem, size_t bytes)
 {
   tlsf = tlsf_create_with_pool(mem, bytes);
-  return mrb_open_allocf(mrb_tlsf_allocf, &tlsf);
+  return alloc_open(mrb_tlsf_allocf, &tlsf, bytes);
 }
 
 #elif defined(PICORB_ALLOC_O1HEAP)
@@ -173,7 +323,7 @@ mrb_o1heap_allocf(mrb_state *mrb, void *p, size_t size, void *o1heap)
 mrb_value
 mrb_alloc_statistics(mrb_state *mrb)
 {
-  O1HeapInstance *o1heap = (O1HeapInstance *)mrb->allocf_ud;
+  O1HeapInstance *o1heap = (O1HeapInstance *)alloc_backend_ud(mrb);
   O1HeapDiagnostics diag = o1heapGetDiagnostics(o1heap);
   mrb_value hash = mrb_hash_new_capa(mrb, 5);
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(allocator)), mrb_symbol_value(MRB_SYM(O1HEAP)));
@@ -182,14 +332,24 @@ mrb_alloc_statistics(mrb_state *mrb)
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(peak_allocated)), mrb_fixnum_value(diag.peak_allocated));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(peak_request_size)), mrb_fixnum_value(diag.peak_request_size));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(oom_count)), mrb_fixnum_value(diag.oom_count));
+  ALLOC_STATISTICS_SLAB(mrb, hash);
   return hash;
 }
 
+#if defined(PICORB_ALLOC_PROFILE)
+size_t
+picorb_alloc_largest_free(mrb_state *mrb)
+{
+  (void)mrb;
+  return PICORB_ALLOC_LARGEST_FREE_UNKNOWN;  // the diagnostics have no such figure
+}
+#endif
+
 mrb_state *
 mrb_open_with_custom_alloc(void* mem, size_t bytes)
 {
   O1HeapInstance *o1heap = o1heapInit(mem, bytes);
-  return mrb_open_allocf(mrb_o1heap_allocf, o1heap);
+  return alloc_open(mrb_o1heap_allocf, o1heap, bytes);
 }
 
 // PICORB_ALLOC_O1HEAP
@@ -224,15 +384,30 @@ mrb_alloc_statistics(mrb_state *mrb)
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(used)), mrb_fixnum_value(data.used));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(free)), mrb_fixnum_value(data.free));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(fresh_blocks)), mrb_fixnum_value(data.fresh_blocks));
+  ALLOC_STATISTICS_SLAB(mrb, hash);
   return hash;
 }
 
+#if defined(PICORB_ALLOC_PROFILE)
+static size_t ta_heap_bytes;
+
+size_t
+picorb_alloc_largest_free(mrb_state *mrb)
+{
+  (void)mrb;
+  return alloc_probe_largest(mrb_ta_allocf, ta_heap_bytes);
+}
+#endif
+
 mrb_state *
 mrb_open_with_custom_alloc(void* mem, size_t bytes)
 {
   void *limit = (void *)((size_t)mem + bytes -1);
   ta_init(mem, limit, 3000, 16, TA_ALIGNMENT);
-  return mrb_open_allocf(mrb_ta_allocf, NULL);
+#if defined(PICORB_ALLOC_PROFILE)
+  ta_heap_bytes = bytes;
+#endif
+  return alloc_open(mrb_ta_allocf, NULL, bytes);
 }
 
 // PICORB_ALLOC_TINYALLOC
@@ -240,11 +415,16 @@ mrb_open_with_custom_alloc(void* mem, size_t bytes)
 
 #include "../lib/estalloc/estalloc.h"
 
+/*
+  mruby calls mrb_basic_alloc_func() without mrb_state or ud,
+  so estalloc serves one heap.
+*/
 static ESTALLOC *est = NULL;
+static mrb_allocf est_allocf_chain = NULL;
+static void *est_chain_ud = NULL;
 
-void *
-//mrb_estalloc_allocf(mrb_state *mrb, void *p, size_t size, void *est)
-mrb_basic_alloc_func(void* ptr, size_t size)
+static void *
+mrb_estalloc_allocf(mrb_state *mrb, void *ptr, size_t size, void *ud)
 {
   if (size == 0) {
     /* `free(NULL)` should be no-op */
@@ -255,6 +435,20 @@ mrb_basic_alloc_func(void* ptr, size_t size)
   return est_realloc(est, ptr, size);
 }
 
+void *
+mrb_basic_alloc_func(void* ptr, size_t size)
+{
+  if (est_allocf_chain == NULL) return mrb_estalloc_allocf(NULL, ptr, size, NULL);
+  return est_allocf_chain(NULL, ptr, size, est_chain_ud);
+}
+
+static inline void *
+alloc_chain_ud(mrb_state *mrb)
+{
+  (void)mrb;
+  return est_chain_ud;
+}
+
 mrb_value
 mrb_alloc_statistics(mrb_state *mrb)
 {
@@ -266,13 +460,29 @@ mrb_alloc_statistics(mrb_state *mrb)
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(used)), mrb_fixnum_value(stat->used));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(free)), mrb_fixnum_value(stat->free));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(frag)), mrb_fixnum_value(stat->frag));
+  ALLOC_STATISTICS_SLAB(mrb, hash);
   return hash;
 }
 
+#if defined(PICORB_ALLOC_PROFILE)
+size_t
+picorb_alloc_largest_free(mrb_state *mrb)
+{
+  (void)mrb;
+  est_take_statistics(est);
+  return alloc_probe_largest(mrb_estalloc_allocf, est->stat.free);
+}
+#endif
+
 mrb_state *
 mrb_open_with_custom_alloc(void* mem, size_t bytes)
 {
   est = est_init(mem, bytes);
+  void *ud = NULL;
+  mrb_allocf allocf = alloc_chain_init(mrb_estalloc_allocf, &ud, bytes);
+  if (allocf == NULL) return NULL;
+  est_chain_ud = ud;
+  est_allocf_chain = allocf;
   return mrb_open();
 }
 
@@ -340,15 +550,37 @@ mrb_alloc_statistics(mrb_state *mrb)
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(peak)), mrb_fixnum_value(peak_usage));
   mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(current)), mrb_fixnum_value(current_usage));
 #endif
+  ALLOC_STATISTICS_SLAB(mrb, hash);
   return hash;
 }
 
+#if defined(PICORB_ALLOC_PROFILE)
+size_t
+picorb_alloc_largest_free(mrb_state *mrb)
+{
+  (void)mrb;
+  return PICORB_ALLOC_LARGEST_FREE_UNKNOWN;  // libc takes more from the OS when it runs out
+}
+#endif
+
 mrb_state *
 mrb_open_with_custom_alloc(void* mem, size_t bytes)
 {
   (void)mem;
   (void)bytes;
-  return mrb_open_allocf(mrb_libc_allocf, NULL);
+  return alloc_open(mrb_libc_allocf, NULL, bytes);
 }
 
 #endif
+
+#if defined(PICORB_ALLOC_PROFILE) && !defined(PICORB_ALLOC_TLSF)
+mrb_bool
+picorb_alloc_each_free(mrb_state *mrb, void (*f)(size_t size, void *ud), void *ud)
+{
+  /* Only the TLSF walk tells the size of each free block */
+  (void)mrb;
+  (void)f;
+  (void)ud;
+  return FALSE;
+}
+#endif
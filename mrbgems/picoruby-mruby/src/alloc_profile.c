@@ -0,0 +1,350 @@
+/*
+  Allocation profiler for every PICORB_ALLOC_* backend.
+  Define PICORB_ALLOC_PROFILE to enable it.
+
+  While profiling, every request is counted in a bucket by its size
+  (power of two from 8 bytes). If PICORB_ALLOC_PROFILE_SITES is
+  greater than 0, requests are also counted by the Ruby method and
+  irep that is running at that moment.
+
+  The free blocks of the heap are counted in the same buckets when the
+  backend can list them (TLSF).
+
+  picorb_alloc_profile_dump() serializes the result as below.
+  All integers are little endian. (see script/alloc_profile.rb)
+
+    "PRAP" version:u8 bucket_count:u8 flags:u16
+    heap_bytes:u32 largest_free:u32 (0xffffffff if the backend can't tell)
+    allocs:u32 reallocs:u32 frees:u32 failures:u32
+    bucket_count * { allocs:u32 reallocs:u32 bytes:u32 }
+    bucket_count * { free_blocks:u32 }  (only if flags & PROFILE_FLAG_FREE_BLOCKS)
+    site_count:u16 sites_dropped:u32
+    site_count * { count:u32 bytes:u32 irep:u32 name_len:u8 name:char[name_len] }
+*/
+
+#if defined(PICORB_ALLOC_PROFILE)
+
+#include <string.h>
+
+#include "mruby.h"
+#include "mruby/presym.h"
+#include "mruby/hash.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
+#include "mruby/proc.h"
+#include "alloc.h"
+#include "alloc_profile.h"
+
+#ifndef PICORB_ALLOC_PROFILE_SITES
+#define PICORB_ALLOC_PROFILE_SITES 0
+#endif
+
+#define PROFILE_BUCKETS      16
+#define PROFILE_MIN_SHIFT    3   // the first bucket is 1..8 bytes
+#define PROFILE_DUMP_VERSION 2
+
+#define PROFILE_FLAG_FREE_BLOCKS 0x0001
+
+typedef struct {
+  uint32_t allocs;
+  uint32_t reallocs;
+  uint32_t bytes;
+} profile_bucket;
+
+#if 0 < PICORB_ALLOC_PROFILE_SITES
+typedef struct {
+  const void *irep;
+  mrb_sym mid;
+  uint32_t count;
+  uint32_t bytes;
+} profile_site;
+#endif
+
+struct picorb_alloc_profile {
+  mrb_allocf next;
+  void *next_ud;
+  size_t heap_bytes;
+  mrb_state *mrb;     // for allocators called without mrb_state
+  mrb_bool running;
+  uint32_t allocs;
+  uint32_t reallocs;
+  uint32_t frees;
+  uint32_t failures;
+  profile_bucket buckets[PROFILE_BUCKETS];
+#if 0 < PICORB_ALLOC_PROFILE_SITES
+  profile_site sites[PICORB_ALLOC_PROFILE_SITES];
+  uint16_t site_count;
+  uint32_t sites_dropped;
+#endif
+};
+
+
+static int
+profile_bucket_index(size_t size)
+{
+  int b = 0;
+  size = (size - 1) >> PROFILE_MIN_SHIFT;
+  while (size && b < PROFILE_BUCKETS - 1) {
+    size >>= 1;
+    b++;
+  }
+  return b;
+}
+
+#if 0 < PICORB_ALLOC_PROFILE_SITES
+static void
+profile_record_site(picorb_alloc_profile *profile, mrb_state *mrb, size_t size)
+{
+  if (mrb == NULL) mrb = profile->mrb;
+  if (mrb == NULL || mrb->c == NULL || mrb->c->ci == NULL) return;
+
+  const mrb_callinfo *ci = mrb->c->ci;
+  const struct RProc *proc = ci->proc;
+  const void *irep = (proc && !MRB_PROC_CFUNC_P(proc)) ? (const void *)proc->body.irep : NULL;
+  mrb_sym mid = ci->mid;
+
+  uint32_t h = ((uint32_t)(uintptr_t)irep >> 3) ^ (uint32_t)mid * 2654435761u;
+  for (int n = 0; n < PICORB_ALLOC_PROFILE_SITES; n++) {
+    profile_site *site = &profile->sites[(h + n) % PICORB_ALLOC_PROFILE_SITES];
+    if (site->count == 0) {
+      site->irep = irep;
+      site->mid = mid;
+      profile->site_count++;
+    } else if (site->irep != irep || site->mid != mid) {
+      continue;
+    }
+    site->count++;
+    site->bytes += size;
+    return;
+  }
+  profile->sites_dropped++;
+}
+#endif
+
+/*
+  The state is taken from the next allocf, and is the ud of
+  picorb_alloc_profile_allocf(). NULL if out of memory.
+*/
+picorb_alloc_profile *
+picorb_alloc_profile_init(mrb_allocf next, void *ud, size_t heap_bytes)
+{
+  picorb_alloc_profile *profile = (picorb_alloc_profile *)next(NULL, NULL, sizeof(picorb_alloc_profile), ud);
+  if (profile == NULL) return NULL;
+  memset(profile, 0, sizeof(picorb_alloc_profile));
+  profile->next = next;
+  profile->next_ud = ud;
+  profile->heap_bytes = heap_bytes;
+  return profile;
+}
+
+void *
+picorb_alloc_profile_next_ud(picorb_alloc_profile *profile)
+{
+  return profile->next_ud;
+}
+
+void *
+picorb_alloc_profile_allocf(mrb_state *mrb, void *p, size_t size, void *ud)
+{
+  picorb_alloc_profile *profile = (picorb_alloc_profile *)ud;
+  void *new_p = profile->next(mrb, p, size, profile->next_ud);
+  if (!profile->running) return new_p;
+
+  if (size == 0) {
+    if (p) profile->frees++;
+    return new_p;
+  }
+  if (new_p == NULL) {
+    profile->failures++;
+    return new_p;
+  }
+  profile_bucket *bucket = &profile->buckets[profile_bucket_index(size)];
+  if (p) {
+    profile->reallocs++;
+    bucket->reallocs++;
+  } else {
+    profile->allocs++;
+    bucket->allocs++;
+  }
+  bucket->bytes += size;
+#if 0 < PICORB_ALLOC_PROFILE_SITES
+  profile_record_site(profile, mrb, size);
+#endif
+  return new_p;
+}
+
+static void
+profile_count_free(size_t size, void *ud)
+{
+  uint32_t *free_blocks = (uint32_t *)ud;
+  free_blocks[profile_bucket_index(size)]++;
+}
+
+static mrb_bool
+profile_free_blocks(mrb_state *mrb, uint32_t free_blocks[PROFILE_BUCKETS])
+{
+  memset(free_blocks, 0, sizeof(uint32_t) * PROFILE_BUCKETS);
+  return picorb_alloc_each_free(mrb, profile_count_free, free_blocks);
+}
+
+void
+picorb_alloc_profile_start(mrb_state *mrb)
+{
+  picorb_alloc_profile *profile = picorb_alloc_profile_of(mrb);
+  profile->running = FALSE;
+  profile->allocs = 0;
+  profile->reallocs = 0;
+  profile->frees = 0;
+  profile->failures = 0;
+  memset(profile->buckets, 0, sizeof(profile->buckets));
+#if 0 < PICORB_ALLOC_PROFILE_SITES
+  memset(profile->sites, 0, sizeof(profile->sites));
+  profile->site_count = 0;
+  profile->sites_dropped = 0;
+#endif
+  profile->mrb = mrb;
+  profile->running = TRUE;
+}
+
+void
+picorb_alloc_profile_stop(mrb_state *mrb)
+{
+  picorb_alloc_profile *profile = picorb_alloc_profile_of(mrb);
+  profile->running = FALSE;
+}
+
+mrb_value
+picorb_alloc_profile_result(mrb_state *mrb)
+{
+  picorb_alloc_profile *profile = picorb_alloc_profile_of(mrb);
+  mrb_bool running = profile->running;
+  profile->running = FALSE;
+
+  mrb_value buckets = mrb_ary_new_capa(mrb, PROFILE_BUCKETS);
+  for (int b = 0; b < PROFILE_BUCKETS; b++) {
+    mrb_value h = mrb_hash_new_capa(mrb, 4);
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(size)), mrb_fixnum_value((mrb_int)1 << (b + PROFILE_MIN_SHIFT)));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(allocs)), mrb_fixnum_value(profile->buckets[b].allocs));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(reallocs)), mrb_fixnum_value(profile->buckets[b].reallocs));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(bytes)), mrb_fixnum_value(profile->buckets[b].bytes));
+    mrb_ary_push(mrb, buckets, h);
+  }
+
+  size_t largest = picorb_alloc_largest_free(mrb);
+  mrb_value largest_free = (largest == PICORB_ALLOC_LARGEST_FREE_UNKNOWN) ? mrb_nil_value() : mrb_fixnum_value(largest);
+  uint32_t counts[PROFILE_BUCKETS];
+  mrb_value free_blocks = mrb_nil_value();
+  if (profile_free_blocks(mrb, counts)) {
+    free_blocks = mrb_ary_new_capa(mrb, PROFILE_BUCKETS);
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+      mrb_ary_push(mrb, free_blocks, mrb_fixnum_value(counts[b]));
+    }
+  }
+  mrb_value result = mrb_hash_new_capa(mrb, 9);
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(allocs)), mrb_fixnum_value(profile->allocs));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(reallocs)), mrb_fixnum_value(profile->reallocs));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(frees)), mrb_fixnum_value(profile->frees));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(failures)), mrb_fixnum_value(profile->failures));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(largest_free)), largest_free);
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(buckets)), buckets);
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(free_blocks)), free_blocks);
+
+#if 0 < PICORB_ALLOC_PROFILE_SITES
+  mrb_value sites = mrb_ary_new_capa(mrb, profile->site_count);
+  for (int n = 0; n < PICORB_ALLOC_PROFILE_SITES; n++) {
+    profile_site *site = &profile->sites[n];
+    if (site->count == 0) continue;
+    mrb_value h = mrb_hash_new_capa(mrb, 4);
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(method)),
+                 site->mid ? mrb_symbol_value(site->mid) : mrb_nil_value());
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(irep)), mrb_fixnum_value((mrb_int)(uintptr_t)site->irep));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(count)), mrb_fixnum_value(site->count));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(bytes)), mrb_fixnum_value(site->bytes));
+    mrb_ary_push(mrb, sites, h);
+  }
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(sites)), sites);
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(sites_dropped)), mrb_fixnum_value(profile->sites_dropped));
+#endif
+
+  profile->running = running;
+  return result;
+}
+
+static void
+dump_u8(mrb_state *mrb, mrb_value str, uint8_t v)
+{
+  mrb_str_cat(mrb, str, (const char *)&v, 1);
+}
+
+static void
+dump_u16(mrb_state *mrb, mrb_value str, uint16_t v)
+{
+  char buf[2] = { (char)(v & 0xff), (char)(v >> 8) };
+  mrb_str_cat(mrb, str, buf, 2);
+}
+
+static void
+dump_u32(mrb_state *mrb, mrb_value str, uint32_t v)
+{
+  char buf[4] = { (char)(v & 0xff), (char)((v >> 8) & 0xff), (char)((v >> 16) & 0xff), (char)(v >> 24) };
+  mrb_str_cat(mrb, str, buf, 4);
+}
+
+mrb_value
+picorb_alloc_profile_dump(mrb_state *mrb)
+{
+  picorb_alloc_profile *profile = picorb_alloc_profile_of(mrb);
+  mrb_bool running = profile->running;
+  profile->running = FALSE;
+
+  size_t largest = picorb_alloc_largest_free(mrb);
+  uint32_t largest_free = (largest == PICORB_ALLOC_LARGEST_FREE_UNKNOWN) ? UINT32_MAX : (uint32_t)largest;
+  uint32_t free_blocks[PROFILE_BUCKETS];
+  uint16_t flags = profile_free_blocks(mrb, free_blocks) ? PROFILE_FLAG_FREE_BLOCKS : 0;
+  mrb_value str = mrb_str_new_capa(mrb, 36 + PROFILE_BUCKETS * 16);
+  mrb_str_cat_lit(mrb, str, "PRAP");
+  dump_u8(mrb, str, PROFILE_DUMP_VERSION);
+  dump_u8(mrb, str, PROFILE_BUCKETS);
+  dump_u16(mrb, str, flags);
+  dump_u32(mrb, str, (uint32_t)profile->heap_bytes);
+  dump_u32(mrb, str, largest_free);
+  dump_u32(mrb, str, profile->allocs);
+  dump_u32(mrb, str, profile->reallocs);
+  dump_u32(mrb, str, profile->frees);
+  dump_u32(mrb, str, profile->failures);
+  for (int b = 0; b < PROFILE_BUCKETS; b++) {
+    dump_u32(mrb, str, profile->buckets[b].allocs);
+    dump_u32(mrb, str, profile->buckets[b].reallocs);
+    dump_u32(mrb, str, profile->buckets[b].bytes);
+  }
+  if (flags & PROFILE_FLAG_FREE_BLOCKS) {
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+      dump_u32(mrb, str, free_blocks[b]);
+    }
+  }
+#if 0 < PICORB_ALLOC_PROFILE_SITES
+  dump_u16(mrb, str, profile->site_count);
+  dump_u32(mrb, str, profile->sites_dropped);
+  for (int n = 0; n < PICORB_ALLOC_PROFILE_SITES; n++) {
+    profile_site *site = &profile->sites[n];
+    if (site->count == 0) continue;
+    mrb_int len = 0;
+    const char *name = site->mid ? mrb_sym_name_len(mrb, site->mid, &len) : "";
+    if (name == NULL) name = "";
+    if (255 < len) len = 255;
+    dump_u32(mrb, str, site->count);
+    dump_u32(mrb, str, site->bytes);
+    dump_u32(mrb, str, (uint32_t)(uintptr_t)site->irep);
+    dump_u8(mrb, str, (uint8_t)len);
+    mrb_str_cat(mrb, str, name, len);
+  }
+#else
+  dump_u16(mrb, str, 0);
+  dump_u32(mrb, str, 0);
+#endif
+
+  profile->running = running;
+  return str;
+}
+
+#endif /* PICORB_ALLOC_PROFILE */
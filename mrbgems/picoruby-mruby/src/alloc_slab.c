@@ -0,0 +1,322 @@
+/*
+  Segregated slab allocator in front of the PICORB_ALLOC_* backends.
+  Define PICORB_ALLOC_SLAB to enable it.
+
+  An arena (PICORB_SLAB_ARENA_SIZE bytes, or 1/PICORB_SLAB_ARENA_RATIO
+  of the heap) is taken from the backend at startup and divided into
+  pages of PICORB_SLAB_PAGE_SIZE bytes. Each page serves one size class
+  of PICORB_SLAB_CLASSES (ascending order) while it has live objects, and goes back to
+  the free page list when it gets empty.
+  Requests larger than the largest class, and requests that find no
+  page available, go to the backend.
+  The state of each heap (picorb_slab) is also taken from the backend,
+  and is the ud of picorb_slab_allocf().
+*/
+
+#if defined(PICORB_ALLOC_SLAB)
+
+#include <string.h>
+
+#include "mruby.h"
+#include "mruby/presym.h"
+#include "mruby/hash.h"
+#include "mruby/array.h"
+#include "alloc_slab.h"
+
+#ifndef PICORB_ALLOC_ALIGN
+#define PICORB_ALLOC_ALIGN 4
+#endif
+#ifndef PICORB_SLAB_CLASSES
+#define PICORB_SLAB_CLASSES 16, 24, 32, 48, 64
+#endif
+#ifndef PICORB_SLAB_PAGE_SIZE
+#define PICORB_SLAB_PAGE_SIZE 512
+#endif
+#ifndef PICORB_SLAB_ARENA_RATIO
+#define PICORB_SLAB_ARENA_RATIO 8
+#endif
+
+#define SLAB_MAX_PAGES  INT16_MAX
+#define SLAB_NIL        (-1)
+
+static const uint16_t slab_class_request[] = { PICORB_SLAB_CLASSES };
+#define SLAB_CLASS_COUNT (sizeof(slab_class_request) / sizeof(slab_class_request[0]))
+
+typedef struct {
+  void *free;       // freelist of returned objects in this page
+  uint16_t used;    // objects in use
+  uint16_t fresh;   // objects carved so far
+  int16_t next;     // link in partial list of the class or free page list
+  int16_t prev;
+  uint8_t cls;
+} slab_page;
+
+typedef struct {
+  uint16_t size;
+  uint16_t per_page;
+  int16_t partial;  // pages that have room
+  uint16_t pages;
+  uint32_t in_use;
+  uint32_t hits;
+  uint32_t misses;
+} slab_class;
+
+struct picorb_slab {
+  mrb_allocf backend;
+  void *backend_ud;
+  uint8_t *arena;
+  uint8_t *arena_end;
+  slab_page *pages;
+  int16_t page_count;
+  int16_t free_pages;
+  uint32_t passthrough;
+  slab_class cls[SLAB_CLASS_COUNT];
+  uint8_t class_of[PICORB_SLAB_PAGE_SIZE / PICORB_ALLOC_ALIGN + 1];
+  uint16_t max_size;
+};
+
+
+static void
+page_list_push(picorb_slab *slab, int16_t *head, int16_t i)
+{
+  slab_page *pg = &slab->pages[i];
+  pg->prev = SLAB_NIL;
+  pg->next = *head;
+  if (*head != SLAB_NIL) slab->pages[*head].prev = i;
+  *head = i;
+}
+
+static void
+page_list_remove(picorb_slab *slab, int16_t *head, int16_t i)
+{
+  slab_page *pg = &slab->pages[i];
+  if (pg->prev != SLAB_NIL) {
+    slab->pages[pg->prev].next = pg->next;
+  } else {
+    *head = pg->next;
+  }
+  if (pg->next != SLAB_NIL) slab->pages[pg->next].prev = pg->prev;
+  pg->next = pg->prev = SLAB_NIL;
+}
+
+static inline mrb_bool
+slab_owns(const picorb_slab *slab, const void *p)
+{
+  return slab->arena <= (const uint8_t *)p && (const uint8_t *)p < slab->arena_end;
+}
+
+static inline int16_t
+slab_page_index(const picorb_slab *slab, const void *p)
+{
+  return (int16_t)(((const uint8_t *)p - slab->arena) / PICORB_SLAB_PAGE_SIZE);
+}
+
+static void *
+slab_alloc(picorb_slab *slab, int c)
+{
+  slab_class *k = &slab->cls[c];
+  int16_t i = k->partial;
+  if (i == SLAB_NIL) {
+    i = slab->free_pages;
+    if (i == SLAB_NIL) {
+      k->misses++;
+      return NULL;
+    }
+    page_list_remove(slab, &slab->free_pages, i);
+    slab_page *pg = &slab->pages[i];
+    pg->free = NULL;
+    pg->used = 0;
+    pg->fresh = 0;
+    pg->cls = c;
+    page_list_push(slab, &k->partial, i);
+    k->pages++;
+  }
+
+  slab_page *pg = &slab->pages[i];
+  void *obj;
+  if (pg->free) {
+    obj = pg->free;
+    pg->free = *(void **)obj;
+  } else {
+    obj = slab->arena + (size_t)i * PICORB_SLAB_PAGE_SIZE + (size_t)pg->fresh * k->size;
+    pg->fresh++;
+  }
+  pg->used++;
+  if (pg->used == k->per_page) page_list_remove(slab, &k->partial, i);
+  k->in_use++;
+  k->hits++;
+  return obj;
+}
+
+static void
+slab_free(picorb_slab *slab, void *p)
+{
+  int16_t i = slab_page_index(slab, p);
+  slab_page *pg = &slab->pages[i];
+  slab_class *k = &slab->cls[pg->cls];
+
+  if (pg->used == k->per_page) page_list_push(slab, &k->partial, i);
+  *(void **)p = pg->free;
+  pg->free = p;
+  pg->used--;
+  k->in_use--;
+  if (pg->used == 0) {
+    page_list_remove(slab, &k->partial, i);
+    k->pages--;
+    page_list_push(slab, &slab->free_pages, i);
+  }
+}
+
+
+//================================================================
+/*! Set up the slab of a heap.
+
+  @param  backend     allocf of the backend.
+  @param  ud          passed to the backend.
+  @param  heap_bytes  size of the whole heap.
+  @return             ud for picorb_slab_allocf, or NULL if out of memory.
+*/
+picorb_slab *
+picorb_slab_init(mrb_allocf backend, void *ud, size_t heap_bytes)
+{
+  picorb_slab *slab = (picorb_slab *)backend(NULL, NULL, sizeof(picorb_slab), ud);
+  if (slab == NULL) return NULL;
+  memset(slab, 0, sizeof(picorb_slab));
+  slab->backend = backend;
+  slab->backend_ud = ud;
+  slab->free_pages = SLAB_NIL;
+
+  // Round the class sizes up so that every object is aligned
+  // and can hold a freelist pointer.
+  uint16_t min_size = (sizeof(void *) + PICORB_ALLOC_ALIGN - 1) / PICORB_ALLOC_ALIGN * PICORB_ALLOC_ALIGN;
+  for (size_t c = 0; c < SLAB_CLASS_COUNT; c++) {
+    uint16_t size = (slab_class_request[c] + PICORB_ALLOC_ALIGN - 1) / PICORB_ALLOC_ALIGN * PICORB_ALLOC_ALIGN;
+    if (size < min_size) size = min_size;
+    if (PICORB_SLAB_PAGE_SIZE < size) size = PICORB_SLAB_PAGE_SIZE;
+    slab->cls[c].size = size;
+    slab->cls[c].per_page = PICORB_SLAB_PAGE_SIZE / size;
+    slab->cls[c].partial = SLAB_NIL;
+  }
+  // class_of[n] is the smallest class that holds n * PICORB_ALLOC_ALIGN bytes
+  size_t c = 0;
+  for (size_t n = 0; n < sizeof(slab->class_of); n++) {
+    while (c < SLAB_CLASS_COUNT && slab->cls[c].size < n * PICORB_ALLOC_ALIGN) c++;
+    if (c == SLAB_CLASS_COUNT) break;
+    slab->class_of[n] = c;
+    slab->max_size = n * PICORB_ALLOC_ALIGN;
+  }
+
+#if defined(PICORB_SLAB_ARENA_SIZE)
+  size_t arena_size = PICORB_SLAB_ARENA_SIZE;
+  (void)heap_bytes;
+#else
+  size_t arena_size = heap_bytes / PICORB_SLAB_ARENA_RATIO;
+#endif
+  size_t count = arena_size / (PICORB_SLAB_PAGE_SIZE + sizeof(slab_page));
+  if (SLAB_MAX_PAGES < count) count = SLAB_MAX_PAGES;
+  if (count == 0) return slab;
+
+  slab->arena = (uint8_t *)backend(NULL, NULL, count * PICORB_SLAB_PAGE_SIZE, ud);
+  slab->pages = (slab_page *)backend(NULL, NULL, count * sizeof(slab_page), ud);
+  if (slab->arena == NULL || slab->pages == NULL) {
+    // Work without the slab
+    if (slab->arena) backend(NULL, slab->arena, 0, ud);
+    if (slab->pages) backend(NULL, slab->pages, 0, ud);
+    slab->arena = NULL;
+    slab->pages = NULL;
+    return slab;
+  }
+  slab->arena_end = slab->arena + count * PICORB_SLAB_PAGE_SIZE;
+  slab->page_count = (int16_t)count;
+  for (int16_t i = slab->page_count - 1; 0 <= i; i--) {
+    page_list_push(slab, &slab->free_pages, i);
+  }
+  return slab;
+}
+
+//================================================================
+/*! ud of the backend behind the slab.
+*/
+void *
+picorb_slab_backend_ud(picorb_slab *slab)
+{
+  return slab->backend_ud;
+}
+
+
+//================================================================
+/*! allocf that serves small objects from the slab.
+  ud is the picorb_slab from picorb_slab_init().
+*/
+void *
+picorb_slab_allocf(mrb_state *mrb, void *p, size_t size, void *ud)
+{
+  picorb_slab *slab = (picorb_slab *)ud;
+  if (p && slab_owns(slab, p)) {
+    if (size == 0) {
+      slab_free(slab, p);
+      return NULL;
+    }
+    size_t old_size = slab->cls[slab->pages[slab_page_index(slab, p)].cls].size;
+    if (size <= old_size) return p;
+    void *new_p = NULL;
+    if (size <= slab->max_size) {
+      new_p = slab_alloc(slab, slab->class_of[(size + PICORB_ALLOC_ALIGN - 1) / PICORB_ALLOC_ALIGN]);
+    }
+    if (new_p == NULL) {
+      new_p = slab->backend(mrb, NULL, size, slab->backend_ud);
+      if (new_p == NULL) return NULL;
+      slab->passthrough++;
+    }
+    memcpy(new_p, p, old_size);
+    slab_free(slab, p);
+    return new_p;
+  }
+
+  if (p == NULL && 0 < size && size <= slab->max_size && slab->arena) {
+    void *new_p = slab_alloc(slab, slab->class_of[(size + PICORB_ALLOC_ALIGN - 1) / PICORB_ALLOC_ALIGN]);
+    if (new_p) return new_p;
+  }
+  if (size != 0) slab->passthrough++;
+  return slab->backend(mrb, p, size, slab->backend_ud);
+}
+
+
+//================================================================
+/*! Add `slab` entry to the hash of mrb_alloc_statistics()
+*/
+void
+picorb_slab_statistics(mrb_state *mrb, picorb_slab *slab, mrb_value hash)
+{
+  mrb_value classes = mrb_ary_new_capa(mrb, SLAB_CLASS_COUNT);
+  int16_t free_pages = 0;
+  for (int16_t i = slab->free_pages; i != SLAB_NIL; i = slab->pages[i].next) {
+    free_pages++;
+  }
+  for (size_t c = 0; c < SLAB_CLASS_COUNT; c++) {
+    slab_class *k = &slab->cls[c];
+    uint32_t capacity = (uint32_t)k->pages * k->per_page;
+    uint32_t requests = k->hits + k->misses;
+    mrb_value h = mrb_hash_new_capa(mrb, 7);
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(size)), mrb_fixnum_value(k->size));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(pages)), mrb_fixnum_value(k->pages));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(in_use)), mrb_fixnum_value(k->in_use));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(hits)), mrb_fixnum_value(k->hits));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(misses)), mrb_fixnum_value(k->misses));
+    // percentages
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(hit_rate)),
+                 mrb_fixnum_value(requests ? (mrb_int)k->hits * 100 / requests : 0));
+    mrb_hash_set(mrb, h, mrb_symbol_value(MRB_SYM(fragmentation)),
+                 mrb_fixnum_value(capacity ? (mrb_int)(capacity - k->in_use) * 100 / capacity : 0));
+    mrb_ary_push(mrb, classes, h);
+  }
+  mrb_value result = mrb_hash_new_capa(mrb, 5);
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(page_size)), mrb_fixnum_value(PICORB_SLAB_PAGE_SIZE));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(pages)), mrb_fixnum_value(slab->page_count));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(free_pages)), mrb_fixnum_value(free_pages));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(passthrough)), mrb_fixnum_value(slab->passthrough));
+  mrb_hash_set(mrb, result, mrb_symbol_value(MRB_SYM(classes)), classes);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(slab)), result);
+}
+
+#endif /* PICORB_ALLOC_SLAB */
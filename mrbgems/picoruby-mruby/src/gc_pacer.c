@@ -0,0 +1,228 @@
+/*
+  Incremental GC pacing for the task scheduler.
+
+  mrb_tasks_run() calls mrb_gc_pacer_step() after each time slice and
+  mrb_gc_pacer_idle() when no task is ready.
+  - The number of steps per slice grows with the number of objects
+    allocated since the last slice, between min_steps and max_steps.
+  - While every task is sleeping, GC steps run until a task gets ready,
+    so that the heap is cleaned up before it gets full.
+*/
+
+#include <string.h>
+#include <picoruby.h>
+#include <mruby/gc.h>
+#include <mruby/hash.h>
+#include <mruby/presym.h>
+#include "hal.h"
+#include "task.h"
+
+#if defined(PICORB_PLATFORM_POSIX)
+#include <time.h>
+#endif
+
+#ifndef MAX_GC_STEPS_PER_TICK
+  #define MAX_GC_STEPS_PER_TICK 5
+#endif
+#ifndef MRB_GC_PACER_MAX_STEPS
+  #define MRB_GC_PACER_MAX_STEPS (MAX_GC_STEPS_PER_TICK * 4)
+#endif
+#ifndef MRB_GC_PACER_OBJS_PER_STEP
+  #define MRB_GC_PACER_OBJS_PER_STEP 128
+#endif
+
+#define q_ready_  (mrb->task.queues[1])
+#define tick_     mrb->task.tick
+
+#define pacer_    (MRB_TASK_SCHEDULER(mrb)->gc_pacer)
+
+
+static uint32_t
+pacer_clock_us(mrb_state *mrb)
+{
+#if defined(PICORB_PLATFORM_POSIX)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+  // Resolution is MRB_TICK_UNIT
+  return tick_ * MRB_TICK_UNIT * 1000;
+#endif
+}
+
+static void
+pacer_gc_step(mrb_state *mrb)
+{
+  mrb_incremental_gc(mrb);
+  pacer_.steps++;
+  if (mrb->gc.state == MRB_GC_STATE_ROOT) {
+    pacer_.cycles++;
+    pacer_.live_after_cycle = mrb->gc.live;
+  }
+}
+
+static void
+pacer_record_pause(mrb_state *mrb, uint32_t us)
+{
+  pacer_.pauses++;
+  pacer_.last_pause_us = us;
+  pacer_.total_pause_us += us;
+  if (pacer_.max_pause_us < us) pacer_.max_pause_us = us;
+}
+
+
+//================================================================
+/*! Run GC steps after a time slice.
+*/
+void
+mrb_gc_pacer_step(mrb_state *mrb)
+{
+  size_t live = mrb->gc.live;
+  size_t allocated = (pacer_.last_live < live) ? live - pacer_.last_live : 0;
+  pacer_.last_live = live;
+
+  if (mrb->gc.disabled || mrb->gc.state == MRB_GC_STATE_ROOT) return;
+
+  size_t steps = pacer_.min_steps + allocated / pacer_.objs_per_step;
+  if ((size_t)pacer_.max_steps < steps) steps = pacer_.max_steps;
+
+  uint32_t start = pacer_clock_us(mrb);
+  uint32_t done = 0;
+  while (mrb->gc.state != MRB_GC_STATE_ROOT && done < steps) {
+    pacer_gc_step(mrb);
+    done++;
+  }
+  pacer_record_pause(mrb, pacer_clock_us(mrb) - start);
+
+  pacer_.slices++;
+  if (pacer_.max_steps_per_slice < done) pacer_.max_steps_per_slice = done;
+  pacer_.last_live = mrb->gc.live;
+}
+
+
+//================================================================
+/*! Run GC steps while no task is ready.
+
+  @return TRUE if something has been done. FALSE if CPU can be idle.
+*/
+mrb_bool
+mrb_gc_pacer_idle(mrb_state *mrb)
+{
+  if (!pacer_.idle || mrb->gc.disabled) return FALSE;
+
+  if (mrb->gc.state == MRB_GC_STATE_ROOT) {
+    // Start a new cycle only if objects have been allocated since the last one.
+    if (mrb->gc.live < pacer_.live_after_cycle + pacer_.objs_per_step) return FALSE;
+  }
+
+  uint32_t done = 0;
+  do {
+    pacer_gc_step(mrb);
+    done++;
+  } while (q_ready_ == NULL && mrb->gc.state != MRB_GC_STATE_ROOT);
+  pacer_.idle_steps += done;
+  pacer_.last_live = mrb->gc.live;
+  return TRUE;
+}
+
+
+//================================================================
+/*! (method) GC.pacing = { min_steps:, max_steps:, objs_per_step:, idle: }
+
+  Missing keys are left unchanged.
+*/
+static mrb_value
+mrb_gc_s_pacing_set(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value opts;
+  mrb_get_args(mrb, "H", &opts);
+
+  int min_steps = pacer_.min_steps;
+  int max_steps = pacer_.max_steps;
+  int objs_per_step = pacer_.objs_per_step;
+  mrb_value v;
+
+  v = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(min_steps)));
+  if (!mrb_nil_p(v)) min_steps = (int)mrb_as_int(mrb, v);
+  v = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(max_steps)));
+  if (!mrb_nil_p(v)) max_steps = (int)mrb_as_int(mrb, v);
+  v = mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(objs_per_step)));
+  if (!mrb_nil_p(v)) objs_per_step = (int)mrb_as_int(mrb, v);
+
+  if (min_steps < 0 || max_steps < min_steps || objs_per_step < 1) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "invalid GC pacing");
+  }
+  pacer_.min_steps = min_steps;
+  pacer_.max_steps = max_steps;
+  pacer_.objs_per_step = objs_per_step;
+
+  if (mrb_hash_key_p(mrb, opts, mrb_symbol_value(MRB_SYM(idle)))) {
+    pacer_.idle = mrb_test(mrb_hash_get(mrb, opts, mrb_symbol_value(MRB_SYM(idle))));
+  }
+  return opts;
+}
+
+static mrb_value
+mrb_gc_s_pacing(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value hash = mrb_hash_new_capa(mrb, 4);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(min_steps)), mrb_fixnum_value(pacer_.min_steps));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(max_steps)), mrb_fixnum_value(pacer_.max_steps));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(objs_per_step)), mrb_fixnum_value(pacer_.objs_per_step));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(idle)), mrb_bool_value(pacer_.idle));
+  return hash;
+}
+
+//================================================================
+/*! (method) GC.pacing_stat
+
+  Pause times are in microseconds.
+  Their resolution is MRB_TICK_UNIT except on POSIX.
+*/
+static mrb_value
+mrb_gc_s_pacing_stat(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value hash = mrb_hash_new_capa(mrb, 9);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(cycles)), mrb_fixnum_value(pacer_.cycles));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(steps)), mrb_fixnum_value(pacer_.steps));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(idle_steps)), mrb_fixnum_value(pacer_.idle_steps));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(max_steps_per_slice)), mrb_fixnum_value(pacer_.max_steps_per_slice));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(avg_steps_per_slice)),
+               mrb_fixnum_value(pacer_.slices ? (pacer_.steps - pacer_.idle_steps) / pacer_.slices : 0));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(last_pause_us)), mrb_fixnum_value(pacer_.last_pause_us));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(max_pause_us)), mrb_fixnum_value(pacer_.max_pause_us));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(avg_pause_us)),
+               mrb_fixnum_value(pacer_.pauses ? pacer_.total_pause_us / pacer_.pauses : 0));
+  return hash;
+}
+
+static mrb_value
+mrb_gc_s_pacing_reset(mrb_state *mrb, mrb_value klass)
+{
+  pacer_.cycles = 0;
+  pacer_.steps = 0;
+  pacer_.idle_steps = 0;
+  pacer_.slices = 0;
+  pacer_.max_steps_per_slice = 0;
+  pacer_.pauses = 0;
+  pacer_.last_pause_us = 0;
+  pacer_.max_pause_us = 0;
+  pacer_.total_pause_us = 0;
+  return mrb_nil_value();
+}
+
+void
+mrb_gc_pacer_init(mrb_state *mrb)
+{
+  memset(&pacer_, 0, sizeof(mrb_gc_pacer));
+  pacer_.min_steps = MAX_GC_STEPS_PER_TICK;
+  pacer_.max_steps = MRB_GC_PACER_MAX_STEPS;
+  pacer_.objs_per_step = MRB_GC_PACER_OBJS_PER_STEP;
+  pacer_.idle = TRUE;
+
+  struct RClass *module_GC = mrb_define_module_id(mrb, MRB_SYM(GC));
+  mrb_define_class_method_id(mrb, module_GC, MRB_SYM(pacing), mrb_gc_s_pacing, MRB_ARGS_NONE());
+  mrb_define_class_method_id(mrb, module_GC, MRB_SYM_E(pacing), mrb_gc_s_pacing_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method_id(mrb, module_GC, MRB_SYM(pacing_stat), mrb_gc_s_pacing_stat, MRB_ARGS_NONE());
+  mrb_define_class_method_id(mrb, module_GC, MRB_SYM(pacing_reset), mrb_gc_s_pacing_reset, MRB_ARGS_NONE());
+}
@@ -16,11 +16,7 @@
 #include <mruby/hash.h>
 #include "hal.h"
 #include "task.h"
-
-#include <mruby/gc.h>
-#ifndef MAX_GC_STEPS_PER_TICK
-  #define MAX_GC_STEPS_PER_TICK 5
-#endif
+#include "gc_pacer.h"
 
 /***** Macros ***************************************************************/
 #ifndef MRB_SCHEDULER_EXIT
@@ -41,6 +37,16 @@
 #define tick_         mrb->task.tick
 #define wakeup_tick_  mrb->task.wakeup_tick
 #define switching_    mrb->task.switching
+#define timer_wheel_  (MRB_TASK_SCHEDULER(mrb)->timer_wheel)
+#define ready_index_  (MRB_TASK_SCHEDULER(mrb)->ready_index)
+#define running_tcb_  (MRB_TASK_SCHEDULER(mrb)->running_tcb)
+#define tick_profile_ (MRB_TASK_SCHEDULER(mrb)->tick_profile)
+
+#if defined(MRB_TASK_PROFILE)
+#define TASK_PROFILE(stmt)  do { stmt; } while (0)
+#else
+#define TASK_PROFILE(stmt)  ((void)0)
+#endif
 
 static void mrb_task_tcb_free(mrb_state *mrb, void *ptr);
 
@@ -48,8 +54,57 @@ struct mrb_data_type mrb_task_tcb_type = {
   "TCB", mrb_task_tcb_free
 };
 
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_SHIFT(level) (MRB_TIMER_WHEEL_BITS * (level))
+
+/***** Local variables ******************************************************/
 /***** Signal catching functions ********************************************/
 /***** Functions ************************************************************/
+static inline int
+highest_bit(uint32_t bits)
+{
+#if defined(__GNUC__)
+  return 31 - __builtin_clz(bits);
+#else
+  int n = 0;
+  while (bits >>= 1) n++;
+  return n;
+#endif
+}
+
+//================================================================
+/*! Find the last TCB in ready queue that has priority
+    less than or equal to `prio`.
+*/
+static mrb_tcb *
+ready_index_find(mrb_state *mrb, int prio)
+{
+  int w = prio >> 5;
+  uint32_t bits = ready_index_.map[w] & (((uint32_t)2 << (prio & 31)) - 1);
+  if (bits == 0) {
+    uint32_t words = ready_index_.summary & (((uint32_t)1 << w) - 1);
+    if (words == 0) return NULL;
+    w = highest_bit(words);
+    bits = ready_index_.map[w];
+  }
+  return ready_index_.tail[(w << 5) + highest_bit(bits)];
+}
+
+static void
+ready_index_set(mrb_state *mrb, int prio, mrb_tcb *tail)
+{
+  int w = prio >> 5;
+  ready_index_.tail[prio] = tail;
+  if (tail) {
+    ready_index_.map[w] |= (uint32_t)1 << (prio & 31);
+    ready_index_.summary |= (uint32_t)1 << w;
+  } else {
+    ready_index_.map[w] &= ~((uint32_t)1 << (prio & 31));
+    if (ready_index_.map[w] == 0) ready_index_.summary &= ~((uint32_t)1 << w);
+  }
+}
+
+
 //================================================================
 /*! Insert task(TCB) to task queue
 
@@ -57,9 +112,11 @@ struct mrb_data_type mrb_task_tcb_type = {
 
   Put the task (TCB) into a queue by each status.
   TCB must be free. (must not be in another queue)
-  The queue is sorted in priority_preemption order.
+  The ready queue is sorted in priority_preemption order.
   If the same priority_preemption value is in the TCB and queue,
   it will be inserted at the end of the same value in queue.
+  Other queues are not sorted.
+  Both are done in constant time.
 */
 static void
 q_insert_task(mrb_state *mrb, mrb_tcb *p_tcb)
@@ -69,24 +126,24 @@ q_insert_task(mrb_state *mrb, mrb_tcb *p_tcb)
   //                              /2   0, 0, 1, 1, 2, 2, 3, 3, 4
   static const uint8_t conv_tbl[] = { 0,    1,    2,    0,    3 };
   mrb_tcb **pp_q = &task_queues_[conv_tbl[p_tcb->status / 2]];
+  mrb_tcb *p = NULL;
 
-  // in case of insert on top.
-  if ((*pp_q == NULL) || (p_tcb->priority_preemption < (*pp_q)->priority_preemption)) {
-    p_tcb->next = *pp_q;
-    *pp_q       = p_tcb;
-    return;
-  }
-
-  // find insert point in sorted linked list.
-  mrb_tcb *p = *pp_q;
-  while (p->next != NULL) {
-    if (p_tcb->priority_preemption < p->next->priority_preemption) break;
-    p = p->next;
+  if (pp_q == &q_ready_) {
+    p_tcb->queued_priority = p_tcb->priority_preemption;
+    p = ready_index_find(mrb, p_tcb->queued_priority);
+    ready_index_set(mrb, p_tcb->queued_priority, p_tcb);
   }
 
   // insert tcb to queue.
-  p_tcb->next = p->next;
-  p->next     = p_tcb;
+  p_tcb->prev = p;
+  if (p == NULL) {
+    p_tcb->next = *pp_q;
+    *pp_q       = p_tcb;
+  } else {
+    p_tcb->next = p->next;
+    p->next     = p_tcb;
+  }
+  if (p_tcb->next) p_tcb->next->prev = p_tcb;
 }
 
 
@@ -102,27 +159,148 @@ q_delete_task(mrb_state *mrb, mrb_tcb *p_tcb)
   static const uint8_t conv_tbl[] = { 0,    1,    2,    0,    3 };
   mrb_tcb **pp_q = &task_queues_[conv_tbl[p_tcb->status / 2]];
 
-  if (*pp_q == p_tcb) {
-    *pp_q       = p_tcb->next;
-    p_tcb->next = NULL;
-    return;
+  mrb_assert(p_tcb->prev != NULL || *pp_q == p_tcb);
+
+  if (pp_q == &q_ready_ && ready_index_.tail[p_tcb->queued_priority] == p_tcb) {
+    mrb_tcb *p = p_tcb->prev;
+    ready_index_set(mrb, p_tcb->queued_priority,
+                    (p && p->queued_priority == p_tcb->queued_priority) ? p : NULL);
   }
 
-  mrb_tcb *p = *pp_q;
-  while (p) {
-    if (p->next == p_tcb) {
-      p->next     = p_tcb->next;
-      p_tcb->next = NULL;
-      return;
-    }
+  if (p_tcb->prev) {
+    p_tcb->prev->next = p_tcb->next;
+  } else {
+    *pp_q = p_tcb->next;
+  }
+  if (p_tcb->next) p_tcb->next->prev = p_tcb->prev;
+  p_tcb->next = NULL;
+  p_tcb->prev = NULL;
+}
+
+
+//================================================================
+/*! Link TCB into the timer wheel.
+
+  @param  expire  tick_ value to be woken up at. tick_ <= expire.
+*/
+static void
+timer_link(mrb_state *mrb, mrb_tcb *tcb, uint32_t expire)
+{
+  uint32_t delta = expire - tick_;
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 &&
+         (delta >> TIMER_WHEEL_SHIFT(level + 1)) != 0) {
+    level++;
+  }
+  int idx = (expire >> TIMER_WHEEL_SHIFT(level)) & TIMER_WHEEL_MASK;
+  mrb_tcb **pp_slot = &timer_wheel_.slot[level][idx];
+
+  tcb->timer_next = *pp_slot;
+  if (tcb->timer_next) tcb->timer_next->timer_pprev = &tcb->timer_next;
+  tcb->timer_pprev = pp_slot;
+  *pp_slot = tcb;
+  timer_wheel_.occupied[level] |= (uint32_t)1 << idx;
+}
+
+
+//================================================================
+/*! Put the sleeping task into the timer wheel.
+
+  It will be woken up when tick_ passes tcb->wakeup_tick.
+*/
+static void
+timer_insert(mrb_state *mrb, mrb_tcb *tcb)
+{
+  uint32_t expire = tcb->wakeup_tick + 1;
+  if ((int32_t)(expire - tick_) <= 0) expire = tick_ + 1;  // already expired
+  timer_link(mrb, tcb, expire);
+
+  if ((int32_t)(expire - 1 - wakeup_tick_) < 0) {
+    wakeup_tick_ = expire - 1;
+  }
+}
+
 
-    p = p->next;
+//================================================================
+/*! Remove the task from the timer wheel if it is in.
+*/
+static void
+timer_remove(mrb_state *mrb, mrb_tcb *tcb)
+{
+  mrb_tcb **pprev = tcb->timer_pprev;
+  if (pprev == NULL) return;
+
+  *pprev = tcb->timer_next;
+  if (tcb->timer_next) tcb->timer_next->timer_pprev = pprev;
+  tcb->timer_next = NULL;
+  tcb->timer_pprev = NULL;
+
+  // pprev points to the slot itself if the TCB was the head.
+  mrb_tcb **base = &timer_wheel_.slot[0][0];
+  if (base <= pprev && pprev < base + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS && *pprev == NULL) {
+    int n = (int)(pprev - base);
+    timer_wheel_.occupied[n / TIMER_WHEEL_SLOTS] &= ~((uint32_t)1 << (n % TIMER_WHEEL_SLOTS));
   }
+}
+
 
-  mrb_assert(!"Not found target task in queue.");
+//================================================================
+/*! Detach all TCBs in the slot and return them as a chain.
+*/
+static mrb_tcb *
+timer_take_slot(mrb_state *mrb, int level, int idx)
+{
+  mrb_tcb *tcb = timer_wheel_.slot[level][idx];
+  timer_wheel_.slot[level][idx] = NULL;
+  timer_wheel_.occupied[level] &= ~((uint32_t)1 << idx);
+  return tcb;
+}
+
+
+//================================================================
+/*! Move TCBs of upper levels down as the lower level wraps around.
+*/
+static void
+timer_cascade(mrb_state *mrb)
+{
+  for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+    int idx = (tick_ >> TIMER_WHEEL_SHIFT(level)) & TIMER_WHEEL_MASK;
+    mrb_tcb *tcb = timer_take_slot(mrb, level, idx);
+    while (tcb) {
+      mrb_tcb *next = tcb->timer_next;
+      timer_link(mrb, tcb, tcb->wakeup_tick + 1);
+      tcb = next;
+    }
+    if (idx != 0) break;
+  }
 }
 
 
+//================================================================
+/*! Estimate the earliest wakeup tick in the timer wheel.
+
+  @return value never later than actual one.
+*/
+static uint32_t
+timer_next_wakeup(mrb_state *mrb)
+{
+  uint32_t min_delta = 1 << 16;  // no significant meaning.
+
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    uint32_t occupied = timer_wheel_.occupied[level];
+    if (occupied == 0) continue;
+    uint32_t base = tick_ >> TIMER_WHEEL_SHIFT(level);
+    for (uint32_t d = 1; d <= TIMER_WHEEL_SLOTS; d++) {
+      if (occupied & ((uint32_t)1 << ((base + d) & TIMER_WHEEL_MASK))) {
+        uint32_t delta = ((base + d) << TIMER_WHEEL_SHIFT(level)) - tick_;
+        if (delta < min_delta) min_delta = delta;
+        break;
+      }
+    }
+  }
+  return tick_ + min_delta - 1;
+}
+
 
 //================================================================
 /*! preempt running task
@@ -130,12 +308,23 @@ q_delete_task(mrb_state *mrb, mrb_tcb *p_tcb)
 inline static void
 preempt_running_task(mrb_state *mrb)
 {
-  for (mrb_tcb *t = q_ready_; t != NULL; t = t->next) {
-    if (t->status == TASKSTATUS_RUNNING) switching_ = TRUE;
-  }
+  if (running_tcb_ && running_tcb_->status == TASKSTATUS_RUNNING) switching_ = TRUE;
 }
 
 
+#if defined(MRB_TICK_PROFILE)
+#include <time.h>
+
+static inline uint64_t
+tick_profile_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+
 //================================================================
 /*! Tick timer interrupt handler.
 
@@ -143,8 +332,18 @@ preempt_running_task(mrb_state *mrb)
 void
 mrb_tick(mrb_state *mrb)
 {
+  if (MRB_TASK_SCHEDULER(mrb) == NULL) return;  // not initialized or finalized
+#if defined(MRB_TICK_PROFILE)
+  uint64_t profile_start = tick_profile_now();
+#endif
   tick_++;
 
+  TASK_PROFILE(
+    if (running_tcb_ && running_tcb_->status == TASKSTATUS_RUNNING) {
+      running_tcb_->profile.ticks++;
+    }
+  );
+
   // Decrease the time slice value for running tasks.
   mrb_tcb *tcb = q_ready_;
   if (tcb && 0 < tcb->timeslice) {
@@ -154,31 +353,39 @@ mrb_tick(mrb_state *mrb)
     }
   }
 
-  // Check the wakeup tick.
-  if ((int32_t)(wakeup_tick_ - tick_) < 0) {
-    int task_switch = 0;
-    wakeup_tick_ = tick_ + (1 << 16);
-
-    // Find a wake up task in waiting task queue.
-    tcb = q_waiting_;
+  // Wake up tasks in the current slot.
+  int idx = tick_ & TIMER_WHEEL_MASK;
+  if (idx == 0) timer_cascade(mrb);
+  if (timer_wheel_.occupied[0] & ((uint32_t)1 << idx)) {
+    tcb = timer_take_slot(mrb, 0, idx);
     while (tcb != NULL) {
       mrb_tcb *t = tcb;
-      tcb = tcb->next;
-      if (t->reason != TASKREASON_SLEEP) continue;
-
-      if ((int32_t)(t->wakeup_tick - tick_) < 0) {
-          q_delete_task(mrb, t);
-          t->status  = TASKSTATUS_READY;
-          t->reason = TASKREASON_NONE;
-          q_insert_task(mrb, t);
-          task_switch = 1;
-      } else if ((int32_t)(t->wakeup_tick - wakeup_tick_) < 0) {
-        wakeup_tick_ = t->wakeup_tick;
-      }
+      tcb = tcb->timer_next;
+      t->timer_next = NULL;
+      t->timer_pprev = NULL;
+      q_delete_task(mrb, t);
+      t->status = TASKSTATUS_READY;
+      t->reason = TASKREASON_NONE;
+      q_insert_task(mrb, t);
+      TASK_PROFILE(
+        t->profile.wakeups++;
+        t->profile.since = t->wakeup_tick + 1;
+        t->profile.woken = 1;
+      );
     }
+    preempt_running_task(mrb);
+  }
 
-    if (task_switch) preempt_running_task(mrb);
+  if ((int32_t)(wakeup_tick_ - tick_) < 0) {
+    wakeup_tick_ = timer_next_wakeup(mrb);
   }
+
+#if defined(MRB_TICK_PROFILE)
+  uint32_t elapsed = (uint32_t)(tick_profile_now() - profile_start);
+  tick_profile_.count++;
+  tick_profile_.total_ns += elapsed;
+  if (tick_profile_.max_ns < elapsed) tick_profile_.max_ns = elapsed;
+#endif
 }
 
 static void
@@ -417,7 +624,7 @@ mrb_tasks_run(mrb_state *mrb)
   while (1) {
     mrb_tcb *tcb = q_ready_;
     if (tcb == NULL) {   // no task to run.
-      hal_idle_cpu(mrb);
+      if (!mrb_gc_pacer_idle(mrb)) hal_idle_cpu(mrb);
       continue;
     }
 
@@ -427,9 +634,26 @@ mrb_tasks_run(mrb_state *mrb)
     tcb->status = TASKSTATUS_RUNNING;   // to execute.
     mrb->c = &tcb->c;
     tcb->timeslice = MRB_TIMESLICE_TICK_COUNT;
+    running_tcb_ = tcb;
+    TASK_PROFILE(
+      tcb->profile.dispatches++;
+      if (tcb->profile.woken) {
+        uint32_t lateness = tick_ - tcb->profile.since;
+        tcb->profile.lateness_total += lateness;
+        if (tcb->profile.lateness_max < lateness) tcb->profile.lateness_max = lateness;
+        tcb->profile.woken = 0;
+      }
+    );
 
     tcb->value = mrb_vm_exec(mrb, mrb->c->ci->proc, mrb->c->ci->pc);
 
+    running_tcb_ = NULL;
+    TASK_PROFILE(
+      if (tcb->status == TASKSTATUS_RUNNING && tcb->timeslice == 0) {
+        tcb->profile.preemptions++;
+      }
+    );
+
     if (mrb->exc) {
       tcb->value = mrb_obj_value(mrb->exc);
       tcb->c.status = MRB_TASK_STOPPED;
@@ -458,6 +682,7 @@ mrb_tasks_run(mrb_state *mrb)
           tcb1->status = TASKSTATUS_READY;
           tcb1->reason = TASKREASON_NONE;
           q_insert_task(mrb, tcb1);
+          TASK_PROFILE(tcb1->profile.blocked_ticks += tick_ - tcb1->profile.since);
         }
         tcb1 = next;
       }
@@ -474,14 +699,7 @@ mrb_tasks_run(mrb_state *mrb)
       continue;
     }
 
-    if (mrb->gc.state != MRB_GC_STATE_ROOT) {
-      int gc_steps = 0;
-      while (mrb->gc.state != MRB_GC_STATE_ROOT && gc_steps < MAX_GC_STEPS_PER_TICK)
-      {
-        mrb_incremental_gc(mrb);
-        gc_steps++;
-      }
-    }
+    mrb_gc_pacer_step(mrb);
 
     /*
       Switch task.
@@ -516,13 +734,11 @@ sleep_ms_impl(mrb_state *mrb, mrb_int ms)
   q_delete_task(mrb, tcb);
   tcb->status       = TASKSTATUS_WAITING;
   tcb->reason      = TASKREASON_SLEEP;
+  if (ms < 0) ms = 0;
   tcb->wakeup_tick = tick_ + (ms / MRB_TICK_UNIT) + !!(ms % MRB_TICK_UNIT);
 
-  if ((int32_t)(tcb->wakeup_tick - wakeup_tick_) < 0) {
-    wakeup_tick_ = tcb->wakeup_tick;
-  }
-
   q_insert_task(mrb, tcb);
+  timer_insert(mrb, tcb);
   mrb_task_enable_irq();
 
   switching_ = TRUE;
@@ -541,6 +757,7 @@ mrb_suspend_task(mrb_state *mrb, mrb_value task)
   if (tcb->status == TASKSTATUS_SUSPENDED) return;
 
   mrb_task_disable_irq();
+  timer_remove(mrb, tcb);
   q_delete_task(mrb, tcb);
   tcb->status = TASKSTATUS_SUSPENDED;
   q_insert_task(mrb, tcb);
@@ -566,13 +783,9 @@ mrb_resume_task(mrb_state *mrb, mrb_value task)
   tcb->status = flag_to_ready_status ? TASKSTATUS_READY : TASKSTATUS_WAITING;
   q_insert_task(mrb, tcb);
 
-  mrb_task_enable_irq();
+  if (tcb->reason & TASKREASON_SLEEP) timer_insert(mrb, tcb);
 
-  if (tcb->reason & TASKREASON_SLEEP) {
-    if ((int32_t)(tcb->wakeup_tick - wakeup_tick_) < 0) {
-      wakeup_tick_ = tcb->wakeup_tick;
-    }
-  }
+  mrb_task_enable_irq();
 }
 
 void
@@ -582,6 +795,7 @@ mrb_terminate_task(mrb_state *mrb, mrb_value task)
   if (tcb->status == TASKSTATUS_DORMANT) return;
 
   mrb_task_disable_irq();
+  timer_remove(mrb, tcb);
   q_delete_task(mrb, tcb);
   tcb->status = TASKSTATUS_DORMANT;
   q_insert_task(mrb, tcb);
@@ -836,6 +1050,7 @@ mrb_task_join(mrb_state *mrb, mrb_value self)
   current_tcb->reason = TASKREASON_JOIN;
   current_tcb->tcb_join = tcb_to_join;
   q_insert_task(mrb, current_tcb);
+  TASK_PROFILE(current_tcb->profile.since = tick_);
   mrb_task_enable_irq();
 
   switching_ = TRUE;
@@ -885,6 +1100,59 @@ mrb_stat_sub(mrb_state *mrb, const mrb_tcb *p_tcb)
   return array;
 }
 
+//================================================================
+/*! (method) accounting of the task. Needs MRB_TASK_PROFILE.
+
+  CPU time is sampled by the tick timer, so `ticks` is the number of
+  ticks that hit while the task was running.
+*/
+static mrb_value
+mrb_task_stat(mrb_state *mrb, mrb_value self)
+{
+#if defined(MRB_TASK_PROFILE)
+  mrb_tcb *tcb = mrb_task_get_tcb(mrb, self);
+  mrb_tcb_profile profile;
+  mrb_task_disable_irq();
+  profile = tcb->profile;
+  mrb_task_enable_irq();
+
+  mrb_value hash = mrb_hash_new_capa(mrb, 8);
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(ticks)), mrb_fixnum_value(profile.ticks));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(dispatches)), mrb_fixnum_value(profile.dispatches));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(preemptions)), mrb_fixnum_value(profile.preemptions));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(wakeups)), mrb_fixnum_value(profile.wakeups));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(lateness_max)), mrb_fixnum_value(profile.lateness_max));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(lateness_total)), mrb_fixnum_value(profile.lateness_total));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(lateness_avg)),
+               mrb_fixnum_value(profile.wakeups ? profile.lateness_total / profile.wakeups : 0));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(blocked_ticks)), mrb_fixnum_value(profile.blocked_ticks));
+  return hash;
+#else
+  mrb_raise(mrb, E_NOTIMP_ERROR, "Task#stat needs MRB_TASK_PROFILE");
+  return mrb_nil_value();
+#endif
+}
+
+//================================================================
+/*! (method) clear lateness_max of Task#stat. Needs MRB_TASK_PROFILE.
+
+  The other figures are counters and can be compared by difference.
+*/
+static mrb_value
+mrb_task_reset_lateness_max(mrb_state *mrb, mrb_value self)
+{
+#if defined(MRB_TASK_PROFILE)
+  mrb_tcb *tcb = mrb_task_get_tcb(mrb, self);
+  mrb_task_disable_irq();
+  tcb->profile.lateness_max = 0;
+  mrb_task_enable_irq();
+  return self;
+#else
+  mrb_raise(mrb, E_NOTIMP_ERROR, "Task#reset_lateness_max needs MRB_TASK_PROFILE");
+  return mrb_nil_value();
+#endif
+}
+
 static mrb_value
 mrb_task_s_stat(mrb_state *mrb, mrb_value klass)
 {
@@ -896,6 +1164,13 @@ mrb_task_s_stat(mrb_state *mrb, mrb_value klass)
   mrb_hash_set(mrb, data, mrb_symbol_value(MRB_SYM(ready)), mrb_stat_sub(mrb, q_ready_));
   mrb_hash_set(mrb, data, mrb_symbol_value(MRB_SYM(waiting)), mrb_stat_sub(mrb, q_waiting_));
   mrb_hash_set(mrb, data, mrb_symbol_value(MRB_SYM(suspended)), mrb_stat_sub(mrb, q_suspended_));
+#if defined(MRB_TICK_PROFILE)
+  mrb_value profile = mrb_hash_new(mrb);
+  mrb_hash_set(mrb, profile, mrb_symbol_value(MRB_SYM(count)), mrb_fixnum_value(tick_profile_.count));
+  mrb_hash_set(mrb, profile, mrb_symbol_value(MRB_SYM(total_ns)), mrb_fixnum_value(tick_profile_.total_ns));
+  mrb_hash_set(mrb, profile, mrb_symbol_value(MRB_SYM(max_ns)), mrb_fixnum_value(tick_profile_.max_ns));
+  mrb_hash_set(mrb, data, mrb_symbol_value(MRB_SYM(tick_profile)), profile);
+#endif
   mrb_task_enable_irq();
 
   struct RClass *class_Stat = mrb_class_get_under_id(mrb, mrb_class_ptr(klass), MRB_SYM(Stat));
@@ -907,7 +1182,10 @@ mrb_task_s_stat(mrb_state *mrb, mrb_value klass)
 void
 mrb_picoruby_mruby_gem_init(mrb_state* mrb)
 {
+  // before hal_init() starts the tick.
+  mrb->ud = mrb_calloc(mrb, 1, sizeof(mrb_task_scheduler));
   hal_init(mrb);
+  mrb_gc_pacer_init(mrb);
 
   // initialize task queue.
   for (int i = 0; i < MRB_NUM_TASK_QUEUE; i++) {
@@ -945,9 +1223,16 @@ mrb_picoruby_mruby_gem_init(mrb_state* mrb)
   mrb_define_method_id(mrb, class_Task, MRB_SYM(resume), mrb_task_resume, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_Task, MRB_SYM(terminate), mrb_task_terminate, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_Task, MRB_SYM(join), mrb_task_join, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Task, MRB_SYM(stat), mrb_task_stat, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Task, MRB_SYM(reset_lateness_max), mrb_task_reset_lateness_max, MRB_ARGS_NONE());
 }
 
 void
 mrb_picoruby_mruby_gem_final(mrb_state* mrb)
 {
+  mrb_task_disable_irq();
+  mrb_task_scheduler *sched = MRB_TASK_SCHEDULER(mrb);
+  mrb->ud = NULL;
+  mrb_task_enable_irq();
+  mrb_free(mrb, sched);
 }
@@ -0,0 +1,40 @@
+# Requests/sec of Net::HTTPClient with and without keep-alive, against
+# the lwIP loopback server. Needs a POSIX build (PICORB_NET_LOOPIF).
+#
+#   bin/picoruby mrbgems/picoruby-net/example/http_bench.rb
+
+PORT = 8080
+REQUESTS = 200
+
+Net._start_loopback_server(PORT)
+
+def bench(label, keep_alive, path)
+  client = Net::HTTPClient.new("127.0.0.1", PORT)
+  client.keep_alive = keep_alive
+  bytes = 0
+  started = Time.now.to_f
+  i = 0
+  while i < REQUESTS
+    res = client.get(path)
+    raise "request failed" if res.nil? || res[:status] != 200
+    bytes += res[:body].size
+    i += 1
+  end
+  elapsed = Time.now.to_f - started
+  Net::HTTPConnectionPool.clear
+  puts label
+  puts "  body bytes:   #{bytes}"
+  puts "  requests/sec: #{elapsed == 0 ? '-' : (REQUESTS / elapsed).to_i}"
+end
+
+bench("Connection: close, Content-Length", false, "/64")
+bench("keep-alive, Content-Length", true, "/64")
+bench("keep-alive, chunked", true, "/chunked/4096")
+
+# The body can also be consumed as it arrives
+received = 0
+Net::HTTPClient.new("127.0.0.1", PORT).get("/chunked/1048576") do |piece|
+  received += piece.size
+end
+puts "streamed: #{received} bytes"
+Net::HTTPConnectionPool.clear
@@ -0,0 +1,39 @@
+# Request latency and streaming throughput of Net::TCPClient against the
+# lwIP loopback interface. Needs a POSIX build (PICORB_NET_LOOPIF).
+#
+#   bin/picoruby mrbgems/picoruby-net/example/loopback_bench.rb
+
+PORT = 8080
+REQUESTS = 200
+LARGE_SIZE = 1024 * 1024
+
+Net._start_loopback_server(PORT)
+
+def get(path)
+  "GET #{path} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n"
+end
+
+# Latency: one small request per connection
+started = Time.now.to_f
+i = 0
+while i < REQUESTS
+  res = Net::TCPClient.request("127.0.0.1", PORT, get("/16"), false)
+  raise "request failed" if res.nil?
+  i += 1
+end
+elapsed = Time.now.to_f - started
+puts "small requests: #{REQUESTS}"
+puts "  average latency: #{(elapsed * 1000000 / REQUESTS).to_i} us"
+
+# Throughput: a large body delivered chunk by chunk
+received = 0
+chunks = 0
+started = Time.now.to_f
+Net::TCPClient.request("127.0.0.1", PORT, get("/#{LARGE_SIZE}"), false) do |chunk|
+  received += chunk.size
+  chunks += 1
+end
+elapsed = Time.now.to_f - started
+puts "large response: #{received} bytes in #{chunks} chunks"
+puts "  elapsed: #{(elapsed * 1000).to_i} ms"
+puts "  KB/s:    #{elapsed == 0 ? '-' : (received / elapsed / 1024).to_i}"
@@ -37,14 +37,80 @@ typedef struct {
   size_t recv_data_len;
 } net_response_t;
 
+/* state values for TCP connection */
+#define NET_TCP_STATE_NONE               0
+#define NET_TCP_STATE_CONNECTION_STARTED 1
+#define NET_TCP_STATE_CONNECTED          2
+#define NET_TCP_STATE_FINISHED           6  /* peer closed, queued data may remain */
+#define NET_TCP_STATE_ERROR              99
+#define NET_TCP_STATE_TIMEOUT            100
+
+/* what TCPClient_wait_step() waits for */
+#define NET_TCP_WAIT_CONNECT  0
+#define NET_TCP_WAIT_READ     1
+#define NET_TCP_WAIT_WRITE    2
+
+#define NET_TCP_DEFAULT_TIMEOUT_MS 20000
+
+typedef struct tcp_connection_state_str tcp_connection_state;
+
+/* TLS sessions kept for resumption, keyed by host and port */
+#define NET_TLS_SESSION_CACHE_SIZE 4
+#define NET_TLS_SESSION_HOST_MAX   64
+
+/* state values for net_http_parser */
+#define NET_HTTP_STATE_HEAD              0
+#define NET_HTTP_STATE_BODY_LENGTH       1
+#define NET_HTTP_STATE_BODY_UNTIL_CLOSE  2
+#define NET_HTTP_STATE_CHUNK_SIZE        3
+#define NET_HTTP_STATE_CHUNK_DATA        4
+#define NET_HTTP_STATE_CHUNK_DATA_END    5
+#define NET_HTTP_STATE_TRAILER           6
+#define NET_HTTP_STATE_DONE              7
+#define NET_HTTP_STATE_ERROR             99
+
+#define NET_HTTP_HEAD_MAX  8192  /* status line and headers */
+#define NET_HTTP_LINE_MAX  32    /* chunk-size line */
+
+typedef struct {
+  int state;
+  int status;           /* 0 until the head is complete */
+  bool head_request;    /* response to HEAD has no body */
+  bool keep_alive;
+  size_t remaining;     /* body or chunk bytes left */
+  char *head;           /* status line and headers */
+  size_t head_len;
+  size_t head_capa;
+  char line[NET_HTTP_LINE_MAX];
+  uint8_t line_len;
+} net_http_parser;
+
 void DNS_resolve(const char *name, bool is_tcp, char *outbuf, size_t outlen);
-bool TCPClient_send(mrb_state *mrb, const net_request_t *req, net_response_t *res);
 bool UDPClient_send(mrb_state *mrb, const net_request_t *req, net_response_t *res);
 
+tcp_connection_state *TCPClient_connect(mrb_state *mrb, const char *host, int port, bool is_tls);
+bool TCPClient_wait_step(tcp_connection_state *cs, int what);
+int TCPClient_state(tcp_connection_state *cs);
+void TCPClient_set_timeout(tcp_connection_state *cs, uint32_t timeout_ms);
+int TCPClient_write(tcp_connection_state *cs, const char *data, size_t len);
+size_t TCPClient_available(tcp_connection_state *cs);
+size_t TCPClient_read(tcp_connection_state *cs, char *buf, size_t len);
+err_t TCPClient_close(tcp_connection_state *cs);
+
+void NetHTTP_parser_init(net_http_parser *p, bool head_request);
+void NetHTTP_parser_free(mrb_state *mrb, net_http_parser *p);
+size_t NetHTTP_parser_feed(mrb_state *mrb, net_http_parser *p, const char *data, size_t len, char *out, size_t *out_len);
+void NetHTTP_parser_finish(net_http_parser *p);
+bool NetHTTP_parser_next_header(const net_http_parser *p, size_t *pos, const char **name, size_t *name_len, const char **value, size_t *value_len);
+
 void lwip_begin(void);
 void lwip_end(void);
+void Net_poll(void);
 void Net_sleep_ms(int);
 err_t Net_get_ip(const char *name, ip_addr_t *ip);
+#if defined(PICORB_NET_LOOPIF)
+err_t Net_loopback_server_start(int port);
+#endif
 
 #ifdef __cplusplus
 }
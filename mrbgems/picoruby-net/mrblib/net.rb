@@ -1,39 +1,17 @@
 module Net
   class HTTPUtil
     def self.format_response(raw_response)
-      if raw_response.is_a?(String)
-        lines = raw_response.split("\r\n")
-        line_number = 0
-        status = 0
-        headers = {}
-        body = ""
-        body_started = false
-        while(true)
-          if lines[line_number] == nil
-            break
-          elsif line_number == 0
-            status = lines[0].split(' ')[1].to_i
-          elsif body_started == false
-            if lines[line_number].length == 0
-              body_started = true
-            else
-              fields = lines[line_number].split(':')
-              headers[fields[0]] = fields[1]&.strip
-            end
-          else
-            body += lines[line_number]
-            body += "\r\n" unless lines[line_number + 1].nil?
-          end
-          line_number += 1
-        end
-        return {
-          status: status,
-          headers: headers,
-          body: body
-        }
-      else
-        return nil
-      end
+      return nil unless raw_response.is_a?(String)
+      parser = HTTPParser.new
+      body = parser.feed(raw_response)
+      parser.finish unless parser.done?
+      return {
+        status: parser.status,
+        headers: parser.headers,
+        body: body
+      }
+    rescue IOError
+      nil
     end
   end
 
@@ -47,32 +25,177 @@ module Net
     end
   end
 
+  # A TCP (or TLS) connection driven by lwIP callbacks.
+  # Waiting never blocks other tasks: each wait step polls lwIP once and
+  # sleeps POLL_INTERVAL_MS until the callback state says it can proceed.
+  # Received data is handed over as it arrives instead of being
+  # accumulated until the peer closes.
   class TCPClient
-    def self.request(host, port, content, is_tls)
-      # ip = DNS.resolve(host, true)
-      _request_impl(host, port, content, is_tls)
+    WAIT_CONNECT = 0
+    WAIT_READ = 1
+    WAIT_WRITE = 2
+
+    STATE_CONNECTED = 2
+    STATE_FINISHED = 6
+    STATE_ERROR = 99
+    STATE_TIMEOUT = 100
+
+    POLL_INTERVAL_MS = 1
+
+    def self.open(host, port, is_tls = false, &block)
+      client = _open(host, port, is_tls)
+      begin
+        client._wait(WAIT_CONNECT)
+      rescue IOError => e
+        client.close
+        raise e
+      end
+      return client unless block
+      begin
+        block.call(client)
+      ensure
+        client.close
+      end
+    end
+
+    # Returns the whole response, or nil on failure.
+    # With a block, yields each chunk as it arrives and returns true.
+    def self.request(host, port, content, is_tls, &block)
+      client = open(host, port, is_tls)
+      begin
+        client.write(content)
+        if block
+          client.each_chunk(&block)
+          true
+        else
+          client.read
+        end
+      ensure
+        client.close
+      end
+    rescue IOError
+      nil
+    end
+
+    def write(data)
+      offset = 0
+      while offset = _write(data, offset)
+        _wait(WAIT_WRITE)
+      end
+      nil
+    end
+
+    # Returns what has arrived so far (at most maxlen bytes if given),
+    # waiting for at least one byte. Returns nil at EOF.
+    def read_chunk(maxlen = nil)
+      _wait(WAIT_READ)
+      _read(maxlen)
+    end
+
+    def each_chunk(maxlen = nil, &block)
+      while chunk = read_chunk(maxlen)
+        block.call(chunk)
+      end
+      self
+    end
+
+    # Reads until the peer closes the connection
+    def read
+      result = ""
+      while chunk = read_chunk
+        result << chunk
+      end
+      result
+    end
+
+    # True if the peer has not closed the connection (doesn't wait)
+    def alive?
+      return false if closed?
+      _wait_step(WAIT_CONNECT)
+      _state == STATE_CONNECTED
+    end
+
+    def _wait(what)
+      until _wait_step(what)
+        sleep_ms POLL_INTERVAL_MS
+      end
+      case _state
+      when STATE_ERROR
+        raise IOError, "connection error"
+      when STATE_TIMEOUT
+        raise IOError, "connection timed out"
+      end
+    end
+  end
+
+  # Idle keep-alive connections, shared by all HTTP clients
+  class HTTPConnectionPool
+    MAX_IDLE = 4
+    IDLE_TIMEOUT_SEC = 10
+    IDLE = [] # [[key, client, released_at], ...]
+
+    def self.checkout(host, port, is_tls)
+      key = "#{host}:#{port}:#{is_tls}"
+      now = Time.now.to_i
+      found = nil
+      i = 0
+      while i < IDLE.size
+        entry = IDLE[i]
+        if found.nil? && entry[0] == key && now - entry[2] < IDLE_TIMEOUT_SEC
+          IDLE.delete_at(i)
+          if entry[1].alive?
+            found = entry[1]
+          else
+            entry[1].close
+          end
+        elsif IDLE_TIMEOUT_SEC <= now - entry[2]
+          IDLE.delete_at(i)
+          entry[1].close
+        else
+          i += 1
+        end
+      end
+      found
+    end
+
+    def self.checkin(host, port, is_tls, client)
+      IDLE.shift[1].close if MAX_IDLE <= IDLE.size
+      IDLE << ["#{host}:#{port}:#{is_tls}", client, Time.now.to_i]
+    end
+
+    def self.clear
+      IDLE.each { |entry| entry[1].close }
+      IDLE.clear
     end
   end
 
   class HTTPClientBase
-    def initialize(host)
+    IDEMPOTENT_METHODS = ["GET", "HEAD"]
+
+    attr_accessor :keep_alive
+
+    def initialize(host, port = nil)
       @host = host
+      @port = port
+      @keep_alive = true
     end
 
-    def get(path)
-      make_request("GET", path)
+    # With a block, the body is yielded in pieces as it arrives
+    # and the returned Hash has no :body
+    def get(path, &block)
+      make_request("GET", path, {}, nil, &block)
     end
 
-    def get_with_headers(path, headers)
-      make_request("GET", path, headers)
+    def get_with_headers(path, headers, &block)
+      make_request("GET", path, headers, nil, &block)
     end
 
-    def post(path, headers, body)
-      make_request("POST", path, headers, body)
+    def post(path, headers, body, &block)
+      make_request("POST", path, headers, body, &block)
     end
 
-    def put(path, headers, body)
-      make_request("PUT", path, headers, body)
+    def put(path, headers, body, &block)
+      make_request("PUT", path, headers, body, &block)
     end
 
     private
@@ -81,7 +204,7 @@ module Net
       req = "#{method} #{path} HTTP/1.1\r\n"
       req += "Host: #{@host}\r\n"
 
-      unless headers.keys.any?{|k| k.downcase == "connection" }
+      unless @keep_alive || headers.keys.any?{|k| k.downcase == "connection" }
         req += "Connection: close\r\n"
       end
 
@@ -95,10 +218,61 @@ module Net
       req
     end
 
-    def make_request(method, path, headers = {}, body = nil)
+    def make_request(method, path, headers = {}, body = nil, &block)
       request = build_request(method, path, headers, body)
-      response = TCPClient.request(@host, port, request, use_tls)
-      Net::HTTPUtil.format_response(response)
+      client = HTTPConnectionPool.checkout(@host, port, use_tls) if @keep_alive
+      if client
+        response = exchange(client, request, method == "HEAD", true, &block)
+        # The server may have dropped the idle connection in the meantime.
+        # Only a request without side effects is sent again: the server
+        # may have applied a POST or PUT before the connection broke.
+        return response unless response == :stale
+        return nil unless IDEMPOTENT_METHODS.include?(method)
+      end
+      client = TCPClient.open(@host, port, use_tls)
+      exchange(client, request, method == "HEAD", false, &block)
+    rescue IOError
+      nil
+    end
+
+    # The client goes back to the pool or is closed, even if the block
+    # raises
+    def exchange(client, request, head_request, reused, &block)
+      parser = HTTPParser.new(head_request)
+      body = block ? nil : ""
+      received = false
+      checked_in = false
+      begin
+        client.write(request)
+        until parser.done?
+          chunk = client.read_chunk
+          if chunk.nil?
+            return :stale if reused && !received
+            parser.finish
+            break
+          end
+          received = true
+          piece = parser.feed(chunk)
+          next if piece.empty?
+          if block
+            block.call(piece)
+          else
+            body << piece
+          end
+        end
+      rescue IOError => e
+        return :stale if reused && !received
+        raise e
+      end
+      if @keep_alive && parser.keep_alive?
+        HTTPConnectionPool.checkin(@host, port, use_tls, client)
+        checked_in = true
+      end
+      response = { status: parser.status, headers: parser.headers }
+      response[:body] = body if body
+      response
+    ensure
+      client.close unless checked_in
     end
 
     def port
@@ -115,7 +289,7 @@ module Net
     private
 
     def port
-      80
+      @port || 80
     end
 
     def use_tls
@@ -127,7 +301,7 @@ module Net
     private
 
     def port
-      443
+      @port || 443
     end
 
     def use_tls
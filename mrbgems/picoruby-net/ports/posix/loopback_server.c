@@ -0,0 +1,193 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "../../include/net.h"
+#include "lwip/tcp.h"
+
+/*
+ * Minimal HTTP responder on the lwIP loopback interface, used by
+ * the examples. `GET /<n> ...` is answered with n bytes of body, and
+ * `GET /chunked/<n> ...` sends them with chunked transfer encoding.
+ * Keep-alive is honored unless the request says `Connection: close`.
+ */
+
+#define LOOPBACK_HEADER_MAX 128
+
+typedef struct {
+  struct tcp_pcb *pcb;
+  size_t remaining;     /* body bytes still to be queued */
+  bool chunked;
+  bool last_chunk_queued;
+  bool close_after;
+  char request[256];
+  u16_t request_len;
+} loopback_conn;
+
+static const char loopback_body[512] =
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+  "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde";
+
+static void
+loopback_close(loopback_conn *conn)
+{
+  tcp_arg(conn->pcb, NULL);
+  tcp_recv(conn->pcb, NULL);
+  tcp_sent(conn->pcb, NULL);
+  tcp_err(conn->pcb, NULL);
+  if (tcp_close(conn->pcb) != ERR_OK) {
+    tcp_abort(conn->pcb);
+  }
+  free(conn);
+}
+
+#define LOOPBACK_CHUNK_OVERHEAD 16  /* size line and CRLF around a chunk */
+
+/* Queues as much of the body as the send buffer allows */
+static void
+loopback_push(loopback_conn *conn)
+{
+  while (0 < conn->remaining) {
+    u16_t len = tcp_sndbuf(conn->pcb);
+    if (conn->chunked) {
+      if (len <= LOOPBACK_CHUNK_OVERHEAD) break;
+      len -= LOOPBACK_CHUNK_OVERHEAD;
+    }
+    if (len == 0) break;
+    if (sizeof(loopback_body) < len) len = sizeof(loopback_body);
+    if (conn->remaining < len) len = (u16_t)conn->remaining;
+    if (conn->chunked) {
+      char size_line[12];
+      int n = snprintf(size_line, sizeof(size_line), "%x\r\n", len);
+      tcp_write(conn->pcb, size_line, (u16_t)n, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+    }
+    if (tcp_write(conn->pcb, loopback_body, len, 0) != ERR_OK) break;
+    if (conn->chunked) {
+      tcp_write(conn->pcb, "\r\n", 2, 0);
+    }
+    conn->remaining -= len;
+  }
+  if (conn->chunked && conn->remaining == 0 && !conn->last_chunk_queued &&
+      5 <= tcp_sndbuf(conn->pcb)) {
+    tcp_write(conn->pcb, "0\r\n\r\n", 5, 0);
+    conn->last_chunk_queued = true;
+  }
+  tcp_output(conn->pcb);
+}
+
+static bool
+loopback_done(loopback_conn *conn)
+{
+  return conn->remaining == 0 && (!conn->chunked || conn->last_chunk_queued);
+}
+
+static void
+loopback_respond(loopback_conn *conn)
+{
+  char header[LOOPBACK_HEADER_MAX];
+  char length[32];
+  const char *path = strchr(conn->request, '/');
+  conn->chunked = (path && strncmp(path, "/chunked/", 9) == 0);
+  if (conn->chunked) path += 8;
+  size_t size = path ? strtoul(path + 1, NULL, 10) : 0;
+  conn->last_chunk_queued = false;
+  conn->close_after = (strstr(conn->request, "Connection: close") != NULL);
+  if (conn->chunked) {
+    strcpy(length, "Transfer-Encoding: chunked");
+  } else {
+    snprintf(length, sizeof(length), "Content-Length: %lu", (unsigned long)size);
+  }
+  int n = snprintf(header, sizeof(header),
+                   "HTTP/1.1 200 OK\r\n%s\r\n%s\r\n",
+                   length,
+                   conn->close_after ? "Connection: close\r\n" : "");
+  tcp_write(conn->pcb, header, (u16_t)n, TCP_WRITE_FLAG_COPY);
+  conn->remaining = size;
+  conn->request_len = 0;
+  loopback_push(conn);
+}
+
+static err_t
+loopback_sent_cb(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  loopback_conn *conn = (loopback_conn *)arg;
+  loopback_push(conn);
+  if (loopback_done(conn) && conn->close_after && tcp_sndqueuelen(pcb) == 0) {
+    loopback_close(conn);
+  }
+  return ERR_OK;
+}
+
+static err_t
+loopback_recv_cb(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  loopback_conn *conn = (loopback_conn *)arg;
+  if (p == NULL) {
+    loopback_close(conn);
+    return ERR_OK;
+  }
+  u16_t room = (u16_t)(sizeof(conn->request) - 1 - conn->request_len);
+  u16_t len = (p->tot_len < room) ? p->tot_len : room;
+  pbuf_copy_partial(p, conn->request + conn->request_len, len, 0);
+  conn->request_len += len;
+  conn->request[conn->request_len] = '\0';
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  if (strstr(conn->request, "\r\n\r\n")) {
+    loopback_respond(conn);
+  }
+  return ERR_OK;
+}
+
+static void
+loopback_err_cb(void *arg, err_t err)
+{
+  free(arg);
+}
+
+static err_t
+loopback_accept_cb(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  if (err != ERR_OK || pcb == NULL) return ERR_VAL;
+  loopback_conn *conn = (loopback_conn *)calloc(1, sizeof(loopback_conn));
+  if (conn == NULL) return ERR_MEM;
+  conn->pcb = pcb;
+  tcp_arg(pcb, conn);
+  tcp_recv(pcb, loopback_recv_cb);
+  tcp_sent(pcb, loopback_sent_cb);
+  tcp_err(pcb, loopback_err_cb);
+  return ERR_OK;
+}
+
+err_t
+Net_loopback_server_start(int port)
+{
+  err_t err = ERR_OK;
+  lwip_begin();
+  struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+  if (pcb == NULL) {
+    err = ERR_MEM;
+    goto out;
+  }
+  err = tcp_bind(pcb, IP4_ADDR_ANY, (u16_t)port);
+  if (err != ERR_OK) {
+    tcp_close(pcb);
+    goto out;
+  }
+  struct tcp_pcb *listener = tcp_listen(pcb);
+  if (listener == NULL) {
+    tcp_close(pcb);
+    err = ERR_MEM;
+    goto out;
+  }
+  tcp_accept(listener, loopback_accept_cb);
+out:
+  lwip_end();
+  return err;
+}
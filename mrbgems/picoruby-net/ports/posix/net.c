@@ -5,18 +5,42 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <stdbool.h>
 
+#include "../../include/net.h"
+#include "lwip/init.h"
+#include "lwip/netif.h"
+#include "lwip/timeouts.h"
+
+/*
+ * There is no network driver on POSIX. lwIP runs in NO_SYS mode with only
+ * the loopback interface (127.0.0.1), which is enough to exercise the
+ * TCP client against Net_loopback_server_start().
+ */
+static bool lwip_initialized = false;
 
 void
-Net_sleep_ms(int ms)
+lwip_begin(void)
 {
-  usleep(ms * 1000);
+  if (!lwip_initialized) {
+    lwip_initialized = true;
+    lwip_init();
+  }
 }
 
 void
-lwip_begin(void)
+Net_poll(void)
 {
-  // no-op
+  lwip_begin();
+  netif_poll_all();
+  sys_check_timeouts();
+}
+
+void
+Net_sleep_ms(int ms)
+{
+  Net_poll();
+  usleep(ms * 1000);
 }
 
 void
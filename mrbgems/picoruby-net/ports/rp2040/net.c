@@ -1,6 +1,12 @@
 #include "pico/stdlib.h"
 #include "pico/cyw43_arch.h"
 
+void
+Net_poll(void)
+{
+  cyw43_arch_poll();
+}
+
 void
 Net_sleep_ms(int ms)
 {
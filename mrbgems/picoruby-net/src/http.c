@@ -0,0 +1,305 @@
+#include "../include/net.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * Incremental HTTP/1.1 response parser
+ *
+ * Feed it whatever the connection returns. The body comes out with the
+ * Content-Length or chunked framing removed. Decoding never makes data
+ * longer, so an output buffer as large as the input is always enough.
+ */
+
+static char
+lower(char c)
+{
+  return ('A' <= c && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static bool
+token_eq(const char *s, size_t len, const char *lit)
+{
+  size_t n = strlen(lit);
+  if (len != n) return false;
+  for (size_t i = 0; i < n; i++) {
+    if (lower(s[i]) != lit[i]) return false;
+  }
+  return true;
+}
+
+/* Whether the comma-separated list in s contains lit (case-insensitive) */
+static bool
+list_has(const char *s, size_t len, const char *lit)
+{
+  size_t i = 0;
+  while (i < len) {
+    while (i < len && (s[i] == ' ' || s[i] == '\t' || s[i] == ',')) i++;
+    size_t start = i;
+    while (i < len && s[i] != ',') i++;
+    size_t end = i;
+    while (start < end && (s[end - 1] == ' ' || s[end - 1] == '\t')) end--;
+    if (token_eq(s + start, end - start, lit)) return true;
+  }
+  return false;
+}
+
+void
+NetHTTP_parser_init(net_http_parser *p, bool head_request)
+{
+  memset(p, 0, sizeof(net_http_parser));
+  p->state = NET_HTTP_STATE_HEAD;
+  p->head_request = head_request;
+}
+
+void
+NetHTTP_parser_free(mrb_state *mrb, net_http_parser *p)
+{
+  if (p->head) {
+    picorb_free(mrb, p->head);
+    p->head = NULL;
+  }
+  p->head_len = p->head_capa = 0;
+}
+
+/*
+ * Iterates header lines of a complete head. Start with *pos = 0.
+ * Lines without a colon are skipped.
+ */
+bool
+NetHTTP_parser_next_header(const net_http_parser *p, size_t *pos,
+                           const char **name, size_t *name_len,
+                           const char **value, size_t *value_len)
+{
+  if (p->status == 0) return false;
+  const char *head = p->head;
+  size_t i = *pos;
+  if (i == 0) {
+    /* skip the status line */
+    while (i < p->head_len && head[i] != '\n') i++;
+    i++;
+  }
+  while (i < p->head_len) {
+    size_t start = i;
+    while (i < p->head_len && head[i] != '\n') i++;
+    size_t end = i++;
+    if (start < end && head[end - 1] == '\r') end--;
+    if (start == end) break; /* blank line ends the head */
+    const char *colon = memchr(head + start, ':', end - start);
+    if (colon == NULL) continue;
+    size_t v = colon - head + 1;
+    while (v < end && (head[v] == ' ' || head[v] == '\t')) v++;
+    size_t v_end = end;
+    while (v < v_end && (head[v_end - 1] == ' ' || head[v_end - 1] == '\t')) v_end--;
+    *name = head + start;
+    *name_len = colon - (head + start);
+    *value = head + v;
+    *value_len = v_end - v;
+    *pos = i;
+    return true;
+  }
+  *pos = p->head_len;
+  return false;
+}
+
+/* Reads the status line and the framing headers, then picks the body state */
+static void
+parse_head(net_http_parser *p)
+{
+  const char *head = p->head;
+  if (p->head_len < 12 || memcmp(head, "HTTP/1.", 7) != 0) {
+    p->state = NET_HTTP_STATE_ERROR;
+    return;
+  }
+  int status = atoi(head + 9);
+  if (status < 100 || 999 < status) {
+    p->state = NET_HTTP_STATE_ERROR;
+    return;
+  }
+  p->status = status;
+  p->keep_alive = (head[7] == '1');
+
+  bool chunked = false;
+  bool has_length = false;
+  size_t length = 0;
+  size_t pos = 0;
+  const char *name, *value;
+  size_t name_len, value_len;
+  while (NetHTTP_parser_next_header(p, &pos, &name, &name_len, &value, &value_len)) {
+    if (token_eq(name, name_len, "content-length")) {
+      has_length = true;
+      length = (size_t)strtoul(value, NULL, 10);
+    } else if (token_eq(name, name_len, "transfer-encoding")) {
+      chunked = list_has(value, value_len, "chunked");
+    } else if (token_eq(name, name_len, "connection")) {
+      if (list_has(value, value_len, "close")) {
+        p->keep_alive = false;
+      } else if (list_has(value, value_len, "keep-alive")) {
+        p->keep_alive = true;
+      }
+    }
+  }
+
+  if (p->head_request || status < 200 || status == 204 || status == 304) {
+    p->state = NET_HTTP_STATE_DONE;
+  } else if (chunked) {
+    p->state = NET_HTTP_STATE_CHUNK_SIZE;
+    p->line_len = 0;
+  } else if (has_length) {
+    p->remaining = length;
+    p->state = (length == 0) ? NET_HTTP_STATE_DONE : NET_HTTP_STATE_BODY_LENGTH;
+  } else {
+    p->state = NET_HTTP_STATE_BODY_UNTIL_CLOSE;
+    p->keep_alive = false;
+  }
+}
+
+/* Collects the head. Returns how many bytes of data belong to it */
+static size_t
+feed_head(mrb_state *mrb, net_http_parser *p, const char *data, size_t len)
+{
+  size_t old_len = p->head_len;
+  size_t n = len;
+  if (NET_HTTP_HEAD_MAX - old_len < n) n = NET_HTTP_HEAD_MAX - old_len;
+  if (p->head_capa < old_len + n) {
+    size_t capa = p->head_capa ? p->head_capa : 256;
+    while (capa < old_len + n) capa *= 2;
+    if (NET_HTTP_HEAD_MAX < capa) capa = NET_HTTP_HEAD_MAX;
+    char *head = (char *)picorb_realloc(mrb, p->head, capa);
+    if (head == NULL) {
+      p->state = NET_HTTP_STATE_ERROR;
+      return len;
+    }
+    p->head = head;
+    p->head_capa = capa;
+  }
+  memcpy(p->head + old_len, data, n);
+  p->head_len = old_len + n;
+
+  /* the terminator may straddle the previous feed */
+  size_t i = (3 < old_len) ? old_len - 3 : 0;
+  for (; i + 3 < p->head_len; i++) {
+    if (memcmp(p->head + i, "\r\n\r\n", 4) == 0) {
+      p->head_len = i + 4;
+      parse_head(p);
+      if (p->state != NET_HTTP_STATE_ERROR && p->status < 200 && p->status != 101) {
+        /* interim response such as 100 Continue: wait for the real one */
+        p->head_len = 0;
+        p->status = 0;
+        p->state = NET_HTTP_STATE_HEAD;
+      }
+      return i + 4 - old_len;
+    }
+  }
+  if (p->head_len == NET_HTTP_HEAD_MAX) {
+    p->state = NET_HTTP_STATE_ERROR;
+  }
+  return n;
+}
+
+/* Handles one line of chunk framing. Returns false on a protocol error */
+static bool
+chunk_line(net_http_parser *p)
+{
+  size_t len = p->line_len;
+  if (0 < len && p->line[len - 1] == '\r') len--;
+  p->line_len = 0;
+  if (p->state == NET_HTTP_STATE_TRAILER) {
+    if (len == 0) p->state = NET_HTTP_STATE_DONE;
+    return true;
+  }
+  p->line[len] = '\0';
+  char *end;
+  unsigned long size = strtoul(p->line, &end, 16);
+  if (end == p->line || (*end != '\0' && *end != ';' && *end != ' ' && *end != '\t')) {
+    return false;
+  }
+  if (size == 0) {
+    p->state = NET_HTTP_STATE_TRAILER;
+  } else {
+    p->remaining = (size_t)size;
+    p->state = NET_HTTP_STATE_CHUNK_DATA;
+  }
+  return true;
+}
+
+/*
+ * Feeds len bytes and writes the decoded body bytes to out (which needs
+ * room for len bytes), setting *out_len.
+ * Returns the number of bytes consumed. It is less than len only when
+ * the response ended before the data did.
+ */
+size_t
+NetHTTP_parser_feed(mrb_state *mrb, net_http_parser *p, const char *data, size_t len, char *out, size_t *out_len)
+{
+  size_t i = 0;
+  size_t olen = 0;
+  while (i < len) {
+    size_t n;
+    char c;
+    switch (p->state) {
+      case NET_HTTP_STATE_HEAD:
+        i += feed_head(mrb, p, data + i, len - i);
+        break;
+      case NET_HTTP_STATE_BODY_LENGTH:
+      case NET_HTTP_STATE_CHUNK_DATA:
+        n = len - i;
+        if (p->remaining < n) n = p->remaining;
+        memcpy(out + olen, data + i, n);
+        olen += n;
+        i += n;
+        p->remaining -= n;
+        if (p->remaining == 0) {
+          p->state = (p->state == NET_HTTP_STATE_BODY_LENGTH) ? NET_HTTP_STATE_DONE : NET_HTTP_STATE_CHUNK_DATA_END;
+        }
+        break;
+      case NET_HTTP_STATE_BODY_UNTIL_CLOSE:
+        n = len - i;
+        memcpy(out + olen, data + i, n);
+        olen += n;
+        i += n;
+        break;
+      case NET_HTTP_STATE_CHUNK_DATA_END:
+        c = data[i++];
+        if (c == '\n') {
+          p->state = NET_HTTP_STATE_CHUNK_SIZE;
+        } else if (c != '\r') {
+          p->state = NET_HTTP_STATE_ERROR;
+        }
+        break;
+      case NET_HTTP_STATE_CHUNK_SIZE:
+      case NET_HTTP_STATE_TRAILER:
+        c = data[i++];
+        if (c == '\n') {
+          if (!chunk_line(p)) p->state = NET_HTTP_STATE_ERROR;
+        } else if (p->line_len < NET_HTTP_LINE_MAX - 1) {
+          p->line[p->line_len++] = c;
+        } else if (p->state == NET_HTTP_STATE_CHUNK_SIZE) {
+          p->state = NET_HTTP_STATE_ERROR;
+        }
+        /* an overlong trailer line is skipped */
+        break;
+      default: /* DONE or ERROR */
+        if (p->state == NET_HTTP_STATE_DONE) {
+          /* bytes after the response: the connection can't be reused */
+          p->keep_alive = false;
+        }
+        *out_len = olen;
+        return i;
+    }
+  }
+  *out_len = olen;
+  return i;
+}
+
+/* Tells the parser that the peer closed the connection */
+void
+NetHTTP_parser_finish(net_http_parser *p)
+{
+  if (p->state == NET_HTTP_STATE_BODY_UNTIL_CLOSE) {
+    p->state = NET_HTTP_STATE_DONE;
+  } else if (p->state != NET_HTTP_STATE_DONE) {
+    p->state = NET_HTTP_STATE_ERROR;
+  }
+  p->keep_alive = false;
+}
@@ -2,6 +2,9 @@
 #include "mruby.h"
 #include "mruby/presym.h"
 #include "mruby/string.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/hash.h"
 
 static mrb_value
 mrb_net_dns_s_resolve(mrb_state *mrb, mrb_value self)
@@ -18,35 +21,251 @@ mrb_net_dns_s_resolve(mrb_state *mrb, mrb_value self)
   }
 }
 
+static struct RClass *IOError;
+
+/*
+ * Net::TCPClient
+ *
+ * The instance holds a tcp_connection_state. Methods here never block;
+ * mrblib/net.rb loops over _wait_step with sleep_ms so that other tasks
+ * keep running while waiting.
+ */
+
+static void
+mrb_net_tcpclient_free(mrb_state *mrb, void *ptr)
+{
+  if (ptr) TCPClient_close((tcp_connection_state *)ptr);
+}
+
+struct mrb_data_type mrb_net_tcpclient_type = {
+  "TCPClient", mrb_net_tcpclient_free,
+};
+
+static tcp_connection_state *
+get_connection(mrb_state *mrb, mrb_value self)
+{
+  tcp_connection_state *cs = (tcp_connection_state *)mrb_data_check_get_ptr(mrb, self, &mrb_net_tcpclient_type);
+  if (cs == NULL) {
+    mrb_raise(mrb, IOError, "closed connection");
+  }
+  return cs;
+}
+
 static mrb_value
-mrb_net_tcpclient_s__request_impl(mrb_state *mrb, mrb_value self)
+mrb_net_tcpclient_s__open(mrb_state *mrb, mrb_value klass)
 {
   const char *host;
   mrb_int port;
+  mrb_bool is_tls;
+  mrb_get_args(mrb, "zib", &host, &port, &is_tls);
+  tcp_connection_state *cs = TCPClient_connect(mrb, host, (int)port, is_tls);
+  if (cs == NULL) {
+    mrb_raisef(mrb, IOError, "failed to connect to %s", host);
+  }
+  return mrb_obj_value(Data_Wrap_Struct(mrb, mrb_class_ptr(klass), &mrb_net_tcpclient_type, cs));
+}
+
+static mrb_value
+mrb_net_tcpclient__wait_step(mrb_state *mrb, mrb_value self)
+{
+  mrb_int what;
+  mrb_get_args(mrb, "i", &what);
+  return mrb_bool_value(TCPClient_wait_step(get_connection(mrb, self), (int)what));
+}
+
+static mrb_value
+mrb_net_tcpclient__state(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(TCPClient_state(get_connection(mrb, self)));
+}
+
+static mrb_value
+mrb_net_tcpclient_timeout_ms_eq(mrb_state *mrb, mrb_value self)
+{
+  mrb_int timeout_ms;
+  mrb_get_args(mrb, "i", &timeout_ms);
+  TCPClient_set_timeout(get_connection(mrb, self), (uint32_t)timeout_ms);
+  return mrb_fixnum_value(timeout_ms);
+}
+
+/* _write(data, offset) -> new offset, or nil when all of data is queued */
+static mrb_value
+mrb_net_tcpclient__write(mrb_state *mrb, mrb_value self)
+{
   mrb_value data;
-  mrb_bool use_dtls;
-  mrb_value ret;
-  mrb_get_args(mrb, "ziob", &host, &port, &data, &use_dtls);
-  net_request_t req = {
-    .host = host,
-    .port = port,
-    .send_data = RSTRING_PTR(data),
-    .send_data_len = RSTRING_LEN(data),
-    .is_tls = use_dtls
-  };
-  net_response_t res = {
-    .recv_data = mrb_calloc(mrb, 1, 1),
-    .recv_data_len = 0
-  };
-  if (TCPClient_send(mrb, &req, &res)) {
-    ret = mrb_str_new(mrb, (const char*)res.recv_data, res.recv_data_len);
-  } else {
-    ret = mrb_nil_value();
+  mrb_int offset = 0;
+  mrb_get_args(mrb, "S|i", &data, &offset);
+  tcp_connection_state *cs = get_connection(mrb, self);
+  if (offset < 0 || RSTRING_LEN(data) < offset) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "offset out of range");
   }
-  mrb_free(mrb, res.recv_data);
-  return ret;
+  int n = TCPClient_write(cs, RSTRING_PTR(data) + offset, RSTRING_LEN(data) - offset);
+  if (n < 0) {
+    mrb_raise(mrb, IOError, "write failed");
+  }
+  if (offset + n == RSTRING_LEN(data)) {
+    return mrb_nil_value();
+  }
+  return mrb_fixnum_value(offset + n);
+}
+
+/* _read(maxlen) -> String of what has arrived, or nil if nothing */
+static mrb_value
+mrb_net_tcpclient__read(mrb_state *mrb, mrb_value self)
+{
+  mrb_int maxlen = 0;
+  mrb_get_args(mrb, "|i", &maxlen);
+  tcp_connection_state *cs = get_connection(mrb, self);
+  size_t len = TCPClient_available(cs);
+  if (0 < maxlen && (size_t)maxlen < len) {
+    len = (size_t)maxlen;
+  }
+  if (len == 0) {
+    return mrb_nil_value();
+  }
+  mrb_value str = mrb_str_new(mrb, NULL, len);
+  TCPClient_read(cs, RSTRING_PTR(str), len);
+  return str;
 }
 
+static mrb_value
+mrb_net_tcpclient_close(mrb_state *mrb, mrb_value self)
+{
+  tcp_connection_state *cs = (tcp_connection_state *)DATA_PTR(self);
+  if (cs) {
+    DATA_PTR(self) = NULL;
+    TCPClient_close(cs);
+  }
+  return mrb_nil_value();
+}
+
+static mrb_value
+mrb_net_tcpclient_closed_p(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(DATA_PTR(self) == NULL);
+}
+
+/*
+ * Net::HTTPParser
+ *
+ * Thin wrapper of the incremental response parser in src/http.c
+ */
+
+static void
+mrb_net_httpparser_free(mrb_state *mrb, void *ptr)
+{
+  if (ptr) {
+    NetHTTP_parser_free(mrb, (net_http_parser *)ptr);
+    mrb_free(mrb, ptr);
+  }
+}
+
+struct mrb_data_type mrb_net_httpparser_type = {
+  "HTTPParser", mrb_net_httpparser_free,
+};
+
+static mrb_value
+mrb_net_httpparser_initialize(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool head_request = FALSE;
+  mrb_get_args(mrb, "|b", &head_request);
+  net_http_parser *p = (net_http_parser *)DATA_PTR(self);
+  if (p) {
+    mrb_net_httpparser_free(mrb, p);
+  }
+  p = (net_http_parser *)mrb_malloc(mrb, sizeof(net_http_parser));
+  NetHTTP_parser_init(p, head_request);
+  DATA_PTR(self) = p;
+  DATA_TYPE(self) = &mrb_net_httpparser_type;
+  return self;
+}
+
+static net_http_parser *
+get_parser(mrb_state *mrb, mrb_value self)
+{
+  return DATA_GET_PTR(mrb, self, &mrb_net_httpparser_type, net_http_parser);
+}
+
+/* feed(data) -> the body bytes found in data, without framing */
+static mrb_value
+mrb_net_httpparser_feed(mrb_state *mrb, mrb_value self)
+{
+  mrb_value data;
+  mrb_get_args(mrb, "S", &data);
+  net_http_parser *p = get_parser(mrb, self);
+  mrb_value body = mrb_str_new(mrb, NULL, RSTRING_LEN(data));
+  size_t len;
+  NetHTTP_parser_feed(mrb, p, RSTRING_PTR(data), RSTRING_LEN(data), RSTRING_PTR(body), &len);
+  if (p->state == NET_HTTP_STATE_ERROR) {
+    mrb_raise(mrb, IOError, "malformed HTTP response");
+  }
+  return mrb_str_resize(mrb, body, (mrb_int)len);
+}
+
+/* Call when the peer has closed the connection */
+static mrb_value
+mrb_net_httpparser_finish(mrb_state *mrb, mrb_value self)
+{
+  net_http_parser *p = get_parser(mrb, self);
+  NetHTTP_parser_finish(p);
+  if (p->state == NET_HTTP_STATE_ERROR) {
+    mrb_raise(mrb, IOError, "incomplete HTTP response");
+  }
+  return mrb_nil_value();
+}
+
+static mrb_value
+mrb_net_httpparser_status(mrb_state *mrb, mrb_value self)
+{
+  net_http_parser *p = get_parser(mrb, self);
+  return p->status ? mrb_fixnum_value(p->status) : mrb_nil_value();
+}
+
+static mrb_value
+mrb_net_httpparser_headers(mrb_state *mrb, mrb_value self)
+{
+  net_http_parser *p = get_parser(mrb, self);
+  if (p->status == 0) {
+    return mrb_nil_value();
+  }
+  mrb_value headers = mrb_hash_new(mrb);
+  size_t pos = 0;
+  const char *name, *value;
+  size_t name_len, value_len;
+  while (NetHTTP_parser_next_header(p, &pos, &name, &name_len, &value, &value_len)) {
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_hash_set(mrb, headers, mrb_str_new(mrb, name, name_len), mrb_str_new(mrb, value, value_len));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return headers;
+}
+
+static mrb_value
+mrb_net_httpparser_done_p(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(get_parser(mrb, self)->state == NET_HTTP_STATE_DONE);
+}
+
+static mrb_value
+mrb_net_httpparser_keep_alive_p(mrb_state *mrb, mrb_value self)
+{
+  net_http_parser *p = get_parser(mrb, self);
+  return mrb_bool_value(p->state == NET_HTTP_STATE_DONE && p->keep_alive);
+}
+
+#if defined(PICORB_NET_LOOPIF)
+static mrb_value
+mrb_net_s__start_loopback_server(mrb_state *mrb, mrb_value self)
+{
+  mrb_int port;
+  mrb_get_args(mrb, "i", &port);
+  if (Net_loopback_server_start((int)port) != ERR_OK) {
+    mrb_raise(mrb, IOError, "failed to start loopback server");
+  }
+  return mrb_nil_value();
+}
+#endif
+
 static mrb_value
 mrb_net_udpclient_s__send_impl(mrb_state *mrb, mrb_value self)
 {
@@ -79,13 +298,35 @@ mrb_net_udpclient_s__send_impl(mrb_state *mrb, mrb_value self)
 void
 mrb_picoruby_net_gem_init(mrb_state* mrb)
 {
+  IOError = mrb_exc_get_id(mrb, MRB_SYM(IOError));
   struct RClass *module_Net = mrb_define_module_id(mrb, MRB_SYM(Net));
 
   struct RClass *class_Net_DNS = mrb_define_class_under_id(mrb, module_Net, MRB_SYM(DNS), mrb->object_class);
   mrb_define_class_method_id(mrb, class_Net_DNS, MRB_SYM(resolve), mrb_net_dns_s_resolve, MRB_ARGS_REQ(2));
 
   struct RClass *class_Net_TCPClient = mrb_define_class_under_id(mrb, module_Net, MRB_SYM(TCPClient), mrb->object_class);
-  mrb_define_class_method_id(mrb, class_Net_TCPClient, MRB_SYM(_request_impl), mrb_net_tcpclient_s__request_impl, MRB_ARGS_REQ(4));
+  MRB_SET_INSTANCE_TT(class_Net_TCPClient, MRB_TT_CDATA);
+  mrb_define_class_method_id(mrb, class_Net_TCPClient, MRB_SYM(_open), mrb_net_tcpclient_s__open, MRB_ARGS_REQ(3));
+  mrb_define_method_id(mrb, class_Net_TCPClient, MRB_SYM(_wait_step), mrb_net_tcpclient__wait_step, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, class_Net_TCPClient, MRB_SYM(_state), mrb_net_tcpclient__state, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Net_TCPClient, MRB_SYM(_write), mrb_net_tcpclient__write, MRB_ARGS_ARG(1, 1));
+  mrb_define_method_id(mrb, class_Net_TCPClient, MRB_SYM(_read), mrb_net_tcpclient__read, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, class_Net_TCPClient, MRB_SYM_E(timeout_ms), mrb_net_tcpclient_timeout_ms_eq, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, class_Net_TCPClient, MRB_SYM(close), mrb_net_tcpclient_close, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Net_TCPClient, MRB_SYM_Q(closed), mrb_net_tcpclient_closed_p, MRB_ARGS_NONE());
+  struct RClass *class_Net_HTTPParser = mrb_define_class_under_id(mrb, module_Net, MRB_SYM(HTTPParser), mrb->object_class);
+  MRB_SET_INSTANCE_TT(class_Net_HTTPParser, MRB_TT_CDATA);
+  mrb_define_method_id(mrb, class_Net_HTTPParser, MRB_SYM(initialize), mrb_net_httpparser_initialize, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, class_Net_HTTPParser, MRB_SYM(feed), mrb_net_httpparser_feed, MRB_ARGS_REQ(1));
+  mrb_define_method_id(mrb, class_Net_HTTPParser, MRB_SYM(finish), mrb_net_httpparser_finish, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Net_HTTPParser, MRB_SYM(status), mrb_net_httpparser_status, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Net_HTTPParser, MRB_SYM(headers), mrb_net_httpparser_headers, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Net_HTTPParser, MRB_SYM_Q(done), mrb_net_httpparser_done_p, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Net_HTTPParser, MRB_SYM_Q(keep_alive), mrb_net_httpparser_keep_alive_p, MRB_ARGS_NONE());
+
+#if defined(PICORB_NET_LOOPIF)
+  mrb_define_class_method_id(mrb, module_Net, MRB_SYM(_start_loopback_server), mrb_net_s__start_loopback_server, MRB_ARGS_REQ(1));
+#endif
 
   struct RClass *class_Net_UDPClient = mrb_define_class_under_id(mrb, module_Net, MRB_SYM(UDPClient), mrb->object_class);
   mrb_define_class_method_id(mrb, class_Net_UDPClient, MRB_SYM(_send_impl), mrb_net_udpclient_s__send_impl, MRB_ARGS_REQ(4));
@@ -26,55 +26,254 @@ c_net_dns_resolve(mrbc_vm *vm, mrbc_value *v, int argc)
   }
 }
 
+/*
+ * Net::TCPClient
+ *
+ * The instance holds a tcp_connection_state. Methods here never block;
+ * mrblib/net.rb loops over _wait_step with sleep_ms so that other tasks
+ * keep running while waiting.
+ */
+
 static void
-c_net_tcpclient__request_impl(mrbc_vm *vm, mrbc_value *v, int argc)
+c_net_tcpclient_free(mrbc_value *self)
 {
-  if (argc != 4) {
+  tcp_connection_state **pcs = (tcp_connection_state **)self->instance->data;
+  if (*pcs) {
+    TCPClient_close(*pcs);
+    *pcs = NULL;
+  }
+}
+
+static tcp_connection_state *
+get_connection(mrbc_vm *vm, mrbc_value self)
+{
+  tcp_connection_state *cs = *(tcp_connection_state **)self.instance->data;
+  if (cs == NULL) {
+    mrbc_raise(vm, MRBC_CLASS(IOError), "closed connection");
+  }
+  return cs;
+}
+
+static void
+c_net_tcpclient__open(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  if (argc != 3) {
     mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
     return;
   }
-  mrbc_value host = GET_ARG(1);
-  if (host.tt != MRBC_TT_STRING) {
+  if (v[1].tt != MRBC_TT_STRING || v[2].tt != MRBC_TT_INTEGER) {
     mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
     return;
   }
-  mrbc_value port = GET_ARG(2);
-  if (port.tt != MRBC_TT_INTEGER) {
-    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
+  const char *host = (const char *)GET_STRING_ARG(1);
+  tcp_connection_state *cs = TCPClient_connect(vm, host, GET_INT_ARG(2), (v[3].tt == MRBC_TT_TRUE));
+  if (cs == NULL) {
+    mrbc_raisef(vm, MRBC_CLASS(IOError), "failed to connect to %s", host);
     return;
   }
-  mrbc_value data = GET_ARG(3);
+  mrbc_value client = mrbc_instance_new(vm, v->cls, sizeof(tcp_connection_state *));
+  *(tcp_connection_state **)client.instance->data = cs;
+  SET_RETURN(client);
+}
+
+static void
+c_net_tcpclient__wait_step(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  tcp_connection_state *cs = get_connection(vm, v[0]);
+  if (cs == NULL) return;
+  SET_BOOL_RETURN(TCPClient_wait_step(cs, GET_INT_ARG(1)));
+}
+
+static void
+c_net_tcpclient__state(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  tcp_connection_state *cs = get_connection(vm, v[0]);
+  if (cs == NULL) return;
+  SET_INT_RETURN(TCPClient_state(cs));
+}
+
+static void
+c_net_tcpclient_timeout_ms_eq(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  tcp_connection_state *cs = get_connection(vm, v[0]);
+  if (cs == NULL) return;
+  TCPClient_set_timeout(cs, (uint32_t)GET_INT_ARG(1));
+  SET_RETURN(v[1]);
+}
+
+/* _write(data, offset) -> new offset, or nil when all of data is queued */
+static void
+c_net_tcpclient__write(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  tcp_connection_state *cs = get_connection(vm, v[0]);
+  if (cs == NULL) return;
+  mrbc_value data = GET_ARG(1);
   if (data.tt != MRBC_TT_STRING) {
     mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
     return;
   }
-  mrbc_value is_tls = GET_ARG(4);
-  if (!((is_tls.tt == MRBC_TT_TRUE) || (is_tls.tt == MRBC_TT_FALSE))) {
+  mrbc_int_t offset = (argc < 2) ? 0 : GET_INT_ARG(2);
+  if (offset < 0 || data.string->size < offset) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "offset out of range");
+    return;
+  }
+  int n = TCPClient_write(cs, (const char *)data.string->data + offset, data.string->size - offset);
+  if (n < 0) {
+    mrbc_raise(vm, MRBC_CLASS(IOError), "write failed");
+    return;
+  }
+  if (offset + n == data.string->size) {
+    SET_NIL_RETURN();
+  } else {
+    SET_INT_RETURN(offset + n);
+  }
+}
+
+/* _read(maxlen) -> String of what has arrived, or nil if nothing */
+static void
+c_net_tcpclient__read(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  tcp_connection_state *cs = get_connection(vm, v[0]);
+  if (cs == NULL) return;
+  size_t len = TCPClient_available(cs);
+  if (0 < argc && v[1].tt == MRBC_TT_INTEGER && 0 < v[1].i && (size_t)v[1].i < len) {
+    len = (size_t)v[1].i;
+  }
+  if (len == 0) {
+    SET_NIL_RETURN();
+    return;
+  }
+  mrbc_value str = mrbc_string_new(vm, NULL, len);
+  TCPClient_read(cs, (char *)str.string->data, len);
+  SET_RETURN(str);
+}
+
+static void
+c_net_tcpclient_close(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  c_net_tcpclient_free(&v[0]);
+  SET_NIL_RETURN();
+}
+
+static void
+c_net_tcpclient_closed_q(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  SET_BOOL_RETURN(*(tcp_connection_state **)v[0].instance->data == NULL);
+}
+
+/*
+ * Net::HTTPParser
+ *
+ * Thin wrapper of the incremental response parser in src/http.c
+ */
+
+static void
+c_net_httpparser_free(mrbc_value *self)
+{
+  NetHTTP_parser_free(NULL, (net_http_parser *)self->instance->data);
+}
+
+static void
+c_net_httpparser_new(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  mrbc_value parser = mrbc_instance_new(vm, v->cls, sizeof(net_http_parser));
+  NetHTTP_parser_init((net_http_parser *)parser.instance->data, (0 < argc && v[1].tt == MRBC_TT_TRUE));
+  SET_RETURN(parser);
+}
+
+/* feed(data) -> the body bytes found in data, without framing */
+static void
+c_net_httpparser_feed(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  net_http_parser *p = (net_http_parser *)v[0].instance->data;
+  mrbc_value data = GET_ARG(1);
+  if (data.tt != MRBC_TT_STRING) {
     mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
     return;
   }
+  mrbc_value body = mrbc_string_new(vm, NULL, data.string->size);
+  size_t len;
+  NetHTTP_parser_feed(vm, p, (const char *)data.string->data, data.string->size, (char *)body.string->data, &len);
+  if (p->state == NET_HTTP_STATE_ERROR) {
+    mrbc_decref(&body);
+    mrbc_raise(vm, MRBC_CLASS(IOError), "malformed HTTP response");
+    return;
+  }
+  body.string->size = len;
+  body.string->data[len] = '\0';
+  SET_RETURN(body);
+}
 
-  net_request_t req = {
-    .host = (const char *)host.string->data,
-    .port = port.i,
-    .send_data = (const char *)data.string->data,
-    .send_data_len = data.string->size,
-    .is_tls = (is_tls.tt == MRBC_TT_TRUE),
-  };
-  net_response_t res = {
-    .recv_data = mrbc_raw_calloc(1, 1),
-    .recv_data_len = 0
-  };
+/* Call when the peer has closed the connection */
+static void
+c_net_httpparser_finish(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  net_http_parser *p = (net_http_parser *)v[0].instance->data;
+  NetHTTP_parser_finish(p);
+  if (p->state == NET_HTTP_STATE_ERROR) {
+    mrbc_raise(vm, MRBC_CLASS(IOError), "incomplete HTTP response");
+    return;
+  }
+  SET_NIL_RETURN();
+}
 
-  if (TCPClient_send(vm, &req, &res)) {
-    mrb_value ret = mrbc_string_new(vm, res.recv_data, res.recv_data_len);
-    SET_RETURN(ret);
+static void
+c_net_httpparser_status(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  net_http_parser *p = (net_http_parser *)v[0].instance->data;
+  if (p->status) {
+    SET_INT_RETURN(p->status);
   } else {
     SET_NIL_RETURN();
   }
-  mrbc_free(vm, res.recv_data);
 }
 
+static void
+c_net_httpparser_headers(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  net_http_parser *p = (net_http_parser *)v[0].instance->data;
+  if (p->status == 0) {
+    SET_NIL_RETURN();
+    return;
+  }
+  mrbc_value headers = mrbc_hash_new(vm, 0);
+  size_t pos = 0;
+  const char *name, *value;
+  size_t name_len, value_len;
+  while (NetHTTP_parser_next_header(p, &pos, &name, &name_len, &value, &value_len)) {
+    mrbc_value key = mrbc_string_new(vm, name, name_len);
+    mrbc_value val = mrbc_string_new(vm, value, value_len);
+    mrbc_hash_set(&headers, &key, &val);
+  }
+  SET_RETURN(headers);
+}
+
+static void
+c_net_httpparser_done_q(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  net_http_parser *p = (net_http_parser *)v[0].instance->data;
+  SET_BOOL_RETURN(p->state == NET_HTTP_STATE_DONE);
+}
+
+static void
+c_net_httpparser_keep_alive_q(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  net_http_parser *p = (net_http_parser *)v[0].instance->data;
+  SET_BOOL_RETURN(p->state == NET_HTTP_STATE_DONE && p->keep_alive);
+}
+
+#if defined(PICORB_NET_LOOPIF)
+static void
+c_net__start_loopback_server(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  if (Net_loopback_server_start(GET_INT_ARG(1)) != ERR_OK) {
+    mrbc_raise(vm, MRBC_CLASS(IOError), "failed to start loopback server");
+    return;
+  }
+  SET_NIL_RETURN();
+}
+#endif
+
 static void
 c_net_udpclient__send_impl(mrbc_vm *vm, mrbc_value *v, int argc)
 {
@@ -133,7 +332,28 @@ mrbc_net_init(mrbc_vm *vm)
   mrbc_define_method(vm, class_Net_DNS, "resolve", c_net_dns_resolve);
 
   mrbc_class *class_Net_TCPClient = mrbc_define_class_under(vm, module_Net, "TCPClient", mrbc_class_object);
-  mrbc_define_method(vm, class_Net_TCPClient, "_request_impl", c_net_tcpclient__request_impl);
+  mrbc_define_destructor(class_Net_TCPClient, c_net_tcpclient_free);
+  mrbc_define_method(vm, class_Net_TCPClient, "_open", c_net_tcpclient__open);
+  mrbc_define_method(vm, class_Net_TCPClient, "_wait_step", c_net_tcpclient__wait_step);
+  mrbc_define_method(vm, class_Net_TCPClient, "_state", c_net_tcpclient__state);
+  mrbc_define_method(vm, class_Net_TCPClient, "_write", c_net_tcpclient__write);
+  mrbc_define_method(vm, class_Net_TCPClient, "_read", c_net_tcpclient__read);
+  mrbc_define_method(vm, class_Net_TCPClient, "timeout_ms=", c_net_tcpclient_timeout_ms_eq);
+  mrbc_define_method(vm, class_Net_TCPClient, "close", c_net_tcpclient_close);
+  mrbc_define_method(vm, class_Net_TCPClient, "closed?", c_net_tcpclient_closed_q);
+  mrbc_class *class_Net_HTTPParser = mrbc_define_class_under(vm, module_Net, "HTTPParser", mrbc_class_object);
+  mrbc_define_destructor(class_Net_HTTPParser, c_net_httpparser_free);
+  mrbc_define_method(vm, class_Net_HTTPParser, "new", c_net_httpparser_new);
+  mrbc_define_method(vm, class_Net_HTTPParser, "feed", c_net_httpparser_feed);
+  mrbc_define_method(vm, class_Net_HTTPParser, "finish", c_net_httpparser_finish);
+  mrbc_define_method(vm, class_Net_HTTPParser, "status", c_net_httpparser_status);
+  mrbc_define_method(vm, class_Net_HTTPParser, "headers", c_net_httpparser_headers);
+  mrbc_define_method(vm, class_Net_HTTPParser, "done?", c_net_httpparser_done_q);
+  mrbc_define_method(vm, class_Net_HTTPParser, "keep_alive?", c_net_httpparser_keep_alive_q);
+
+#if defined(PICORB_NET_LOOPIF)
+  mrbc_define_method(vm, module_Net, "_start_loopback_server", c_net__start_loopback_server);
+#endif
 
   mrbc_class *class_Net_UDPClient = mrbc_define_class_under(vm, module_Net, "UDPClient", mrbc_class_object);
   mrbc_define_method(vm, class_Net_UDPClient, "_send_impl", c_net_udpclient__send_impl);
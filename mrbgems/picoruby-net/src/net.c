@@ -1,38 +1,101 @@
 #include "../include/net.h"
 #include "lwipopts.h"
 #include "lwip/dns.h"
+#include "lwip/sys.h"
+
+#define NET_DNS_TIMEOUT_MS 10000
+
+/*
+ * lwIP keeps the callback argument of a query until it is answered,
+ * which may be after Net_get_ip() has given up. So the answer goes to
+ * this static slot, and the argument is the number of the query: an
+ * answer to any other query than the one waited for is dropped.
+ */
+typedef enum {
+  NET_DNS_IDLE = 0,
+  NET_DNS_PENDING,
+  NET_DNS_DONE,
+} net_dns_state_t;
+
+static struct {
+  volatile net_dns_state_t state;
+  volatile uint32_t query;    // the query the slot waits for
+  ip_addr_t addr;
+} dns_slot;
 
 static void
 dns_found(const char *name, const ip_addr_t *ip, void *arg)
 {
-  ip_addr_t *result = (ip_addr_t *)arg;
+  if ((uint32_t)(uintptr_t)arg != dns_slot.query || dns_slot.state != NET_DNS_PENDING) {
+    return;  // abandoned after a timeout
+  }
   if (ip) {
-    ip4_addr_copy(*result, *ip);
+    ip4_addr_copy(dns_slot.addr, *ip);
   } else {
-    ip4_addr_set_loopback(result);
+    ip4_addr_set_u32(&dns_slot.addr, IPADDR_NONE);
   }
+  dns_slot.state = NET_DNS_DONE;
 }
 
 static err_t
 get_ip_impl(const char *name, ip_addr_t *ip)
 {
   lwip_begin();
-  err_t err = dns_gethostbyname(name, ip, dns_found, ip);
+  dns_slot.query++;
+  dns_slot.state = NET_DNS_PENDING;
+  ip4_addr_set_zero(&dns_slot.addr);
+  err_t err = dns_gethostbyname(name, ip, dns_found, (void *)(uintptr_t)dns_slot.query);
+  if (err != ERR_INPROGRESS) {
+    dns_slot.state = NET_DNS_IDLE;
+  }
   lwip_end();
   return err;
 }
 
+/* Copies the answer out once the slot has it, or abandons the query */
+static bool
+get_ip_result(ip_addr_t *ip, bool abandon)
+{
+  bool done = false;
+  lwip_begin();
+  if (dns_slot.state == NET_DNS_DONE) {
+    ip4_addr_copy(*ip, dns_slot.addr);
+    done = true;
+  }
+  if (done || abandon) {
+    dns_slot.state = NET_DNS_IDLE;
+  }
+  lwip_end();
+  return done;
+}
+
+/*
+ * Returns ERR_OK and sets ip, or ERR_VAL if the name can't be resolved.
+ * An address literal (including 127.0.0.1) resolves without a query.
+ */
 err_t
 Net_get_ip(const char *name, ip_addr_t *ip)
 {
-  get_ip_impl(name, ip);
-  while (!ip_addr_get_ip4_u32(ip)) {
-    Net_sleep_ms(50);
+  ip4_addr_set_zero(ip);
+  err_t err = get_ip_impl(name, ip);
+  if (err == ERR_INPROGRESS) {
+    uint32_t start = sys_now();
+    while (!get_ip_result(ip, false)) {
+      if (NET_DNS_TIMEOUT_MS < sys_now() - start) {
+        get_ip_result(ip, true);
+        break;
+      }
+      Net_sleep_ms(10);
+    }
+  } else if (err != ERR_OK) {
+    return ERR_VAL;
+  }
+  if (!ip_addr_get_ip4_u32(ip) || ip_addr_get_ip4_u32(ip) == IPADDR_NONE) {
+    return ERR_VAL;
   }
   return ERR_OK;
 }
 
-
 #if defined(PICORB_VM_MRUBY)
 
 #include "mruby/net.c"
@@ -1,62 +1,124 @@
 #include "../include/net.h"
 #include "../include/mbedtls_debug.h"
 #include "lwip/altcp_tls.h"
+#include "lwip/sys.h"
+#include "altcp_tls_mbedtls_structs.h"
 
-/* platform-dependent definitions */
+#include <string.h>
 
-/* state values for TCP connection */
-#define NET_TCP_STATE_NONE               0
-#define NET_TCP_STATE_CONNECTION_STARTED 1
-#define NET_TCP_STATE_CONNECTED          2
-#define NET_TCP_STATE_WAITING_PACKET     3
-#define NET_TCP_STATE_PACKET_RECVED      4
-#define NET_TCP_STATE_FINISHED           6
-#define NET_TCP_STATE_ERROR              99
-#define NET_TCP_STATE_TIMEOUT            100
+/* platform-dependent definitions */
 
-/* TCP connection struct */
-typedef struct tcp_connection_state_str
+/*
+ * TCP connection struct
+ *
+ * Received pbufs are queued as they come and copied only once, when
+ * Ruby reads them. The receive window is reopened by what was read,
+ * so the queue never grows beyond TCP_WND.
+ */
+struct tcp_connection_state_str
 {
   int state;
   struct altcp_pcb *pcb;
-  const char *send_data;
-  size_t send_data_len;
-  char *recv_data;
-  size_t recv_data_len;
+  struct pbuf *recv_queue;
+  uint32_t timeout_ms;
+  uint32_t wait_since;
+  bool waiting;
   mrb_state *mrb;
-  struct altcp_tls_config *tls_config;
-} tcp_connection_state;
+  int tls_session;      /* slot in tls_sessions, or -1 */
+};
 
 /* end of platform-dependent definitions */
 
+/*
+ * TLS session resumption
+ *
+ * The session of the last handshake with each host is kept so that the
+ * next connection can skip the full handshake. One client config is
+ * shared by all connections; creating it seeds the DRBG, which is too
+ * costly to repeat per connection.
+ */
+
+typedef struct {
+  char host[NET_TLS_SESSION_HOST_MAX];
+  int port;
+  bool valid;
+  uint32_t used_at;
+  struct altcp_tls_session session;
+} tls_session_entry;
+
+static tls_session_entry tls_sessions[NET_TLS_SESSION_CACHE_SIZE];
+static struct altcp_tls_config *tls_client_config = NULL;
+
+/* Returns the slot for host:port, taking over the least recently used one */
+static int
+tls_session_slot(const char *host, int port)
+{
+  int lru = 0;
+  if (NET_TLS_SESSION_HOST_MAX <= strlen(host)) return -1;
+  for (int i = 0; i < NET_TLS_SESSION_CACHE_SIZE; i++) {
+    tls_session_entry *e = &tls_sessions[i];
+    if (e->port == port && strcmp(e->host, host) == 0) {
+      e->used_at = sys_now();
+      return i;
+    }
+    if (e->used_at < tls_sessions[lru].used_at) lru = i;
+  }
+  tls_session_entry *e = &tls_sessions[lru];
+  if (e->valid) {
+    altcp_tls_free_session(&e->session);
+    e->valid = false;
+  }
+  strcpy(e->host, host);
+  e->port = port;
+  e->used_at = sys_now();
+  return lru;
+}
+
 static void
-TCPClient_free_tls_config(tcp_connection_state *cs)
+tls_session_save(tcp_connection_state *cs)
 {
-  if (cs && cs->tls_config) {
-    altcp_tls_free_config(cs->tls_config);
+  if (cs->tls_session < 0 || cs->pcb == NULL) return;
+  tls_session_entry *e = &tls_sessions[cs->tls_session];
+  struct altcp_tls_session session;
+  altcp_tls_init_session(&session);
+  if (altcp_tls_get_session(cs->pcb, &session) != ERR_OK) {
+    /* keep what we have */
+    altcp_tls_free_session(&session);
+    return;
   }
+  if (e->valid) altcp_tls_free_session(&e->session);
+  e->session = session;
+  e->valid = true;
 }
 
-static err_t
+err_t
 TCPClient_close(tcp_connection_state *cs)
 {
   err_t err = ERR_OK;
-  if (!cs || !cs->pcb) return ERR_ARG;
+  if (!cs) return ERR_ARG;
   mrb_state *mrb = cs->mrb;
   lwip_begin();
-  altcp_arg(cs->pcb, NULL);
-  altcp_recv(cs->pcb, NULL);
-  altcp_sent(cs->pcb, NULL);
-  altcp_err(cs->pcb, NULL);
-  err = altcp_close(cs->pcb);
-  if (err != ERR_OK) {
-    picorb_warn("altcp_close failed: %d\n", err);
-    altcp_abort(cs->pcb);
+  if (cs->pcb) {
+    if (cs->state == NET_TCP_STATE_CONNECTED) {
+      /* TLS 1.3 tickets arrive after the handshake */
+      tls_session_save(cs);
+    }
+    altcp_arg(cs->pcb, NULL);
+    altcp_recv(cs->pcb, NULL);
+    altcp_err(cs->pcb, NULL);
+    err = altcp_close(cs->pcb);
+    if (err != ERR_OK) {
+      picorb_warn("altcp_close failed: %d\n", err);
+      altcp_abort(cs->pcb);
+      err = ERR_ABRT;
+    }
     cs->pcb = NULL;
-    err = ERR_ABRT;
+  }
+  if (cs->recv_queue) {
+    pbuf_free(cs->recv_queue);
+    cs->recv_queue = NULL;
   }
   lwip_end();
-  TCPClient_free_tls_config(cs);
   picorb_free(mrb, cs);
   return err;
 }
@@ -65,69 +127,41 @@ static err_t
 TCPClient_recv_cb(void *arg, struct altcp_pcb *pcb, struct pbuf *pbuf, err_t err)
 {
   tcp_connection_state *cs = (tcp_connection_state *)arg;
-  mrb_state *mrb = cs->mrb;
   if (err != ERR_OK) {
+    MRB;
     picorb_warn("TCPClient_recv_cb: err=%d\n", err);
+    if (pbuf) pbuf_free(pbuf);
     cs->state = NET_TCP_STATE_ERROR;
-    pbuf_free(pbuf);
-    return TCPClient_close(cs);
+    return ERR_OK;
   }
-  if (pbuf != NULL) {
-    char *tmpbuf = picorb_alloc(mrb, pbuf->tot_len + 1);
-    struct pbuf *current_pbuf = pbuf;
-    int offset = 0;
-    while (current_pbuf != NULL) {
-      pbuf_copy_partial(current_pbuf, tmpbuf + offset, current_pbuf->len, 0);
-      offset += current_pbuf->len;
-      current_pbuf = current_pbuf->next;
-    }
-    tmpbuf[pbuf->tot_len] = '\0';
-    assert(cs->recv_data);
-    char *new_recv_data = (char *)picorb_realloc(mrb, cs->recv_data, cs->recv_data_len + pbuf->tot_len + 1);
-    if (new_recv_data == NULL) {
-      picorb_free(mrb, tmpbuf);
+  if (pbuf == NULL) {
+    cs->state = NET_TCP_STATE_FINISHED;
+    return ERR_OK;
+  }
+  if (cs->recv_queue == NULL) {
+    cs->recv_queue = pbuf;
+  } else {
+    if (0xFFFF - cs->recv_queue->tot_len < pbuf->tot_len) {
+      /* tot_len is u16_t. Refusing makes lwIP offer it again later */
       return ERR_MEM;
     }
-    cs->recv_data = new_recv_data;
-    memcpy(cs->recv_data + cs->recv_data_len, tmpbuf, pbuf->tot_len);
-    cs->recv_data_len += pbuf->tot_len;
-    picorb_free(mrb, tmpbuf);
-    altcp_recved(pcb, pbuf->tot_len);
-    cs->state = NET_TCP_STATE_PACKET_RECVED;
-    pbuf_free(pbuf);
-  } else {
-    cs->state = NET_TCP_STATE_FINISHED;
+    pbuf_cat(cs->recv_queue, pbuf);
   }
   return ERR_OK;
 }
 
-static err_t
-TCPClient_sent_cb(void *arg, struct altcp_pcb *pcb, u16_t len)
-{
-  // do nothing as of now
-  return ERR_OK;
-}
-
 static err_t
 TCPClient_connected_cb(void *arg, struct altcp_pcb *pcb, err_t err)
 {
   tcp_connection_state *cs = (tcp_connection_state *)arg;
-  MRB;
   if (err != ERR_OK) {
+    MRB;
     picorb_warn("TCPClient_connected_cb: err=%d\n", err);
-    return TCPClient_close(cs);
+    cs->state = NET_TCP_STATE_ERROR;
+    return ERR_OK;
   }
   cs->state = NET_TCP_STATE_CONNECTED;
-  return ERR_OK;
-}
-
-static err_t
-TCPClient_poll_cb(void *arg, struct altcp_pcb *pcb)
-{
-  tcp_connection_state *cs = (tcp_connection_state *)arg;
-  MRB;
-  picorb_warn("TCPClient_poll_cb (timeout)\n");
-  cs->state = NET_TCP_STATE_TIMEOUT;
+  tls_session_save(cs);
   return ERR_OK;
 }
 
@@ -138,151 +172,186 @@ TCPClient_err_cb(void *arg, err_t err)
   tcp_connection_state *cs = (tcp_connection_state *)arg;
   MRB;
   picorb_warn("Error with: %d\n", err);
+  /* the pcb has already been freed by lwIP */
+  cs->pcb = NULL;
   cs->state = NET_TCP_STATE_ERROR;
 }
 
-static tcp_connection_state *
-TCPClient_new_connection(mrb_state *mrb, const net_request_t *req, net_response_t *res)
+/*
+ * Starts connecting and returns immediately.
+ * Use TCPClient_wait_step(cs, NET_TCP_WAIT_CONNECT) to see it complete.
+ */
+tcp_connection_state *
+TCPClient_connect(mrb_state *mrb, const char *host, int port, bool is_tls)
 {
-  tcp_connection_state *cs = (tcp_connection_state *)picorb_alloc(mrb, sizeof(tcp_connection_state));
-  cs->tls_config = NULL;
-  cs->state = NET_TCP_STATE_NONE;
-  cs->pcb = altcp_new(NULL);
-  altcp_recv(cs->pcb, TCPClient_recv_cb);
-  altcp_sent(cs->pcb, TCPClient_sent_cb);
-  altcp_err(cs->pcb, TCPClient_err_cb);
-  altcp_poll(cs->pcb, TCPClient_poll_cb, 30);
-  altcp_arg(cs->pcb, cs);
-  cs->send_data = req->send_data;
-  cs->send_data_len = req->send_data_len;
-  cs->recv_data = res->recv_data;
-  cs->recv_data_len = res->recv_data_len;
-  cs->mrb       = mrb;
-  return cs;
-}
+  err_t err;
+  ip_addr_t ip;
+  if (Net_get_ip(host, &ip) != ERR_OK) {
+    return NULL;
+  }
 
-static tcp_connection_state *
-TCPClient_new_tls_connection(mrb_state *mrb, const net_request_t *req, net_response_t *res)
-{
   tcp_connection_state *cs = (tcp_connection_state *)picorb_alloc(mrb, sizeof(tcp_connection_state));
+  if (!cs) return NULL;
+  memset(cs, 0, sizeof(tcp_connection_state));
   cs->state = NET_TCP_STATE_NONE;
+  cs->timeout_ms = NET_TCP_DEFAULT_TIMEOUT_MS;
+  cs->mrb = mrb;
+  cs->tls_session = -1;
 
-  struct altcp_tls_config *tls_config = altcp_tls_create_config_client(NULL, 0);
-  cs->pcb = altcp_tls_new(tls_config, IPADDR_TYPE_V4);
+  lwip_begin();
+  if (is_tls) {
+    if (tls_client_config == NULL) {
+      tls_client_config = altcp_tls_create_config_client(NULL, 0);
+    }
+    if (tls_client_config) {
+      cs->pcb = altcp_tls_new(tls_client_config, IPADDR_TYPE_V4);
+    }
+    if (cs->pcb) {
+      mbedtls_ssl_set_hostname(altcp_tls_context(cs->pcb), host);
+      cs->tls_session = tls_session_slot(host, port);
+      if (0 <= cs->tls_session && tls_sessions[cs->tls_session].valid) {
+        altcp_tls_set_session(cs->pcb, &tls_sessions[cs->tls_session].session);
+      }
+    }
+  } else {
+    cs->pcb = altcp_new(NULL);
+  }
   if (!cs->pcb) {
-    picorb_warn("altcp_tls_new failed\n");
-    altcp_tls_free_config(tls_config);
-    picorb_free(mrb, cs);
+    lwip_end();
+    picorb_warn("altcp_new failed\n");
+    TCPClient_close(cs);
     return NULL;
   }
-  cs->tls_config = tls_config;
-  mbedtls_ssl_set_hostname(altcp_tls_context(cs->pcb), req->host);
+  altcp_arg(cs->pcb, cs);
   altcp_recv(cs->pcb, TCPClient_recv_cb);
-  altcp_sent(cs->pcb, TCPClient_sent_cb);
   altcp_err(cs->pcb, TCPClient_err_cb);
-  altcp_poll(cs->pcb, TCPClient_poll_cb, 10);
-  altcp_arg(cs->pcb, cs);
-  cs->send_data = req->send_data;
-  cs->send_data_len = req->send_data_len;
-  cs->recv_data = res->recv_data;
-  cs->recv_data_len = res->recv_data_len;
-  cs->mrb       = mrb;
-  return cs;
-}
-
-static tcp_connection_state *
-TCPClient_connect_impl(mrb_state *mrb, ip_addr_t *ip, const net_request_t *req, net_response_t *res)
-{
-  err_t err;
-  tcp_connection_state *cs;
-  if (req->is_tls) {
-    cs = TCPClient_new_tls_connection(mrb, req, res);
-  } else {
-    cs = TCPClient_new_connection(mrb, req, res);
-  }
-  if (cs) {
-    lwip_begin();
-    err = altcp_connect(cs->pcb, ip, req->port, TCPClient_connected_cb);
-    if (err != ERR_OK) {
-      picorb_warn("altcp_connect failed: %d\n", err);
-      cs->state = NET_TCP_STATE_ERROR;
-      lwip_end();
-      return cs;
-    }
-    lwip_end();
-    cs->state = NET_TCP_STATE_CONNECTION_STARTED;
+  err = altcp_connect(cs->pcb, &ip, port, TCPClient_connected_cb);
+  lwip_end();
+  if (err != ERR_OK) {
+    picorb_warn("altcp_connect failed: %d\n", err);
+    TCPClient_close(cs);
+    return NULL;
   }
+  cs->state = NET_TCP_STATE_CONNECTION_STARTED;
   return cs;
 }
 
-static int
-TCPClient_poll_impl(tcp_connection_state **pcs)
+/*
+ * Drives lwIP once and tells whether `what` can proceed without waiting.
+ * A failed or closed connection counts as ready, so check the state.
+ * It times out after cs->timeout_ms of consecutive unsuccessful steps.
+ */
+bool
+TCPClient_wait_step(tcp_connection_state *cs, int what)
 {
-  err_t err;
-  if (*pcs == NULL)
-    return 0;
-  tcp_connection_state *cs = *pcs;
-  switch(cs->state)
-  {
+  bool ready = false;
+  Net_poll();
+  switch (cs->state) {
     case NET_TCP_STATE_NONE:
-      break;
     case NET_TCP_STATE_CONNECTION_STARTED:
       break;
-    case NET_TCP_STATE_WAITING_PACKET:
-      break;
     case NET_TCP_STATE_CONNECTED:
-      cs->state = NET_TCP_STATE_WAITING_PACKET;
-      lwip_begin();
-      err = altcp_write(cs->pcb, cs->send_data, cs->send_data_len, 0);
-      if (err != ERR_OK) {
-        MRB;
-        picorb_warn("altcp_write failed: %d\n", err);
-        cs->state = NET_TCP_STATE_ERROR;
-        return 1;
+      if (what == NET_TCP_WAIT_CONNECT) {
+        ready = true;
+      } else if (what == NET_TCP_WAIT_READ) {
+        ready = (cs->recv_queue != NULL);
+      } else {
+        lwip_begin();
+        ready = (cs->pcb == NULL || 0 < altcp_sndbuf(cs->pcb));
+        lwip_end();
       }
-      altcp_output(cs->pcb);
-      lwip_end();
       break;
-    case NET_TCP_STATE_PACKET_RECVED:
-      cs->state = NET_TCP_STATE_WAITING_PACKET;
+    default:
+      ready = true;
       break;
-    case NET_TCP_STATE_FINISHED:
-    case NET_TCP_STATE_ERROR:
-    case NET_TCP_STATE_TIMEOUT:
-      return 0;
   }
+  if (ready) {
+    cs->waiting = false;
+    return true;
+  }
+  uint32_t now = sys_now();
+  if (!cs->waiting) {
+    cs->waiting = true;
+    cs->wait_since = now;
+  } else if (cs->timeout_ms < now - cs->wait_since) {
+    cs->waiting = false;
+    cs->state = NET_TCP_STATE_TIMEOUT;
+    return true;
+  }
+  return false;
+}
+
+int
+TCPClient_state(tcp_connection_state *cs)
+{
   return cs->state;
 }
 
-bool
-TCPClient_send(mrb_state *mrb, const net_request_t *req, net_response_t *res)
+void
+TCPClient_set_timeout(tcp_connection_state *cs, uint32_t timeout_ms)
 {
-  bool ret = false;
-  ip_addr_t ip;
-  ip4_addr_set_zero(&ip);
-  Net_get_ip(req->host, &ip);
-  if (!ip4_addr_isloopback(&ip)) {
-    char ip_str[16];
-    ipaddr_ntoa_r(&ip, ip_str, 16);
-    tcp_connection_state *cs = TCPClient_connect_impl(mrb, &ip, req, res);
-    if (cs) {
-      int max_wait = 200;
-      while (TCPClient_poll_impl(&cs) && 0 < max_wait--) {
-        // res->recv_data is ready after connection is complete
-        Net_sleep_ms(100);
-      }
-      if (max_wait <= 0) {
-        picorb_warn("TCPClient_send: timeout\n");
-      } else {
-        res->recv_data = cs->recv_data;
-        res->recv_data_len = cs->recv_data_len;
-      }
-      if (cs->state == NET_TCP_STATE_FINISHED) {
-        ret = true;
-      }
-      TCPClient_close(cs);
-    }
+  cs->timeout_ms = timeout_ms;
+}
+
+/*
+ * Queues as much of data as the send buffer takes.
+ * Returns the number of bytes accepted (may be 0) or -1 on error.
+ */
+int
+TCPClient_write(tcp_connection_state *cs, const char *data, size_t len)
+{
+  err_t err;
+  if (cs->pcb == NULL || cs->state != NET_TCP_STATE_CONNECTED) {
+    return -1;
   }
-  return ret;
+  cs->waiting = false;
+  lwip_begin();
+  size_t room = altcp_sndbuf(cs->pcb);
+  if (room < len) len = room;
+  if (0xFFFF < len) len = 0xFFFF;
+  if (len == 0) {
+    lwip_end();
+    return 0;
+  }
+  err = altcp_write(cs->pcb, data, (u16_t)len, TCP_WRITE_FLAG_COPY);
+  if (err == ERR_OK) {
+    altcp_output(cs->pcb);
+  }
+  lwip_end();
+  if (err == ERR_MEM) {
+    return 0;
+  }
+  if (err != ERR_OK) {
+    MRB;
+    picorb_warn("altcp_write failed: %d\n", err);
+    cs->state = NET_TCP_STATE_ERROR;
+    return -1;
+  }
+  return (int)len;
+}
+
+size_t
+TCPClient_available(tcp_connection_state *cs)
+{
+  return cs->recv_queue ? cs->recv_queue->tot_len : 0;
 }
 
+/* Moves up to len queued bytes into buf and reopens the window */
+size_t
+TCPClient_read(tcp_connection_state *cs, char *buf, size_t len)
+{
+  struct pbuf *queue = cs->recv_queue;
+  if (queue == NULL || len == 0) {
+    return 0;
+  }
+  cs->waiting = false;
+  if (queue->tot_len < len) len = queue->tot_len;
+  lwip_begin();
+  pbuf_copy_partial(queue, buf, (u16_t)len, 0);
+  cs->recv_queue = pbuf_free_header(queue, (u16_t)len);
+  if (cs->pcb) {
+    altcp_recved(cs->pcb, (u16_t)len);
+  }
+  lwip_end();
+  return len;
+}
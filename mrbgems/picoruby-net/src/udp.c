@@ -148,12 +148,10 @@ UDPClient_send(mrb_state *mrb, const net_request_t *req, net_response_t *res)
 {
   bool ret = false;
   ip_addr_t ip;
-  ip4_addr_set_zero(&ip);
-  Net_get_ip(req->host, &ip);
 
   udp_connection_state *cs = NULL;
 
-  if (!ip4_addr_isloopback(&ip)) {
+  if (Net_get_ip(req->host, &ip) == ERR_OK) {
     cs = UDPClient_send_impl(mrb, &ip, req, res);
     if (cs) {
       int max_wait = 50;
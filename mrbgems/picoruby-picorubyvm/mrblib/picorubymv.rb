@@ -8,4 +8,15 @@ class PicoRubyVM
     alloc_stop_profiling
     alloc_profiling_result
   end
+
+  # Saves the binary dump of the allocation profile (microruby with
+  # PICORB_ALLOC_PROFILE). Render it on host with
+  # `ruby mrbgems/picoruby-mruby/script/alloc_profile.rb path`
+  def self.alloc_profile_save(path)
+    data = alloc_profiling_dump
+    File.open(path, "w") do |f|
+      f.write(data)
+    end
+    data.size
+  end
 end
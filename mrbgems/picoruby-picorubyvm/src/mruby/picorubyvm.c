@@ -11,24 +11,48 @@ mrb_picorubyvm_s_memory_statistics(mrb_state *mrb, mrb_value klass)
 static mrb_value
 mrb_picorubyvm_s_alloc_start_profiling(mrb_state *mrb, mrb_value klass)
 {
+#if defined(PICORB_ALLOC_PROFILE)
+  picorb_alloc_profile_start(mrb);
+  return mrb_fixnum_value(0);
+#else
   mrb_notimplement(mrb);
   return mrb_nil_value();
+#endif
 }
 
 static mrb_value
 mrb_picorubyvm_s_alloc_stop_profiling(mrb_state *mrb, mrb_value klass)
 {
+#if defined(PICORB_ALLOC_PROFILE)
+  picorb_alloc_profile_stop(mrb);
+  return mrb_fixnum_value(0);
+#else
   mrb_notimplement(mrb);
   return mrb_nil_value();
+#endif
 }
 
 static mrb_value
 mrb_picorubyvm_s_alloc_profiling_result(mrb_state *mrb, mrb_value klass)
 {
+#if defined(PICORB_ALLOC_PROFILE)
+  return picorb_alloc_profile_result(mrb);
+#else
   mrb_notimplement(mrb);
   return mrb_nil_value();
+#endif
 }
 
+static mrb_value
+mrb_picorubyvm_s_alloc_profiling_dump(mrb_state *mrb, mrb_value klass)
+{
+#if defined(PICORB_ALLOC_PROFILE)
+  return picorb_alloc_profile_dump(mrb);
+#else
+  mrb_notimplement(mrb);
+  return mrb_nil_value();
+#endif
+}
 
 void
 mrb_picoruby_picorubyvm_gem_init(mrb_state *mrb)
@@ -39,6 +63,7 @@ mrb_picoruby_picorubyvm_gem_init(mrb_state *mrb)
   mrb_define_class_method_id(mrb, class_PicoRubyVM, MRB_SYM(alloc_start_profiling), mrb_picorubyvm_s_alloc_start_profiling, MRB_ARGS_NONE());
   mrb_define_class_method_id(mrb, class_PicoRubyVM, MRB_SYM(alloc_stop_profiling), mrb_picorubyvm_s_alloc_stop_profiling, MRB_ARGS_NONE());
   mrb_define_class_method_id(mrb, class_PicoRubyVM, MRB_SYM(alloc_profiling_result), mrb_picorubyvm_s_alloc_profiling_result, MRB_ARGS_NONE());
+  mrb_define_class_method_id(mrb, class_PicoRubyVM, MRB_SYM(alloc_profiling_dump), mrb_picorubyvm_s_alloc_profiling_dump, MRB_ARGS_NONE());
 
   mrb_instruction_sequence_init(mrb, class_PicoRubyVM);
 }
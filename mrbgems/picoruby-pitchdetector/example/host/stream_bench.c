@@ -0,0 +1,214 @@
+/*
+ * picoruby-pitchdetector/example/host/stream_bench.c
+ *
+ * Host benchmark of the streaming mode in ports/common/pitchdetector.c.
+ * Plays a melody of harmonic tones (a note every half second) through
+ * detect_pitch_core() on BUFFER_SIZE blocks and through the stream API
+ * at several hops. Reports results per second, CPU time per second of
+ * audio and the latency from a note change to the first result at the
+ * pitch the detector settles on. It also checks that the sliding sums
+ * equal the difference function computed from scratch.
+ *
+ *   cc -O2 -Iinclude -o stream_bench mrbgems/picoruby-pitchdetector/example/host/stream_bench.c -lm
+ *   ./stream_bench
+ */
+
+#define PICORUBY_H  // skip its contents, ports/common needs none of them
+#include "../../ports/common/pitchdetector.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NOTE_SAMPLES (SAMPLE_RATE / 2)
+#define CHUNK        64     // samples per DMA transfer
+#define CENTS_SETTLED 20.0
+#define MAX_RESULTS  8192
+
+static const double melody[] = {
+  196.0, 246.94, 293.66, 392.0, 329.63, 261.63, 220.0, 174.61,
+  146.83, 196.0, 246.94, 329.63, 440.0, 392.0, 293.66, 196.0
+};
+#define NOTE_COUNT  (sizeof(melody) / sizeof(melody[0]))
+#define SONG_LENGTH (NOTE_COUNT * NOTE_SAMPLES)
+
+static uint16_t song[SONG_LENGTH];
+
+typedef struct {
+  float frequency;
+  uint32_t position;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static int result_count;
+
+static void
+synthesize(void)
+{
+  uint32_t lcg = 1;
+  double phase = 0;
+  for (uint32_t i = 0; i < SONG_LENGTH; i++) {
+    double freq = melody[i / NOTE_SAMPLES];
+    phase += 2 * M_PI * freq / SAMPLE_RATE;
+    double v = 0;
+    for (int h = 1; h <= 4; h++) {
+      v += sin(phase * h) / h;
+    }
+    lcg = lcg * 1103515245u + 12345u;
+    int s = (int)(2048 + 480 * v) + (int)((lcg >> 16) % 41) - 20;
+    song[i] = (uint16_t)s;
+  }
+}
+
+static void
+reset_detector(void)
+{
+  memset(signal_history, 0, sizeof(signal_history));
+  noise_estimate = 0;
+  history_index = 0;
+  history_filled = false;
+  result_count = 0;
+}
+
+static void
+add_result(float frequency, uint32_t position)
+{
+  if (result_count < MAX_RESULTS) {
+    results[result_count].frequency = frequency;
+    results[result_count].position = position;
+    result_count++;
+  }
+}
+
+static double
+seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double
+run_block(void)
+{
+  static uint16_t work[BUFFER_SIZE];
+  reset_detector();
+  double sec = 0;
+  for (uint32_t pos = 0; pos + BUFFER_SIZE <= SONG_LENGTH; pos += BUFFER_SIZE) {
+    memcpy(work, song + pos, sizeof(work));
+    double t0 = seconds();
+    float frequency = detect_pitch_core(work);
+    sec += seconds() - t0;
+    add_result(frequency, pos + BUFFER_SIZE);
+  }
+  return sec;
+}
+
+static double
+run_stream(uint16_t hop)
+{
+  reset_detector();
+  PITCHDETECTOR_stream_init(hop);
+  double sec = 0;
+  for (uint32_t pos = 0; pos < SONG_LENGTH; pos += CHUNK) {
+    double t0 = seconds();
+    PITCHDETECTOR_stream_write(song + pos, CHUNK);
+    PITCHDETECTOR_stream_process();
+    pitchdetector_result_t result;
+    while (PITCHDETECTOR_stream_read(&result)) {
+      add_result(result.frequency, result.position);
+    }
+    sec += seconds() - t0;
+  }
+  return sec;
+}
+
+// Mean samples from a note change to the first result within
+// CENTS_SETTLED of the last result of that note
+static double
+latency(int *measured)
+{
+  double total = 0;
+  *measured = 0;
+  for (uint32_t n = 1; n < NOTE_COUNT; n++) {
+    uint32_t start = n * NOTE_SAMPLES;
+    uint32_t end = start + NOTE_SAMPLES;
+    float settled = 0;
+    for (int i = 0; i < result_count; i++) {
+      if (start < results[i].position && results[i].position <= end) {
+        settled = results[i].frequency;
+      }
+    }
+    if (settled <= 0) continue;
+    for (int i = 0; i < result_count; i++) {
+      if (start < results[i].position && results[i].position <= end &&
+          0 < results[i].frequency &&
+          fabs(1200 * log2(results[i].frequency / settled)) < CENTS_SETTLED) {
+        total += results[i].position - start;
+        (*measured)++;
+        break;
+      }
+    }
+  }
+  return *measured ? total / *measured : 0;
+}
+
+static void
+report(const char *name, double sec)
+{
+  int measured;
+  double lat = latency(&measured);
+  double audio_sec = (double)SONG_LENGTH / SAMPLE_RATE;
+  printf("%-10s %10.1f %14.3f %12.1f %10d/%d\n",
+         name, result_count / audio_sec, sec * 1000 / audio_sec,
+         lat * 1000 / SAMPLE_RATE, measured, (int)NOTE_COUNT - 1);
+}
+
+// Feeds one hop at a time and compares the sliding d(tau) with a
+// recomputation over the window held in stream_x
+static bool
+sliding_sums_exact(uint16_t hop)
+{
+  PITCHDETECTOR_stream_init(hop);
+  for (uint32_t pos = 0; pos + hop <= SONG_LENGTH; pos += hop) {
+    PITCHDETECTOR_stream_write(song + pos, hop);
+    PITCHDETECTOR_stream_process();
+    if (stream_count < BUFFER_SIZE) continue;
+    for (int tau = 0; tau < STREAM_LAGS; tau++) {
+      uint32_t d = 0;
+      for (int k = 1; k <= STREAM_WINDOW; k++) {
+        int32_t delta = stream_x[k] - stream_x[k + tau];
+        d += (uint32_t)(delta * delta);
+      }
+      if (d != stream_diff[tau]) {
+        printf("hop %u: d(%d) is %u, expected %u at sample %u\n",
+               hop, tau, stream_diff[tau], d, pos + hop);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int
+main(void)
+{
+  static const uint16_t hops[] = { 512, 256, 128, 64, 32 };
+  synthesize();
+  PITCHDETECTOR_set_volume_threshold(300);
+
+  printf("%u notes of %d ms, %d samples per write\n",
+         (unsigned)NOTE_COUNT, NOTE_SAMPLES * 1000 / SAMPLE_RATE, CHUNK);
+  printf("%-10s %10s %14s %12s %12s\n",
+         "", "results/s", "CPU ms/audio s", "latency ms", "notes");
+  report("block", run_block());
+  for (size_t i = 0; i < sizeof(hops) / sizeof(hops[0]); i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "hop %u", hops[i]);
+    report(name, run_stream(hops[i]));
+  }
+
+  bool exact = sliding_sums_exact(128) && sliding_sums_exact(PITCHDETECTOR_HOP_MIN);
+  printf("sliding sums exact: %s\n", exact ? "yes" : "NO");
+  return exact ? 0 : 1;
+}
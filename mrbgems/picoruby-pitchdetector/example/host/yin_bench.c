@@ -0,0 +1,144 @@
+/*
+ * picoruby-pitchdetector/example/host/yin_bench.c
+ *
+ * Host benchmark of the YIN difference function variants in
+ * ports/common/pitchdetector.c. Feeds synthetic sines and harmonic tones
+ * (with a little noise) through detect_pitch_core() and reports frames
+ * per second, for the difference function alone and for the whole
+ * detection, how accurate the detected pitch is and how often it is the
+ * one the naive reference finds.
+ *
+ *   cc -O2 -Iinclude -o yin_bench mrbgems/picoruby-pitchdetector/example/host/yin_bench.c -lm
+ *   ./yin_bench
+ */
+
+#define PICORUBY_H  // skip its contents, ports/common needs none of them
+#define PITCHDETECTOR_YIN_BENCHMARK
+#include "../../ports/common/pitchdetector.c"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAMES_PER_SIGNAL 20
+#define AMPLITUDE         1000.0
+#define NOISE             20     // peak, in ADC counts
+#define CENTS_OK          5.0    // a tuner has to be at least this close
+#define CENTS_SAME        1.0
+
+static const double frequencies[] = {
+  82.41, 110.0, 146.83, 196.0, 246.94, 329.63, 440.0, 587.33, 783.99
+};
+#define FREQ_COUNT (sizeof(frequencies) / sizeof(frequencies[0]))
+#define FRAMES     (FREQ_COUNT * 2 * FRAMES_PER_SIGNAL)
+
+static float reference[FRAMES];  // detect_pitch_core() with YIN_NAIVE
+
+static const char *const variant_names[] = { "naive", "fft", "fixed" };
+
+static uint32_t lcg = 1;
+
+static int
+noise(void)
+{
+  lcg = lcg * 1103515245u + 12345u;
+  return (int)((lcg >> 16) % (2 * NOISE + 1)) - NOISE;
+}
+
+// 12-bit ADC samples around mid scale. harmonics: 1 for a sine,
+// 4 for a tone with partials at 1/n amplitude
+static void
+synthesize(uint16_t *buffer, double freq, int harmonics, double phase)
+{
+  double norm = 0;
+  for (int h = 1; h <= harmonics; h++) {
+    norm += 1.0 / h;
+  }
+  for (int i = 0; i < BUFFER_SIZE; i++) {
+    double v = 0;
+    for (int h = 1; h <= harmonics; h++) {
+      v += sin(2 * M_PI * freq * h * i / SAMPLE_RATE + phase * h) / h;
+    }
+    int s = (int)(2048 + AMPLITUDE * v / norm) + noise();
+    buffer[i] = (uint16_t)(s < 0 ? 0 : (4095 < s ? 4095 : s));
+  }
+}
+
+static void
+reset_detector(void)
+{
+  memset(signal_history, 0, sizeof(signal_history));
+  noise_estimate = 0;
+  history_index = 0;
+  history_filled = false;
+  lcg = 1;
+}
+
+static double
+seconds(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void
+bench(int variant)
+{
+  static uint16_t input[BUFFER_SIZE];
+  static uint16_t work[BUFFER_SIZE];
+  yin_variant = variant;
+  reset_detector();
+
+  int frames = 0, detected = 0, correct = 0, same = 0;
+  double cents_sum = 0, detect_sec = 0, diff_sec = 0;
+  for (int harmonics = 1; harmonics <= 4; harmonics += 3) {
+    for (size_t f = 0; f < FREQ_COUNT; f++) {
+      for (int n = 0; n < FRAMES_PER_SIGNAL; n++) {
+        synthesize(input, frequencies[f], harmonics, n * 0.7);
+
+        memcpy(work, input, sizeof(work));
+        double t0 = seconds();
+        float pitch = detect_pitch_core(work);
+        detect_sec += seconds() - t0;
+
+        memcpy(work, input, sizeof(work));
+        t0 = seconds();
+        yin_difference_function(work, 2048.0f);
+        diff_sec += seconds() - t0;
+
+        if (variant == YIN_NAIVE) reference[frames] = pitch;
+        if (pitch == reference[frames] ||
+            (0 < pitch && 0 < reference[frames] &&
+             fabs(1200 * log2(pitch / reference[frames])) < CENTS_SAME)) {
+          same++;
+        }
+        frames++;
+        if (0 < pitch) {
+          double cents = 1200 * log2(pitch / frequencies[f]);
+          detected++;
+          cents_sum += fabs(cents);
+          if (fabs(cents) < CENTS_OK) correct++;
+        }
+      }
+    }
+  }
+  printf("%-6s %10.0f %10.0f %9.1f%% %9.1f%% %10.2f %9.1f%%\n",
+         variant_names[variant], frames / diff_sec, frames / detect_sec,
+         100.0 * detected / frames, 100.0 * correct / frames,
+         detected ? cents_sum / detected : 0.0, 100.0 * same / frames);
+}
+
+int
+main(void)
+{
+  PITCHDETECTOR_set_volume_threshold(300);
+  printf("%d frames of %d samples at %d Hz, sines and 4-partial tones\n",
+         (int)FRAMES, BUFFER_SIZE, SAMPLE_RATE);
+  printf("%-6s %10s %10s %10s %10s %10s %10s\n",
+         "", "diff fps", "detect fps", "detected", "<5 cents", "avg cents", "as naive");
+  bench(YIN_NAIVE);
+  bench(YIN_FFT);
+  bench(YIN_FIXED);
+  return 0;
+}
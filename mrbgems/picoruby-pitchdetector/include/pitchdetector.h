@@ -2,6 +2,7 @@
 #define PITCHDETECTOR_DEFINED_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -10,13 +11,31 @@ extern "C" {
 #define SAMPLE_RATE 8000 // 8kHz
 #define BUFFER_SIZE 1024
 
-void PITCHDETECTOR_start(uint8_t input);
+// Streaming mode
+#define PITCHDETECTOR_HOP_MIN 32
+#define PITCHDETECTOR_HOP_MAX (BUFFER_SIZE / 2)
+#define PITCHDETECTOR_RESULT_QUEUE_LEN 16 // power of two
+
+typedef struct {
+  float frequency;    // Hz, 0.0f if no pitch
+  float confidence;   // 0.0-1.0
+  uint32_t position;  // samples read since the start, at the end of the window
+} pitchdetector_result_t;
+
+// hop: 0 for one analysis per BUFFER_SIZE block, otherwise streaming
+void PITCHDETECTOR_start(uint8_t input, uint16_t hop);
 void PITCHDETECTOR_stop(void);
 float PITCHDETECTOR_detect_pitch(void);
 void PITCHDETECTOR_set_volume_threshold(uint16_t value);
 
 float detect_pitch_core(uint16_t *buffer);
 
+uint16_t PITCHDETECTOR_stream_init(uint16_t hop);
+bool PITCHDETECTOR_stream_write(const uint16_t *samples, uint32_t count);
+uint32_t PITCHDETECTOR_stream_process(void);
+bool PITCHDETECTOR_stream_read(pitchdetector_result_t *result);
+uint32_t PITCHDETECTOR_stream_dropped(void);
+
 #ifdef __cplusplus
 }
 #endif
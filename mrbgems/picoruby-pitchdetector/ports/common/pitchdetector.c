@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <string.h>
 #include <math.h>
 #include "picoruby.h"
 #include "../../include/pitchdetector.h"
@@ -144,24 +145,205 @@ apply_highpass_filter(uint16_t *buffer, float dc_offset)
   }
 }
 
-// Core of the YIN pitch detection algorithm.
-// - Compares the signal with delayed versions of itself
-// - Finds repeating patterns (which indicate pitch)
-// - Creates a "difference function" that has valleys at pitch periods
+/* ==================================================================
+  Difference function variants
+  - YIN_NAIVE: the definition, O(N^2) in float. Kept as the reference
+  - YIN_FFT:   d(tau) = e(0) + e(tau) - 2 * r(tau) where e are running
+               sums of squares and the autocorrelation r comes from one
+               complex FFT of BUFFER_SIZE points. O(N log N)
+  - YIN_FIXED: the same identity with integer running sums and an
+               integer multiply-accumulate for r. O(N^2) but without
+               float emulation, for cores without an FPU (RP2040)
+================================================================== */
+#define YIN_NAIVE 0
+#define YIN_FFT   1
+#define YIN_FIXED 2
+
+#if !defined(PITCHDETECTOR_YIN)
+  #if defined(PICO_RP2040)
+    #define PITCHDETECTOR_YIN YIN_FIXED
+  #else
+    #define PITCHDETECTOR_YIN YIN_FFT
+  #endif
+#endif
+
+#if defined(PITCHDETECTOR_YIN_BENCHMARK)
+  // example/host/yin_bench.c switches between all of them
+  static int yin_variant = PITCHDETECTOR_YIN;
+  #define YIN_ENABLED(v) 1
+#else
+  #define YIN_ENABLED(v) (PITCHDETECTOR_YIN == (v))
+#endif
+
+#define YIN_WINDOW (BUFFER_SIZE / 2)
+
+#if YIN_ENABLED(YIN_NAIVE)
 static void
-yin_difference_function(uint16_t *buffer, float dc_offset)
+yin_difference_naive(uint16_t *buffer, float dc_offset)
 {
-  // Calculate difference function
-  for (int tau = 0; tau < BUFFER_SIZE / 2; tau++) {
+  (void)dc_offset; // cancels out in the difference
+  for (int tau = 0; tau < YIN_WINDOW; tau++) {
     float sum = 0;
-    for (int j = 0; j < BUFFER_SIZE / 2; j++) {
-      float delta = (buffer[j] - dc_offset) - (buffer[j + tau] - dc_offset);
+    for (int j = 0; j < YIN_WINDOW; j++) {
+      float delta = (float)buffer[j] - (float)buffer[j + tau];
       sum += delta * delta;
     }
     yin_buffer[tau] = sum;
   }
+}
+#endif
+
+#if YIN_ENABLED(YIN_FFT)
+#define FFT_PI 3.14159265358979f
+
+static float fft_re[BUFFER_SIZE];
+static float fft_im[BUFFER_SIZE];
+static float fft_cos[BUFFER_SIZE / 2];
+static float fft_sin[BUFFER_SIZE / 2];
+static bool fft_ready = false;
+
+// In-place radix-2 forward FFT of BUFFER_SIZE points
+static void
+fft(float *re, float *im)
+{
+  if (!fft_ready) {
+    for (int k = 0; k < BUFFER_SIZE / 2; k++) {
+      float phase = -2.0f * FFT_PI * k / BUFFER_SIZE;
+      fft_cos[k] = cosf(phase);
+      fft_sin[k] = sinf(phase);
+    }
+    fft_ready = true;
+  }
+  // Bit reversal
+  for (int i = 1, j = 0; i < BUFFER_SIZE; i++) {
+    int bit = BUFFER_SIZE >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j |= bit;
+    if (i < j) {
+      float t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  // Butterflies
+  for (int len = 2; len <= BUFFER_SIZE; len <<= 1) {
+    int half = len >> 1;
+    int step = BUFFER_SIZE / len;
+    for (int i = 0; i < BUFFER_SIZE; i += len) {
+      for (int k = 0; k < half; k++) {
+        float wr = fft_cos[k * step];
+        float wi = fft_sin[k * step];
+        int a = i + k;
+        int b = a + half;
+        float tr = re[b] * wr - im[b] * wi;
+        float ti = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+      }
+    }
+  }
+}
+
+static void
+yin_difference_fft(uint16_t *buffer, float dc_offset)
+{
+  // Window a (first half, zero padded) in the real part and the whole
+  // buffer b in the imaginary part: one FFT gives both spectra.
+  // tau + j stays below BUFFER_SIZE, so the circular correlation of a
+  // and b is the linear one
+  for (int j = 0; j < BUFFER_SIZE; j++) {
+    float x = buffer[j] - dc_offset;
+    fft_re[j] = j < YIN_WINDOW ? x : 0.0f;
+    fft_im[j] = x;
+  }
+  fft(fft_re, fft_im);
+
+  // R = conj(A) * B, stored conjugated so that a forward FFT inverts it
+  for (int k = 0; k <= BUFFER_SIZE / 2; k++) {
+    int m = (BUFFER_SIZE - k) & (BUFFER_SIZE - 1);
+    float ar = (fft_re[k] + fft_re[m]) * 0.5f;
+    float ai = (fft_im[k] - fft_im[m]) * 0.5f;
+    float br = (fft_im[k] + fft_im[m]) * 0.5f;
+    float bi = (fft_re[m] - fft_re[k]) * 0.5f;
+    float pr = ar * br + ai * bi;
+    float pi = ar * bi - ai * br;
+    fft_re[k] = pr;
+    fft_im[k] = -pi;
+    fft_re[m] = pr;
+    fft_im[m] = pi;
+  }
+  fft(fft_re, fft_im);
+
+  float energy0 = 0;
+  for (int j = 0; j < YIN_WINDOW; j++) {
+    float x = buffer[j] - dc_offset;
+    energy0 += x * x;
+  }
+  float energy = energy0;
+  for (int tau = 0; tau < YIN_WINDOW; tau++) {
+    float d = energy0 + energy - 2.0f * fft_re[tau] / BUFFER_SIZE;
+    yin_buffer[tau] = d < 0 ? 0 : d;
+    float out = buffer[tau] - dc_offset;
+    float in = buffer[tau + YIN_WINDOW] - dc_offset;
+    energy += in * in - out * out;
+  }
+}
+#endif
+
+#if YIN_ENABLED(YIN_FIXED)
+static int16_t fixed_buffer[BUFFER_SIZE];
+
+static void
+yin_difference_fixed(uint16_t *buffer, float dc_offset)
+{
+  // Scale to 11 bits so that every sum below fits 32 bits
+  int32_t dc = (int32_t)(dc_offset + 0.5f);
+  int32_t peak = 0;
+  for (int j = 0; j < BUFFER_SIZE; j++) {
+    int32_t x = (int32_t)buffer[j] - dc;
+    if (x < 0) x = -x;
+    if (peak < x) peak = x;
+  }
+  int shift = 0;
+  while (1023 < (peak >> shift)) {
+    shift++;
+  }
+  for (int j = 0; j < BUFFER_SIZE; j++) {
+    fixed_buffer[j] = (int16_t)(((int32_t)buffer[j] - dc) >> shift);
+  }
+
+  int32_t energy0 = 0;
+  for (int j = 0; j < YIN_WINDOW; j++) {
+    energy0 += fixed_buffer[j] * fixed_buffer[j];
+  }
+  int32_t energy = energy0;
+  for (int tau = 0; tau < YIN_WINDOW; tau++) {
+    const int16_t *a = fixed_buffer;
+    const int16_t *b = fixed_buffer + tau;
+    int32_t r = 0;
+    for (int j = 0; j < YIN_WINDOW; j++) {
+      r += a[j] * b[j];
+    }
+    // Up to 2^31: fits unsigned
+    uint32_t d = (uint32_t)energy0 + (uint32_t)energy - 2u * (uint32_t)r;
+    yin_buffer[tau] = (float)d;
+    int32_t out = fixed_buffer[tau];
+    int32_t in = fixed_buffer[tau + YIN_WINDOW];
+    energy += in * in - out * out;
+  }
+}
+#endif
 
-  // Apply cumulative mean normalized difference function
+// Turns the difference function into the cumulative mean normalized
+// difference function (CMNDF) in place.
+// - Divides each lag by the average of the lags before it
+// - Values near 0 mean "repeats well", values near 1 mean "no pattern"
+static void
+cumulative_mean_normalize(void)
+{
   yin_buffer[0] = 1.0f;
   float running_sum = 0;
 
@@ -171,6 +353,31 @@ yin_difference_function(uint16_t *buffer, float dc_offset)
   }
 }
 
+// Core of the YIN pitch detection algorithm.
+// - Compares the signal with delayed versions of itself
+// - Finds repeating patterns (which indicate pitch)
+// - Creates a "difference function" that has valleys at pitch periods
+static void
+yin_difference_function(uint16_t *buffer, float dc_offset)
+{
+  // Calculate difference function
+#if defined(PITCHDETECTOR_YIN_BENCHMARK)
+  switch (yin_variant) {
+    case YIN_NAIVE: yin_difference_naive(buffer, dc_offset); break;
+    case YIN_FIXED: yin_difference_fixed(buffer, dc_offset); break;
+    default:        yin_difference_fft(buffer, dc_offset); break;
+  }
+#elif PITCHDETECTOR_YIN == YIN_NAIVE
+  yin_difference_naive(buffer, dc_offset);
+#elif PITCHDETECTOR_YIN == YIN_FIXED
+  yin_difference_fixed(buffer, dc_offset);
+#else
+  yin_difference_fft(buffer, dc_offset);
+#endif
+
+  cumulative_mean_normalize();
+}
+
 // Makes pitch detection more precise.
 // - Takes the rough pitch estimate and refines it
 // - Uses mathematical curve-fitting for sub-sample accuracy
@@ -305,18 +512,19 @@ analyze_low_frequency(uint16_t *buffer, float dc_offset, int estimated_period)
 {
   if (estimated_period == 0) return 0.0f;
 
+  // Search around the estimated period for better precision
+  int search_range = estimated_period / 20;  // ±5% search range
+
   // Use multiple periods for better low-frequency analysis
   int analysis_window = estimated_period * 3;  // Analyze 3 periods
-  if (analysis_window > BUFFER_SIZE - estimated_period) {
-    analysis_window = BUFFER_SIZE - estimated_period;
+  if (analysis_window > BUFFER_SIZE - estimated_period - search_range) {
+    // The longest test period must stay inside the buffer
+    analysis_window = BUFFER_SIZE - estimated_period - search_range;
   }
 
   float best_correlation = 0;
   int best_offset = 0;
 
-  // Search around the estimated period for better precision
-  int search_range = estimated_period / 20;  // ±5% search range
-
   for (int offset = -search_range; offset <= search_range; offset++) {
     int test_period = estimated_period + offset;
     if (test_period <= 0 || test_period >= BUFFER_SIZE / 2) continue;
@@ -416,6 +624,248 @@ detect_pitch_core(uint16_t *buffer)
   return frequency;
 }
 
+/* ==================================================================
+  Streaming mode
+  Samples arrive in any amount (PITCHDETECTOR_stream_write(), from the
+  ADC DMA interrupt) and PITCHDETECTOR_stream_process() analyzes
+  overlapping windows of BUFFER_SIZE samples, one every `hop` samples.
+  The difference function is not recomputed per window: the samples of
+  a hop add their terms and the ones leaving the window take theirs
+  away, so the CPU time per second does not depend on the hop.
+================================================================== */
+
+#define STREAM_IN_LEN BUFFER_SIZE  // power of two
+#define STREAM_LAGS   (BUFFER_SIZE / 2)
+#define STREAM_WINDOW (BUFFER_SIZE - STREAM_LAGS)
+// stream_count stops here: past it every hop sees a full window, and the
+// positions handed to stream_update_diff() no longer depend on it
+#define STREAM_COUNT_MAX (BUFFER_SIZE + PITCHDETECTOR_HOP_MAX)
+
+// Raw ADC samples: written by the interrupt, read by stream_process()
+static uint16_t stream_in[STREAM_IN_LEN];
+static volatile uint32_t stream_in_head;  // total samples written
+static volatile uint32_t stream_in_tail;  // total samples read
+static volatile uint32_t stream_dropped;
+static volatile bool stream_overrun;
+
+// Filtered 11-bit samples: the last BUFFER_SIZE ones, then the hop in progress
+static int16_t stream_x[BUFFER_SIZE + PITCHDETECTOR_HOP_MAX];
+static uint32_t stream_diff[STREAM_LAGS];  // d(tau) of the current window
+static int32_t stream_sum;                 // of the last BUFFER_SIZE samples
+static uint32_t stream_sum_sq;
+static uint32_t stream_count;              // since the last restart, up to STREAM_COUNT_MAX
+static uint16_t stream_hop;
+static uint16_t stream_fill;               // samples of the hop in progress
+static int32_t stream_hp_in;
+static int32_t stream_hp_out;              // Q4
+
+static pitchdetector_result_t stream_results[PITCHDETECTOR_RESULT_QUEUE_LEN];
+static uint16_t stream_results_head;
+static uint16_t stream_results_tail;
+
+// Forgets the window, after an overrun broke the sample sequence
+static void
+stream_restart(void)
+{
+  memset(stream_x, 0, sizeof(stream_x));
+  memset(stream_diff, 0, sizeof(stream_diff));
+  stream_sum = 0;
+  stream_sum_sq = 0;
+  stream_count = 0;
+  stream_fill = 0;
+}
+
+// The high-pass filter of apply_highpass_filter() (alpha = 0.95, here
+// 243/256) in fixed point. It removes the DC offset too. The result is
+// halved to 11 bits so that d(tau) fits 32 bits
+static int16_t
+stream_filter(uint16_t raw)
+{
+  int32_t in = raw;
+  if (stream_count == 0) {
+    stream_hp_in = in;
+    stream_hp_out = 0;
+  }
+  stream_hp_out = ((stream_hp_out + (in - stream_hp_in) * 16) * 243) >> 8;
+  stream_hp_in = in;
+  int32_t x = stream_hp_out >> 5;
+  if (x < -1023) x = -1023;
+  if (1023 < x) x = 1023;
+  return (int16_t)x;
+}
+
+// Adds the terms of the hop that just completed to d(tau) and removes
+// the ones of the samples that left the window.
+// stream_x[0] is the sample first - BUFFER_SIZE. first is at most
+// STREAM_COUNT_MAX, so the positions below fit int32_t
+static void
+stream_update_diff(uint32_t first, uint16_t count)
+{
+  int32_t base = (int32_t)first - BUFFER_SIZE;
+  int32_t in0 = (int32_t)first - (STREAM_LAGS - 1);
+  int32_t in1 = in0 + count;
+  int32_t out0 = in0 - STREAM_WINDOW;
+  int32_t out1 = in1 - STREAM_WINDOW;
+  // Nothing to take away until the window has filled once
+  if (in0 < 0) in0 = 0;
+  if (out0 < 0) out0 = 0;
+  int32_t in_count = in0 < in1 ? in1 - in0 : 0;
+  int32_t out_count = out0 < out1 ? out1 - out0 : 0;
+  const int16_t *xi = stream_x + (in0 - base);
+  const int16_t *xo = stream_x + (out0 - base);
+
+  // One sample against every lag at a time: the inner loops run over
+  // contiguous memory
+  for (int32_t k = 0; k < in_count; k++) {
+    int32_t x = xi[k];
+    for (int tau = 0; tau < STREAM_LAGS; tau++) {
+      int32_t delta = x - xi[k + tau];
+      stream_diff[tau] += (uint32_t)(delta * delta);
+    }
+  }
+  for (int32_t k = 0; k < out_count; k++) {
+    int32_t x = xo[k];
+    for (int tau = 0; tau < STREAM_LAGS; tau++) {
+      int32_t delta = x - xo[k + tau];
+      stream_diff[tau] -= (uint32_t)(delta * delta);
+    }
+  }
+}
+
+// detect_pitch_core() on the sliding sums
+static void
+stream_analyze(void)
+{
+  pitchdetector_result_t result = {
+    .frequency = 0.0f,
+    .confidence = 0.0f,
+    .position = stream_in_tail,
+  };
+  float mean = (float)stream_sum / BUFFER_SIZE;
+  // x4: back from 11 bits to ADC counts
+  float signal_power = 4.0f * ((float)stream_sum_sq / BUFFER_SIZE - mean * mean);
+  update_noise_estimate(signal_power);
+
+  float threshold = (float)volume_threshold * volume_threshold;
+  if (threshold <= signal_power && POWER_THRESHOLD <= signal_power / (4096.0f * 4096.0f)) {
+    for (int tau = 0; tau < STREAM_LAGS; tau++) {
+      yin_buffer[tau] = (float)stream_diff[tau];
+    }
+    cumulative_mean_normalize();
+    int period = find_fundamental_period(calculate_adaptive_threshold(signal_power));
+    if (period != 0) {
+      float frequency = (float)SAMPLE_RATE / parabolic_interpolation(period);
+      if (75.0f <= frequency && frequency <= 850.0f) {
+        float confidence = 1.0f - yin_buffer[period];
+        result.frequency = frequency;
+        result.confidence = confidence < 0.0f ? 0.0f : confidence;
+      }
+    }
+  }
+
+  // Nobody reads them: the oldest result gives way
+  uint16_t next = (stream_results_head + 1) & (PITCHDETECTOR_RESULT_QUEUE_LEN - 1);
+  if (next == stream_results_tail) {
+    stream_results_tail = (stream_results_tail + 1) & (PITCHDETECTOR_RESULT_QUEUE_LEN - 1);
+  }
+  stream_results[stream_results_head] = result;
+  stream_results_head = next;
+}
+
+// Starts the streaming mode. Returns the hop actually used
+uint16_t
+PITCHDETECTOR_stream_init(uint16_t hop)
+{
+  if (hop < PITCHDETECTOR_HOP_MIN) hop = PITCHDETECTOR_HOP_MIN;
+  if (PITCHDETECTOR_HOP_MAX < hop) hop = PITCHDETECTOR_HOP_MAX;
+  stream_hop = hop;
+  stream_in_head = 0;
+  stream_in_tail = 0;
+  stream_dropped = 0;
+  stream_overrun = false;
+  stream_results_head = 0;
+  stream_results_tail = 0;
+  stream_restart();
+  return hop;
+}
+
+// Queues raw samples. Safe to call from an interrupt while
+// PITCHDETECTOR_stream_process() runs. false if they did not fit
+bool
+PITCHDETECTOR_stream_write(const uint16_t *samples, uint32_t count)
+{
+  uint32_t head = stream_in_head;
+  if (STREAM_IN_LEN - (head - stream_in_tail) < count) {
+    stream_dropped += count;
+    stream_overrun = true;
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    stream_in[(head + i) & (STREAM_IN_LEN - 1)] = samples[i];
+  }
+  stream_in_head = head + count;
+  return true;
+}
+
+// Analyzes every hop completed by the queued samples.
+// Returns the number of results added
+uint32_t
+PITCHDETECTOR_stream_process(void)
+{
+  if (stream_hop == 0) return 0;
+  if (stream_overrun) {
+    stream_overrun = false;
+    stream_in_tail = stream_in_head;
+    stream_restart();
+    return 0;
+  }
+  uint32_t produced = 0;
+  uint32_t head = stream_in_head;
+  while (stream_in_tail != head) {
+    uint16_t raw = stream_in[stream_in_tail & (STREAM_IN_LEN - 1)];
+    int16_t x = stream_filter(raw);
+    // stream_x[stream_fill] is the sample BUFFER_SIZE before this one
+    if (BUFFER_SIZE <= stream_count) {
+      int32_t old = stream_x[stream_fill];
+      stream_sum -= old;
+      stream_sum_sq -= (uint32_t)(old * old);
+    }
+    stream_sum += x;
+    stream_sum_sq += (uint32_t)(x * x);
+    stream_x[BUFFER_SIZE + stream_fill] = x;
+    if (stream_count < STREAM_COUNT_MAX) stream_count++;
+    stream_in_tail++;
+
+    if (++stream_fill == stream_hop) {
+      stream_update_diff(stream_count - stream_hop, stream_hop);
+      memmove(stream_x, stream_x + stream_hop, BUFFER_SIZE * sizeof(int16_t));
+      stream_fill = 0;
+      if (BUFFER_SIZE <= stream_count) {
+        stream_analyze();
+        produced++;
+      }
+    }
+  }
+  return produced;
+}
+
+// Takes the oldest result. false if there is none
+bool
+PITCHDETECTOR_stream_read(pitchdetector_result_t *result)
+{
+  if (stream_results_tail == stream_results_head) return false;
+  *result = stream_results[stream_results_tail];
+  stream_results_tail = (stream_results_tail + 1) & (PITCHDETECTOR_RESULT_QUEUE_LEN - 1);
+  return true;
+}
+
+// Samples lost because PITCHDETECTOR_stream_process() fell behind
+uint32_t
+PITCHDETECTOR_stream_dropped(void)
+{
+  return stream_dropped;
+}
+
 // Allows adjustment of sensitivity.
 // - Sets minimum signal level required for pitch detection
 // - Higher values = less sensitive (ignores quiet sounds)
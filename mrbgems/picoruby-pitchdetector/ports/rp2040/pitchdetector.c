@@ -13,6 +13,10 @@ uint16_t buffer_b[BUFFER_SIZE];
 uint16_t *active_buffer;
 volatile bool buffer_ready = false;
 
+// Streaming mode: DMA transfers of one hop, handed to the common code
+static bool streaming = false;
+static uint16_t transfer_count = BUFFER_SIZE;
+
 // DMA interrupt handler
 static void
 dma_handler()
@@ -20,13 +24,15 @@ dma_handler()
   // Clear interrupt
   dma_hw->ints0 = 1u << dma_chan;
 
+  uint16_t *filled_buffer = active_buffer;
+
   // Switch buffers
   if (active_buffer == buffer_a) {
     active_buffer = buffer_b;
     dma_channel_configure(dma_chan, &dma_config,
       buffer_b,          // Write destination
       &adc_hw->fifo,     // Read source
-      BUFFER_SIZE,       // Transfer count
+      transfer_count,    // Transfer count
       true               // Start immediately
     );
   } else {
@@ -34,17 +40,29 @@ dma_handler()
     dma_channel_configure(dma_chan, &dma_config,
       buffer_a,          // Write destination
       &adc_hw->fifo,     // Read source
-      BUFFER_SIZE,       // Transfer count
+      transfer_count,    // Transfer count
       true               // Start immediately
     );
   }
 
-  buffer_ready = true;
+  if (streaming) {
+    PITCHDETECTOR_stream_write(filled_buffer, transfer_count);
+  } else {
+    buffer_ready = true;
+  }
 }
 
 void
-PITCHDETECTOR_start(uint8_t input)
+PITCHDETECTOR_start(uint8_t input, uint16_t hop)
 {
+  streaming = (0 < hop);
+  if (streaming) {
+    transfer_count = PITCHDETECTOR_stream_init(hop);
+  } else {
+    transfer_count = BUFFER_SIZE;
+  }
+  buffer_ready = false;
+
   // Select ADC input channel
   adc_select_input(input);
 
@@ -75,7 +93,7 @@ PITCHDETECTOR_start(uint8_t input)
   dma_channel_configure(dma_chan, &dma_config,
     buffer_a,          // Write destination
     &adc_hw->fifo,     // Read source
-    BUFFER_SIZE,       // Transfer count
+    transfer_count,    // Transfer count
     false              // Don't start yet
   );
 
@@ -119,6 +137,17 @@ PITCHDETECTOR_stop(void)
 float
 PITCHDETECTOR_detect_pitch(void)
 {
+ if (streaming) {
+   // The latest result, if any since the last call
+   pitchdetector_result_t result;
+   float frequency = 0.0f;
+   PITCHDETECTOR_stream_process();
+   while (PITCHDETECTOR_stream_read(&result)) {
+     frequency = result.frequency;
+   }
+   return frequency;
+ }
+
  if (buffer_ready) {
    buffer_ready = false;
 
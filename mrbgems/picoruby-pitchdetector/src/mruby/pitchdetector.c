@@ -2,12 +2,18 @@
 #include <mruby/presym.h>
 #include <mruby/class.h>
 #include <mruby/variable.h>
+#include <mruby/array.h>
 
 static mrb_value
 mrb_start(mrb_state *mrb, mrb_value self)
 {
+  mrb_int hop = 0;
+  mrb_get_args(mrb, "|i", &hop);
+  if (hop < 0 || PITCHDETECTOR_HOP_MAX < hop) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "hop must be 0..%d", PITCHDETECTOR_HOP_MAX);
+  }
   mrb_value adc_input = mrb_iv_get(mrb, self, MRB_SYM(adc_input));
-  PITCHDETECTOR_start((uint8_t)mrb_fixnum(adc_input));
+  PITCHDETECTOR_start((uint8_t)mrb_fixnum(adc_input), (uint16_t)hop);
   return mrb_nil_value();
 }
 
@@ -38,14 +44,33 @@ mrb_detect_pitch(mrb_state *mrb, mrb_value self)
   }
 }
 
+static mrb_value
+mrb_read_pitch(mrb_state *mrb, mrb_value self)
+{
+  pitchdetector_result_t result;
+  PITCHDETECTOR_stream_process();
+  if (!PITCHDETECTOR_stream_read(&result)) {
+    return mrb_nil_value();
+  }
+  return mrb_assoc_new(mrb, mrb_float_value(mrb, result.frequency), mrb_float_value(mrb, result.confidence));
+}
+
+static mrb_value
+mrb_dropped_samples(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(PITCHDETECTOR_stream_dropped());
+}
+
 void
 mrb_picoruby_pitchdetector_gem_init(mrb_state *mrb)
 {
   struct RClass *class_PD = mrb_define_class_id(mrb, MRB_SYM(PitchDetector), mrb->object_class);
 
-  mrb_define_method_id(mrb, class_PD, MRB_SYM(start), mrb_start, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_PD, MRB_SYM(start), mrb_start, MRB_ARGS_OPT(1));
   mrb_define_method_id(mrb, class_PD, MRB_SYM(stop), mrb_stop, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_PD, MRB_SYM(detect_pitch), mrb_detect_pitch, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_PD, MRB_SYM(read_pitch), mrb_read_pitch, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_PD, MRB_SYM(dropped_samples), mrb_dropped_samples, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_PD, MRB_SYM_E(volume_threshold), mrb_volume_threshold_set, MRB_ARGS_REQ(1));
 }
 
@@ -11,8 +11,16 @@ c_volume_threshold_set(mrbc_vm *vm, mrbc_value v[], int argc)
 static void
 c_start(mrbc_vm *vm, mrbc_value v[], int argc)
 {
+  mrbc_int_t hop = 0;
+  if (0 < argc) {
+    hop = GET_INT_ARG(1);
+  }
+  if (hop < 0 || PITCHDETECTOR_HOP_MAX < hop) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "hop out of range");
+    return;
+  }
   mrbc_value adc_input = mrbc_instance_getiv(&v[0], mrbc_str_to_symid("adc_input"));
-  PITCHDETECTOR_start((uint8_t)adc_input.i);
+  PITCHDETECTOR_start((uint8_t)adc_input.i, (uint16_t)hop);
 }
 
 static void
@@ -32,6 +40,29 @@ c_detect_pitch(mrbc_vm *vm, mrbc_value v[], int argc)
   }
 }
 
+static void
+c_read_pitch(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  pitchdetector_result_t result;
+  PITCHDETECTOR_stream_process();
+  if (!PITCHDETECTOR_stream_read(&result)) {
+    SET_NIL_RETURN();
+    return;
+  }
+  mrbc_value ret = mrbc_array_new(vm, 2);
+  mrbc_value frequency = mrbc_float_value(vm, result.frequency);
+  mrbc_value confidence = mrbc_float_value(vm, result.confidence);
+  mrbc_array_set(&ret, 0, &frequency);
+  mrbc_array_set(&ret, 1, &confidence);
+  SET_RETURN(ret);
+}
+
+static void
+c_dropped_samples(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  SET_INT_RETURN(PITCHDETECTOR_stream_dropped());
+}
+
 void
 mrbc_pitchdetector_init(mrbc_vm *vm)
 {
@@ -40,5 +71,7 @@ mrbc_pitchdetector_init(mrbc_vm *vm)
   mrbc_define_method(vm, class_PD, "start", c_start);
   mrbc_define_method(vm, class_PD, "stop", c_stop);
   mrbc_define_method(vm, class_PD, "detect_pitch", c_detect_pitch);
+  mrbc_define_method(vm, class_PD, "read_pitch", c_read_pitch);
+  mrbc_define_method(vm, class_PD, "dropped_samples", c_dropped_samples);
   mrbc_define_method(vm, class_PD, "volume_threshold=", c_volume_threshold_set);
 }
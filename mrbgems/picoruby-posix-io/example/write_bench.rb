@@ -0,0 +1,43 @@
+# Line-oriented output with and without the IO write buffer.
+# Syscall counts come from /proc/self/io, so they are only shown on Linux.
+#
+#   bin/picoruby mrbgems/picoruby-posix-io/example/write_bench.rb
+
+LINES = 20000
+PATH = "/tmp/picoruby_write_bench.txt"
+
+def write_syscalls
+  return nil unless File.exist?("/proc/self/io")
+  File.open("/proc/self/io") do |f|
+    while line = f.gets
+      return line.split(":")[1].to_i if line.start_with?("syscw:")
+    end
+  end
+  nil
+end
+
+def bench(sync)
+  File.open(PATH, "w") do |f|
+    f.sync = sync
+    syscalls = write_syscalls
+    started = Time.now.to_f
+    i = 0
+    while i < LINES
+      f.puts "line #{i}: the quick brown fox jumps over the lazy dog"
+      i += 1
+    end
+    f.flush
+    elapsed = Time.now.to_f - started
+    syscalls = write_syscalls.to_i - syscalls.to_i
+    bytes = f.pos
+    puts "sync=#{sync}"
+    puts "  bytes:    #{bytes}"
+    puts "  elapsed:  #{(elapsed * 1000).to_i} ms"
+    puts "  KB/s:     #{elapsed == 0 ? '-' : (bytes / elapsed / 1024).to_i}"
+    puts "  syscalls: #{syscalls}" if write_syscalls
+  end
+end
+
+bench(true)
+bench(false)
+File.unlink(PATH)
@@ -19,12 +19,14 @@ extern "C" {
 # endif
 #endif
 
+/* default capacity of read and write buffers, see IO#buffer_size= */
 #define PICORB_IO_BUF_SIZE 4096
 
 struct picorb_io_buf {
-  short start;
-  short len;
-  char mem[PICORB_IO_BUF_SIZE];
+  int start;
+  int len;
+  int capa;  /* size of mem */
+  char mem[];
 };
 
 struct picorb_io {
@@ -38,7 +40,9 @@ struct picorb_io {
   int fd;   /* file descriptor, or -1 */
   int fd2;  /* file descriptor to write if it's different from fd, or -1 */
   int pid;  /* child's pid (for pipes)  */
-  struct picorb_io_buf *buf;
+  int buf_size; /* capacity of buf and wbuf */
+  struct picorb_io_buf *buf;   /* read buffer */
+  struct picorb_io_buf *wbuf;  /* write buffer, allocated on first buffered write */
 };
 
 #define PICORB_O_RDONLY            0x0000
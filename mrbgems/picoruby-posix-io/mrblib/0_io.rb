@@ -144,6 +144,21 @@ class IO
   # 15.2.20.5.5
   alias each_line each
 
+  # Yields the content in pieces of up to `size` bytes.
+  # The same String is reused for every chunk, so dup it to keep it.
+  def each_chunk(size = nil, &block)
+    unless block
+      raise ArgumentError, "block not supplied"
+    end
+
+    size ||= buffer_size
+    chunk = ""
+    while read(size, chunk)
+      block.call(chunk)
+    end
+    self
+  end
+
   def each_char(&block)
     unless block
       raise ArgumentError, "block not supplied"
@@ -29,6 +29,7 @@
 #else
   #include <sys/wait.h>
   #include <sys/time.h>
+  #include <sys/uio.h>
   #include <unistd.h>
   typedef size_t fsize_t;
   typedef time_t ftime_t;
@@ -49,6 +50,10 @@
 #include <stdio.h>
 #include <limits.h>
 
+#ifndef S_ISREG
+# define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
+#endif
+
 #define OPEN_ACCESS_MODE_FLAGS (O_RDONLY | O_WRONLY | O_RDWR)
 #define OPEN_RDONLY_P(f)       ((bool)(((f) & OPEN_ACCESS_MODE_FLAGS) == O_RDONLY))
 #define OPEN_WRONLY_P(f)       ((bool)(((f) & OPEN_ACCESS_MODE_FLAGS) == O_WRONLY))
@@ -159,14 +164,152 @@ io_get_open_fptr(mrbc_vm *vm, mrbc_value io)
   return fptr;
 }
 
+static int
+io_get_write_fd(struct picorb_io *fptr)
+{
+  if (fptr->fd2 == -1) {
+    return fptr->fd;
+  }
+  else {
+    return fptr->fd2;
+  }
+}
+
+static struct picorb_io_buf *
+io_buf_alloc(mrbc_vm *vm, int capa)
+{
+  struct picorb_io_buf *buf;
+
+  buf = (struct picorb_io_buf*)mrbc_alloc(vm, sizeof(struct picorb_io_buf) + capa);
+  if (buf == NULL) return NULL;
+  buf->start = 0;
+  buf->len = 0;
+  buf->capa = capa;
+  return buf;
+}
+
+/*
+ * Write buffer
+ *
+ * Unless `sync` is set, IO#write appends to fptr->wbuf and only calls
+ * the kernel when the buffer would overflow. The pending bytes and the
+ * new chunk then go out together in one writev(2), so a large write
+ * costs no extra copy. The buffer is flushed before anything that
+ * depends on the file position or on the peer having seen the data:
+ * read, seek, pos, sysread/syswrite, pread/pwrite, sync=, flush and close.
+ */
+
+static int
+io_write_all(int fd, const char *ptr, fsize_t len)
+{
+  fssize_t n;
+
+  while (0 < len) {
+    n = write(fd, ptr, len);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    ptr += n;
+    len -= (fsize_t)n;
+  }
+  return 0;
+}
+
+/* Writes pending bytes in wbuf (if any) followed by ptr[0..len) */
+static int
+io_write_gather(int fd, struct picorb_io_buf *wbuf, const char *ptr, fsize_t len)
+{
+  int ret = 0;
+#if defined(_WIN32) || defined(_WIN64)
+  if (wbuf && 0 < wbuf->len) {
+    ret = io_write_all(fd, wbuf->mem, (fsize_t)wbuf->len);
+  }
+  if (ret == 0) {
+    ret = io_write_all(fd, ptr, len);
+  }
+#else
+  struct iovec iov[2];
+  struct iovec *p = iov;
+  int cnt = 0;
+  fssize_t n;
+
+  if (wbuf && 0 < wbuf->len) {
+    iov[cnt].iov_base = wbuf->mem;
+    iov[cnt].iov_len = (size_t)wbuf->len;
+    cnt++;
+  }
+  if (0 < len) {
+    iov[cnt].iov_base = (void *)ptr;
+    iov[cnt].iov_len = len;
+    cnt++;
+  }
+  while (0 < cnt) {
+    n = writev(fd, p, cnt);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      ret = -1;
+      break;
+    }
+    while (0 < cnt && p->iov_len <= (size_t)n) {
+      n -= (fssize_t)p->iov_len;
+      p++;
+      cnt--;
+    }
+    if (0 < cnt) {
+      p->iov_base = (char *)p->iov_base + n;
+      p->iov_len -= (size_t)n;
+    }
+  }
+#endif
+  /* Unwritten bytes are dropped on error so that close doesn't fail twice */
+  if (wbuf) wbuf->len = 0;
+  return ret;
+}
+
+static int
+io_wbuf_flush(mrbc_vm *vm, struct picorb_io *fptr)
+{
+  if (fptr == NULL || fptr->wbuf == NULL || fptr->wbuf->len == 0) {
+    return 0;
+  }
+  if (io_write_gather(io_get_write_fd(fptr), fptr->wbuf, NULL, 0) == -1) {
+    mrbc_raise(vm, MRBC_CLASS(IOError), "flush failed");
+    return -1;
+  }
+  return 0;
+}
+
+static int
+io_wbuf_write(mrbc_vm *vm, struct picorb_io *fptr, const char *ptr, fsize_t len)
+{
+  struct picorb_io_buf *wbuf = fptr->wbuf;
+
+  if (wbuf == NULL) {
+    wbuf = io_buf_alloc(vm, fptr->buf_size);
+    if (wbuf == NULL) {
+      return io_write_all(io_get_write_fd(fptr), ptr, len);
+    }
+    fptr->wbuf = wbuf;
+  }
+  if (len <= (fsize_t)(wbuf->capa - wbuf->len)) {
+    memcpy(wbuf->mem + wbuf->len, ptr, len);
+    wbuf->len += (int)len;
+    return 0;
+  }
+  return io_write_gather(io_get_write_fd(fptr), wbuf, ptr, len);
+}
+
 static struct picorb_io*
 io_get_read_fptr(mrbc_vm *vm, mrbc_value io)
 {
   struct picorb_io *fptr = io_get_open_fptr(vm, io);
+  if (fptr == NULL) return NULL; /* raise error */
   if (!fptr->readable) {
     mrbc_raise(vm, MRBC_CLASS(IOError), "not opened for reading");
     return NULL;
   }
+  if (io_wbuf_flush(vm, fptr) == -1) return NULL;
   return fptr;
 }
 
@@ -176,6 +319,58 @@ sysread(int fd, void *buf, fsize_t nbytes, off_t offset)
   return (fssize_t)read(fd, buf, nbytes);
 }
 
+/*
+ * Reading into a String
+ *
+ * mruby/c strings don't keep a capacity, so these resize the payload
+ * directly and let the caller read(2) into it instead of going through
+ * the IO buffer and mrbc_string_append_cbuf().
+ */
+
+/* Makes room for capa bytes (plus NUL) without changing the length */
+static int
+io_str_reserve(mrbc_vm *vm, mrbc_value str, mrbc_int_t capa)
+{
+  uint8_t *data = (uint8_t *)mrbc_realloc(vm, str.string->data, capa + 1);
+  if (data == NULL) {
+    mrbc_raise(vm, MRBC_CLASS(RuntimeError), "no memory");
+    return -1;
+  }
+  str.string->data = data;
+  return 0;
+}
+
+static void
+io_str_set_len(mrbc_value str, mrbc_int_t len)
+{
+  str.string->size = len;
+  str.string->data[len] = '\0';
+}
+
+/*
+ * Appends up to maxlen bytes read from fd to str.
+ * Returns the number of bytes read, 0 on EOF or -1 on error.
+ */
+static fssize_t
+io_read_into(mrbc_vm *vm, int fd, mrbc_value str, mrbc_int_t maxlen,
+    fssize_t (*readfunc)(int, void*, fsize_t, off_t), off_t offset)
+{
+  mrbc_int_t len = str.string->size;
+  fssize_t n;
+
+  if (io_str_reserve(vm, str, len + maxlen) == -1) return -1;
+  do {
+    n = readfunc(fd, str.string->data + len, (fsize_t)maxlen, offset);
+  } while (n == -1 && errno == EINTR);
+  if (n < 0) n = -1;
+  if (n < maxlen) {
+    /* give back what was not filled; shrinking never fails in practice */
+    io_str_reserve(vm, str, len + (0 < n ? n : 0));
+  }
+  io_str_set_len(str, len + (0 < n ? n : 0));
+  return n;
+}
+
 static mrbc_value
 io_read_common(mrbc_vm *vm,
     fssize_t (*readfunc)(int, void*, fsize_t, off_t),
@@ -191,29 +386,29 @@ io_read_common(mrbc_vm *vm,
     return mrbc_string_new(vm, NULL, 0);
   }
 
+  struct picorb_io *fptr = io_get_read_fptr(vm, io);
+  if (fptr == NULL) return mrbc_nil_value(); /* raise error */
+
   if (buf.tt == MRBC_TT_NIL) {
     buf = mrbc_string_new(vm, NULL, 0);
   }
+  else {
+    io_str_set_len(buf, 0);
+  }
 
-//  if (buf.string->size != maxlen) {
-//    mrbc_realloc(vm, buf.string->data, maxlen);
-//  }
-
-  struct picorb_io *fptr = io_get_read_fptr(vm, io);
-  char temp[maxlen];
-  ret = readfunc(fptr->fd, temp, (fsize_t)maxlen, offset);
+  ret = io_read_into(vm, fptr->fd, buf, maxlen, readfunc, offset);
   if (ret < 0) {
-    mrbc_raise(vm, MRBC_CLASS(RuntimeError), "sysread failed");
-    //mrbc_decref(&buf); ????
-    buf = mrbc_nil_value();
+    if (vm->exception.tt != MRBC_TT_EXCEPTION) {
+      mrbc_raise(vm, MRBC_CLASS(RuntimeError), "sysread failed");
+    }
+    return mrbc_nil_value();
   }
   assert(ret <= maxlen);
-  if (ret == 0 && maxlen > 0) {
+  if (ret == 0) {
     fptr->eof = 1;
     eof_error(vm);
-    buf = mrbc_nil_value();
+    return mrbc_nil_value();
   }
-  mrbc_string_append_cstr(&buf, temp);
   return buf;
 }
 
@@ -269,9 +464,7 @@ static void
 io_init_buf(mrbc_vm *vm, struct picorb_io *fptr)
 {
   if (fptr->readable) {
-    fptr->buf = (struct picorb_io_buf*)mrbc_alloc(vm, sizeof(struct picorb_io_buf));
-    fptr->buf->start = 0;
-    fptr->buf->len = 0;
+    fptr->buf = io_buf_alloc(vm, fptr->buf_size);
   }
 }
 
@@ -354,6 +547,15 @@ fptr_finalize(mrbc_vm *vm, struct picorb_io *fptr, int quiet)
     return;
   }
 
+  if (fptr->wbuf) {
+    if (fptr->fd >= 0 &&
+        io_write_gather(io_get_write_fd(fptr), fptr->wbuf, NULL, 0) == -1) {
+      saved_errno = errno;
+    }
+    mrbc_free(vm, fptr->wbuf);
+    fptr->wbuf = NULL;
+  }
+
   if (fptr->fd >= limit) {
 #ifdef _WIN32
     if (fptr->is_socket) {
@@ -423,6 +625,8 @@ io_alloc(struct picorb_io *fptr)
   fptr->fd2 = -1;
   fptr->pid = 0;
   fptr->buf = 0;
+  fptr->wbuf = 0;
+  fptr->buf_size = PICORB_IO_BUF_SIZE;
   fptr->readable = 0;
   fptr->writable = 0;
   fptr->sync = 0;
@@ -448,17 +652,6 @@ io_get_write_fptr(mrbc_vm *vm, mrbc_value io)
   return fptr;
 }
 
-static int
-io_get_write_fd(struct picorb_io *fptr)
-{
-  if (fptr->fd2 == -1) {
-    return fptr->fd;
-  }
-  else {
-    return fptr->fd2;
-  }
-}
-
 static fssize_t
 syswrite(int fd, const void *buf, fsize_t nbytes, off_t offset)
 {
@@ -482,21 +675,24 @@ io_write_common(mrbc_vm *vm,
 }
 
 static mrbc_int_t
-fd_write(mrbc_vm *vm, int fd, mrbc_value str)
+fd_write(mrbc_vm *vm, struct picorb_io *fptr, mrbc_value str, bool through)
 {
-  fssize_t len, sum, n;
+  fsize_t len = (fsize_t)(str.string->size);
+  int ret;
 
-  len = (fssize_t)(str.string->size);
-  if (len == 0)return 0;
+  if (len == 0) return 0;
 
-  for (sum=0; sum<len; sum+=n) {
-    n = write(fd, str.string->data, (fsize_t)len);
-    if (n == -1) {
-      //mrb_sys_fail(mrb, "syswrite");
-      mrbc_raise(vm, MRBC_CLASS(RuntimeError), "syswrite failed");
-    }
+  if (through) {
+    ret = io_write_gather(io_get_write_fd(fptr), fptr->wbuf, (const char *)str.string->data, len);
+  }
+  else {
+    ret = io_wbuf_write(vm, fptr, (const char *)str.string->data, len);
+  }
+  if (ret == -1) {
+    //mrb_sys_fail(mrb, "syswrite");
+    mrbc_raise(vm, MRBC_CLASS(RuntimeError), "syswrite failed");
   }
-  return len;
+  return (mrbc_int_t)len;
 }
 
 int
@@ -680,6 +876,8 @@ c_io_new(mrbc_vm *vm, mrbc_value v[], int argc)
   fptr->fd = (int)fd;
   fptr->readable = OPEN_READABLE_P(flags);
   fptr->writable = OPEN_WRITABLE_P(flags);
+  /* Nothing flushes at exit, so standard streams are write-through */
+  fptr->sync = (fd <= 2);
   io_init_buf(vm, fptr);
 
   SET_RETURN(io);
@@ -919,6 +1117,10 @@ io_reset_outbuf(mrbc_vm *vm, mrbc_value outbuf, mrbc_int_t len)
   if (outbuf.tt == MRBC_TT_NIL) {
     outbuf = mrbc_string_new(vm, NULL, 0);
   }
+  else {
+    /* keep the allocation so that a reused buffer isn't reallocated */
+    io_str_set_len(outbuf, 0);
+  }
   return outbuf;
 }
 
@@ -929,14 +1131,14 @@ io_fill_buf(mrbc_vm *vm, struct picorb_io *fptr)
 
   if (buf->len > 0) return;
 
-  int n = read(fptr->fd, buf->mem, PICORB_IO_BUF_SIZE);
+  fssize_t n = read(fptr->fd, buf->mem, (fsize_t)buf->capa);
   if (n < 0) {
     mrbc_raise(vm, MRBC_CLASS(RuntimeError), "sysread failed");
     return;
   }
   if (n == 0) fptr->eof = 1;
   buf->start = 0;
-  buf->len = (short)n;
+  buf->len = (int)n;
 }
 
 static void
@@ -949,9 +1151,9 @@ io_buf_reset(struct picorb_io_buf *buf)
 static void
 io_buf_shift(struct picorb_io_buf *buf, mrbc_int_t n)
 {
-  assert(n <= SHRT_MAX);
-  buf->start += (short)n;
-  buf->len -= (short)n;
+  assert(n <= buf->len);
+  buf->start += (int)n;
+  buf->len -= (int)n;
 }
 
 static void
@@ -969,16 +1171,57 @@ io_buf_cat_all(mrbc_vm *vm, mrbc_value outbuf, struct picorb_io_buf *buf)
   io_buf_reset(buf);
 }
 
+/*
+ * Reads until EOF straight into outbuf. For a regular file the rest of
+ * the file is known from fstat(2) so the string is sized once; otherwise
+ * it grows geometrically and is trimmed at the end.
+ */
 static mrbc_value
 io_read_all(mrbc_vm *vm, struct picorb_io *fptr, mrbc_value outbuf)
 {
+  struct picorb_io_buf *buf = fptr->buf;
+  struct stat st;
+  off_t pos;
+  mrbc_int_t len, capa;
+  fssize_t n;
+
+  if (0 < buf->len) {
+    io_buf_cat_all(vm, outbuf, buf);
+  }
+  if (fptr->eof) {
+    return outbuf;
+  }
+
+  len = outbuf.string->size;
+  capa = len + buf->capa;
+  if (fstat(fptr->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+      (pos = lseek(fptr->fd, 0, SEEK_CUR)) != -1 && pos < st.st_size) {
+    /* +1 so that EOF is seen without growing the string */
+    capa = len + (mrbc_int_t)(st.st_size - pos) + 1;
+  }
+  if (io_str_reserve(vm, outbuf, capa) == -1) {
+    return outbuf;
+  }
   for (;;) {
-    io_fill_buf(vm, fptr);
-    if (fptr->eof) {
-      return outbuf;
+    if (len == capa) {
+      capa += capa / 2;
+      if (io_str_reserve(vm, outbuf, capa) == -1) break;
+    }
+    n = read(fptr->fd, outbuf.string->data + len, (fsize_t)(capa - len));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      mrbc_raise(vm, MRBC_CLASS(RuntimeError), "sysread failed");
+      break;
+    }
+    if (n == 0) {
+      fptr->eof = 1;
+      break;
     }
-    io_buf_cat_all(vm, outbuf, fptr->buf);
+    len += n;
   }
+  io_str_reserve(vm, outbuf, len);
+  io_str_set_len(outbuf, len);
+  return outbuf;
 }
 
 static void
@@ -1202,6 +1445,8 @@ c_io_sysseek(mrbc_vm *vm, mrbc_value v[], int argc)
   }
 
   fptr = io_get_open_fptr(vm, v[0]);
+  if (fptr == NULL) return; /* raise error */
+  if (io_wbuf_flush(vm, fptr) == -1) return;
   pos = lseek(fptr->fd, (off_t)offset, (int)whence);
   if (pos == -1) {
     mrbc_raise(vm, MRBC_CLASS(RuntimeError), "sysseek failed");
@@ -1306,7 +1551,21 @@ c_io_read(mrbc_vm *vm, mrbc_value v[], int argc)
   struct picorb_io_buf *buf = fptr->buf;
 
   for (;;) {
-    io_fill_buf(vm, fptr);
+    if (buf->len == 0 && buf->capa <= length) {
+      /* large read: bypass the buffer */
+      fssize_t n = io_read_into(vm, fptr->fd, outbuf, length, sysread, 0);
+      if (n < 0) {
+        if (vm->exception.tt != MRBC_TT_EXCEPTION) {
+          mrbc_raise(vm, MRBC_CLASS(RuntimeError), "sysread failed");
+        }
+        return;
+      }
+      if (n == 0) fptr->eof = 1;
+      length -= n;
+    }
+    else {
+      io_fill_buf(vm, fptr);
+    }
     if (fptr->eof || length == 0) {
       if (outbuf.string->size == 0) {
         SET_NIL_RETURN();
@@ -1355,12 +1614,17 @@ c_io_write(mrbc_vm *vm, mrbc_value v[], int argc)
     fptr->buf->start = fptr->buf->len = 0;
   }
 
+  /* In sync mode, arguments of a single call are still coalesced */
+  bool through = fptr->sync && argc == 1;
   for (int i = 1; i < argc + 1; i++) {
-    len += fd_write(vm, fd, v[i]);
+    len += fd_write(vm, fptr, v[i], through);
     if (vm->exception.tt == MRBC_TT_EXCEPTION) {
       return; /* raise error */
     }
   }
+  if (fptr->sync && io_wbuf_flush(vm, fptr) == -1) {
+    return; /* raise error */
+  }
   SET_INT_RETURN(len);
 }
 
@@ -1422,7 +1686,11 @@ c_io_pwrite(mrbc_vm *vm, mrbc_value v[], int argc)
   buf = GET_ARG(1);
   off = GET_INT_ARG(2);
 
-  res = io_write_common(vm, pwrite, io_get_write_fptr(vm, v[0]), buf.string->data, buf.string->size, (off_t)off);
+  struct picorb_io *fptr = io_get_write_fptr(vm, v[0]);
+  if (fptr == NULL || io_wbuf_flush(vm, fptr) == -1) {
+    return; /* raise error */
+  }
+  res = io_write_common(vm, pwrite, fptr, buf.string->data, buf.string->size, (off_t)off);
   if (res.tt == MRBC_TT_NIL) {
     mrbc_raise(vm, MRBC_CLASS(IOError), "pwrite failed");
     return; /* raise error */
@@ -1446,7 +1714,9 @@ c_io_closed_q(mrbc_vm *vm, mrbc_value v[], int argc)
 static void
 c_io_flush(mrbc_vm *vm, mrbc_value v[], int argc)
 {
-  io_get_open_fptr(vm, v[0]);
+  struct picorb_io *fptr = io_get_open_fptr(vm, v[0]);
+  if (fptr == NULL) return; /* raise error */
+  io_wbuf_flush(vm, fptr);
 }
 
 static void
@@ -1464,18 +1734,23 @@ c_io_ungetc(mrbc_vm *vm, mrbc_value v[], int argc)
   str = GET_ARG(1);
 
   len = str.string->size;
-  if (len > SHRT_MAX) {
+  if (len > INT_MAX - buf->len) {
     mrbc_raise(vm, MRBC_CLASS(ArgumentError), "string too long to ungetc");
     return;
   }
-  if (len > PICORB_IO_BUF_SIZE - buf->len) {
-    fptr->buf = (struct picorb_io_buf*)mrbc_realloc(vm, buf, sizeof(struct picorb_io_buf)+buf->len+len-PICORB_IO_BUF_SIZE);
-    buf = fptr->buf;
+  if (len > buf->capa - buf->len) {
+    buf = (struct picorb_io_buf*)mrbc_realloc(vm, buf, sizeof(struct picorb_io_buf)+buf->len+len);
+    if (buf == NULL) {
+      mrbc_raise(vm, MRBC_CLASS(RuntimeError), "no memory");
+      return;
+    }
+    buf->capa = buf->len + (int)len;
+    fptr->buf = buf;
   }
   memmove(buf->mem+len, buf->mem+buf->start, buf->len);
   memcpy(buf->mem, str.string->data, len);
   buf->start = 0;
-  buf->len += (short)len;
+  buf->len += (int)len;
   SET_NIL_RETURN();
 }
 
@@ -1490,11 +1765,12 @@ c_io_pos(mrbc_vm *vm, mrbc_value v[], int argc)
   }
 
   if (fptr->buf) {
-    SET_INT_RETURN(pos - fptr->buf->len);
+    pos -= fptr->buf->len;
   }
-  else {
-    SET_INT_RETURN(pos);
+  if (fptr->wbuf) {
+    pos += fptr->wbuf->len;
   }
+  SET_INT_RETURN(pos);
 }
 
 static void
@@ -1533,6 +1809,8 @@ c_io_close_write(mrbc_vm *vm, mrbc_value v[], int argc)
 {
   struct picorb_io *fptr;
   fptr = io_get_open_fptr(vm, v[0]);
+  if (fptr == NULL) return; /* raise error */
+  if (io_wbuf_flush(vm, fptr) == -1) return;
   if (close((int)fptr->fd2) == -1) {
     mrbc_raise(vm, MRBC_CLASS(RuntimeError), "close failed");
     return;
@@ -1881,7 +2159,11 @@ c_io_syswrite(mrbc_vm *vm, mrbc_value v[], int argc)
   }
   buf = GET_ARG(1);
 
-  res = io_write_common(vm, syswrite, io_get_write_fptr(vm, v[0]), buf.string->data, buf.string->size, 0);
+  struct picorb_io *fptr = io_get_write_fptr(vm, v[0]);
+  if (fptr == NULL || io_wbuf_flush(vm, fptr) == -1) {
+    return; /* raise error */
+  }
+  res = io_write_common(vm, syswrite, fptr, buf.string->data, buf.string->size, 0);
   if (res.tt == MRBC_TT_NIL) {
     mrbc_raise(vm, MRBC_CLASS(RuntimeError), "syswrite failed");
     return; /* raise error */
@@ -1905,17 +2187,88 @@ c_io_sync_eq(mrbc_vm *vm, mrbc_value v[], int argc)
 {
   struct picorb_io *fptr;
   fptr = io_get_open_fptr(vm, v[0]);
+  if (fptr == NULL) return; /* raise error */
   mrbc_value sync = GET_ARG(1);
-  fptr->sync = (sync.tt != MRBC_TT_FALSE);
+  fptr->sync = (sync.tt != MRBC_TT_FALSE && sync.tt != MRBC_TT_NIL);
+  if (fptr->sync) {
+    io_wbuf_flush(vm, fptr);
+  }
+  SET_RETURN(sync);
+}
+
+static void
+c_io_buffer_size(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  struct picorb_io *fptr = io_get_open_fptr(vm, v[0]);
+  if (fptr == NULL) return; /* raise error */
+  SET_INT_RETURN(fptr->buf_size);
+}
+
+/*
+ * call-seq:
+ *  buffer_size = size -> size
+ *
+ * Capacity of the read and write buffers. Buffered input is kept even
+ * if it's longer than the new size; pending output is flushed.
+ */
+static void
+c_io_buffer_size_eq(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  struct picorb_io *fptr = io_get_open_fptr(vm, v[0]);
+  if (fptr == NULL) return; /* raise error */
+  if (argc != 1 || v[1].tt != MRBC_TT_INTEGER) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "buffer size should be an integer");
+    return;
+  }
+  mrbc_int_t size = GET_INT_ARG(1);
+  if (size < 1 || (mrbc_int_t)(INT_MAX - sizeof(struct picorb_io_buf)) < size) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "invalid buffer size");
+    return;
+  }
+
+  if (io_wbuf_flush(vm, fptr) == -1) return;
+  if (fptr->wbuf) {
+    mrbc_free(vm, fptr->wbuf);
+    fptr->wbuf = NULL;
+  }
+  if (fptr->buf) {
+    struct picorb_io_buf *buf = fptr->buf;
+    int capa = (size < buf->len) ? buf->len : (int)size;
+    memmove(buf->mem, buf->mem + buf->start, buf->len);
+    buf->start = 0;
+    buf = (struct picorb_io_buf*)mrbc_realloc(vm, buf, sizeof(struct picorb_io_buf) + capa);
+    if (buf == NULL) {
+      mrbc_raise(vm, MRBC_CLASS(RuntimeError), "no memory");
+      return;
+    }
+    buf->capa = capa;
+    fptr->buf = buf;
+  }
+  fptr->buf_size = (int)size;
+  SET_INT_RETURN(size);
 }
 
 /* initialization */
 
+/* Don't lose buffered output of an IO that was never closed */
+static void
+io_free(mrbc_value *self)
+{
+  struct picorb_io *fptr = io_data_get_ptr(*self);
+  if (fptr == NULL || fptr->wbuf == NULL) return;
+  if (fptr->fd >= 0) {
+    io_write_gather(io_get_write_fd(fptr), fptr->wbuf, NULL, 0);
+  }
+  mrbc_raw_free(fptr->wbuf);
+  fptr->wbuf = NULL;
+}
+
 void
 mrbc_posix_io_init(mrbc_vm *vm)
 {
   mrbc_class_EOFError = mrbc_define_class(vm, "EOFError", MRBC_CLASS(IOError));
   mrbc_class *mrbc_class_IO = mrbc_define_class(vm, "IO", mrbc_class_object);
+  mrbc_define_destructor(mrbc_class_IO, io_free);
 
   // class methods
   mrbc_define_method(vm, mrbc_class_IO, "new", c_io_new);
@@ -1929,6 +2282,8 @@ mrbc_posix_io_init(mrbc_vm *vm)
 #endif
 
   // instance methods
+  mrbc_define_method(vm, mrbc_class_IO, "buffer_size",    c_io_buffer_size);
+  mrbc_define_method(vm, mrbc_class_IO, "buffer_size=",   c_io_buffer_size_eq);
   mrbc_define_method(vm, mrbc_class_IO, "isatty",         c_io_isatty);
   mrbc_define_method(vm, mrbc_class_IO, "tty?",           c_io_isatty);
   mrbc_define_method(vm, mrbc_class_IO, "eof?",           c_io_eof_q);
@@ -1964,5 +2319,6 @@ mrbc_posix_io_init(mrbc_vm *vm)
   mrbc_define_method(vm, mrbc_class_IO, "readbyte",       c_io_readbyte);
 
   mrbc_io_file_init(vm, mrbc_class_IO);
+  mrbc_define_destructor(mrbc_get_class_by_name("File"), io_free);
   mrbc_io_file_test_init(vm);
 }
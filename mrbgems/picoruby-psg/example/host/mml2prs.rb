@@ -0,0 +1,27 @@
+# Compiles MML into a PRS file on the host with CRuby, for psg_render.c.
+# Without tracks, writes a short tune using every timbre, an envelope
+# and panning.
+#
+#   ruby mrbgems/picoruby-psg/example/host/mml2prs.rb out.prs ['track0' ['track1' ['track2']]]
+
+module PSG
+  class Driver
+    CHIP_CLOCK = 2_000_000 # include/psg.h
+  end
+end
+
+dir = File.expand_path("../../mrblib", __dir__)
+load File.join(dir, "mml.rb")
+load File.join(dir, "prs.rb")
+
+filename = ARGV.shift or abort "usage: ruby #{$0} out.prs [track ...]"
+tracks = ARGV
+if tracks.empty?
+  tracks = [
+    't132 @1 o5 l8 v13 p5 [cdefgab>c<]4 [c>c<]8',
+    't132 @2 o4 l4 s8 m300 p11 [cegb]4 [fa>c<a]4',
+    't132 @3 o3 l2 v11 [c g]4 @0 q4 [f c]4'
+  ]
+end
+PRS::Compiler.save(tracks, filename, songname: "psg_render")
+puts "#{filename}: #{File.size(filename)} bytes, #{tracks.size} tracks"
@@ -0,0 +1,207 @@
+/*
+ * picoruby-psg/example/host/psg_render.c
+ *
+ * Offline renderer for the host: plays a PRS file (compile MML with
+ * mml2prs.rb) through ports/common/psg.c without any hardware, writes
+ * the result as raw PCM and reports how many samples per second
+ * PSG_render_block() and the sample-by-sample reference render.
+ * The two outputs must be identical.
+ *
+ *   cc -O2 -o psg_render mrbgems/picoruby-psg/example/host/psg_render.c
+ *   ./psg_render song.prs [out.raw]
+ *   play -t raw -r 22050 -e signed -b 16 -c 2 out.raw
+ */
+
+#define PSG_RENDER_REFERENCE
+#include "../../ports/common/psg.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PRS_HEADER_SIZE 32
+#define TAIL_MS         500  // let the last notes ring
+#define ROUNDS          5    // best of
+
+typedef struct {
+  uint32_t ms;
+  psg_packet_t pkt;
+} event_t;
+
+static event_t *events;
+static size_t event_count;
+static uint8_t track_count;
+
+psg_cs_token_t
+PSG_enter_critical(void)
+{
+  return 0;
+}
+
+void
+PSG_exit_critical(psg_cs_token_t token)
+{
+  (void)token;
+}
+
+static void
+add_event(uint32_t ms, uint8_t op, uint8_t reg, uint8_t val, uint8_t arg)
+{
+  events = realloc(events, sizeof(event_t) * (event_count + 1));
+  if (!events) {
+    perror("realloc");
+    exit(1);
+  }
+  events[event_count].ms = ms;
+  events[event_count].pkt = (psg_packet_t){ .op = op, .reg = reg, .val = val, .arg = arg };
+  event_count++;
+}
+
+// Reads the commands the way PSG::Driver#play_prs does, without looping.
+// Returns the time of the last command in ms.
+static uint32_t
+load_prs(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    perror(filename);
+    exit(1);
+  }
+  uint8_t header[PRS_HEADER_SIZE];
+  if (fread(header, 1, PRS_HEADER_SIZE, fp) != PRS_HEADER_SIZE || memcmp(header, "PRS\0", 4)) {
+    fprintf(stderr, "%s: not a PRS file\n", filename);
+    exit(1);
+  }
+  track_count = header[6];
+  uint32_t ms = 0;
+  int op, val;
+  while ((op = fgetc(fp)) != EOF && (val = fgetc(fp)) != EOF) {
+    uint8_t ch = op & 0x0F;
+    switch (op & 0xF0) {
+      case 0x70: {  // OP_WAIT
+        int val2 = fgetc(fp), val3 = fgetc(fp);
+        if (val2 == EOF || val3 == EOF) break;
+        ms += val | (val2 << 8) | (val3 << 16);
+        break;
+      }
+      case 0x10: add_event(ms, PSG_PKT_CH_MUTE, ch, val, 0); break;
+      case 0x20: add_event(ms, PSG_PKT_REG_WRITE, ch, val, 0); break;
+      case 0x30: add_event(ms, PSG_PKT_LEGATO_SET, ch, val, 0); break;
+      case 0x40: add_event(ms, PSG_PKT_PAN_SET, ch, val, 0); break;
+      case 0x50: add_event(ms, PSG_PKT_TIMBRE_SET, ch, val, 0); break;
+      case 0x60: {  // OP_SET_LFO
+        int val2 = fgetc(fp), val3 = fgetc(fp);
+        if (val2 == EOF || val3 == EOF) break;
+        add_event(ms, PSG_PKT_LFO_SET, val, val2, val3);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  fclose(fp);
+  return ms;
+}
+
+// Same state as reset_psg() in src/psg.c, then unmutes the tracks as
+// PSG::Driver#play_mml does
+static void
+reset(void)
+{
+  memset(&psg, 0, sizeof(psg));
+  psg.r.volume[0] = psg.r.volume[1] = psg.r.volume[2] = 15;
+  psg.r.mixer = 0x38;
+  psg.mute_mask = 0x07;
+  psg.pan[0] = psg.pan[1] = psg.pan[2] = 8;
+  for (uint8_t tr = 0; tr < track_count && tr < 3; tr++) {
+    psg.mute_mask &= ~(1u << tr);
+  }
+}
+
+// Renders in BUF_SAMPLES / 2 blocks like the core 1 loop, running the
+// 1 ms tick (packets, then LFO) for the time rendered so far in between
+static double
+render(void (*renderer)(uint32_t *, uint32_t), uint32_t *out, uint32_t samples)
+{
+  struct timespec t0, t1;
+  reset();
+  size_t next = 0;
+  uint32_t tick_ms = 0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (uint32_t pos = 0; pos < samples; pos += BUF_SAMPLES / 2) {
+    uint32_t now_ms = (uint32_t)((uint64_t)pos * 1000 / SAMPLE_RATE);
+    while (tick_ms < now_ms) {
+      tick_ms++;
+      while (next < event_count && events[next].ms <= tick_ms) {
+        PSG_process_packet(&events[next++].pkt);
+      }
+      PSG_tick_1ms();
+    }
+    renderer(out + pos, BUF_SAMPLES / 2);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static double
+best_of(void (*renderer)(uint32_t *, uint32_t), uint32_t *out, uint32_t samples)
+{
+  double best = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    double sec = render(renderer, out, samples);
+    if (i == 0 || sec < best) best = sec;
+  }
+  return best;
+}
+
+static void
+report(const char *name, uint32_t samples, double sec)
+{
+  printf("%-20s %8.2f Msamples/s (%.0fx realtime)\n",
+         name, samples / sec / 1e6, samples / sec / SAMPLE_RATE);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s song.prs [out.raw]\n", argv[0]);
+    return 1;
+  }
+  uint32_t song_ms = load_prs(argv[1]) + TAIL_MS;
+  uint32_t samples = (uint32_t)((uint64_t)song_ms * SAMPLE_RATE / 1000);
+  samples = (samples + BUF_SAMPLES / 2 - 1) / (BUF_SAMPLES / 2) * (BUF_SAMPLES / 2);
+
+  uint32_t *block = malloc(samples * sizeof(uint32_t));
+  uint32_t *ref = malloc(samples * sizeof(uint32_t));
+  if (!block || !ref) {
+    perror("malloc");
+    return 1;
+  }
+  printf("%s: %zu commands, %.1f s, %u samples\n", argv[1], event_count, song_ms / 1000.0, samples);
+  report("PSG_render_block", samples, best_of(PSG_render_block, block, samples));
+  report("PSG_render_block_ref", samples, best_of(PSG_render_block_ref, ref, samples));
+
+  int exact = memcmp(block, ref, samples * sizeof(uint32_t)) == 0;
+  printf("bit-exact: %s\n", exact ? "yes" : "NO");
+
+  if (2 < argc) {
+    // 12-bit unsigned -> 16-bit signed little endian, L R
+    FILE *fp = fopen(argv[2], "wb");
+    if (!fp) {
+      perror(argv[2]);
+      return 1;
+    }
+    for (uint32_t i = 0; i < samples; i++) {
+      int16_t l = (int16_t)(((int32_t)(block[i] >> 16) - 2048) * 16);
+      int16_t r = (int16_t)(((int32_t)(block[i] & 0xFFFF) - 2048) * 16);
+      uint8_t frame[4] = { l & 0xFF, (l >> 8) & 0xFF, r & 0xFF, (r >> 8) & 0xFF };
+      fwrite(frame, 1, sizeof(frame), fp);
+    }
+    fclose(fp);
+  }
+  free(block);
+  free(ref);
+  free(events);
+  return exact ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+/*
+ * picoruby-psg/include/mml.h
+ *
+ * Native MML compiler: the same language as mrblib/mml.rb, turned into
+ * psg_packet_t directly so that playback allocates no Ruby objects.
+ */
+
+#ifndef PSG_MML_DEFINED_H_
+#define PSG_MML_DEFINED_H_
+
+#include "psg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PSG_MML_MAX_TRACKS  3
+#define PSG_MML_QUEUE_LEN   8   // events parsed ahead per track
+#define PSG_MML_MAX_NESTING 8   // [ ... ]N
+#ifndef PSG_MML_MAX_EXPANDED
+#define PSG_MML_MAX_EXPANDED 8192 // bytes per track after loop expansion
+#endif
+#define PSG_MML_ERROR       ((size_t)-1)
+#define PSG_MML_TOO_LONG    ((size_t)-2)
+
+typedef enum {
+  PSG_MML_SEGNO = 0,
+  PSG_MML_MUTE,        // flag, release
+  PSG_MML_PLAY,        // tone period, sustain
+  PSG_MML_VOLUME,
+  PSG_MML_ENV_PERIOD,
+  PSG_MML_ENV_SHAPE,
+  PSG_MML_LEGATO,
+  PSG_MML_TIMBRE,
+  PSG_MML_PAN,
+  PSG_MML_LFO,         // depth, rate
+  PSG_MML_MIXER,
+  PSG_MML_NOISE,
+} psg_mml_command_t;
+
+typedef struct {
+  uint8_t command;     // psg_mml_command_t
+  int32_t arg0;
+  int32_t arg1;
+} psg_mml_event_t;
+
+/* One track: the parser state of MML#reduce_next */
+typedef struct {
+  const char *src;     // expanded by psg_mml_expand()
+  uint32_t len;
+  uint32_t cursor;
+  uint32_t segno_pos;
+  int32_t  octave;
+  int32_t  tempo;
+  int32_t  q;
+  int32_t  transpose;
+  int32_t  detune;
+  int32_t  common_duration;
+  bool     loop;
+  bool     finished;
+  bool     wrapped;    // back at the segno with no note since
+  uint8_t  track_id;
+  uint8_t  queue_head;
+  uint8_t  queue_len;
+  psg_mml_event_t queue[PSG_MML_QUEUE_LEN];
+} psg_mml_track_t;
+
+/* Up to three tracks merged in time order as MML.compile_multi does */
+typedef struct {
+  psg_mml_track_t track[PSG_MML_MAX_TRACKS];
+  psg_mml_event_t event[PSG_MML_MAX_TRACKS];  // next event of each track
+  uint32_t tick[PSG_MML_MAX_TRACKS];          // and when it happens
+  uint8_t  count;
+  uint8_t  active;     // bit per track that still has an event
+  uint8_t  mixer;      // R7 as PSG::Driver#play_mml keeps it
+  uint32_t prev_time;
+  uint32_t delay;      // ms not yet carried by a packet
+  char     error[80];
+} psg_mml_t;
+
+// Length of the track after loop expansion, PSG_MML_ERROR if nested too
+// deep, PSG_MML_TOO_LONG if longer than PSG_MML_MAX_EXPANDED
+size_t psg_mml_expanded_size(const char *src, size_t len);
+// Writes the expanded, lowercased track to dst and returns its length
+size_t psg_mml_expand(char *dst, const char *src, size_t len);
+
+void psg_mml_init(psg_mml_t *mml);
+// src must be expanded and stay alive while mml is in use
+void psg_mml_add_track(psg_mml_t *mml, const char *src, size_t len, bool loop);
+// Parses the first event of each track. false on error (see mml->error)
+bool psg_mml_start(psg_mml_t *mml);
+// Writes up to max packets (max >= 2). Returns the count, 0 when the
+// song is over or PSG_MML_ERROR
+size_t psg_mml_compile(psg_mml_t *mml, psg_packet_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PSG_MML_DEFINED_H_ */
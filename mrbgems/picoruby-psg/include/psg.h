@@ -53,6 +53,8 @@ typedef struct {
   volatile uint16_t head;  // writer cursor (next free)
   volatile uint16_t tail;  // reader cursor (next valid)
   psg_packet_t *buf;
+  volatile bool starved;       // reader took the last packet
+  volatile uint32_t underruns; // packets pushed after they were due
 } psg_ringbuf_t;
 
 typedef enum {
@@ -153,6 +155,9 @@ typedef struct {
 // Callback
 bool PSG_audio_cb(void);
 void PSG_render_block(uint32_t *dst, uint32_t samples);
+#if defined(PSG_RENDER_REFERENCE)
+void PSG_render_block_ref(uint32_t *dst, uint32_t samples);
+#endif
 
 // Ring buffer
 bool PSG_rb_peek(psg_packet_t *out);
@@ -2,6 +2,8 @@ module PSG
   class Driver
 
     WAIT_MS = 500
+    FEED_MS = 100 # ring buffer refill interval
+    PRS_CHUNK_SIZE = 256
 
     def initialize(type, **opt)
       case type
@@ -36,49 +38,12 @@ module PSG
 
     def play_mml(tracks, terminate: true)
       trap
-      mixer = 0b111000 # Noise all off, Tone all on
       # Give the ring buffer time to fill with some amount of packets
       tracks.size.times { |tr| invoke :mute, tr, 0, WAIT_MS }
-      MML.compile_multi(tracks, loop: true) do |delta, tr, command, arg0, arg1 = 0|
-        case command
-        when :segno
-          # Ignore. MML takes care of `$` macro
-        when :mute
-          invoke :mute, tr, arg0, delta
-        when :play
-          invoke :send_reg, tr * 2    , arg0 & 0xFF       , delta
-          invoke :send_reg, tr * 2 + 1, (arg0 >> 8) & 0x0F, 0
-        when :volume
-          invoke :send_reg, tr + 8, arg0, delta
-        when :env_period
-          invoke :send_reg, 11, arg0 & 0xFF, delta
-          invoke :send_reg, 12, arg0 >> 8  , 0
-        when :env_shape
-          invoke :send_reg, 13, arg0, delta
-        when :legato
-          invoke :set_legato, tr, arg0, delta
-        when :timbre
-          invoke :set_timbre, tr, arg0, delta
-        when :pan
-          invoke :set_pan, tr, arg0, delta
-        when :lfo
-          invoke :set_lfo, tr, arg0, arg1, delta
-        when :mixer
-          case arg0
-          when 0 # Tone on, Noise off
-            mixer |= (1 << (tr + 3))  # Set noise bit (off)
-            mixer &= ~(1 << tr)       # Clear tone bit (on)
-          when 1 # Tone off, Noise on
-            mixer &= ~(1 << (tr + 3)) # Clear noise bit (on)
-            mixer |= (1 << tr)        # Set tone bit (off)
-          when 2 # Tone on, Noise on
-            mixer &= ~(1 << tr)       # Clear tone bit (on)
-            mixer &= ~(1 << (tr + 3)) # Clear noise bit (on)
-          end
-          invoke :send_reg, 7, mixer, delta
-        when :noise
-          invoke :send_reg, 6, arg0, delta
-        end
+      # Compiled in C (src/mml.c) straight into the ring buffer
+      mml_start(tracks, true)
+      while mml_fill
+        sleep_ms FEED_MS
       end
       join if terminate
       return self
@@ -93,12 +58,14 @@ module PSG
       file = File.open(filename, "r")
       header = file.read(PRS::HEADER_SIZE)
       length, loop_start_pos = PRS.check_header(header.to_s)
-      delta = 0
+      prs_start
       while true
-        op, val = file.read(2)&.bytes
-        if op.nil? || val.nil?
+        chunk = file.read(PRS_CHUNK_SIZE)
+        if chunk.nil? || chunk.empty?
           if 0 < loop_start_pos
             file.seek(loop_start_pos)
+            # A wait at the end of the file delays the loop
+            prs_start(true)
             3.times do |tr|
               invoke :mute, tr, 0, 0
             end
@@ -108,28 +75,10 @@ module PSG
             break
           end
         end
-        case op & 0xF0
-        when PRS::OP_WAIT
-          val2, val3 = file.read(2)&.bytes
-          break if val2.nil? || val3.nil?
-          delta = val | (val2 << 8) | (val3 << 16)
-          next
-        when PRS::OP_MUTE
-          invoke :mute, op & 0x0F, val, delta
-        when PRS::OP_SEND_REG
-          invoke :send_reg, op & 0x0F, val, delta
-        when PRS::OP_SET_LEGATO
-          invoke :set_legato, op & 0x0F, val, delta
-        when PRS::OP_SET_PAN
-          invoke :set_pan, op & 0x0F, val, delta
-        when PRS::OP_SET_TIMBRE
-          invoke :set_timbre, op & 0x0F, val, delta
-        when PRS::OP_SET_LFO
-          val2, val3 = file.read(2)&.bytes
-          break if val2.nil? || val3.nil?
-          invoke :set_lfo, val, val2, val3, delta
+        # Commands are decoded in C (src/psg.c) without Ruby objects
+        until prs_feed(chunk)
+          sleep_ms FEED_MS
         end
-        delta = 0
       end
     rescue => e
       puts "Error during MML playback: #{e.message}"
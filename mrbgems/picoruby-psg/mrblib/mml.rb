@@ -47,7 +47,7 @@ class MML # Music Macro Language
       # @type var min_tick: Integer
       delta = min_tick - prev_time
       # @type var min_track: Integer
-      yield(delta, min_track, event[0], event[1])
+      yield(delta, min_track, event[0], event[1], event[2])
       prev_time = min_tick
 
       next_event = parsers[min_track].reduce_next
@@ -152,6 +152,7 @@ class MML # Music Macro Language
         depth = subvalue
         unless depth.nil?
           mod_depth = depth * 100
+          mod_rate = nil # not the one of a previous `j`
           if @track.getbyte(@cursor + 1) == 44 # ','
             @cursor += 1
             mod_rate = subvalue
@@ -163,7 +164,7 @@ class MML # Music Macro Language
         if sign == 43 || sign == 45 # '+' or '-'
           @cursor += 1
           n = subvalue || 0
-          @transpose = sign == "+" ? n : -n
+          @transpose = sign == 43 ? n : -n
         end
       when 108 # 'l' # Length
         fraction = subvalue
@@ -174,8 +175,8 @@ class MML # Music Macro Language
         @cursor += 1
         @octave = (@track.getbyte(@cursor) || 52) - 48 # Convert one letter ASCII number to integer
       when 112 # 'p' # Pan
-        pan = [subvalue, 15].min
-        push_event(:pan, pan || 8)
+        pan = [subvalue || 8, 15].min
+        push_event(:pan, pan)
       when 113 # 'q' # Gate time
         @cursor += 1
         @q = (@track.getbyte(@cursor) || 56) - 48 # Convert one letter ASCII number to integer
@@ -189,14 +190,13 @@ class MML # Music Macro Language
         @tempo = subvalue
         update_common_duration(4) # Note: common fraction is also reset
       when 118 # 'v' # Volume
-        @volume = [subvalue, 15].min
-        push_event(:volume, @volume || 15)
+        @volume = [subvalue || 15, 15].min
+        push_event(:volume, @volume)
       when 120 # 'x' # Mixer
         @cursor += 1
-        push_event(:mixer, @track.getbyte(@cursor) || 0)
+        push_event(:mixer, (@track.getbyte(@cursor) || 48) - 48)
       when 121 # 'y' # Noise period
-        @cursor += 1
-        push_event(:noise, @track.getbyte(@cursor) || 0)
+        push_event(:noise, subvalue || 0)
       when 122 # 'z' # Detune
         @detune = subvalue || 0
       when 123 # '{' # Start envelope non-reset section
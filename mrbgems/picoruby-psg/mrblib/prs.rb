@@ -82,7 +82,6 @@ module PRS
       @file.write("\0\0\0\0") # Placeholder for loop start position
       @file.write(@songname.ljust(SONGNAME_MAX_LEN, "\0"))
       mixer = 0b111000 # Noise all off, Tone all on
-      chip_clock = PSG::Driver::CHIP_CLOCK
       loop_start_pos = 0
       MML.compile_multi(@tracks) do |delta, tr, command, *args|
         if 0 < delta
@@ -94,8 +93,8 @@ module PRS
         when :mute
           gen2(OP_MUTE, tr, args[0])
         when :play
-          gen2(OP_SEND_REG, tr * 2, (chip_clock / (32 * args[0])).to_i & 0xFF)
-          gen2(OP_SEND_REG, tr * 2 + 1, ((chip_clock / (32 * args[0])).to_i >> 8) & 0x0F)
+          gen2(OP_SEND_REG, tr * 2, args[0] & 0xFF)
+          gen2(OP_SEND_REG, tr * 2 + 1, (args[0] >> 8) & 0x0F)
         when :rest
           gen2(OP_SEND_REG, tr * 2, 0)
           gen2(OP_SEND_REG, tr * 2 + 1, 0)
@@ -4,6 +4,8 @@
 
 #include "../../include/psg.h"
 
+#include <string.h>
+
 static inline void
 __breakpoint(void)
 {
@@ -319,6 +321,22 @@ soft_clip(uint32_t x)
   return (y > MAX_SAMPLE_WIDTH) ? MAX_SAMPLE_WIDTH : (uint16_t)y;
 }
 
+// Phase increment with vibrato applied. The LFO only moves in
+// PSG_tick_1ms(), so this is constant between ticks.
+static inline uint32_t
+lfo_tone_inc(int tr)
+{
+  /* Vibrato: ±depth cent  -> multiplicative factor ~= 2^(cent/1200) */
+  int8_t depth = (int8_t)psg.lfo_depth[tr];          /* signed */
+  uint16_t ph  = psg.lfo_phase[tr];
+  /* simple triangle LFO: 0-32767-0-… */
+  int16_t tri = (ph < 32768) ? ph : (65535 - ph);    /* 0-32767 */
+  int32_t cent = (depth * tri) >> 15;                /* −depth..+depth */
+  /* ln(2)/1200 ≒ 0.0005775  -> use 16.16 fixed ->> 38 */
+  int32_t frac = (cent * 38) >> 8;                   /* ~= log2 factor */
+  return psg.tone_inc[tr] + ((psg.tone_inc[tr] * frac) >> 16);  /* FM */
+}
+
 static inline void
 PSG_calc_sample(uint16_t *l, uint16_t *r)
 {
@@ -339,16 +357,7 @@ PSG_calc_sample(uint16_t *l, uint16_t *r)
   for (int tr = 0; tr < 3; ++tr) {
     // phase
     if (psg.tone_inc[tr]) {
-      /* Vibrato: ±depth cent  -> multiplicative factor ~= 2^(cent/1200) */
-      int8_t depth = (int8_t)psg.lfo_depth[tr];          /* signed */
-      uint16_t ph  = psg.lfo_phase[tr];
-      /* simple triangle LFO: 0-32767-0-… */
-      int16_t tri = (ph < 32768) ? ph : (65535 - ph);    /* 0-32767 */
-      int32_t cent = (depth * tri) >> 15;                /* −depth..+depth */
-      /* ln(2)/1200 ≒ 0.0005775  -> use 16.16 fixed ->> 38 */
-      int32_t frac = (cent * 38) >> 8;                   /* ~= log2 factor */
-      uint32_t inc = psg.tone_inc[tr] + ((psg.tone_inc[tr] * frac) >> 16);  /* FM */
-      psg.tone_phase[tr] += inc;
+      psg.tone_phase[tr] += lfo_tone_inc(tr);
     }
 
     uint32_t tone_amp;
@@ -407,8 +416,10 @@ PSG_calc_sample(uint16_t *l, uint16_t *r)
   *r = (uint16_t)soft_clip(mix_r);
 }
 
+#if defined(PSG_RENDER_REFERENCE)
+// Sample-by-sample renderer that PSG_render_block() must match bit for bit
 void
-PSG_render_block(uint32_t *dst, uint32_t samples)
+PSG_render_block_ref(uint32_t *dst, uint32_t samples)
 {
   for (uint32_t i = 0; i < samples; i++) {
     uint16_t l, r;
@@ -416,6 +427,181 @@ PSG_render_block(uint32_t *dst, uint32_t samples)
     dst[i] = ((uint32_t)l << 16) | r;
   }
 }
+#endif
+
+/*
+ * Block renderer
+ *
+ * Produces the same samples as PSG_calc_sample() but one channel at a
+ * time over a run of samples: timbre, mixer, mute, volume and pan are
+ * looked up once per run and the vibrato increment once per chunk.
+ * A run ends right before the sample on which update_envelope() would
+ * step a level, and that sample is rendered alone after calling
+ * update_envelope() as the per-sample path does. Register writes made
+ * by the tick interrupt in the middle of a chunk are picked up at the
+ * next run instead of the next sample.
+ */
+#ifndef PSG_CHUNK_SAMPLES
+#define PSG_CHUNK_SAMPLES 64
+#endif
+
+static uint32_t chunk_mix_l[PSG_CHUNK_SAMPLES];
+static uint32_t chunk_mix_r[PSG_CHUNK_SAMPLES];
+static uint32_t chunk_noise[PSG_CHUNK_SAMPLES]; // 0 or 0xFFFFFFFF
+
+static inline bool
+envelope_active(int tr)
+{
+  return (psg.r.volume[tr] & 0x10) && psg.env_running[tr] && psg.r.envelope_period;
+}
+
+// Samples up to and including the one on which update_envelope() steps
+// a level. 0 when no envelope is running.
+static inline uint32_t
+envelope_countdown(void)
+{
+  uint32_t next = 0;
+  for (int tr = 0; tr < 3; ++tr) {
+    if (!envelope_active(tr)) continue;
+    uint32_t k = 1;
+    if (psg.env_cnt[tr] + 1u < psg.r.envelope_period) {
+      k = psg.r.envelope_period - psg.env_cnt[tr];
+    }
+    if (next == 0 || k < next) next = k;
+  }
+  return next;
+}
+
+// What update_envelope() does over n samples on which no level steps
+static inline void
+envelope_skip(uint32_t n)
+{
+  for (int tr = 0; tr < 3; ++tr) {
+    if (envelope_active(tr)) psg.env_cnt[tr] += n;
+  }
+}
+
+static void
+render_channel(int tr, uint32_t inc, uint32_t offset, uint32_t n)
+{
+  const uint32_t *noise = chunk_noise + offset;
+  uint32_t *mix_l = chunk_mix_l + offset;
+  uint32_t *mix_r = chunk_mix_r + offset;
+  uint32_t phase = psg.tone_phase[tr];
+  bool use_tone = !(psg.r.mixer & (1 << tr));
+  uint32_t noise_mask = (psg.r.mixer & (1 << (tr + 3))) ? 0 : 0xFFFFFFFF;
+
+  uint8_t vol = psg.r.volume[tr];
+  if (vol & 0x10) vol = psg.env_level[tr];
+  uint32_t gain = vol_tab[vol & 0x0F];
+
+  if ((psg.mute_mask & (1u << tr)) || gain == 0 || (!use_tone && !noise_mask)) {
+    psg.tone_phase[tr] = phase + inc * n;
+    return;
+  }
+  uint8_t bal = psg.pan[tr];
+  uint32_t pan_l = pan_tab_l[bal];
+  uint32_t pan_r = pan_tab_r[bal];
+
+#define PSG_CHANNEL_LOOP(tone_amp) \
+  for (uint32_t i = 0; i < n; i++) { \
+    phase += inc; \
+    uint32_t active_amp = (tone_amp) | (noise[i] & noise_mask & 4095); \
+    uint32_t amp = (active_amp * gain) >> 12; \
+    mix_l[i] += (amp * pan_l) >> 12; \
+    mix_r[i] += (amp * pan_r) >> 12; \
+  }
+
+  switch (use_tone ? psg.timbre[tr] : PSG_TIMBRE_SQUARE) {
+    case PSG_TIMBRE_TRIANGLE:
+      PSG_CHANNEL_LOOP((((phase >> 19) ^ (phase >> 31)) & 0x1FFF) >> 1);
+      break;
+    case PSG_TIMBRE_SAWTOOTH:
+      PSG_CHANNEL_LOOP(phase >> 20);
+      break;
+    case PSG_TIMBRE_INVSAWTOOTH:
+      PSG_CHANNEL_LOOP(4095 - (phase >> 20));
+      break;
+    default: {
+      // Square wave and noise are either silent or at full amplitude,
+      // so each sample adds a precomputed level or nothing
+      uint32_t amp = (4095 * gain) >> 12;
+      uint32_t on_l = (amp * pan_l) >> 12;
+      uint32_t on_r = (amp * pan_r) >> 12;
+      uint32_t tone_mask = use_tone ? 0xFFFFFFFF : 0;
+      for (uint32_t i = 0; i < n; i++) {
+        phase += inc;
+        uint32_t on = ((0u - (phase >> 31)) & tone_mask) | (noise[i] & noise_mask);
+        mix_l[i] += on_l & on;
+        mix_r[i] += on_r & on;
+      }
+      break;
+    }
+  }
+#undef PSG_CHANNEL_LOOP
+
+  psg.tone_phase[tr] = phase;
+}
+
+static void
+render_chunk(uint32_t *dst, uint32_t n)
+{
+  // noise LFSR (17-bit) runs whether or not a channel listens to it
+  uint32_t shift = psg.noise_shift;
+  uint32_t cnt = psg.noise_cnt;
+  uint32_t period = psg.r.noise_period + 1;
+  for (uint32_t i = 0; i < n; i++) {
+    if (++cnt >= period) {
+      uint32_t fb = ((shift ^ (shift >> 3)) & 1);
+      shift = (shift >> 1) | (fb << 16);
+      cnt = 0;
+    }
+    chunk_noise[i] = 0u - (shift & 1);
+  }
+  psg.noise_shift = shift;
+  psg.noise_cnt = cnt;
+
+  uint32_t inc[3];
+  for (int tr = 0; tr < 3; ++tr) {
+    inc[tr] = psg.tone_inc[tr] ? lfo_tone_inc(tr) : 0;
+  }
+  memset(chunk_mix_l, 0, n * sizeof(uint32_t));
+  memset(chunk_mix_r, 0, n * sizeof(uint32_t));
+
+  uint32_t pos = 0;
+  while (pos < n) {
+    uint32_t len = n - pos;
+    uint32_t k = envelope_countdown();
+    if (k == 1) {
+      update_envelope();
+      len = 1;
+    } else if (k) {
+      if (k - 1 < len) len = k - 1;
+      envelope_skip(len);
+    }
+    for (int tr = 0; tr < 3; ++tr) {
+      render_channel(tr, inc[tr], pos, len);
+    }
+    pos += len;
+  }
+
+  for (uint32_t i = 0; i < n; i++) {
+    uint16_t l = (uint16_t)soft_clip(chunk_mix_l[i]);
+    uint16_t r = (uint16_t)soft_clip(chunk_mix_r[i]);
+    dst[i] = ((uint32_t)l << 16) | r;
+  }
+}
+
+void
+PSG_render_block(uint32_t *dst, uint32_t samples)
+{
+  while (samples) {
+    uint32_t n = (samples < PSG_CHUNK_SAMPLES) ? samples : PSG_CHUNK_SAMPLES;
+    render_chunk(dst, n);
+    dst += n;
+    samples -= n;
+  }
+}
 
 uint32_t pcm_buf[BUF_SAMPLES] = {0};
 volatile uint32_t wr_idx = 0;
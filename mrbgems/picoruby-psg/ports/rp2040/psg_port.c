@@ -82,12 +82,18 @@ static inline void
 psg_process_packets(void)
 {
   psg_packet_t pkt;
+  bool popped = false;
   while (PSG_rb_peek(&pkt)) {
     if (0 < (int32_t)(pkt.tick - g_tick_ms)) break;
+    // Late after the ring ran dry: the producer did not keep up
+    if (rb.starved && pkt.tick < g_tick_ms) rb.underruns++;
+    rb.starved = false;
     g_tick_ms -= pkt.tick;
     PSG_rb_pop();
     PSG_process_packet(&pkt);
+    popped = true;
   }
+  if (popped && rb.tail == rb.head) rb.starved = true;
 }
 
 static bool
@@ -0,0 +1,506 @@
+/*
+ * picoruby-psg/src/mml.c
+ *
+ * Native counterpart of mrblib/mml.rb. The parser works on the loop
+ * expanded track in place and queues at most a few events per track,
+ * and the merged events are mapped to packets as PSG::Driver#play_mml
+ * does, so a whole song goes out without creating Ruby objects.
+ */
+
+#include "../include/mml.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DURATION_BASE (1000.0 * 60 * 4)
+#define PERIOD_FACTOR (CHIP_CLOCK / 32)
+
+/* a b c d e f g */
+static const int8_t notes[7] = { 0, 2, 3, 5, 7, 8, 10 };
+static const double coef_table[4] = { 1.0, 1.5, 1.75, 1.875 };
+
+/* ----- loop expansion ------------------------------------------------ */
+
+/*
+ * [ ... ]N repeats N times (no N: dropped), '|' is removed and a stray
+ * ']' ends the track, as MML#expand_loops does. dst == NULL only counts.
+ * The result is kept within PSG_MML_MAX_EXPANDED bytes, since the whole
+ * track is allocated at once.
+ */
+static size_t
+expand(char *dst, const char *src, size_t len, size_t *index, int depth)
+{
+  if (PSG_MML_MAX_NESTING < depth) return PSG_MML_ERROR;
+  size_t out = 0;
+  while (*index < len) {
+    char c = src[*index];
+    if (c == '[') {
+      size_t start = ++(*index);
+      size_t inner = expand(NULL, src, len, index, depth + 1);
+      if (inner == PSG_MML_ERROR || inner == PSG_MML_TOO_LONG) return inner;
+      size_t count = 0;
+      while (*index < len && '0' <= src[*index] && src[*index] <= '9') {
+        count = count * 10 + (size_t)(src[*index] - '0');
+        if (0xFFFF < count) return PSG_MML_ERROR;
+        (*index)++;
+      }
+      if (count && (PSG_MML_MAX_EXPANDED - out) / count < inner) return PSG_MML_TOO_LONG;
+      if (dst && count) {
+        expand(dst + out, src, len, &start, depth + 1);
+        for (size_t i = 1; i < count; i++) {
+          memcpy(dst + out + inner * i, dst + out, inner);
+        }
+      }
+      out += inner * count;
+    } else if (c == ']') {
+      (*index)++;
+      return out;
+    } else {
+      if (c != '|') {
+        if (out == PSG_MML_MAX_EXPANDED) return PSG_MML_TOO_LONG;
+        if (dst) dst[out] = ('A' <= c && c <= 'Z') ? c + ('a' - 'A') : c;
+        out++;
+      }
+      (*index)++;
+    }
+  }
+  return out;
+}
+
+size_t
+psg_mml_expanded_size(const char *src, size_t len)
+{
+  size_t index = 0;
+  return expand(NULL, src, len, &index, 0);
+}
+
+size_t
+psg_mml_expand(char *dst, const char *src, size_t len)
+{
+  size_t index = 0;
+  return expand(dst, src, len, &index, 0);
+}
+
+/* ----- one track ----------------------------------------------------- */
+
+static int
+peek(const psg_mml_track_t *t, uint32_t pos)
+{
+  return (pos < t->len) ? (uint8_t)t->src[pos] : -1;
+}
+
+static void
+push_event(psg_mml_track_t *t, uint8_t command, int32_t arg0, int32_t arg1)
+{
+  psg_mml_event_t *ev = &t->queue[(t->queue_head + t->queue_len) % PSG_MML_QUEUE_LEN];
+  ev->command = command;
+  ev->arg0 = arg0;
+  ev->arg1 = arg1;
+  t->queue_len++;
+}
+
+// Digits after the cursor, 0 when there are none
+static int32_t
+subvalue(psg_mml_track_t *t)
+{
+  uint32_t val = 0;
+  int c;
+  t->cursor++;
+  while ((c = peek(t, t->cursor)) >= '0' && c <= '9') {
+    if (val < 100000000) val = val * 10 + (uint32_t)(c - '0');
+    t->cursor++;
+  }
+  t->cursor--;
+  return (int32_t)val;
+}
+
+static double
+punti_coef(psg_mml_track_t *t)
+{
+  int punti = 0;
+  t->cursor++;
+  while (peek(t, t->cursor) == '.') {
+    punti++;
+    t->cursor++;
+  }
+  t->cursor--;
+  return (punti < 4) ? coef_table[punti] : 2.0;
+}
+
+static void
+update_common_duration(psg_mml_track_t *t, double fraction)
+{
+  t->common_duration = (int32_t)(DURATION_BASE / t->tempo / fraction + 0.5);
+}
+
+static int32_t
+get_tone_period(psg_mml_track_t *t, int note, int semitone)
+{
+  int val = notes[note - 'a'];
+  int octave_fix = (note == 'a' || note == 'b') ? 1 : 0;
+  switch (semitone) {
+    case '-':
+      t->cursor++;
+      if (note == 'a') {
+        octave_fix = 0;
+        val += 11;
+      } else {
+        val -= 1;
+      }
+      break;
+    case '+': case '#':
+      t->cursor++;
+      val += 1;
+      break;
+    default:
+      break;
+  }
+  // 2 << shift as Ruby computes it, negative shifts included
+  int shift = t->octave + octave_fix;
+  double base = (0 <= shift) ? ldexp(2.0, shift) : (shift == -1 ? 1.0 : 0.0);
+  double pitch = 6.875 * base * pow(2.0, val / 12.0);
+  if (t->transpose != 0) pitch *= pow(2.0, t->transpose / 12.0);
+  if (t->detune != 0) pitch /= pow(2.0, t->detune / 128.0);
+  double period = PERIOD_FACTOR / pitch;
+  if (!(period < 2147483647.0)) return -1;
+  return (int32_t)period;
+}
+
+static bool
+track_error(psg_mml_t *mml, psg_mml_track_t *t, const char *what, int c)
+{
+  if (c < 0) {
+    snprintf(mml->error, sizeof(mml->error), "TR: %d %s at position %u",
+             t->track_id, what, (unsigned)t->cursor);
+  } else {
+    snprintf(mml->error, sizeof(mml->error), "TR: %d %s: `%c` at position %u",
+             t->track_id, what, c, (unsigned)t->cursor);
+  }
+  return false;
+}
+
+// MML#reduce_next. Returns false on a syntax error; *ev is NULL when the
+// track is over
+static bool
+reduce_next(psg_mml_t *mml, psg_mml_track_t *t, psg_mml_event_t **ev)
+{
+  *ev = NULL;
+  if (t->queue_len == 0 && !t->finished) {
+    while (t->queue_len < PSG_MML_QUEUE_LEN - 2) {
+      int c = peek(t, t->cursor);
+      if (c < 0) {
+        // Back to the segno, unless the last pass had nothing to play
+        if (t->loop && 0 < t->segno_pos && !t->wrapped) {
+          t->cursor = t->segno_pos;
+          t->wrapped = true;
+          continue;
+        }
+        push_event(t, PSG_MML_MUTE, 1, 0);
+        t->finished = true;
+        break;
+      }
+      int32_t tone_period = 0;
+      int32_t length = 0;
+      bool note = false;
+      switch (c) {
+        case '$':
+          t->segno_pos = t->cursor + 1;
+          push_event(t, PSG_MML_SEGNO, 0, 0);
+          break;
+        case '<':
+          if (1 < t->octave) t->octave--;
+          break;
+        case '>':
+          if (t->octave < 8) t->octave++;
+          break;
+        case '@': {
+          t->cursor++;
+          int d = peek(t, t->cursor);
+          push_event(t, PSG_MML_TIMBRE, ((d < 0) ? '0' : d) - '0', 0);
+          break;
+        }
+        case 'a': case 'b': case 'c': case 'd': case 'e': case 'f': case 'g': case 'r': {
+          note = true;
+          if (c == 'r') {
+            tone_period = -1;
+          } else {
+            tone_period = get_tone_period(t, c, peek(t, t->cursor + 1));
+            if (tone_period < 0) return track_error(mml, t, "Invalid note", c);
+          }
+          int next = peek(t, t->cursor + 1);
+          if (('1' <= next && next <= '9') || next == '.') {
+            int32_t fraction = subvalue(t);
+            if (fraction == 0) {
+              length = (int32_t)(t->common_duration * punti_coef(t) + 0.5);
+            } else {
+              double coef = punti_coef(t);
+              length = (int32_t)(DURATION_BASE / t->tempo / fraction * coef + 0.5);
+            }
+          } else {
+            length = t->common_duration;
+          }
+          break;
+        }
+        case 'j': {
+          int32_t depth = subvalue(t);
+          if (depth) {
+            int32_t rate = 0;
+            if (peek(t, t->cursor + 1) == ',') {
+              t->cursor++;
+              rate = subvalue(t);
+            }
+            push_event(t, PSG_MML_LFO, depth * 100, rate);
+          }
+          break;
+        }
+        case 'k': {
+          int sign = peek(t, t->cursor + 1);
+          if (sign == '+' || sign == '-') {
+            t->cursor++;
+            int32_t n = subvalue(t);
+            t->transpose = (sign == '+') ? n : -n;
+          }
+          break;
+        }
+        case 'l': {
+          int32_t fraction = subvalue(t);
+          if (fraction) update_common_duration(t, fraction * punti_coef(t));
+          break;
+        }
+        case 'o': {
+          t->cursor++;
+          int d = peek(t, t->cursor);
+          t->octave = ((d < 0) ? '4' : d) - '0';
+          break;
+        }
+        case 'p': {
+          int32_t pan = subvalue(t);
+          push_event(t, PSG_MML_PAN, pan ? (pan < 15 ? pan : 15) : 8, 0);
+          break;
+        }
+        case 'q': {
+          t->cursor++;
+          int d = peek(t, t->cursor);
+          t->q = ((d < 0) ? '8' : d) - '0';
+          if (t->q < 1 || 8 < t->q) t->q = 8;
+          break;
+        }
+        case 's':
+          push_event(t, PSG_MML_VOLUME, 16, 0); // Use envelope instead of volume
+          push_event(t, PSG_MML_ENV_SHAPE, subvalue(t) & 0x0F, 0);
+          break;
+        case 'm':
+          push_event(t, PSG_MML_ENV_PERIOD, subvalue(t) & 0xFFFF, 0);
+          break;
+        case 't': {
+          int32_t tempo = subvalue(t);
+          if (tempo == 0) return track_error(mml, t, "Invalid tempo", -1);
+          t->tempo = tempo;
+          update_common_duration(t, 4); // Note: common fraction is also reset
+          break;
+        }
+        case 'v': {
+          int32_t volume = subvalue(t);
+          push_event(t, PSG_MML_VOLUME, volume ? (volume < 15 ? volume : 15) : 15, 0);
+          break;
+        }
+        case 'x': {
+          t->cursor++;
+          int d = peek(t, t->cursor);
+          push_event(t, PSG_MML_MIXER, ((d < 0) ? '0' : d) - '0', 0);
+          break;
+        }
+        case 'y':
+          push_event(t, PSG_MML_NOISE, subvalue(t), 0);
+          break;
+        case 'z':
+          t->detune = subvalue(t);
+          break;
+        case '{':
+          push_event(t, PSG_MML_LEGATO, 1, 0);
+          break;
+        case '}':
+          push_event(t, PSG_MML_LEGATO, 0, 0);
+          break;
+        case ' ': case '|':
+          break;
+        default:
+          return track_error(mml, t, "Invalid character", c);
+      }
+      t->cursor++;
+      if (!note) continue;
+
+      int32_t sustain = 0;
+      if (0 <= tone_period) {
+        sustain = (t->q == 8) ? length : (int32_t)(length / 8.0 * t->q);
+      }
+      int32_t release = length - sustain;
+      if (0 < sustain) push_event(t, PSG_MML_PLAY, tone_period, sustain);
+      if (0 < release) {
+        push_event(t, PSG_MML_MUTE, 1, release); // mute once
+        push_event(t, PSG_MML_MUTE, 0, 0);       // unmute after release
+      }
+      if (0 < length) t->wrapped = false;  // a note of no length would loop forever
+      if (t->queue_len) break;
+    }
+  }
+  if (t->queue_len) {
+    *ev = &t->queue[t->queue_head];
+    t->queue_head = (t->queue_head + 1) % PSG_MML_QUEUE_LEN;
+    t->queue_len--;
+  }
+  return true;
+}
+
+/* ----- merged tracks ------------------------------------------------- */
+
+void
+psg_mml_init(psg_mml_t *mml)
+{
+  memset(mml, 0, sizeof(psg_mml_t));
+  mml->mixer = 0x38; // Noise all off, Tone all on
+}
+
+void
+psg_mml_add_track(psg_mml_t *mml, const char *src, size_t len, bool loop)
+{
+  if (PSG_MML_MAX_TRACKS <= mml->count) return;
+  psg_mml_track_t *t = &mml->track[mml->count];
+  memset(t, 0, sizeof(psg_mml_track_t));
+  t->src = src;
+  t->len = (uint32_t)len;
+  t->octave = 4;
+  t->tempo = 120;
+  t->q = 8;
+  t->loop = loop;
+  t->track_id = mml->count;
+  update_common_duration(t, 4);
+  mml->count++;
+}
+
+bool
+psg_mml_start(psg_mml_t *mml)
+{
+  for (uint8_t tr = 0; tr < mml->count; tr++) {
+    psg_mml_event_t *ev;
+    if (!reduce_next(mml, &mml->track[tr], &ev)) return false;
+    if (ev) {
+      mml->event[tr] = *ev;
+      mml->tick[tr] = 0;
+      mml->active |= (1u << tr);
+    }
+  }
+  return true;
+}
+
+static psg_packet_t *
+packet(psg_packet_t *out, uint8_t op, uint8_t reg, uint8_t val, uint8_t arg)
+{
+  out->tick = 0;
+  out->op = op;
+  out->reg = reg;
+  out->val = val;
+  out->arg = arg;
+  return out;
+}
+
+// The packets PSG::Driver#play_mml sends for an event
+static size_t
+emit(psg_mml_t *mml, uint8_t tr, const psg_mml_event_t *ev, psg_packet_t *out)
+{
+  int32_t a = ev->arg0;
+  switch (ev->command) {
+    case PSG_MML_MUTE:
+      packet(&out[0], PSG_PKT_CH_MUTE, tr, (uint8_t)a, 0);
+      return 1;
+    case PSG_MML_PLAY:
+      packet(&out[0], PSG_PKT_REG_WRITE, tr * 2, a & 0xFF, 0);
+      packet(&out[1], PSG_PKT_REG_WRITE, tr * 2 + 1, (a >> 8) & 0x0F, 0);
+      return 2;
+    case PSG_MML_VOLUME:
+      packet(&out[0], PSG_PKT_REG_WRITE, tr + 8, (uint8_t)a, 0);
+      return 1;
+    case PSG_MML_ENV_PERIOD:
+      packet(&out[0], PSG_PKT_REG_WRITE, 11, a & 0xFF, 0);
+      packet(&out[1], PSG_PKT_REG_WRITE, 12, (a >> 8) & 0xFF, 0);
+      return 2;
+    case PSG_MML_ENV_SHAPE:
+      packet(&out[0], PSG_PKT_REG_WRITE, 13, (uint8_t)a, 0);
+      return 1;
+    case PSG_MML_LEGATO:
+      packet(&out[0], PSG_PKT_LEGATO_SET, tr, (uint8_t)a, 0);
+      return 1;
+    case PSG_MML_TIMBRE:
+      packet(&out[0], PSG_PKT_TIMBRE_SET, tr, (uint8_t)a, 0);
+      return 1;
+    case PSG_MML_PAN:
+      packet(&out[0], PSG_PKT_PAN_SET, tr, (uint8_t)a, 0);
+      return 1;
+    case PSG_MML_LFO:
+      packet(&out[0], PSG_PKT_LFO_SET, tr, (uint8_t)a, (uint8_t)ev->arg1);
+      return 1;
+    case PSG_MML_MIXER:
+      switch (a) {
+        case 0: // Tone on, Noise off
+          mml->mixer |= (1 << (tr + 3));
+          mml->mixer &= ~(1 << tr);
+          break;
+        case 1: // Tone off, Noise on
+          mml->mixer &= ~(1 << (tr + 3));
+          mml->mixer |= (1 << tr);
+          break;
+        case 2: // Tone on, Noise on
+          mml->mixer &= ~(1 << tr);
+          mml->mixer &= ~(1 << (tr + 3));
+          break;
+        default:
+          break;
+      }
+      packet(&out[0], PSG_PKT_REG_WRITE, 7, mml->mixer, 0);
+      return 1;
+    case PSG_MML_NOISE:
+      packet(&out[0], PSG_PKT_REG_WRITE, 6, (uint8_t)a, 0);
+      return 1;
+    default: // segno: MML takes care of `$` itself
+      return 0;
+  }
+}
+
+size_t
+psg_mml_compile(psg_mml_t *mml, psg_packet_t *out, size_t max)
+{
+  size_t n = 0;
+  while (mml->active && n + 2 <= max) {
+    // The earliest track, the lower one on a tie
+    int tr = -1;
+    for (int i = 0; i < mml->count; i++) {
+      if (!(mml->active & (1u << i))) continue;
+      if (tr < 0 || mml->tick[i] < mml->tick[tr]) tr = i;
+    }
+    psg_mml_event_t ev = mml->event[tr];
+    mml->delay += mml->tick[tr] - mml->prev_time;
+    mml->prev_time = mml->tick[tr];
+
+    size_t emitted = emit(mml, (uint8_t)tr, &ev, out + n);
+    if (emitted) {
+      // A segno has no packet, so its delay goes with the next one
+      out[n].tick = mml->delay;
+      mml->delay = 0;
+      n += emitted;
+    }
+
+    psg_mml_event_t *next;
+    if (!reduce_next(mml, &mml->track[tr], &next)) return PSG_MML_ERROR;
+    if (next) {
+      // add tick if play or rest
+      if (ev.command == PSG_MML_PLAY || ev.command == PSG_MML_MUTE) {
+        mml->tick[tr] += ev.arg1;
+      }
+      mml->event[tr] = *next;
+    } else {
+      mml->active &= ~(1u << tr);
+    }
+  }
+  return n;
+}
@@ -3,16 +3,41 @@
  */
 
 #include "../include/psg.h"
+#include "../include/mml.h"
 
 #include "picoruby.h"
 #include "mruby/presym.h"
 #include "mruby/class.h"
 #include "mruby/hash.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
 
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 
+#define PRS_OP_MUTE       0x10
+#define PRS_OP_SEND_REG   0x20
+#define PRS_OP_SET_LEGATO 0x30
+#define PRS_OP_SET_PAN    0x40
+#define PRS_OP_SET_TIMBRE 0x50
+#define PRS_OP_SET_LFO    0x60
+#define PRS_OP_WAIT       0x70
+
+#define MML_FILL_BATCH    16
+
+/* The song being streamed into the ring buffer */
+static psg_mml_t mml;
+static char *mml_src[PSG_MML_MAX_TRACKS];
+
+/* PRS commands may straddle two chunks */
+static struct {
+  uint32_t delta;
+  uint32_t offset;     // bytes of the current chunk already consumed
+  uint8_t  cmd[4];
+  uint8_t  cmd_len;
+} prs;
+
 static mrb_value
 mrb_driver_send_reg(mrb_state *mrb, mrb_value klass)
 {
@@ -41,6 +66,8 @@ reset_psg(mrb_state *mrb)
   rb.buf = mrb_malloc(mrb, sizeof(psg_packet_t) * PSG_PACKET_QUEUE_LEN);
   rb.head = 0;
   rb.tail = 0;
+  rb.starved = false;
+  rb.underruns = 0;
   psg_cs_token_t t = PSG_enter_critical();
   memset(&psg, 0, sizeof(psg));
   psg.r.volume[0] = psg.r.volume[1] = psg.r.volume[2] = 15; // max volume. no envelope
@@ -91,6 +118,25 @@ mrb_driver_buffer_empty_p(mrb_state *mrb, mrb_value self)
   }
 }
 
+static mrb_value
+mrb_driver_underruns(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(rb.underruns);
+}
+
+static void
+free_mml_src(mrb_state *mrb)
+{
+  for (int i = 0; i < PSG_MML_MAX_TRACKS; i++) {
+    if (mml_src[i]) {
+      mrb_free(mrb, mml_src[i]);
+      mml_src[i] = NULL;
+    }
+  }
+  mml.count = 0;
+  mml.active = 0;
+}
+
 static mrb_value
 mrb_driver_deinit(mrb_state *mrb, mrb_value self)
 {
@@ -99,9 +145,152 @@ mrb_driver_deinit(mrb_state *mrb, mrb_value self)
     mrb_free(mrb, rb.buf);
     rb.buf = NULL;
   }
+  free_mml_src(mrb);
   return mrb_nil_value();
 }
 
+static uint16_t
+rb_room(void)
+{
+  return (PSG_PACKET_QUEUE_LEN - 1) - ((rb.head - rb.tail) & PSG_PACKET_QUEUE_MASK);
+}
+
+/* mml_start(tracks, loop = false) */
+static mrb_value
+mrb_driver_mml_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_value tracks;
+  mrb_bool loop = FALSE;
+  mrb_get_args(mrb, "A|b", &tracks, &loop);
+  mrb_int count = RARRAY_LEN(tracks);
+  if (count == 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "No tracks provided for MML compilation");
+  }
+  if (PSG_MML_MAX_TRACKS < count) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "Too many tracks: %d (maximum is %d)", count, PSG_MML_MAX_TRACKS);
+  }
+  free_mml_src(mrb);
+  psg_mml_init(&mml);
+  for (mrb_int i = 0; i < count; i++) {
+    mrb_value track = mrb_ary_ref(mrb, tracks, i);
+    if (!mrb_string_p(track)) {
+      mrb_raisef(mrb, E_TYPE_ERROR, "Track %d is not a String", i);
+    }
+    size_t size = psg_mml_expanded_size(RSTRING_PTR(track), RSTRING_LEN(track));
+    if (size == PSG_MML_ERROR) {
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "Loops nested too deep in track %d", i);
+    }
+    if (size == PSG_MML_TOO_LONG) {
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "Track %d is longer than %d bytes after loop expansion", i, PSG_MML_MAX_EXPANDED);
+    }
+    mml_src[i] = mrb_malloc(mrb, size + 1);
+    psg_mml_expand(mml_src[i], RSTRING_PTR(track), RSTRING_LEN(track));
+    psg_mml_add_track(&mml, mml_src[i], size, loop);
+  }
+  if (!psg_mml_start(&mml)) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, mml.error);
+  }
+  rb.starved = false;
+  return mrb_nil_value();
+}
+
+/* Tops up the ring buffer. false once the whole song is in it */
+static mrb_value
+mrb_driver_mml_fill(mrb_state *mrb, mrb_value self)
+{
+  psg_packet_t pkts[MML_FILL_BATCH];
+  while (mml.active) {
+    uint16_t room = rb_room();
+    if (room < 2) {
+      return mrb_true_value();
+    }
+    size_t n = psg_mml_compile(&mml, pkts, room < MML_FILL_BATCH ? room : MML_FILL_BATCH);
+    if (n == PSG_MML_ERROR) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, mml.error);
+    }
+    for (size_t i = 0; i < n; i++) {
+      PSG_rb_push(&pkts[i]);
+    }
+  }
+  return mrb_false_value();
+}
+
+/* prs_start(rewind = false): rewind keeps the pending wait for the loop */
+static mrb_value
+mrb_driver_prs_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_bool rewind = FALSE;
+  mrb_get_args(mrb, "|b", &rewind);
+  if (!rewind) {
+    prs.delta = 0;
+    rb.starved = false;
+  }
+  prs.offset = 0;
+  prs.cmd_len = 0;
+  return mrb_nil_value();
+}
+
+/*
+ * Decodes a chunk of PRS commands into the ring buffer.
+ * Returns true when the chunk is consumed, false when the buffer is full;
+ * call again with the same chunk to resume.
+ */
+static mrb_value
+mrb_driver_prs_feed(mrb_state *mrb, mrb_value self)
+{
+  mrb_value chunk;
+  mrb_get_args(mrb, "S", &chunk);
+  const uint8_t *data = (const uint8_t *)RSTRING_PTR(chunk);
+  uint32_t len = (uint32_t)RSTRING_LEN(chunk);
+  while (true) {
+    uint8_t op = prs.cmd[0] & 0xF0;
+    if (prs.cmd_len < 2 ||
+        (prs.cmd_len < 4 && (op == PRS_OP_WAIT || op == PRS_OP_SET_LFO))) {
+      if (len <= prs.offset) {
+        prs.offset = 0;
+        return mrb_true_value();
+      }
+      prs.cmd[prs.cmd_len++] = data[prs.offset++];
+      continue;
+    }
+    if (op == PRS_OP_WAIT) {
+      prs.delta = prs.cmd[1] | (prs.cmd[2] << 8) | ((uint32_t)prs.cmd[3] << 16);
+      prs.cmd_len = 0;
+      continue;
+    }
+    if (rb_room() == 0) {
+      return mrb_false_value();
+    }
+    psg_packet_t p = {
+      .tick = prs.delta,
+      .reg  = prs.cmd[0] & 0x0F,
+      .val  = prs.cmd[1],
+    };
+    bool known = true;
+    switch (op) {
+      case PRS_OP_MUTE:       p.op = PSG_PKT_CH_MUTE;    break;
+      case PRS_OP_SEND_REG:   p.op = PSG_PKT_REG_WRITE;  break;
+      case PRS_OP_SET_LEGATO: p.op = PSG_PKT_LEGATO_SET; break;
+      case PRS_OP_SET_PAN:    p.op = PSG_PKT_PAN_SET;    break;
+      case PRS_OP_SET_TIMBRE: p.op = PSG_PKT_TIMBRE_SET; break;
+      case PRS_OP_SET_LFO:
+        p.op  = PSG_PKT_LFO_SET;
+        p.reg = prs.cmd[1];
+        p.val = prs.cmd[2];
+        p.arg = prs.cmd[3];
+        break;
+      default:
+        known = false;
+        break;
+    }
+    if (known) {
+      PSG_rb_push(&p);
+    }
+    prs.delta = 0;
+    prs.cmd_len = 0;
+  }
+}
+
 /* Set LFO: tr, depth(cent), rate(0.1Hz) */
 static mrb_value
 mrb_driver_set_lfo(mrb_state *mrb, mrb_value self)
@@ -212,6 +401,11 @@ mrb_picoruby_psg_gem_init(mrb_state* mrb)
   mrb_define_method_id(mrb, class_Driver, MRB_SYM(send_reg), mrb_driver_send_reg, MRB_ARGS_ARG(2, 1));
   mrb_define_method_id(mrb, class_Driver, MRB_SYM_Q(buffer_empty), mrb_driver_buffer_empty_p, MRB_ARGS_NONE());
   mrb_define_method_id(mrb, class_Driver, MRB_SYM(deinit), mrb_driver_deinit, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Driver, MRB_SYM(underruns), mrb_driver_underruns, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Driver, MRB_SYM(mml_start), mrb_driver_mml_start, MRB_ARGS_ARG(1, 1));
+  mrb_define_method_id(mrb, class_Driver, MRB_SYM(mml_fill), mrb_driver_mml_fill, MRB_ARGS_NONE());
+  mrb_define_method_id(mrb, class_Driver, MRB_SYM(prs_start), mrb_driver_prs_start, MRB_ARGS_OPT(1));
+  mrb_define_method_id(mrb, class_Driver, MRB_SYM(prs_feed), mrb_driver_prs_feed, MRB_ARGS_REQ(1));
   mrb_define_method_id(mrb, class_Driver, MRB_SYM(set_lfo), mrb_driver_set_lfo, MRB_ARGS_ARG(3, 1));
   mrb_define_method_id(mrb, class_Driver, MRB_SYM(set_pan), mrb_driver_set_pan, MRB_ARGS_ARG(2, 1));
   mrb_define_method_id(mrb, class_Driver, MRB_SYM(set_timbre), mrb_driver_set_timbre, MRB_ARGS_ARG(2, 1));
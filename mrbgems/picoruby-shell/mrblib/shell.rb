@@ -69,8 +69,7 @@ class Shell
           actual_crc = if f.respond_to?(:physical_address)
                          CRC.crc32_from_address(f.physical_address, code.size)
                        else
-                         actual_code = f.read if 0 < actual_len
-                         CRC.crc32(actual_code)
+                         CRC::CRC32.new.update_io(f).digest
                        end
           if (actual_len == code.length) && ( crc.nil? || (actual_crc == crc) )
             puts " ... OK (#{code.length} bytes)"
@@ -0,0 +1,55 @@
+# Inserting 10k rows with a cached statement per row vs. insert_many,
+# then reading them back as Hashes. The rows don't fit the RAM disk,
+# so this runs on the flash volume.
+#
+#   bin/picoruby mrbgems/picoruby-sqlite3/example/bulk_insert_bench.rb
+
+ROWS = 10_000
+DB_PATH = "/bench_bulk.db"
+
+def rate(count, elapsed)
+  elapsed == 0 ? '-' : (count / elapsed).to_i
+end
+
+File.unlink(DB_PATH) if File.exist?(DB_PATH)
+
+SQLite3::Database.open(DB_PATH) do |db|
+  db.execute("CREATE TABLE log (id INTEGER PRIMARY KEY, t INTEGER, value INTEGER)")
+  sql = "INSERT INTO log (t, value) VALUES (?, ?)"
+
+  # execute() per row: the statement is prepared once and then cached
+  started = Time.now.to_f
+  db.execute("BEGIN")
+  i = 0
+  while i < ROWS
+    db.execute(sql, [i, i * 3])
+    i += 1
+  end
+  db.execute("COMMIT")
+  elapsed = Time.now.to_f - started
+  puts "execute per row: #{rate(ROWS, elapsed)} rows/s"
+
+  db.execute("DELETE FROM log")
+
+  rows = Array.new(ROWS)
+  i = 0
+  while i < ROWS
+    rows[i] = [i, i * 3]
+    i += 1
+  end
+  started = Time.now.to_f
+  db.insert_many(sql, rows)
+  elapsed = Time.now.to_f - started
+  puts "insert_many:     #{rate(ROWS, elapsed)} rows/s"
+
+  db.results_as_hash = true
+  started = Time.now.to_f
+  count = 0
+  db.execute("SELECT id, t, value FROM log") do |row|
+    count += 1
+  end
+  elapsed = Time.now.to_f - started
+  puts "select as hash:  #{rate(count, elapsed)} rows/s (#{count} rows)"
+end
+
+File.unlink(DB_PATH)
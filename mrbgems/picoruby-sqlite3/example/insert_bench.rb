@@ -0,0 +1,48 @@
+# Insert and select rates of SQLite3 on a FAT RAM disk.
+#
+#   bin/picoruby mrbgems/picoruby-sqlite3/example/insert_bench.rb
+
+ROWS = 500
+
+ram = FAT.new(:ram, label: "RAMDISK")
+ram.mkfs
+VFS.mount(ram, "/ram")
+
+def rate(count, elapsed)
+  elapsed == 0 ? '-' : (count / elapsed).to_i
+end
+
+SQLite3::Database.open("/ram/bench.db") do |db|
+  db.execute("CREATE TABLE log (id INTEGER PRIMARY KEY, t INTEGER, value TEXT)")
+
+  # autocommit: every row is its own transaction, dominated by page I/O
+  started = Time.now.to_f
+  i = 0
+  while i < ROWS
+    db.execute("INSERT INTO log (t, value) VALUES (?, ?)", [i, "value #{i}"])
+    i += 1
+  end
+  elapsed = Time.now.to_f - started
+  puts "insert (autocommit):  #{rate(ROWS, elapsed)} rows/s"
+
+  started = Time.now.to_f
+  db.execute("BEGIN")
+  i = 0
+  while i < ROWS
+    db.execute("INSERT INTO log (t, value) VALUES (?, ?)", [i, "value #{i}"])
+    i += 1
+  end
+  db.execute("COMMIT")
+  elapsed = Time.now.to_f - started
+  puts "insert (transaction): #{rate(ROWS, elapsed)} rows/s"
+
+  started = Time.now.to_f
+  count = 0
+  db.execute("SELECT id, t, value FROM log") do |row|
+    count += 1
+  end
+  elapsed = Time.now.to_f - started
+  puts "select:               #{rate(count, elapsed)} rows/s (#{count} rows)"
+end
+
+VFS.unmount(ram)
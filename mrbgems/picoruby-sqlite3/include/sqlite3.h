@@ -19,6 +19,9 @@ typedef struct {
   bool closed;
 } DbState;
 
+void prb_sqlite3_raise(mrbc_vm *vm, sqlite3 *db, int status);
+int prb_sqlite3_bind(sqlite3_stmt *st, int index, mrbc_value *val);
+
 void mrbc_init_class_SQLite3_Database(mrbc_vm *vm, mrbc_class *class_SQLite3);
 void mrbc_init_class_SQLite3_Statement(mrbc_vm *vm, mrbc_class *class_SQLite3);
 
@@ -13,6 +13,8 @@ extern "C" {
 #endif
 
 #define PATHNAME_MAX_LEN 512
+/* An SD card's erase block can be megabytes. SQLite doesn't need more */
+#define PRB_SECTOR_SIZE_MAX 4096
 
 typedef struct PRBFile
 {
@@ -21,6 +23,11 @@ typedef struct PRBFile
   mrbc_value *file;
   char pathname[PATHNAME_MAX_LEN];
   int sector_size;
+  int iocap;
+  /* write coalescing buffer for journals, see prb_file_buffered_write() */
+  uint8_t *wbuf;
+  int64_t wbuf_offset;
+  int wbuf_len;
 } PRBFile;
 
 mrbc_int_t prb_time_gettime_us(void);
@@ -29,6 +36,10 @@ int prb_file_new(PRBFile *prbfile, const char *zName, int flags);
 int prb_file_close(PRBFile *prbfile);
 int prb_file_read(PRBFile *prbfile, void *zBuf, size_t nBuf);
 int prb_file_write(PRBFile *prbfile, const void *zBuf, size_t nBuf);
+int prb_file_pread(PRBFile *prbfile, void *zBuf, size_t nBuf, int64_t offset);
+int prb_file_pwrite(PRBFile *prbfile, const void *zBuf, size_t nBuf, int64_t offset);
+int prb_file_buffered_write(PRBFile *prbfile, const void *zBuf, size_t nBuf, int64_t offset);
+int prb_file_flush(PRBFile *prbfile);
 int prb_file_fsync(PRBFile *prbfile);
 int prb_file_seek(PRBFile *prbfile, int offset);
 int prb_file_tell(PRBFile *prbfile);
@@ -22,10 +22,14 @@ class SQLite3
       alias :open :new
     end
 
+    STATEMENT_CACHE_SIZE = 8
+
     attr_accessor :results_as_hash
 
     def execute(sql, bind_vars = [])
-      prepare(sql) do |stmt|
+      entry = checkout_statement(sql)
+      stmt = entry[1]
+      begin
         stmt.bind_params(*bind_vars)
         resultset = SQLite3::ResultSet.new(self, stmt)
         if block_given?
@@ -35,6 +39,8 @@ class SQLite3
         else
           resultset.to_a
         end
+      ensure
+        checkin_statement(entry)
       end
     end
 
@@ -47,5 +53,49 @@ class SQLite3
         stmt.close unless stmt.closed?
       end
     end
+
+    def close
+      clear_statement_cache
+      _close
+    end
+
+    def clear_statement_cache
+      @statement_cache&.each do |entry|
+        entry[1].close unless entry[1].closed?
+      end
+      @statement_cache = []
+    end
+
+    # Prepared statements of execute() are kept in an LRU list of
+    # [sql, statement]. An entry is taken out while in use, so a nested
+    # execute() of the same SQL prepares its own.
+    # Statements are reset when they come back, so that a SELECT left
+    # half read does not keep its read transaction open in the cache.
+    private def checkout_statement(sql)
+      cache = (@statement_cache ||= [])
+      i = 0
+      while i < cache.size
+        if cache[i][0] == sql
+          return cache.delete_at(i)
+        end
+        i += 1
+      end
+      [sql.dup, SQLite3::Statement.new(self, sql)]
+    end
+
+    private def checkin_statement(entry)
+      return if entry[1].closed?
+      if closed?
+        entry[1].close
+        return
+      end
+      entry[1].reset!
+      entry[1].clear_bindings!
+      cache = (@statement_cache ||= [])
+      cache.unshift(entry)
+      while STATEMENT_CACHE_SIZE < cache.size
+        cache.pop&.last&.close
+      end
+    end
   end
 end
@@ -47,15 +47,13 @@ class SQLite3
     end
 
     def next
-      row = @stmt.step
-      return nil if @stmt.done? || row.nil?
       if @db.results_as_hash
-        row_hash = {}
-        @stmt.columns&.each_with_index do |column, i|
-          row_hash[column] = row[i]
-        end
-        row_hash
+        # the column name Strings are shared as keys by every row
+        @columns ||= @stmt.columns
+        @stmt.step_hash(@columns)
       else
+        row = @stmt.step
+        return nil if @stmt.done? || row.nil?
         row
       end
     end
@@ -1,5 +1,7 @@
 #include "../include/sqlite3.h"
 
+#include <stdio.h>
+
 static void
 c__open(mrbc_vm *vm, mrbc_value v[], int argc)
 {
@@ -61,6 +63,103 @@ c_closed_q(mrbc_vm *vm, mrbc_value v[], int argc)
   }
 }
 
+#define INSERT_MANY_ERRMSG_MAX 128
+
+/* Undoes the rows inserted so far, and only those */
+static void
+insert_many_rollback(sqlite3 *db, bool own_transaction)
+{
+  if (own_transaction) {
+    sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+  } else {
+    sqlite3_exec(db, "ROLLBACK TO insert_many; RELEASE insert_many", NULL, NULL, NULL);
+  }
+}
+
+/*
+ * insert_many(sql, rows) -> Integer
+ *
+ * Prepares sql once, then binds each row (an Array) and steps it in a
+ * single transaction. Everything is rolled back on the first error.
+ * Inside the caller's transaction a savepoint stands in for it, so only
+ * the rows of this call are rolled back.
+ * Returns the number of rows inserted.
+ */
+static void
+c_insert_many(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  DbState *state = (DbState *)v[0].instance->data;
+  if (state->closed) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "insert_many called on a closed database");
+    return;
+  }
+  if (v[1].tt != MRBC_TT_STRING || v[2].tt != MRBC_TT_ARRAY) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "insert_many(String, Array) expected");
+    return;
+  }
+  sqlite3 *db = state->db;
+  sqlite3_stmt *st;
+  int rc = sqlite3_prepare_v2(db, (const char *)v[1].string->data, (int)v[1].string->size, &st, NULL);
+  if (rc != SQLITE_OK) {
+    prb_sqlite3_raise(vm, db, rc);
+    return;
+  }
+  /* Join the caller's transaction if there is one */
+  bool own_transaction = sqlite3_get_autocommit(db);
+  rc = sqlite3_exec(db, own_transaction ? "BEGIN" : "SAVEPOINT insert_many", NULL, NULL, NULL);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(st);
+    prb_sqlite3_raise(vm, db, rc);
+    return;
+  }
+  int count = mrbc_array_size(&v[2]);
+  int i;
+  for (i = 0; i < count; i++) {
+    mrbc_value row = mrbc_array_get(&v[2], i);
+    if (row.tt != MRBC_TT_ARRAY) {
+      rc = SQLITE_MISMATCH;
+      break;
+    }
+    int n = mrbc_array_size(&row);
+    for (int j = 0; j < n && rc == SQLITE_OK; j++) {
+      mrbc_value val = mrbc_array_get(&row, j);
+      rc = prb_sqlite3_bind(st, j + 1, &val);
+    }
+    if (rc != SQLITE_OK) break;
+    rc = sqlite3_step(st);
+    if (rc != SQLITE_DONE) break;
+    rc = sqlite3_reset(st);
+    if (rc != SQLITE_OK) break;
+    sqlite3_clear_bindings(st);
+  }
+  if (i < count) {
+    int err = rc;
+    sqlite3_reset(st);
+    sqlite3_finalize(st);
+    if (err == SQLITE_MISMATCH) {
+      insert_many_rollback(db, own_transaction);
+      mrbc_raise(vm, MRBC_CLASS(TypeError), "each row must be an Array of Integer, Float, String or nil");
+      return;
+    }
+    /* ROLLBACK would overwrite the message */
+    char msg[INSERT_MANY_ERRMSG_MAX];
+    snprintf(msg, sizeof(msg), "%s", sqlite3_errmsg(db));
+    insert_many_rollback(db, own_transaction);
+    mrbc_raise(vm, MRBC_CLASS(RuntimeError), msg);
+    return;
+  }
+  sqlite3_finalize(st);
+  rc = sqlite3_exec(db, own_transaction ? "COMMIT" : "RELEASE insert_many", NULL, NULL, NULL);
+  if (rc != SQLITE_OK) {
+    char msg[INSERT_MANY_ERRMSG_MAX];
+    snprintf(msg, sizeof(msg), "%s", sqlite3_errmsg(db));
+    insert_many_rollback(db, own_transaction);
+    mrbc_raise(vm, MRBC_CLASS(RuntimeError), msg);
+    return;
+  }
+  SET_INT_RETURN(count);
+}
+
 static void
 array_callback_funciton(mrbc_value *result_array, int count, char **data, char **columns)
 {
@@ -83,7 +182,8 @@ mrbc_init_class_SQLite3_Database(mrbc_vm *vm, mrbc_class *class_SQLite3)
 {
   mrbc_class *class_SQLite3_Database = mrbc_define_class_under(vm, class_SQLite3, "Database", mrbc_class_object);
 
-  mrbc_define_method(vm, class_SQLite3_Database, "close", c_close);
+  mrbc_define_method(vm, class_SQLite3_Database, "_close", c_close);
   mrbc_define_method(vm, class_SQLite3_Database, "closed?", c_closed_q);
   mrbc_define_method(vm, class_SQLite3_Database, "_open", c__open);
+  mrbc_define_method(vm, class_SQLite3_Database, "insert_many", c_insert_many);
 }
@@ -35,6 +35,41 @@ prb_time_gettime_us(void)
   return ret;
 }
 
+/*
+ * SQLite's sector is the unit a write can disturb on power loss, which
+ * is the erase block rather than the FAT sector.
+ */
+static void
+prb_file_device_setup(PRBFile *prbfile, const char *zName, int flags)
+{
+  int sector_size, block_size, device_flags;
+  if (vfs_methods.file_device_info &&
+      vfs_methods.file_device_info(prbfile->file->instance->data, &sector_size, &block_size, &device_flags) == 0) {
+    prbfile->sector_size = (PRB_SECTOR_SIZE_MAX < block_size) ? PRB_SECTOR_SIZE_MAX : block_size;
+    if (prbfile->sector_size < 512) {
+      prbfile->sector_size = 512;
+    }
+    if (device_flags & FILE_DEVICE_VOLATILE) {
+      /* A RAM disk loses everything on power loss, so no write can be torn */
+      prbfile->iocap = SQLITE_IOCAP_ATOMIC | SQLITE_IOCAP_SAFE_APPEND |
+                       SQLITE_IOCAP_SEQUENTIAL | SQLITE_IOCAP_POWERSAFE_OVERWRITE;
+    }
+  } else if (strncmp(zName, FLASH_VOLUME_NAME, sizeof(FLASH_VOLUME_NAME)) == 0) {
+    prbfile->sector_size = 4096;
+  } else {
+    prbfile->sector_size = 512;
+  }
+  /*
+   * Journals are written by many small appends (a page record is three
+   * writes). They are gathered up to the end of the erase block.
+   */
+  if (flags & (SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_TEMP_JOURNAL |
+               SQLITE_OPEN_SUBJOURNAL | SQLITE_OPEN_SUPER_JOURNAL | SQLITE_OPEN_WAL)) {
+    /* On failure the journal is just written through */
+    prbfile->wbuf = prb_raw_alloc(prbfile->sector_size);
+  }
+}
+
 int
 prb_file_new(PRBFile *prbfile, const char *zName, int flags)
 {
@@ -66,24 +101,23 @@ prb_file_new(PRBFile *prbfile, const char *zName, int flags)
   prbfile->file = mrbc_alloc(vm, sizeof(mrbc_value));
   memcpy(prbfile->file, &v[0], sizeof(mrbc_value));
 
-  /* FIXME: retrieve from the real filesystem */
-  if (strncmp(zName, FLASH_VOLUME_NAME, sizeof(FLASH_VOLUME_NAME)) == 0) {
-    prbfile->sector_size = 4096;
-  } else {
-    prbfile->sector_size = 512;
-  }
-
+  prb_file_device_setup(prbfile, zName, flags);
   return 0;
 }
 
 int prb_file_close(PRBFile *prbfile)
 {
   D();
+  int ret = prb_file_flush(prbfile);
+  if (prbfile->wbuf) {
+    prb_raw_free(prbfile->wbuf);
+    prbfile->wbuf = NULL;
+  }
   mrbc_value v[1];
   v[0] = *prbfile->file;
   prb_funcall(vfs_methods.file_close, &v[0], 0);
   mrbc_raw_free(prbfile->file);
-  return 0;
+  return ret;
 }
 
 int prb_file_read(PRBFile *prbfile, void *zBuf, size_t nBuf)
@@ -120,6 +154,108 @@ int prb_file_write(PRBFile *prbfile, const void *zBuf, size_t nBuf)
   return v->i;
 }
 
+/*
+ * Positioned page I/O. The VFS driver's native functions are used when
+ * it provides them; otherwise it falls back to seek + read/write on the
+ * Ruby file object, which allocates a String per page.
+ */
+int prb_file_pread(PRBFile *prbfile, void *zBuf, size_t nBuf, int64_t offset)
+{
+  D();
+  if (vfs_methods.file_pread) {
+    return vfs_methods.file_pread(prbfile->file->instance->data, zBuf, nBuf, offset);
+  }
+  if (prb_file_seek(prbfile, offset) < 0) {
+    return -1;
+  }
+  return prb_file_read(prbfile, zBuf, nBuf);
+}
+
+int prb_file_pwrite(PRBFile *prbfile, const void *zBuf, size_t nBuf, int64_t offset)
+{
+  D();
+  if (vfs_methods.file_pwrite) {
+    return vfs_methods.file_pwrite(prbfile->file->instance->data, zBuf, nBuf, offset);
+  }
+  if (prb_file_seek(prbfile, offset) < 0) {
+    return -1;
+  }
+  return prb_file_write(prbfile, zBuf, nBuf);
+}
+
+/*
+ * Write coalescing
+ *
+ * Only one file holds buffered data at a time: a write to any other file
+ * flushes it first, so writes reach the disk in the order SQLite issued
+ * them. The buffer never crosses an erase block boundary.
+ */
+static PRBFile *pending_file = NULL;
+
+int prb_file_flush(PRBFile *prbfile)
+{
+  D();
+  if (prbfile->wbuf_len == 0) {
+    return 0;
+  }
+  int len = prbfile->wbuf_len;
+  prbfile->wbuf_len = 0;
+  if (pending_file == prbfile) {
+    pending_file = NULL;
+  }
+  return (prb_file_pwrite(prbfile, prbfile->wbuf, len, prbfile->wbuf_offset) == len) ? 0 : -1;
+}
+
+int prb_file_buffered_write(PRBFile *prbfile, const void *zBuf, size_t nBuf, int64_t offset)
+{
+  D();
+  if (pending_file && pending_file != prbfile && prb_file_flush(pending_file) < 0) {
+    return -1;
+  }
+  if (prbfile->wbuf == NULL) {
+    return prb_file_pwrite(prbfile, zBuf, nBuf, offset);
+  }
+  if (0 < prbfile->wbuf_len && offset != prbfile->wbuf_offset + prbfile->wbuf_len) {
+    if (prb_file_flush(prbfile) < 0) {
+      return -1;
+    }
+  }
+  const uint8_t *src = (const uint8_t *)zBuf;
+  int64_t block = prbfile->sector_size;
+  size_t rest = nBuf;
+  while (0 < rest) {
+    if (prbfile->wbuf_len == 0) {
+      /* whole blocks go straight to the disk */
+      size_t direct = (offset % block == 0) ? rest - rest % block : 0;
+      if (0 < direct) {
+        if (prb_file_pwrite(prbfile, src, direct, offset) != (int)direct) {
+          return -1;
+        }
+        src += direct;
+        offset += direct;
+        rest -= direct;
+        continue;
+      }
+      prbfile->wbuf_offset = offset;
+    }
+    int64_t block_end = (prbfile->wbuf_offset / block + 1) * block;
+    size_t n = (size_t)(block_end - offset);
+    if (rest < n) n = rest;
+    memcpy(prbfile->wbuf + prbfile->wbuf_len, src, n);
+    prbfile->wbuf_len += n;
+    src += n;
+    offset += n;
+    rest -= n;
+    if (offset == block_end && prb_file_flush(prbfile) < 0) {
+      return -1;
+    }
+  }
+  if (0 < prbfile->wbuf_len) {
+    pending_file = prbfile;
+  }
+  return nBuf;
+}
+
 int prb_file_fsync(PRBFile *prbfile)
 {
   D();
@@ -80,65 +80,102 @@ c_Statement_closed_q(mrbc_vm *vm, mrbc_value v[], int argc)
   }
 }
 
-static void
-c_Statement_step(mrbc_vm *vm, mrbc_value v[], int argc)
+static mrbc_value
+column_value(mrbc_vm *vm, sqlite3_stmt *stmt, int i)
 {
-  DbStatement *cxt = (DbStatement *)v[0].instance->data;
-  sqlite3_stmt *stmt = cxt->st;
-  if (cxt->done_p) {
-    SET_NIL_RETURN();
-    return;
+  switch (sqlite3_column_type(stmt, i)) {
+    case SQLITE_INTEGER:
+      return mrbc_integer_value(sqlite3_column_int64(stmt, i));
+    case SQLITE_FLOAT:
+      return mrbc_float_value(vm, sqlite3_column_double(stmt, i));
+    case SQLITE_TEXT:
+      return mrbc_string_new(
+        vm,
+        (const char *)sqlite3_column_text(stmt, i),
+        sqlite3_column_bytes(stmt, i)
+      );
+    case SQLITE_BLOB:
+      return mrbc_string_new(
+        vm,
+        (const char *)sqlite3_column_blob(stmt, i),
+        sqlite3_column_bytes(stmt, i)
+      );
+    default:
+      return mrbc_nil_value();
   }
-  int value = sqlite3_step(stmt);
-  int length = sqlite3_column_count(stmt);
-  mrbc_value list = mrbc_array_new(vm, length);
+}
 
-  switch (value) {
+/* Steps once. Returns false (with done_p set or an exception raised) when there is no row */
+static bool
+statement_step(mrbc_vm *vm, DbStatement *cxt)
+{
+  if (cxt->done_p) {
+    return false;
+  }
+  int status = sqlite3_step(cxt->st);
+  switch (status) {
     case SQLITE_ROW:
-      {
-        int i;
-        for (i = 0; i < length; i++) {
-          mrbc_value value;
-          switch (sqlite3_column_type(stmt, i)) {
-            case SQLITE_INTEGER:
-              value = mrbc_integer_value(sqlite3_column_int64(stmt, i));
-              break;
-            case SQLITE_FLOAT:
-              value = mrbc_float_value(vm, sqlite3_column_double(stmt, i));
-              break;
-            case SQLITE_TEXT:
-              value = mrbc_string_new_cstr(vm, (const char *)sqlite3_column_text(stmt, i));
-              break;
-            case SQLITE_BLOB:
-              value = mrbc_string_new(
-                vm,
-                (const char *)sqlite3_column_blob(stmt, i),
-                sqlite3_column_bytes(stmt, i)
-              );
-              break;
-            case SQLITE_NULL:
-              value = mrbc_nil_value();
-              break;
-            default:
-              value = mrbc_nil_value();
-              mrbc_raise(vm, MRBC_CLASS(RuntimeError), "bad type");
-          }
-          mrbc_array_push(&list, &value);
-        }
-      }
-      break;
+      return true;
     case SQLITE_DONE:
       cxt->done_p = 1;
-      SET_NIL_RETURN();
-      break;
+      return false;
     default:
-      sqlite3_reset(stmt);
+      sqlite3_reset(cxt->st);
       cxt->done_p = 0;
-      prb_sqlite3_raise(vm, sqlite3_db_handle(cxt->st), value);
+      prb_sqlite3_raise(vm, sqlite3_db_handle(cxt->st), status);
+      return false;
+  }
+}
+
+static void
+c_Statement_step(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  DbStatement *cxt = (DbStatement *)v[0].instance->data;
+  if (!statement_step(vm, cxt)) {
+    SET_NIL_RETURN();
+    return;
+  }
+  int length = sqlite3_column_count(cxt->st);
+  mrbc_value list = mrbc_array_new(vm, length);
+  for (int i = 0; i < length; i++) {
+    mrbc_value value = column_value(vm, cxt->st, i);
+    mrbc_array_push(&list, &value);
   }
   SET_RETURN(list);
 }
 
+/*
+ * step_hash(columns) -> Hash | nil
+ *
+ * Like step, but the row is a Hash keyed by the given column names.
+ * The same key Strings are shared by every row.
+ */
+static void
+c_Statement_step_hash(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  DbStatement *cxt = (DbStatement *)v[0].instance->data;
+  if (v[1].tt != MRBC_TT_ARRAY) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "columns must be an Array");
+    return;
+  }
+  if (!statement_step(vm, cxt)) {
+    SET_NIL_RETURN();
+    return;
+  }
+  int length = sqlite3_column_count(cxt->st);
+  if (mrbc_array_size(&v[1]) < length) {
+    length = mrbc_array_size(&v[1]);
+  }
+  mrbc_value hash = mrbc_hash_new(vm, length);
+  for (int i = 0; i < length; i++) {
+    mrbc_value key = mrbc_array_get(&v[1], i);
+    mrbc_incref(&key);
+    mrbc_value value = column_value(vm, cxt->st, i);
+    mrbc_hash_set(&hash, &key, &value);
+  }
+  SET_RETURN(hash);
+}
+
 static void
 c_Statement_reset_bang(mrbc_vm *vm, mrbc_value v[], int argc)
 {
@@ -147,6 +184,13 @@ c_Statement_reset_bang(mrbc_vm *vm, mrbc_value v[], int argc)
   cxt->done_p = 0;
 }
 
+static void
+c_Statement_clear_bindings_bang(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  DbStatement *cxt = (DbStatement *)v[0].instance->data;
+  sqlite3_clear_bindings(cxt->st);
+}
+
 static void
 c_Statement_done_q(mrbc_vm *vm, mrbc_value v[], int argc)
 {
@@ -165,35 +209,39 @@ c_Statement_column_count(mrbc_vm *vm, mrbc_value v[], int argc)
   SET_INT_RETURN(sqlite3_column_count(cxt->st));
 }
 
-static void
-c_Statement_bind_param(mrbc_vm *vm, mrbc_value v[], int argc)
+/* Returns SQLITE_MISMATCH for a value that has no SQLite type */
+int
+prb_sqlite3_bind(sqlite3_stmt *st, int index, mrbc_value *val)
 {
-  DbStatement *cxt = (DbStatement *)v[0].instance->data;
-  int index = GET_INT_ARG(1);
-  int status;
-  switch (v[2].tt) {
+  switch (val->tt) {
     case MRBC_TT_FIXNUM:
-      status = sqlite3_bind_int64(cxt->st, index, v[2].i);
-      break;
+      return sqlite3_bind_int64(st, index, val->i);
     case MRBC_TT_FLOAT:
-      status = sqlite3_bind_double(cxt->st, index, v[2].d);
-      break;
+      return sqlite3_bind_double(st, index, val->d);
     case MRBC_TT_STRING:
-      status = sqlite3_bind_text(
-        cxt->st,
+      return sqlite3_bind_text(
+        st,
         index,
-        (const char *)v[2].string->data,
-        (int)v[2].string->size,
+        (const char *)val->string->data,
+        (int)val->string->size,
         SQLITE_TRANSIENT
       );
-      break;
     case MRBC_TT_NIL:
-      status = sqlite3_bind_null(cxt->st, index);
-      break;
+      return sqlite3_bind_null(st, index);
     default:
-      mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
-      return;
-      break;
+      return SQLITE_MISMATCH;
+  }
+}
+
+static void
+c_Statement_bind_param(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  DbStatement *cxt = (DbStatement *)v[0].instance->data;
+  int index = GET_INT_ARG(1);
+  int status = prb_sqlite3_bind(cxt->st, index, &v[2]);
+  if (status == SQLITE_MISMATCH) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+    return;
   }
   prb_sqlite3_raise(vm, sqlite3_db_handle(cxt->st), status);
 }
@@ -229,7 +277,9 @@ mrbc_init_class_SQLite3_Statement(mrbc_vm *vm, mrbc_class *class_SQLite3)
   mrbc_define_method(vm, class_SQLite3_Statement, "close", c_Statement_close);
   mrbc_define_method(vm, class_SQLite3_Statement, "closed?", c_Statement_closed_q);
   mrbc_define_method(vm, class_SQLite3_Statement, "step", c_Statement_step);
+  mrbc_define_method(vm, class_SQLite3_Statement, "step_hash", c_Statement_step_hash);
   mrbc_define_method(vm, class_SQLite3_Statement, "reset!", c_Statement_reset_bang);
+  mrbc_define_method(vm, class_SQLite3_Statement, "clear_bindings!", c_Statement_clear_bindings_bang);
   mrbc_define_method(vm, class_SQLite3_Statement, "done?", c_Statement_done_q);
   mrbc_define_method(vm, class_SQLite3_Statement, "column_count", c_Statement_column_count);
   mrbc_define_method(vm, class_SQLite3_Statement, "bind_param", c_Statement_bind_param);
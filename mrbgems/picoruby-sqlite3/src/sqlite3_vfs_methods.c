@@ -179,7 +179,7 @@ prbIOClose(sqlite3_file *pFile)
 {
   D();
   PRBFile *prbfile = (PRBFile *)pFile;
-  return prb_file_close(prbfile);
+  return (prb_file_close(prbfile) == 0) ? SQLITE_OK : SQLITE_IOERR_CLOSE;
 }
 
 int
@@ -187,10 +187,19 @@ prbIORead(sqlite3_file *pFile, void *zBuf, int iAmt, sqlite3_int64 iOfst)
 {
   D();
   PRBFile *prbfile = (PRBFile *)pFile;
-  if (prb_file_seek(prbfile, iOfst) < 0) {
-    return SQLITE_ERROR;
+  if (prb_file_flush(prbfile) < 0) {
+    return SQLITE_IOERR_READ;
   }
-  return (iAmt == prb_file_read(prbfile, zBuf, iAmt)) ? SQLITE_OK : SQLITE_IOERR_SHORT_READ;
+  int n = prb_file_pread(prbfile, zBuf, iAmt, iOfst);
+  if (n < 0) {
+    return SQLITE_IOERR_READ;
+  }
+  if (n < iAmt) {
+    /* SQLite requires the rest to be zero-filled on a short read */
+    memset((char *)zBuf + n, 0, iAmt - n);
+    return SQLITE_IOERR_SHORT_READ;
+  }
+  return SQLITE_OK;
 }
 
 
@@ -199,10 +208,7 @@ prbIOWrite(sqlite3_file *pFile, const void *zBuf, int iAmt, sqlite3_int64 iOfst)
 {
   D();
   PRBFile *prbfile = (PRBFile *)pFile;
-  if (prb_file_seek(prbfile, iOfst) < 0) {
-    return SQLITE_ERROR;
-  }
-  return (iAmt == prb_file_write(prbfile, zBuf, iAmt)) ? SQLITE_OK : SQLITE_IOERR_WRITE;
+  return (iAmt == prb_file_buffered_write(prbfile, zBuf, iAmt, iOfst)) ? SQLITE_OK : SQLITE_IOERR_WRITE;
 }
 
 int
@@ -217,7 +223,10 @@ prbIOSync(sqlite3_file *pFile, int flags)
 {
   D();
   PRBFile *prbfile = (PRBFile *)pFile;
-  return prb_file_fsync(prbfile);
+  if (prb_file_flush(prbfile) < 0 || prb_file_fsync(prbfile) < 0) {
+    return SQLITE_IOERR_FSYNC;
+  }
+  return SQLITE_OK;
 }
 
 int
@@ -225,6 +234,9 @@ prbIOFileSize(sqlite3_file *pFile, sqlite3_int64 *pSize)
 {
   D();
   PRBFile *prbfile = (PRBFile *)pFile;
+  if (prb_file_flush(prbfile) < 0) {
+    return SQLITE_IOERR_FSTAT;
+  }
   mrbc_value v[1];
   v[0] = *prbfile->file;
   prb_funcall(vfs_methods.file_size, &v[0], 0);
@@ -273,6 +285,7 @@ int
 prbIODeviceCharacteristics(sqlite3_file *pFile)
 {
   D();
-  return 0;
+  PRBFile *prbfile = (PRBFile *)pFile;
+  return prbfile->iocap;
 }
 
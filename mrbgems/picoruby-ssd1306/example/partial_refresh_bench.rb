@@ -0,0 +1,78 @@
+# Bus bytes per frame of a small animation (a bouncing ball and a
+# progress bar) sent with update_display versus update_display_optimized.
+# A fake I2C object counts the bytes instead of talking to a panel.
+#
+#   bin/picoruby mrbgems/picoruby-ssd1306/example/partial_refresh_bench.rb
+
+require 'ssd1306'
+
+class CountingI2C
+  attr_reader :bytes, :transfers
+
+  def initialize
+    @bytes = 0
+    @transfers = 0
+  end
+
+  def reset
+    @bytes = 0
+    @transfers = 0
+  end
+
+  def write(address, *outputs, timeout: nil)
+    count = 1 # address byte
+    outputs.each do |out|
+      case out
+      when Integer
+        count += 1
+      when String, Array
+        count += out.size
+      end
+    end
+    @bytes += count
+    @transfers += 1
+    count
+  end
+end
+
+W = 128
+H = 64
+BALL = 10
+FRAMES = 60
+
+def animate(display, bus, optimized)
+  display.clear
+  bus.reset
+  x = 3
+  y = 5
+  dx = 3
+  dy = 2
+  frame = 0
+  t0 = Time.now.to_f
+  while frame < FRAMES
+    display.erase(x, y, BALL, BALL)
+    x += dx
+    y += dy
+    dx = -dx if x <= 0 || W - BALL <= x
+    dy = -dy if y <= 0 || H - BALL <= y
+    display.draw_rect(x, y, BALL, BALL, 1, true)
+    display.draw_rect(4, H - 4, (frame * (W - 8)) / FRAMES + 1, 2, 1, true)
+    if optimized
+      display.update_display_optimized
+    else
+      display.update_display
+    end
+    frame += 1
+  end
+  t1 = Time.now.to_f
+  [bus.bytes, bus.transfers, t1 - t0]
+end
+
+bus = CountingI2C.new
+display = SSD1306.new(i2c: bus, w: W, h: H)
+
+[false, true].each do |optimized|
+  bytes, transfers, sec = animate(display, bus, optimized)
+  name = optimized ? "update_display_optimized" : "update_display"
+  puts "#{name}: #{bytes / FRAMES} bytes/frame, #{transfers / FRAMES} transfers/frame, #{(sec * 1000 / FRAMES).to_i} ms/frame"
+end
@@ -174,16 +174,16 @@ class SSD1306
     @vram.pages.size
   end
 
-  # Update only dirty pages for better performance
+  # Update only the columns drawn since the last update, page by page
   def update_display_optimized
     dirty_pages = @vram.dirty_pages
     return 0 if dirty_pages.empty?
-    dirty_pages.each do |col, row, data|
-      # Set addressing range for this page only
-      @i2c.write(@address, 0x00, COLUMNADDR, 0, @width - 1)
+    dirty_pages.each do |col, row, data, x, y, w, h|
+      # Set addressing range to the dirty window of this page
+      @i2c.write(@address, 0x00, COLUMNADDR, x, x + w - 1)
       @i2c.write(@address, 0x00, PAGEADDR, row, row)
-      # Send page data
-      @i2c.write(@address, 0x40, data)
+      # Send the changed columns only
+      @i2c.write(@address, 0x40, w == @width ? data : data[x, w].to_s)
     end
     dirty_pages.size
   end
@@ -0,0 +1,94 @@
+# Path resolution and File.open throughput of VFS. The former Ruby
+# implementation of sanitize_and_split is kept here for comparison.
+#
+#   bin/picoruby mrbgems/picoruby-vfs/example/open_bench.rb
+
+COUNT = 2000
+
+def legacy_sanitize(path)
+  dirs = case path
+  when "/"
+    [""]
+  when ""
+    return ENV["HOME"].to_s
+  else
+    path.split("/")
+  end
+  if dirs[0] != ""
+    dirs = (ENV["PWD"] || "").split("/") + dirs
+  end
+  sanitized_dirs = []
+  prefix_dirs = []
+  dirs.each do |dir|
+    next if dir == "." || dir == ""
+    if dir == ".."
+      if sanitized_dirs.empty?
+        prefix_dirs << ".."
+      else
+        sanitized_dirs.pop
+      end
+    else
+      sanitized_dirs << dir
+    end
+  end
+  "#{prefix_dirs.join("/")}/#{sanitized_dirs.join("/")}"
+end
+
+def legacy_split(sanitized_path)
+  volume = VFS::VOLUMES.map { |v|
+    sanitized_path.start_with?(v[:mountpoint]) ? v : nil
+  }.max {|v| v ? v[:mountpoint].length : -1}
+  if volume
+    cut = volume[:mountpoint] == "/" ? 0 : 1
+    [volume, "/#{sanitized_path[volume[:mountpoint].length + cut, 255]}"]
+  else
+    [VFS::VOLUMES[0], sanitized_path]
+  end
+end
+
+def rate(count, elapsed)
+  elapsed == 0 ? '-' : (count / elapsed).to_i
+end
+
+ram = FAT.new(:ram, label: "RAMDISK")
+ram.mkfs
+VFS.mount(ram, "/ram")
+File.open("/ram/bench.txt", "w") { |f| f.write("x") }
+ENV["PWD"] = "/ram"
+
+paths = ["/ram/bench.txt", "bench.txt", "./lib/../bench.txt", "/home/app.rb"]
+
+started = Time.now.to_f
+i = 0
+while i < COUNT
+  legacy_split(legacy_sanitize(paths[i % paths.size]))
+  i += 1
+end
+puts "resolve (Ruby):   #{rate(COUNT, Time.now.to_f - started)} paths/s"
+
+started = Time.now.to_f
+i = 0
+while i < COUNT
+  VFS.sanitize_and_split(paths[i % paths.size])
+  i += 1
+end
+puts "resolve (native): #{rate(COUNT, Time.now.to_f - started)} paths/s"
+
+started = Time.now.to_f
+i = 0
+while i < COUNT
+  File.open("bench.txt", "r") { |f| }
+  i += 1
+end
+puts "File.open:        #{rate(COUNT, Time.now.to_f - started)} opens/s"
+
+started = Time.now.to_f
+i = 0
+while i < COUNT
+  File.exist?("/ram/bench.txt")
+  i += 1
+end
+puts "File.exist?:      #{rate(COUNT, Time.now.to_f - started)} calls/s"
+
+ENV["PWD"] = "/"
+VFS.unmount(ram)
@@ -0,0 +1,17 @@
+#ifndef VFS_DEFINED_H_
+#define VFS_DEFINED_H_
+
+#include <stddef.h>
+
+#define VFS_MOUNT_NODES_MAX 32
+#define VFS_MOUNT_NAMES_MAX 256
+
+/* Buffer size VFS_normalize() needs */
+#define VFS_NORMALIZED_CAPA(pwd_len, path_len) ((pwd_len) + (path_len) + 3)
+
+size_t VFS_normalize(const char *pwd, size_t pwd_len, const char *path, size_t path_len, char *out);
+void VFS_mount_table_clear(void);
+int VFS_mount_table_add(const char *mountpoint, size_t len, int volume);
+int VFS_mount_table_lookup(const char *path, size_t len, size_t *rest);
+
+#endif
@@ -16,8 +16,6 @@ class File
     def size = @stat.size
   end
 
-  CHUNK_SIZE = 127
-
   class << self
     def expand_path(path, default_path = '.')
       if path.start_with?("/")
@@ -35,14 +33,16 @@ class File
       count
     end
 
-    def open(path, mode = "r")
+    # fastseek: true keeps a cluster link map for quick random access.
+    #   nil (default) lets the driver decide by the mode and file size.
+    def open(path, mode = "r", fastseek: nil)
       if block_given?
-        file = self.new(path, mode)
+        file = self.new(path, mode, fastseek: fastseek)
         result = yield(file)
         file.close
         result
       else
-        self.new(path, mode)
+        self.new(path, mode, fastseek: fastseek)
       end
     end
 
@@ -87,9 +87,9 @@ class File
     end
   end
 
-  def initialize(path, mode = "r")
+  def initialize(path, mode = "r", fastseek: nil)
     @path = path
-    @file = VFS::File.open(path, mode)
+    @file = VFS::File.open(path, mode, fastseek)
   end
 
   attr_reader :path
@@ -119,10 +119,11 @@ class File
     @file.seek(0)
   end
 
-  def each_line(&block)
-    while line = gets do
+  def each_line(*args, chomp: false, &block)
+    while line = gets(*args, chomp: chomp) do
       block.call line
     end
+    self
   end
 
   def gets(*args, chomp: false)
@@ -139,45 +140,13 @@ class File
         limit = nil
       end
     when 2
-      rs = args[0].to_s
+      rs = args[0]&.to_s
       limit = args[1].to_i
     else
       raise ArgumentError.new("wrong number of arguments (expected 0..2)")
     end
-    result = ""
-    chunk_size = CHUNK_SIZE
-    initial_pos = self.tell
-    rs = "" unless rs
-    rs_adjust = rs.length - 1
-    if limit
-      (limit / chunk_size).times do
-        if chunk = @file.read(limit)
-          result << chunk
-        end
-      end
-      if (chunk = @file.read(limit % chunk_size))
-        result << chunk
-      end
-      if pos = result.index(rs)
-        result = result[0, pos + 1 + rs_adjust]
-      end
-    else
-      index_at = 0
-      while chunk = @file.read(chunk_size) do
-        result << chunk
-        if pos = result.index(rs, [index_at - rs_adjust, 0].max || 0)
-          result = result[0, pos + 1 + rs_adjust] || ""
-          break
-        end
-        index_at += chunk_size
-      end
-    end
-    if result&.length == 0 || result.nil?
-      return nil
-    else
-      self.seek(initial_pos + (result&.length || 0))
-      return chomp ? result.chomp(rs) : result
-    end
+    # The driver reads ahead and cuts lines out of its buffer
+    @file.gets(rs, limit, chomp)
   end
 
   def eof?
@@ -188,14 +157,9 @@ class File
     if length && length < 0
       raise ArgumentError.new("negative length #{length} given")
     end
-    if length.is_a?(Integer)
+    if length.is_a?(Integer) || length.nil?
+      # read(nil) is sized from what is left in the file
       outbuf << @file.read(length).to_s
-    elsif length.nil?
-      while buff = @file.read(1024)
-        outbuf << buff
-      end
-    else
-      # ????
     end
     if 0 == outbuf.length
       (length.nil? || length == 0) ? "" : nil
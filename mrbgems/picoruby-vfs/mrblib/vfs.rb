@@ -12,6 +12,7 @@ class VFS
       end
       driver.mount(mountpoint) # It raises if error
       VOLUMES << { driver: driver, mountpoint: mountpoint }
+      update_mount_table
       ENV["PWD"] = mountpoint if ENV["PWD"]&.empty?
     end
 
@@ -26,6 +27,7 @@ class VFS
       end
       driver.unmount
       VOLUMES.delete_at index
+      update_mount_table
       if VOLUMES.empty?
         ENV["PWD"] = ""
       end
@@ -112,49 +114,25 @@ class VFS
       split(sanitize path)
     end
 
+    # Normalization and the longest-prefix mount lookup are native
+    # (src/vfs.c) since every File and Dir operation goes through them.
     def sanitize(path)
-      dirs = case path
-      when "/"
-        [""]
-      when ""
-        return ENV["HOME"].to_s
-      else
-        path.split("/")
-      end
-      if dirs[0] != "" # path.start_with?("/")
-        # Relative path
-        dirs = (ENV["PWD"] || "").split("/") + dirs
-      end
-      sanitized_dirs = []
-      prefix_dirs = []
-      dirs.each do |dir|
-        next if dir == "." || dir == ""
-        if dir == ".."
-          if sanitized_dirs.empty?
-            prefix_dirs << ".."
-          else
-            sanitized_dirs.pop
-          end
-        else
-          sanitized_dirs << dir
-        end
-      end
-      "#{prefix_dirs.join("/")}/#{sanitized_dirs.join("/")}"
+      return ENV["HOME"].to_s if path == ""
+      _normalize(path, ENV["PWD"])
     end
 
     def split(sanitized_path)
-      found = false
-      volume = VOLUMES.map { |v|
-        sanitized_path.start_with?(v[:mountpoint]) ? v : nil
-      }.max {|v| v ? v[:mountpoint].length : -1}
-      if volume
-        cut = volume[:mountpoint] == "/" ? 0 : 1
-        [volume, "/#{sanitized_path[volume[:mountpoint].length + cut, 255]}"]
+      if found = _lookup(sanitized_path)
+        [VOLUMES[found[0]], found[1]]
       else
         [VOLUMES[0], sanitized_path] # fallback
       end
     end
 
+    def update_mount_table
+      self._mount_table = VOLUMES.map { |v| v[:mountpoint] }
+    end
+
     def volume_index(mountpoint)
       # mruby/c doesn't have Array#any?
       # also, mruby/c's Array#index doesn't take block argument
@@ -174,9 +152,9 @@ class VFS
   end
 
   class File
-    def self.open(path, mode)
+    def self.open(path, mode, fastseek = nil)
       volume, _path = VFS.sanitize_and_split(path)
-      volume[:driver].open_file(_path, mode)
+      volume[:driver].open_file(_path, mode, fastseek)
     end
 
     def self.utime(atime, mtime, *filenames)
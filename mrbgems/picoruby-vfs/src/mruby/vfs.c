@@ -0,0 +1,82 @@
+#include "mruby.h"
+#include "mruby/presym.h"
+#include "mruby/array.h"
+#include "mruby/string.h"
+
+/*
+ * VFS._normalize(path, pwd) -> String
+ */
+static mrb_value
+mrb_vfs_s__normalize(mrb_state *mrb, mrb_value klass)
+{
+  const char *path, *pwd = NULL;
+  mrb_int path_len, pwd_len = 0;
+  mrb_get_args(mrb, "s!s!", &path, &path_len, &pwd, &pwd_len);
+  if (path == NULL) {
+    mrb_raise(mrb, E_TYPE_ERROR, "wrong type of argument");
+  }
+  if (pwd == NULL) {
+    pwd = "";
+    pwd_len = 0;
+  }
+  mrb_value str = mrb_str_new(mrb, NULL, VFS_NORMALIZED_CAPA(pwd_len, path_len));
+  size_t len = VFS_normalize(pwd, pwd_len, path, path_len, RSTRING_PTR(str));
+  return mrb_str_resize(mrb, str, (mrb_int)len);
+}
+
+/*
+ * VFS._lookup(sanitized_path) -> [Integer, String] | nil
+ *   the index in VOLUMES and the path inside the volume
+ */
+static mrb_value
+mrb_vfs_s__lookup(mrb_state *mrb, mrb_value klass)
+{
+  const char *path;
+  mrb_int len;
+  mrb_get_args(mrb, "s", &path, &len);
+  size_t rest;
+  int volume = VFS_mount_table_lookup(path, len, &rest);
+  if (volume < 0) {
+    return mrb_nil_value();
+  }
+  mrb_value inner = ((mrb_int)rest == len) ? mrb_str_new_lit(mrb, "/") : mrb_str_new(mrb, path + rest, len - rest);
+  return mrb_assoc_new(mrb, mrb_fixnum_value(volume), inner);
+}
+
+/*
+ * VFS._mount_table = mountpoints
+ *   rebuilds the table; mountpoints[i] belongs to VOLUMES[i]
+ */
+static mrb_value
+mrb_vfs_s__mount_table_eq(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value mountpoints;
+  mrb_get_args(mrb, "A", &mountpoints);
+  VFS_mount_table_clear();
+  mrb_int size = RARRAY_LEN(mountpoints);
+  for (mrb_int i = 0; i < size; i++) {
+    mrb_value mountpoint = mrb_ary_ref(mrb, mountpoints, i);
+    if (!mrb_string_p(mountpoint)) {
+      mrb_raise(mrb, E_TYPE_ERROR, "mountpoint must be a String");
+    }
+    if (VFS_mount_table_add(RSTRING_PTR(mountpoint), RSTRING_LEN(mountpoint), (int)i) < 0) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "too many mountpoints");
+    }
+  }
+  return mountpoints;
+}
+
+void
+mrb_picoruby_vfs_gem_init(mrb_state* mrb)
+{
+  struct RClass *class_VFS = mrb_define_class_id(mrb, MRB_SYM(VFS), mrb->object_class);
+
+  mrb_define_class_method_id(mrb, class_VFS, MRB_SYM(_normalize), mrb_vfs_s__normalize, MRB_ARGS_REQ(2));
+  mrb_define_class_method_id(mrb, class_VFS, MRB_SYM(_lookup), mrb_vfs_s__lookup, MRB_ARGS_REQ(1));
+  mrb_define_class_method_id(mrb, class_VFS, MRB_SYM_E(_mount_table), mrb_vfs_s__mount_table_eq, MRB_ARGS_REQ(1));
+}
+
+void
+mrb_picoruby_vfs_gem_final(mrb_state* mrb)
+{
+}
@@ -0,0 +1,96 @@
+#include <mrubyc.h>
+
+/*
+ * VFS._normalize(path, pwd) -> String
+ */
+static void
+c_vfs__normalize(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_value path = GET_ARG(1);
+  mrbc_value pwd = GET_ARG(2);
+  if (path.tt != MRBC_TT_STRING || (pwd.tt != MRBC_TT_STRING && pwd.tt != MRBC_TT_NIL)) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
+    return;
+  }
+  const char *pwd_ptr = "";
+  size_t pwd_len = 0;
+  if (pwd.tt == MRBC_TT_STRING) {
+    pwd_ptr = (const char *)pwd.string->data;
+    pwd_len = pwd.string->size;
+  }
+  size_t path_len = path.string->size;
+  char *out = mrbc_alloc(vm, VFS_NORMALIZED_CAPA(pwd_len, path_len));
+  if (out == NULL) {
+    mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "can't allocate path");
+    return;
+  }
+  size_t len = VFS_normalize(pwd_ptr, pwd_len, (const char *)path.string->data, path_len, out);
+  out[len] = '\0';
+  SET_RETURN(mrbc_string_new_alloc(vm, out, len));
+}
+
+/*
+ * VFS._lookup(sanitized_path) -> [Integer, String] | nil
+ *   the index in VOLUMES and the path inside the volume
+ */
+static void
+c_vfs__lookup(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_value path = GET_ARG(1);
+  if (path.tt != MRBC_TT_STRING) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
+    return;
+  }
+  const char *ptr = (const char *)path.string->data;
+  size_t len = path.string->size;
+  size_t rest;
+  int volume = VFS_mount_table_lookup(ptr, len, &rest);
+  if (volume < 0) {
+    SET_NIL_RETURN();
+    return;
+  }
+  mrbc_value ret = mrbc_array_new(vm, 2);
+  mrbc_value index = mrbc_integer_value(volume);
+  mrbc_value inner = (rest == len) ? mrbc_string_new(vm, "/", 1) : mrbc_string_new(vm, ptr + rest, len - rest);
+  mrbc_array_push(&ret, &index);
+  mrbc_array_push(&ret, &inner);
+  SET_RETURN(ret);
+}
+
+/*
+ * VFS._mount_table = mountpoints
+ *   rebuilds the table; mountpoints[i] belongs to VOLUMES[i]
+ */
+static void
+c_vfs__mount_table_eq(mrbc_vm *vm, mrbc_value v[], int argc)
+{
+  mrbc_value mountpoints = GET_ARG(1);
+  if (mountpoints.tt != MRBC_TT_ARRAY) {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong type of argument");
+    return;
+  }
+  VFS_mount_table_clear();
+  int size = mrbc_array_size(&mountpoints);
+  for (int i = 0; i < size; i++) {
+    mrbc_value mountpoint = mrbc_array_get(&mountpoints, i);
+    if (mountpoint.tt != MRBC_TT_STRING) {
+      mrbc_raise(vm, MRBC_CLASS(TypeError), "mountpoint must be a String");
+      return;
+    }
+    if (VFS_mount_table_add((const char *)mountpoint.string->data, mountpoint.string->size, i) < 0) {
+      mrbc_raise(vm, MRBC_CLASS(RuntimeError), "too many mountpoints");
+      return;
+    }
+  }
+  SET_RETURN(mountpoints);
+}
+
+void
+mrbc_vfs_init(mrbc_vm *vm)
+{
+  mrbc_class *class_VFS = mrbc_define_class(vm, "VFS", mrbc_class_object);
+
+  mrbc_define_method(vm, class_VFS, "_normalize", c_vfs__normalize);
+  mrbc_define_method(vm, class_VFS, "_lookup", c_vfs__lookup);
+  mrbc_define_method(vm, class_VFS, "_mount_table=", c_vfs__mount_table_eq);
+}
@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <string.h>
+#include "../include/vfs.h"
+
+/*
+ * Path normalization
+ *
+ * Same result as the former Ruby implementation: "." and empty
+ * components are dropped, ".." removes the previous component, and
+ * ".." above the root is kept as a prefix like "../a".
+ * A relative path is resolved against pwd.
+ */
+
+static void
+normalize_append(char *out, size_t *len, int *up, const char *s, size_t n)
+{
+  size_t i = 0;
+  while (i < n) {
+    while (i < n && s[i] == '/') i++;
+    size_t start = i;
+    while (i < n && s[i] != '/') i++;
+    size_t clen = i - start;
+    if (clen == 0 || (clen == 1 && s[start] == '.')) {
+      continue;
+    }
+    if (clen == 2 && s[start] == '.' && s[start + 1] == '.') {
+      if (*len == 0) {
+        (*up)++;
+      } else {
+        while (out[--(*len)] != '/')
+          ;
+      }
+      continue;
+    }
+    out[(*len)++] = '/';
+    memcpy(out + *len, s + start, clen);
+    *len += clen;
+  }
+}
+
+/* out needs VFS_NORMALIZED_CAPA(pwd_len, path_len) bytes. Returns the length */
+size_t
+VFS_normalize(const char *pwd, size_t pwd_len, const char *path, size_t path_len, char *out)
+{
+  size_t len = 0;
+  int up = 0;
+  if (path_len == 0 || path[0] != '/') {
+    normalize_append(out, &len, &up, pwd, pwd_len);
+  }
+  normalize_append(out, &len, &up, path, path_len);
+  if (len == 0) {
+    out[len++] = '/';
+  }
+  if (0 < up) {
+    /* "..", "../.." ... goes in front */
+    size_t prefix = up * 3 - 1;
+    memmove(out + prefix, out, len);
+    for (int i = 0; i < up; i++) {
+      out[i * 3] = '.';
+      out[i * 3 + 1] = '.';
+      if (i < up - 1) out[i * 3 + 2] = '/';
+    }
+    len += prefix;
+  }
+  return len;
+}
+
+/*
+ * Mount table
+ *
+ * A trie of mountpoint components. Node 0 is the root "/".
+ * Lookup finds the deepest mountpoint that is a whole-component
+ * prefix of the path.
+ */
+
+typedef struct {
+  uint16_t name;    /* offset in mount_names */
+  uint8_t name_len;
+  int8_t child;     /* first child or -1 */
+  int8_t sibling;   /* next sibling or -1 */
+  int8_t volume;    /* index in VFS::VOLUMES or -1 */
+} vfs_mount_node;
+
+static vfs_mount_node mount_nodes[VFS_MOUNT_NODES_MAX];
+static char mount_names[VFS_MOUNT_NAMES_MAX];
+static int mount_nodes_len = 0;
+static size_t mount_names_len = 0;
+
+void
+VFS_mount_table_clear(void)
+{
+  mount_nodes[0].name = 0;
+  mount_nodes[0].name_len = 0;
+  mount_nodes[0].child = -1;
+  mount_nodes[0].sibling = -1;
+  mount_nodes[0].volume = -1;
+  mount_nodes_len = 1;
+  mount_names_len = 0;
+}
+
+static int
+find_child(int node, const char *name, size_t len)
+{
+  for (int c = mount_nodes[node].child; 0 <= c; c = mount_nodes[c].sibling) {
+    if (mount_nodes[c].name_len == len && memcmp(mount_names + mount_nodes[c].name, name, len) == 0) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+/* Returns -1 when the table is full */
+int
+VFS_mount_table_add(const char *mountpoint, size_t len, int volume)
+{
+  if (mount_nodes_len == 0) {
+    VFS_mount_table_clear();
+  }
+  int node = 0;
+  size_t i = 0;
+  while (i < len) {
+    while (i < len && mountpoint[i] == '/') i++;
+    size_t start = i;
+    while (i < len && mountpoint[i] != '/') i++;
+    size_t clen = i - start;
+    if (clen == 0) break;
+    int child = find_child(node, mountpoint + start, clen);
+    if (child < 0) {
+      if (mount_nodes_len == VFS_MOUNT_NODES_MAX || UINT8_MAX < clen ||
+          VFS_MOUNT_NAMES_MAX - mount_names_len < clen) {
+        return -1;
+      }
+      child = mount_nodes_len++;
+      memcpy(mount_names + mount_names_len, mountpoint + start, clen);
+      mount_nodes[child].name = (uint16_t)mount_names_len;
+      mount_nodes[child].name_len = (uint8_t)clen;
+      mount_nodes[child].child = -1;
+      mount_nodes[child].volume = -1;
+      mount_nodes[child].sibling = mount_nodes[node].child;
+      mount_nodes[node].child = (int8_t)child;
+      mount_names_len += clen;
+    }
+    node = child;
+  }
+  mount_nodes[node].volume = (int8_t)volume;
+  return 0;
+}
+
+/*
+ * Returns the volume index, or -1 when no mountpoint matches.
+ * *rest is where the path inside the volume starts; it is either
+ * the end of path or a '/'.
+ */
+int
+VFS_mount_table_lookup(const char *path, size_t len, size_t *rest)
+{
+  if (mount_nodes_len == 0 || len == 0 || path[0] != '/') {
+    return -1;
+  }
+  int node = 0;
+  int volume = mount_nodes[0].volume;
+  *rest = 0;
+  size_t i = 0;
+  while (i < len) {
+    while (i < len && path[i] == '/') i++;
+    size_t start = i;
+    while (i < len && path[i] != '/') i++;
+    if (i == start) break;
+    node = find_child(node, path + start, i - start);
+    if (node < 0) break;
+    if (0 <= mount_nodes[node].volume) {
+      volume = mount_nodes[node].volume;
+      *rest = i;
+    }
+  }
+  return volume;
+}
+
+#if defined(PICORB_VM_MRUBY)
+
+#include "mruby/vfs.c"
+
+#elif defined(PICORB_VM_MRUBYC)
+
+#include "mrubyc/vfs.c"
+
+#endif
@@ -0,0 +1,66 @@
+class VFSTest < Picotest::Test
+  class PseudoDriver
+    attr_reader :mountpoint
+    def mount(mountpoint)
+      @mountpoint = mountpoint
+    end
+    def unmount
+    end
+  end
+
+  def setup
+    @pwd = ENV["PWD"]
+    @saved_volumes = VFS::VOLUMES.dup
+    VFS::VOLUMES.clear
+    @root = PseudoDriver.new
+    @sd = PseudoDriver.new
+    VFS.mount(@root, "/")
+    VFS.mount(@sd, "/sd")
+  end
+
+  def teardown
+    VFS::VOLUMES.clear
+    @saved_volumes.each { |v| VFS::VOLUMES << v }
+    VFS.update_mount_table
+    ENV["PWD"] = @pwd.to_s
+  end
+
+  def test_sanitize_absolute
+    assert_equal "/", VFS.sanitize("/")
+    assert_equal "/a/b", VFS.sanitize("/a/./b/")
+    assert_equal "/a/c", VFS.sanitize("/a//b/../c")
+    assert_equal "../a", VFS.sanitize("/../a")
+    assert_equal "../", VFS.sanitize("/..")
+  end
+
+  def test_sanitize_relative
+    ENV["PWD"] = "/home/user"
+    assert_equal "/home/user/a", VFS.sanitize("a")
+    assert_equal "/home/user", VFS.sanitize(".")
+    assert_equal "/home/b", VFS.sanitize("../b")
+    assert_equal "../../", VFS.sanitize("../../../..")
+  end
+
+  def test_split
+    ENV["PWD"] = "/"
+    assert_equal "/", VFS.sanitize_and_split("/home")[0][:mountpoint]
+    assert_equal "/home", VFS.sanitize_and_split("home/")[1]
+    assert_equal "/sd", VFS.sanitize_and_split("/sd/home")[0][:mountpoint]
+    assert_equal "/home", VFS.sanitize_and_split("/sd/home/")[1]
+    assert_equal "/", VFS.sanitize_and_split("/sd")[1]
+  end
+
+  def test_split_matches_whole_components
+    volume, path = VFS.sanitize_and_split("/sdcard/a")
+    assert_equal "/", volume[:mountpoint]
+    assert_equal "/sdcard/a", path
+  end
+
+  def test_split_after_unmount
+    ENV["PWD"] = "/"
+    VFS.unmount(@sd)
+    volume, path = VFS.sanitize_and_split("/sd/home")
+    assert_equal "/", volume[:mountpoint]
+    assert_equal "/sd/home", path
+  end
+end
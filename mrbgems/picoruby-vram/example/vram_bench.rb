@@ -0,0 +1,56 @@
+# Full-frame render rate of a 128x64 VRAM in every pixel format:
+# clear, filled rectangles, outlines, diagonals and a screen of 8x8 glyphs.
+#
+#   bin/picoruby mrbgems/picoruby-vram/example/vram_bench.rb
+
+W = 128
+H = 64
+FRAMES = 50
+
+FORMATS = [
+  [:mono, 1],
+  [:gray4, 0x0F],
+  [:gray8, 0xFF],
+  [:rgb565, 0xF800],
+  [:rgb888, 0xFF8000],
+  [:argb8888, 0xFF00FF00]
+]
+
+GLYPH = [0x3C, 0x42, 0xA5, 0x81, 0xA5, 0x99, 0x42, 0x3C]
+
+def render(vram, color, frame)
+  vram.fill(0)
+  y = 0
+  while y < H
+    vram.draw_rect((frame + y) % 32, y, 96, 6, color)
+    y += 8
+  end
+  vram.draw_line(0, 0, W - 1, 0, color)
+  vram.draw_line(0, H - 1, W - 1, H - 1, color)
+  vram.draw_line(0, 0, 0, H - 1, color)
+  vram.draw_line(W - 1, 0, W - 1, H - 1, color)
+  vram.draw_line(0, 0, W - 1, H - 1, color)
+  vram.draw_line(0, H - 1, W - 1, 0, color)
+  y = 0
+  while y < H
+    x = 0
+    while x < W
+      vram.draw_bitmap(x: x, y: y, w: 8, h: 8, data: GLYPH, color: color)
+      x += 8
+    end
+    y += 16
+  end
+end
+
+FORMATS.each do |format, color|
+  vram = VRAM.new(w: W, h: H, cols: 1, rows: 8, format: format)
+  started = Time.now.to_f
+  frame = 0
+  while frame < FRAMES
+    render(vram, color, frame)
+    frame += 1
+  end
+  elapsed = Time.now.to_f - started
+  fps = elapsed == 0 ? '-' : (FRAMES / elapsed).to_i
+  puts "#{format.to_s.ljust(9, " ")} #{fps} frames/s"
+end
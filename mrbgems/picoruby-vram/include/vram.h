@@ -29,15 +29,15 @@ typedef struct display_page {
   mrbc_value buffer;  // Pixel data
 #endif
   bool  dirty;
+  int dirty_x0, dirty_y0;  // Page-local box modified since the last
+  int dirty_x1, dirty_y1;  // dirty_pages, x1 and y1 exclusive
   size_t buffer_size;
-  void (*set_pixel)(struct display_page*, int x, int y, uint32_t color);
-  uint32_t (*get_pixel)(struct display_page*, int x, int y);
-  void (*fill)(struct display_page*, uint32_t color);
 } display_page_t;
 
 typedef struct display {
   int w;
   int h;
+  int cols, rows;    // Pages are laid out in a cols x rows grid
   int page_count;
 #if defined(PICORB_VM_MRUBY)
   display_page_t *pages;
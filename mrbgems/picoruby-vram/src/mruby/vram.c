@@ -26,97 +26,64 @@ struct mrb_data_type mrb_vram_type = {
   "VRAM", mrb_vram_free,
 };
 
-static void
-mono_page_set_pixel(struct display_page *page, int x, int y, uint32_t color)
-{
-  if (x < 0 || x >= page->w || y < 0 || y >= page->h) return;
-
-  unsigned char *data = (unsigned char *)RSTRING_PTR(page->buffer);
-  int byte_idx = x + (y / 8) * page->w;
-  int bit_idx = y % 8;
-
-  if (byte_idx < 0 || byte_idx >= RSTRING_LEN(page->buffer)) return;
-
-  if (color) {
-    data[byte_idx] |= (1 << bit_idx);
-  } else {
-    data[byte_idx] &= ~(1 << bit_idx);
-  }
-  page->dirty = true;
-}
-
-static uint32_t
-mono_page_get_pixel(struct display_page *page, int x, int y)
-{
-  if (x < 0 || x >= page->w || y < 0 || y >= page->h) return 0;
-
-  unsigned char *data = (unsigned char *)RSTRING_PTR(page->buffer);
-  int byte_idx = x + (y / 8) * page->w;
-  int bit_idx = y % 8;
-
-  if (byte_idx < 0 || byte_idx >= RSTRING_LEN(page->buffer)) return 0;
-
-  return (data[byte_idx] >> bit_idx) & 1;
-}
-
-static void
-mono_page_fill(struct display_page *page, uint32_t color)
-{
-  unsigned char *data = (unsigned char *)RSTRING_PTR(page->buffer);
-  memset(data, color ? 0xFF : 0x00, RSTRING_LEN(page->buffer));
-  page->dirty = true;
-}
-
 /*
  * vram = VRAM.new(w: 128, h: 64, cols: 1, rows: 8)
  * vram.name = "SSD1306"
+ * VRAM.new(w: 240, h: 240, cols: 1, rows: 4, format: :rgb565)
 */
 static mrb_value
 mrb_vram_s_new(mrb_state* mrb, mrb_value klass)
 {
-  const mrb_sym kw_names[] = { MRB_SYM(w), MRB_SYM(h), MRB_SYM(cols), MRB_SYM(rows) };
-  mrb_value kw_values[4];
+  const mrb_sym kw_names[] = { MRB_SYM(w), MRB_SYM(h), MRB_SYM(cols), MRB_SYM(rows), MRB_SYM(format) };
+  mrb_value kw_values[5];
   mrb_value kw_rest;
-  mrb_kwargs kwargs = { 4, 4, kw_names, kw_values, &kw_rest };
+  mrb_kwargs kwargs = { 5, 4, kw_names, kw_values, &kw_rest };
   mrb_get_args(mrb, ":", &kwargs);
 
   mrb_int w = mrb_fixnum(kw_values[0]);
   mrb_int h = mrb_fixnum(kw_values[1]);
   mrb_int cols = mrb_fixnum(kw_values[2]);
   mrb_int rows = mrb_fixnum(kw_values[3]);
+  if (w <= 0 || h <= 0 || cols <= 0 || rows <= 0 || w < cols || h < rows) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "Invalid arguments for VRAM.new");
+  }
+  pixel_format_t format = PIXEL_FORMAT_MONO;
+  if (!mrb_undef_p(kw_values[4])) {
+    int f = mrb_symbol_p(kw_values[4]) ? vram_format_from_name(mrb_sym_name(mrb, mrb_symbol(kw_values[4]))) : -1;
+    if (f < 0) mrb_raise(mrb, E_ARGUMENT_ERROR, "Unknown pixel format");
+    format = (pixel_format_t)f;
+  }
   mrb_int page_w = w / cols;
   mrb_int page_h = h / rows;
 
   display_t *disp = mrb_malloc(mrb, sizeof(display_t));
   disp->w = w;
   disp->h = h;
-  disp->page_count = rows * cols;
-  disp->pages = mrb_malloc(mrb, sizeof(display_page_t) * disp->page_count);
+  disp->cols = cols;
+  disp->rows = rows;
+  disp->page_count = 0;
+  disp->pages = mrb_malloc(mrb, sizeof(display_page_t) * rows * cols);
 
   mrb_value vram = mrb_obj_value(Data_Wrap_Struct(mrb, mrb_class_ptr(klass), &mrb_vram_type, disp));
 
-  mrb_int page_size = page_w * ((page_h + 7) / 8); // TODO: support formats
+  mrb_int page_size = (mrb_int)vram_page_size(format, page_w, page_h);
 
   for (mrb_int ty = 0; ty < rows; ty++) {
     for (mrb_int tx = 0; tx < cols; tx++) {
       display_page_t *page = &disp->pages[ty * cols + tx];
+      page->page_id = ty * cols + tx;
       page->x = tx * page_w;
       page->y = ty * page_h;
       page->w = page_w;
       page->h = page_h;
+      page->pixel_format = format;
       // Create buffer with exact size needed
       page->buffer = mrb_str_new(mrb, NULL, page_size);
-      char *data = RSTRING_PTR(page->buffer);
-      memset(data, 0, page_size);
+      page->buffer_size = page_size;
       mrb_gc_register(mrb, page->buffer);
-      page->dirty = false;
-      { // TODO: support formats
-        page->pixel_format = PIXEL_FORMAT_MONO;
-        page->set_pixel = mono_page_set_pixel;
-        page->get_pixel = mono_page_get_pixel;
-        page->fill = mono_page_fill;
-      }
-      page->fill(page, 0);
+      disp->page_count++;
+      vram_page_fill(page, 0);
+      page_clear_dirty(page);
     }
   }
 
@@ -125,7 +92,8 @@ mrb_vram_s_new(mrb_state* mrb, mrb_value klass)
 
 /*
  * vram.pages       => [[0, 0, "\x00..."], ] # All [col, row, data]
- * vram.dirty_pages => [[1, 2, "\x00..."], ] # [col, row, data] that are dirty
+ * vram.dirty_pages => [[1, 2, "\x00...", x, y, w, h], ]
+ *   # Dirty pages only, with the page-local box drawn since the last call
  */
 static mrb_value
 mrb_vram_pages_sub(mrb_state* mrb, mrb_value self, mrb_bool dirty)
@@ -137,15 +105,20 @@ mrb_vram_pages_sub(mrb_state* mrb, mrb_value self, mrb_bool dirty)
   for (mrb_int i = 0; i < disp->page_count; i++) {
     display_page_t *page = &disp->pages[i];
     if (!dirty || page->dirty) {
-      mrb_int cols = disp->w / page->w;
-      mrb_int col = i % cols;
-      mrb_int row = i / cols;
-      mrb_value entry = mrb_ary_new_capa(mrb, 3);
+      mrb_int col = i % disp->cols;
+      mrb_int row = i / disp->cols;
+      mrb_value entry = mrb_ary_new_capa(mrb, dirty ? 7 : 3);
       mrb_ary_push(mrb, entry, mrb_fixnum_value(col));
       mrb_ary_push(mrb, entry, mrb_fixnum_value(row));
       mrb_ary_push(mrb, entry, page->buffer);
+      if (dirty) {
+        mrb_ary_push(mrb, entry, mrb_fixnum_value(page->dirty_x0));
+        mrb_ary_push(mrb, entry, mrb_fixnum_value(page->dirty_y0));
+        mrb_ary_push(mrb, entry, mrb_fixnum_value(page->dirty_x1 - page->dirty_x0));
+        mrb_ary_push(mrb, entry, mrb_fixnum_value(page->dirty_y1 - page->dirty_y0));
+      }
       mrb_ary_push(mrb, result, entry);
-      if (clear_dirty) page->dirty = false;
+      if (clear_dirty) page_clear_dirty(page);
     }
   }
   return result;
@@ -170,40 +143,7 @@ mrb_vram_draw_line(mrb_state* mrb, mrb_value self)
   mrb_get_args(mrb, "iiiii", &x0, &y0, &x1, &y1, &color);
 
   display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
-
-  // Bresenham's line algorithm
-  mrb_int dx = x1 > x0 ? x1 - x0 : x0 - x1;
-  mrb_int dy = y1 > y0 ? y1 - y0 : y0 - y1;
-  mrb_int sx = x0 < x1 ? 1 : -1;
-  mrb_int sy = y0 < y1 ? 1 : -1;
-  mrb_int err = dx - dy;
-
-  mrb_int x = x0;
-  mrb_int y = y0;
-
-  while (1) {
-    // Set pixel at current position
-    for (mrb_int i = 0; i < disp->page_count; i++) {
-      display_page_t *page = &disp->pages[i];
-      if (x >= page->x && x < page->x + page->w &&
-          y >= page->y && y < page->y + page->h) {
-        page->set_pixel(page, x - page->x, y - page->y, color);
-        break;
-      }
-    }
-
-    if (x == x1 && y == y1) break;
-
-    mrb_int e2 = 2 * err;
-    if (e2 > -dy) {
-      err -= dy;
-      x += sx;
-    }
-    if (e2 < dx) {
-      err += dx;
-      y += sy;
-    }
-  }
+  vram_draw_line(disp, x0, y0, x1, y1, color);
 
   return self;
 }
@@ -215,21 +155,7 @@ mrb_vram_draw_rect(mrb_state* mrb, mrb_value self)
   mrb_get_args(mrb, "iiiii", &x, &y, &w, &h, &color);
 
   display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
-
-  for (mrb_int i = 0; i < h; i++) {
-    for (mrb_int j = 0; j < w; j++) {
-      mrb_int px = x + j;
-      mrb_int py = y + i;
-      for (mrb_int k = 0; k < disp->page_count; k++) {
-        display_page_t *page = &disp->pages[k];
-        if (px >= page->x && px < page->x + page->w &&
-            py >= page->y && py < page->y + page->h) {
-          page->set_pixel(page, px - page->x, py - page->y, color);
-          break;
-        }
-      }
-    }
-  }
+  vram_fill_rect(disp, x, y, w, h, color);
 
   return self;
 }
@@ -241,39 +167,49 @@ mrb_vram_set_pixel(mrb_state* mrb, mrb_value self)
   mrb_get_args(mrb, "iii", &x, &y, &color);
 
   display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
-
-  for (mrb_int i = 0; i < disp->page_count; i++) {
-    display_page_t *page = &disp->pages[i];
-    if (x >= page->x && x < page->x + page->w &&
-        y >= page->y && y < page->y + page->h) {
-      page->set_pixel(page, x - page->x, y - page->y, color);
-      break;
-    }
-  }
+  vram_set_pixel(disp, x, y, color);
 
   return self;
 }
 
+static mrb_value
+mrb_vram_get_pixel(mrb_state* mrb, mrb_value self)
+{
+  mrb_int x, y;
+  mrb_get_args(mrb, "ii", &x, &y);
+
+  display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
+  return mrb_fixnum_value(vram_get_pixel(disp, x, y));
+}
+
 static mrb_value
 mrb_vram_fill(mrb_state* mrb, mrb_value self)
 {
   mrb_int color;
   mrb_get_args(mrb, "i", &color);
   display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
-  for (mrb_int i = 0; i < disp->page_count; i++) {
-    display_page_t *page = &disp->pages[i];
-    page->fill(page, color);
-  }
+  vram_fill(disp, color);
   return self;
 }
 
+/* Integer color: keyword or 1 */
+static uint32_t
+vram_color_kwarg(mrb_state *mrb, mrb_value value)
+{
+  if (mrb_undef_p(value)) return 1;
+  if (!mrb_integer_p(value)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "color must be an Integer");
+  }
+  return (uint32_t)mrb_integer(value);
+}
+
 static mrb_value
 mrb_vram_draw_bitmap(mrb_state* mrb, mrb_value self)
 {
-  const mrb_sym kw_names[] = { MRB_SYM(x), MRB_SYM(y), MRB_SYM(w), MRB_SYM(h), MRB_SYM(data) };
-  mrb_value kw_values[5];
+  const mrb_sym kw_names[] = { MRB_SYM(x), MRB_SYM(y), MRB_SYM(w), MRB_SYM(h), MRB_SYM(data), MRB_SYM(color) };
+  mrb_value kw_values[6];
   mrb_value kw_rest;
-  mrb_kwargs kwargs = { 5, 5, kw_names, kw_values, &kw_rest };
+  mrb_kwargs kwargs = { 6, 5, kw_names, kw_values, &kw_rest };
   mrb_get_args(mrb, ":", &kwargs);
 
   display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
@@ -290,31 +226,28 @@ mrb_vram_draw_bitmap(mrb_state* mrb, mrb_value self)
   mrb_int width = mrb_integer(kw_values[2]);
   mrb_int height = mrb_integer(kw_values[3]);
   mrb_value data_val = kw_values[4];
+  uint32_t color = vram_color_kwarg(mrb, kw_values[5]);
 
   if (width <= 0 || height <= 0) return self;
 
   mrb_int data_len = RARRAY_LEN(data_val);
-
-  for (mrb_int img_y = 0; img_y < height && img_y < data_len; img_y++) {
+  if (data_len < height) height = data_len;
+  if (height == 0) return self;
+
+  // Pack the rows (bit width-1 is the leftmost pixel) into 1-bit image rows
+  mrb_int stride = (width + 7) / 8;
+  uint8_t stack_bits[VRAM_BITMAP_STACK];
+  uint8_t *bits = stack_bits;
+  if ((mrb_int)sizeof(stack_bits) < stride * height) {
+    bits = mrb_malloc(mrb, stride * height);
+  }
+  for (mrb_int img_y = 0; img_y < height; img_y++) {
     mrb_value row_val = mrb_ary_ref(mrb, data_val, img_y);
-    if (mrb_integer_p(row_val)) {
-      uint64_t row_data = (uint64_t)mrb_integer(row_val);
-      for (mrb_int img_x = 0; img_x < width; img_x++) {
-        uint8_t pixel = (row_data >> (width - 1 - img_x)) & 1;
-        mrb_int screen_x = x + img_x;
-        mrb_int screen_y = y + img_y;
-
-        for (mrb_int i = 0; i < disp->page_count; i++) {
-          display_page_t *page = &disp->pages[i];
-          if (screen_x >= page->x && screen_x < page->x + page->w &&
-              screen_y >= page->y && screen_y < page->y + page->h) {
-            page->set_pixel(page, screen_x - page->x, screen_y - page->y, pixel);
-            break;
-          }
-        }
-      }
-    }
+    uint64_t row_data = mrb_integer_p(row_val) ? (uint64_t)mrb_integer(row_val) : 0;
+    vram_pack_row(bits + img_y * stride, row_data, width);
   }
+  vram_blit(disp, x, y, width, height, bits, stride, color);
+  if (bits != stack_bits) mrb_free(mrb, bits);
 
   return self;
 }
@@ -322,10 +255,10 @@ mrb_vram_draw_bitmap(mrb_state* mrb, mrb_value self)
 static mrb_value
 mrb_vram_draw_bytes(mrb_state* mrb, mrb_value self)
 {
-  const mrb_sym kw_names[] = { MRB_SYM(x), MRB_SYM(y), MRB_SYM(w), MRB_SYM(h), MRB_SYM(data) };
-  mrb_value kw_values[5];
+  const mrb_sym kw_names[] = { MRB_SYM(x), MRB_SYM(y), MRB_SYM(w), MRB_SYM(h), MRB_SYM(data), MRB_SYM(color) };
+  mrb_value kw_values[6];
   mrb_value kw_rest;
-  mrb_kwargs kwargs = { 5, 5, kw_names, kw_values, &kw_rest };
+  mrb_kwargs kwargs = { 6, 5, kw_names, kw_values, &kw_rest };
   mrb_get_args(mrb, ":", &kwargs);
 
   display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
@@ -342,34 +275,22 @@ mrb_vram_draw_bytes(mrb_state* mrb, mrb_value self)
   mrb_int width = mrb_integer(kw_values[2]);
   mrb_int height = mrb_integer(kw_values[3]);
   mrb_value data_val = kw_values[4];
+  uint32_t color = vram_color_kwarg(mrb, kw_values[5]);
 
   if (width <= 0 || height <= 0) return self;
 
   const uint8_t *image_data = (const uint8_t *)RSTRING_PTR(data_val);
   mrb_int data_size = RSTRING_LEN(data_val);
-
-  for (mrb_int img_y = 0; img_y < height; img_y++) {
-    for (mrb_int img_x = 0; img_x < width; img_x++) {
-      mrb_int byte_idx = (img_y * ((width + 7) / 8)) + (img_x / 8);
-      mrb_int bit_idx = 7 - (img_x % 8);
-
-      uint8_t pixel = 0;
-      if (byte_idx < data_size) {
-        pixel = (image_data[byte_idx] >> bit_idx) & 1;
-      }
-
-      mrb_int screen_x = x + img_x;
-      mrb_int screen_y = y + img_y;
-
-      for (mrb_int i = 0; i < disp->page_count; i++) {
-        display_page_t *page = &disp->pages[i];
-        if (screen_x >= page->x && screen_x < page->x + page->w &&
-            screen_y >= page->y && screen_y < page->y + page->h) {
-          page->set_pixel(page, screen_x - page->x, screen_y - page->y, pixel);
-          break;
-        }
-      }
-    }
+  mrb_int stride = (width + 7) / 8;
+
+  if (data_size < stride * height) {
+    // Missing bytes are blank
+    uint8_t *bits = mrb_calloc(mrb, stride * height, 1);
+    memcpy(bits, image_data, data_size);
+    vram_blit(disp, x, y, width, height, bits, stride, color);
+    mrb_free(mrb, bits);
+  } else {
+    vram_blit(disp, x, y, width, height, image_data, stride, color);
   }
 
   return self;
@@ -382,40 +303,26 @@ mrb_vram_erase(mrb_state* mrb, mrb_value self)
   mrb_get_args(mrb, "iiii", &x, &y, &w, &h);
 
   display_t *disp = (display_t *)mrb_data_get_ptr(mrb, self, &mrb_vram_type);
-
-  for (mrb_int i = 0; i < h; i++) {
-    for (mrb_int j = 0; j < w; j++) {
-      mrb_int px = x + j;
-      mrb_int py = y + i;
-      for (mrb_int k = 0; k < disp->page_count; k++) {
-        display_page_t *page = &disp->pages[k];
-        if (px >= page->x && px < page->x + page->w &&
-            py >= page->y && py < page->y + page->h) {
-          page->set_pixel(page, px - page->x, py - page->y, 0);
-          break;
-        }
-      }
-    }
-  }
+  vram_fill_rect(disp, x, y, w, h, 0);
 
   return self;
 }
 
-
 void
 mrb_picoruby_vram_gem_init(mrb_state* mrb)
 {
   struct RClass *class_VRAM = mrb_define_class_id(mrb, MRB_SYM(VRAM), mrb->object_class);
   MRB_SET_INSTANCE_TT(class_VRAM, MRB_TT_CDATA);
 
-  mrb_define_class_method_id(mrb, class_VRAM, MRB_SYM(new), mrb_vram_s_new, MRB_ARGS_KEY(4, 4));
+  mrb_define_class_method_id(mrb, class_VRAM, MRB_SYM(new), mrb_vram_s_new, MRB_ARGS_KEY(5, 4));
   mrb_define_method_id(mrb, class_VRAM, MRB_SYM(pages), mrb_vram_pages, MRB_ARGS_OPT(1));
   mrb_define_method_id(mrb, class_VRAM, MRB_SYM(dirty_pages), mrb_vram_dirty_pages, MRB_ARGS_OPT(1));
   mrb_define_method_id(mrb, class_VRAM, MRB_SYM(draw_line), mrb_vram_draw_line, MRB_ARGS_REQ(5));
   mrb_define_method_id(mrb, class_VRAM, MRB_SYM(draw_rect), mrb_vram_draw_rect, MRB_ARGS_REQ(5));
-  mrb_define_method_id(mrb, class_VRAM, MRB_SYM(draw_bitmap), mrb_vram_draw_bitmap, MRB_ARGS_KEY(5, 5));
-  mrb_define_method_id(mrb, class_VRAM, MRB_SYM(draw_bytes), mrb_vram_draw_bytes, MRB_ARGS_KEY(5, 5));
+  mrb_define_method_id(mrb, class_VRAM, MRB_SYM(draw_bitmap), mrb_vram_draw_bitmap, MRB_ARGS_KEY(6, 5));
+  mrb_define_method_id(mrb, class_VRAM, MRB_SYM(draw_bytes), mrb_vram_draw_bytes, MRB_ARGS_KEY(6, 5));
   mrb_define_method_id(mrb, class_VRAM, MRB_SYM(set_pixel), mrb_vram_set_pixel, MRB_ARGS_REQ(3));
+  mrb_define_method_id(mrb, class_VRAM, MRB_SYM(get_pixel), mrb_vram_get_pixel, MRB_ARGS_REQ(2));
   mrb_define_method_id(mrb, class_VRAM, MRB_SYM(fill), mrb_vram_fill, MRB_ARGS_REQ(1));
   mrb_define_method_id(mrb, class_VRAM, MRB_SYM(erase), mrb_vram_erase, MRB_ARGS_REQ(4));
 }
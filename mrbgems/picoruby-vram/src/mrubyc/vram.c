@@ -18,49 +18,9 @@ mrbc_vram_free(mrb_value *self)
   }
 }
 
-static void
-mrubyc_mono_page_set_pixel(struct display_page *page, int x, int y, uint32_t color)
-{
-  if (x < 0 || x >= page->w || y < 0 || y >= page->h) return;
-
-  unsigned char *data = (unsigned char *)page->buffer.string->data;
-  int byte_idx = x + (y / 8) * page->w;
-  int bit_idx = y % 8;
-
-  if (byte_idx < 0 || byte_idx >= (int)page->buffer.string->size) return;
-
-  if (color) {
-    data[byte_idx] |= (1 << bit_idx);
-  } else {
-    data[byte_idx] &= ~(1 << bit_idx);
-  }
-  page->dirty = true;
-}
-
-static uint32_t
-mrubyc_mono_page_get_pixel(struct display_page *page, int x, int y)
-{
-  if (x < 0 || x >= page->w || y < 0 || y >= page->h) return 0;
-
-  unsigned char *data = (unsigned char *)page->buffer.string->data;
-  int byte_idx = x + (y / 8) * page->w;
-  int bit_idx = y % 8;
-
-  if (byte_idx < 0 || byte_idx >= (int)page->buffer.string->size) return 0;
-
-  return (data[byte_idx] >> bit_idx) & 1;
-}
-
-static void
-mrubyc_mono_page_fill(struct display_page *page, uint32_t color)
-{
-  unsigned char *data = (unsigned char *)page->buffer.string->data;
-  memset(data, color ? 0xFF : 0x00, page->buffer.string->size);
-  page->dirty = true;
-}
-
 /*
  * VRAM.new(w: 128, h: 64, cols: 1, rows: 8)
+ * VRAM.new(w: 240, h: 240, cols: 1, rows: 4, format: :rgb565)
  */
 static void
 c_vram_new(mrbc_vm *vm, mrbc_value *v, int argc)
@@ -69,13 +29,26 @@ c_vram_new(mrbc_vm *vm, mrbc_value *v, int argc)
   mrbc_value h_val = mrbc_hash_get(v + 1, &mrbc_symbol_value(mrbc_str_to_symid("h")));
   mrbc_value cols_val = mrbc_hash_get(v + 1, &mrbc_symbol_value(mrbc_str_to_symid("cols")));
   mrbc_value rows_val = mrbc_hash_get(v + 1, &mrbc_symbol_value(mrbc_str_to_symid("rows")));
+  mrbc_value format_val = mrbc_hash_get(v + 1, &mrbc_symbol_value(mrbc_str_to_symid("format")));
 
   if (mrbc_type(w_val) != MRBC_TT_INTEGER || mrbc_type(h_val) != MRBC_TT_INTEGER ||
-      mrbc_type(cols_val) != MRBC_TT_INTEGER || mrbc_type(rows_val) != MRBC_TT_INTEGER) {
+      mrbc_type(cols_val) != MRBC_TT_INTEGER || mrbc_type(rows_val) != MRBC_TT_INTEGER ||
+      w_val.i <= 0 || h_val.i <= 0 || cols_val.i <= 0 || rows_val.i <= 0 ||
+      w_val.i < cols_val.i || h_val.i < rows_val.i) {
     mrbc_raise(vm, MRBC_CLASS(ArgumentError), "Invalid arguments for VRAM.new");
     return;
   }
 
+  pixel_format_t format = PIXEL_FORMAT_MONO;
+  if (mrbc_type(format_val) != MRBC_TT_NIL) {
+    int f = (mrbc_type(format_val) == MRBC_TT_SYMBOL) ? vram_format_from_name(mrbc_symid_to_str(format_val.sym_id)) : -1;
+    if (f < 0) {
+      mrbc_raise(vm, MRBC_CLASS(ArgumentError), "Unknown pixel format");
+      return;
+    }
+    format = (pixel_format_t)f;
+  }
+
   int w = w_val.i;
   int h = h_val.i;
   int cols = cols_val.i;
@@ -92,29 +65,34 @@ c_vram_new(mrbc_vm *vm, mrbc_value *v, int argc)
 
   disp->w = w;
   disp->h = h;
+  disp->cols = cols;
+  disp->rows = rows;
   disp->page_count = rows * cols;
 
-  int page_size = page_w * ((page_h + 7) / 8);
+  int page_size = (int)vram_page_size(format, page_w, page_h);
 
   for (int ty = 0; ty < rows; ty++) {
     for (int tx = 0; tx < cols; tx++) {
       display_page_t *page = &disp->pages[ty * cols + tx];
+      page->page_id = ty * cols + tx;
       page->x = tx * page_w;
       page->y = ty * page_h;
       page->w = page_w;
       page->h = page_h;
+      page->pixel_format = format;
 
       // Create buffer string
       page->buffer = mrbc_string_new(vm, NULL, page_size);
-      memset(page->buffer.string->data, 0, page_size);
+      if (mrbc_type(page->buffer) != MRBC_TT_STRING) {
+        disp->page_count = ty * cols + tx;
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "Failed to allocate page buffer");
+        return;
+      }
+      page->buffer_size = page_size;
       // TODO: memory leak of page->buffer happens
 
-      page->dirty = false;
-      page->pixel_format = PIXEL_FORMAT_MONO;
-      page->set_pixel = mrubyc_mono_page_set_pixel;
-      page->get_pixel = mrubyc_mono_page_get_pixel;
-      page->fill = mrubyc_mono_page_fill;
-      page->fill(page, 0);
+      vram_page_fill(page, 0);
+      page_clear_dirty(page);
     }
   }
 
@@ -138,16 +116,21 @@ vram_pages_sub(mrbc_vm *vm, mrbc_value *v, int argc, bool dirty)
   for (int i = 0; i < disp->page_count; i++) {
     display_page_t *page = &disp->pages[i];
     if (!dirty || page->dirty) {
-      int cols = disp->w / page->w;
-      int col = i % cols;
-      int row = i / cols;
-      mrbc_value entry = mrbc_array_new(vm, 3);
+      int col = i % disp->cols;
+      int row = i / disp->cols;
+      mrbc_value entry = mrbc_array_new(vm, dirty ? 7 : 3);
       mrbc_incref(&entry);
       mrbc_array_set(&entry, 0, &mrbc_integer_value(col));
       mrbc_array_set(&entry, 1, &mrbc_integer_value(row));
       mrbc_array_set(&entry, 2, &page->buffer);
+      if (dirty) {
+        mrbc_array_set(&entry, 3, &mrbc_integer_value(page->dirty_x0));
+        mrbc_array_set(&entry, 4, &mrbc_integer_value(page->dirty_y0));
+        mrbc_array_set(&entry, 5, &mrbc_integer_value(page->dirty_x1 - page->dirty_x0));
+        mrbc_array_set(&entry, 6, &mrbc_integer_value(page->dirty_y1 - page->dirty_y0));
+      }
       mrbc_array_push(&result, &entry);
-      if (clear_dirty) page->dirty = false;
+      if (clear_dirty) page_clear_dirty(page);
     }
   }
   return result;
@@ -164,7 +147,8 @@ c_vram_pages(mrbc_vm *vm, mrbc_value *v, int argc)
 }
 
 /*
- * vram.dirty_pages
+ * vram.dirty_pages => [[col, row, data, x, y, w, h], ]
+ *   x, y, w, h: page-local box drawn since the last call
  */
 static void
 c_vram_dirty_pages(mrbc_vm *vm, mrbc_value *v, int argc)
@@ -186,19 +170,27 @@ c_vram_set_pixel(mrbc_vm *vm, mrbc_value *v, int argc)
   int y = GET_INT_ARG(2);
   int color = GET_INT_ARG(3);
 
-  for (int i = 0; i < disp->page_count; i++) {
-    display_page_t *page = &disp->pages[i];
-    if (x >= page->x && x < page->x + page->w &&
-        y >= page->y && y < page->y + page->h) {
-      page->set_pixel(page, x - page->x, y - page->y, color);
-      break;
-    }
-  }
+  vram_set_pixel(disp, x, y, color);
 
   //mrbc_incref(&v[0]);
   //SET_RETURN(v[0]);
 }
 
+/*
+ * vram.get_pixel(x, y)
+ */
+static void
+c_vram_get_pixel(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  display_t *disp = (display_t *)v[0].instance->data;
+  if (!disp) return;
+
+  int x = GET_INT_ARG(1);
+  int y = GET_INT_ARG(2);
+
+  SET_INT_RETURN(vram_get_pixel(disp, x, y));
+}
+
 /*
  * vram.draw_line(x0, y0, x1, y1, color)
  */
@@ -214,39 +206,7 @@ c_vram_draw_line(mrbc_vm *vm, mrbc_value *v, int argc)
   int y1 = GET_INT_ARG(4);
   int color = GET_INT_ARG(5);
 
-  // Bresenham's line algorithm
-  int dx = x1 > x0 ? x1 - x0 : x0 - x1;
-  int dy = y1 > y0 ? y1 - y0 : y0 - y1;
-  int sx = x0 < x1 ? 1 : -1;
-  int sy = y0 < y1 ? 1 : -1;
-  int err = dx - dy;
-
-  int x = x0;
-  int y = y0;
-
-  while (1) {
-    // Set pixel at current position
-    for (int i = 0; i < disp->page_count; i++) {
-      display_page_t *page = &disp->pages[i];
-      if (x >= page->x && x < page->x + page->w &&
-          y >= page->y && y < page->y + page->h) {
-        page->set_pixel(page, x - page->x, y - page->y, color);
-        break;
-      }
-    }
-
-    if (x == x1 && y == y1) break;
-
-    int e2 = 2 * err;
-    if (e2 > -dy) {
-      err -= dy;
-      x += sx;
-    }
-    if (e2 < dx) {
-      err += dx;
-      y += sy;
-    }
-  }
+  vram_draw_line(disp, x0, y0, x1, y1, color);
 
   //mrbc_incref(&v[0]);
   //SET_RETURN(v[0]);
@@ -267,20 +227,7 @@ c_vram_draw_rect(mrbc_vm *vm, mrbc_value *v, int argc)
   int h = GET_INT_ARG(4);
   int color = GET_INT_ARG(5);
 
-  for (int i = 0; i < h; i++) {
-    for (int j = 0; j < w; j++) {
-      int px = x + j;
-      int py = y + i;
-      for (int k = 0; k < disp->page_count; k++) {
-        display_page_t *page = &disp->pages[k];
-        if (px >= page->x && px < page->x + page->w &&
-            py >= page->y && py < page->y + page->h) {
-          page->set_pixel(page, px - page->x, py - page->y, color);
-          break;
-        }
-      }
-    }
-  }
+  vram_fill_rect(disp, x, y, w, h, color);
 
   //mrbc_incref(&v[0]);
   //SET_RETURN(v[0]);
@@ -296,17 +243,29 @@ c_vram_fill(mrbc_vm *vm, mrbc_value *v, int argc)
   if (!disp) return;
 
   int color = GET_INT_ARG(1);
-  for (int i = 0; i < disp->page_count; i++) {
-    display_page_t *page = &disp->pages[i];
-    page->fill(page, color);
-  }
+  vram_fill(disp, color);
 
   //mrbc_incref(&v[0]);
   //SET_RETURN(v[0]);
 }
 
+/* Integer color: keyword or 1; returns false after raising */
+static bool
+vram_color_kwarg(mrbc_vm *vm, mrbc_value *v, uint32_t *color)
+{
+  mrbc_value color_val = mrbc_hash_get(v + 1, &mrbc_symbol_value(mrbc_str_to_symid("color")));
+  *color = 1;
+  if (mrbc_type(color_val) == MRBC_TT_NIL) return true;
+  if (mrbc_type(color_val) != MRBC_TT_INTEGER) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "color must be an Integer");
+    return false;
+  }
+  *color = (uint32_t)color_val.i;
+  return true;
+}
+
 /*
- * vram.draw_bitmap(x:, y:, w:, h:, data:)
+ * vram.draw_bitmap(x:, y:, w:, h:, data:, color: 1)
  * data: Array[Integer] - each element represents a row's bit pattern
  */
 static void
@@ -327,6 +286,8 @@ c_vram_draw_bitmap(mrbc_vm *vm, mrbc_value *v, int argc)
     mrbc_raise(vm, MRBC_CLASS(ArgumentError), "Invalid arguments for draw_bitmap");
     return;
   }
+  uint32_t color;
+  if (!vram_color_kwarg(vm, v, &color)) return;
 
   int x = x_val.i;
   int y = y_val.i;
@@ -334,31 +295,31 @@ c_vram_draw_bitmap(mrbc_vm *vm, mrbc_value *v, int argc)
   int height = height_val.i;
 
   if (width <= 0 || height <= 0) return;
-
-  for (int img_y = 0; img_y < height && img_y < data_val.array->n_stored; img_y++) {
-    mrbc_value row_val = mrbc_array_get(&data_val, img_y);
-    if (mrbc_type(row_val) == MRBC_TT_INTEGER) {
-      uint64_t row_data = (uint64_t)row_val.i;
-      for (int img_x = 0; img_x < width; img_x++) {
-        uint8_t pixel = (row_data >> (width - 1 - img_x)) & 1;
-        int screen_x = x + img_x;
-        int screen_y = y + img_y;
-
-        for (int i = 0; i < disp->page_count; i++) {
-          display_page_t *page = &disp->pages[i];
-          if (screen_x >= page->x && screen_x < page->x + page->w &&
-              screen_y >= page->y && screen_y < page->y + page->h) {
-            page->set_pixel(page, screen_x - page->x, screen_y - page->y, pixel);
-            break;
-          }
-        }
-      }
+  if (data_val.array->n_stored < height) height = data_val.array->n_stored;
+  if (height == 0) return;
+
+  // Pack the rows (bit width-1 is the leftmost pixel) into 1-bit image rows
+  int stride = (width + 7) / 8;
+  uint8_t stack_bits[VRAM_BITMAP_STACK];
+  uint8_t *bits = stack_bits;
+  if ((int)sizeof(stack_bits) < stride * height) {
+    bits = mrbc_alloc(vm, stride * height);
+    if (!bits) {
+      mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "Failed to allocate bitmap");
+      return;
     }
   }
+  for (int img_y = 0; img_y < height; img_y++) {
+    mrbc_value row_val = mrbc_array_get(&data_val, img_y);
+    uint64_t row_data = (mrbc_type(row_val) == MRBC_TT_INTEGER) ? (uint64_t)row_val.i : 0;
+    vram_pack_row(bits + img_y * stride, row_data, width);
+  }
+  vram_blit(disp, x, y, width, height, bits, stride, color);
+  if (bits != stack_bits) mrbc_free(vm, bits);
 }
 
 /*
- * vram.draw_bytes(x:, y:, w:, h:, data:)
+ * vram.draw_bytes(x:, y:, w:, h:, data:, color: 1)
  * data: String - packed byte array
  */
 static void
@@ -379,6 +340,8 @@ c_vram_draw_bytes(mrbc_vm *vm, mrbc_value *v, int argc)
     mrbc_raise(vm, MRBC_CLASS(ArgumentError), "Invalid arguments for draw_bytes");
     return;
   }
+  uint32_t color;
+  if (!vram_color_kwarg(vm, v, &color)) return;
 
   int x = x_val.i;
   int y = y_val.i;
@@ -389,29 +352,21 @@ c_vram_draw_bytes(mrbc_vm *vm, mrbc_value *v, int argc)
 
   const uint8_t *image_data = (const uint8_t *)data_val.string->data;
   int data_size = data_val.string->size;
-
-  for (int img_y = 0; img_y < height; img_y++) {
-    for (int img_x = 0; img_x < width; img_x++) {
-      int byte_idx = (img_y * ((width + 7) / 8)) + (img_x / 8);
-      int bit_idx = 7 - (img_x % 8);
-
-      uint8_t pixel = 0;
-      if (byte_idx < data_size) {
-        pixel = (image_data[byte_idx] >> bit_idx) & 1;
-      }
-
-      int screen_x = x + img_x;
-      int screen_y = y + img_y;
-
-      for (int i = 0; i < disp->page_count; i++) {
-        display_page_t *page = &disp->pages[i];
-        if (screen_x >= page->x && screen_x < page->x + page->w &&
-            screen_y >= page->y && screen_y < page->y + page->h) {
-          page->set_pixel(page, screen_x - page->x, screen_y - page->y, pixel);
-          break;
-        }
-      }
+  int stride = (width + 7) / 8;
+
+  if (data_size < stride * height) {
+    // Missing bytes are blank
+    uint8_t *bits = mrbc_alloc(vm, stride * height);
+    if (!bits) {
+      mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "Failed to allocate bitmap");
+      return;
     }
+    memset(bits, 0, stride * height);
+    memcpy(bits, image_data, data_size);
+    vram_blit(disp, x, y, width, height, bits, stride, color);
+    mrbc_free(vm, bits);
+  } else {
+    vram_blit(disp, x, y, width, height, image_data, stride, color);
   }
 }
 
@@ -429,20 +384,7 @@ c_vram_erase(mrbc_vm *vm, mrbc_value *v, int argc)
   int w = GET_INT_ARG(3);
   int h = GET_INT_ARG(4);
 
-  for (int i = 0; i < h; i++) {
-    for (int j = 0; j < w; j++) {
-      int px = x + j;
-      int py = y + i;
-      for (int k = 0; k < disp->page_count; k++) {
-        display_page_t *page = &disp->pages[k];
-        if (px >= page->x && px < page->x + page->w &&
-            py >= page->y && py < page->y + page->h) {
-          page->set_pixel(page, px - page->x, py - page->y, 0);
-          break;
-        }
-      }
-    }
-  }
+  vram_fill_rect(disp, x, y, w, h, 0);
 }
 
 void
@@ -455,6 +397,7 @@ mrbc_vram_init(struct VM *vm)
   mrbc_define_method(0, class_VRAM, "pages", c_vram_pages);
   mrbc_define_method(0, class_VRAM, "dirty_pages", c_vram_dirty_pages);
   mrbc_define_method(0, class_VRAM, "set_pixel", c_vram_set_pixel);
+  mrbc_define_method(0, class_VRAM, "get_pixel", c_vram_get_pixel);
   mrbc_define_method(0, class_VRAM, "draw_line", c_vram_draw_line);
   mrbc_define_method(0, class_VRAM, "draw_rect", c_vram_draw_rect);
   mrbc_define_method(0, class_VRAM, "draw_bitmap", c_vram_draw_bitmap);
@@ -1,5 +1,437 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
 #include "../include/vram.h"
 
+#if defined(PICORB_VM_MRUBY)
+#include "mruby/string.h"
+#define PAGE_DATA(page) ((uint8_t *)RSTRING_PTR((page)->buffer))
+#elif defined(PICORB_VM_MRUBYC)
+#define PAGE_DATA(page) ((uint8_t *)(page)->buffer.string->data)
+#endif
+
+/*
+ * Drawing primitives shared by both VMs
+ *
+ * Buffer layouts:
+ *   MONO      SSD1306 style: one byte is a column of 8 rows, LSB on top
+ *   GRAY4     two pixels per byte, the left one in the high nibble
+ *   GRAY8     one byte per pixel
+ *   RGB565    two bytes per pixel, high byte first as SPI panels expect
+ *   RGB888    R, G, B
+ *   ARGB8888  A, R, G, B
+ * Rows of the other formats follow each other without padding.
+ *
+ * Rectangles are clipped against each page once. The clipped part is
+ * filled row by row with memset or 16/32-bit stores (byte-wise masks
+ * across each 8-row band for MONO) rather than pixel by pixel.
+ *
+ * Each page keeps the bounding box of what was drawn since dirty_pages
+ * last cleared it, so drivers can send just that window.
+ */
+
+static const char * const vram_format_names[] = {
+  "mono", "gray4", "gray8", "rgb565", "rgb888", "argb8888",
+};
+
+/* Returns -1 for an unknown name */
+static int
+vram_format_from_name(const char *name)
+{
+  for (int i = 0; i < (int)(sizeof(vram_format_names) / sizeof(vram_format_names[0])); i++) {
+    if (strcmp(name, vram_format_names[i]) == 0) return i;
+  }
+  return -1;
+}
+
+static size_t
+vram_page_size(pixel_format_t format, int w, int h)
+{
+  switch (format) {
+    case PIXEL_FORMAT_MONO:     return (size_t)w * ((h + 7) / 8);
+    case PIXEL_FORMAT_GRAY4:    return (size_t)((w + 1) / 2) * h;
+    case PIXEL_FORMAT_GRAY8:    return (size_t)w * h;
+    case PIXEL_FORMAT_RGB565:   return (size_t)w * h * 2;
+    case PIXEL_FORMAT_RGB888:   return (size_t)w * h * 3;
+    case PIXEL_FORMAT_ARGB8888: return (size_t)w * h * 4;
+  }
+  return 0;
+}
+
+/* Bytes from a row start to pixel x; GRAY4 gives the byte of the pair */
+static size_t
+vram_row_offset(const display_page_t *page, int x, int y)
+{
+  switch (page->pixel_format) {
+    case PIXEL_FORMAT_GRAY4:    return (size_t)((page->w + 1) / 2) * y + x / 2;
+    case PIXEL_FORMAT_GRAY8:    return (size_t)page->w * y + x;
+    case PIXEL_FORMAT_RGB565:   return ((size_t)page->w * y + x) * 2;
+    case PIXEL_FORMAT_RGB888:   return ((size_t)page->w * y + x) * 3;
+    case PIXEL_FORMAT_ARGB8888: return ((size_t)page->w * y + x) * 4;
+    default:                    return (size_t)page->w * (y / 8) + x;
+  }
+}
+
+/* color in the byte order of the buffer, ready for a 16/32-bit store */
+static uint16_t
+rgb565_pattern(uint32_t color)
+{
+  uint8_t bytes[2] = { (uint8_t)(color >> 8), (uint8_t)color };
+  uint16_t pattern;
+  memcpy(&pattern, bytes, 2);
+  return pattern;
+}
+
+static uint32_t
+argb8888_pattern(uint32_t color)
+{
+  uint8_t bytes[4] = { (uint8_t)(color >> 24), (uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color };
+  uint32_t pattern;
+  memcpy(&pattern, bytes, 4);
+  return pattern;
+}
+
+static void
+page_put(display_page_t *page, uint8_t *data, int x, int y, uint32_t color)
+{
+  uint8_t *p = data + vram_row_offset(page, x, y);
+  switch (page->pixel_format) {
+    case PIXEL_FORMAT_MONO:
+      if (color) {
+        *p |= (uint8_t)(1 << (y % 8));
+      } else {
+        *p &= (uint8_t)~(1 << (y % 8));
+      }
+      break;
+    case PIXEL_FORMAT_GRAY4:
+      if (x % 2) {
+        *p = (*p & 0xF0) | (color & 0x0F);
+      } else {
+        *p = (*p & 0x0F) | (uint8_t)((color & 0x0F) << 4);
+      }
+      break;
+    case PIXEL_FORMAT_GRAY8:
+      *p = (uint8_t)color;
+      break;
+    case PIXEL_FORMAT_RGB565: {
+      uint16_t pattern = rgb565_pattern(color);
+      memcpy(p, &pattern, 2);
+      break;
+    }
+    case PIXEL_FORMAT_RGB888:
+      p[0] = (uint8_t)(color >> 16);
+      p[1] = (uint8_t)(color >> 8);
+      p[2] = (uint8_t)color;
+      break;
+    case PIXEL_FORMAT_ARGB8888: {
+      uint32_t pattern = argb8888_pattern(color);
+      memcpy(p, &pattern, 4);
+      break;
+    }
+  }
+}
+
+static uint32_t
+page_get(const display_page_t *page, const uint8_t *data, int x, int y)
+{
+  const uint8_t *p = data + vram_row_offset(page, x, y);
+  switch (page->pixel_format) {
+    case PIXEL_FORMAT_MONO:     return (*p >> (y % 8)) & 1;
+    case PIXEL_FORMAT_GRAY4:    return (x % 2) ? (*p & 0x0F) : (*p >> 4);
+    case PIXEL_FORMAT_GRAY8:    return *p;
+    case PIXEL_FORMAT_RGB565:   return (uint32_t)p[0] << 8 | p[1];
+    case PIXEL_FORMAT_RGB888:   return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    case PIXEL_FORMAT_ARGB8888: return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+  }
+  return 0;
+}
+
+/* Grows the dirty box of the page to cover the page-local rectangle */
+static void
+page_mark_dirty(display_page_t *page, int x, int y, int w, int h)
+{
+  if (!page->dirty) {
+    page->dirty = true;
+    page->dirty_x0 = x;
+    page->dirty_y0 = y;
+    page->dirty_x1 = x + w;
+    page->dirty_y1 = y + h;
+    return;
+  }
+  if (x < page->dirty_x0) page->dirty_x0 = x;
+  if (y < page->dirty_y0) page->dirty_y0 = y;
+  if (page->dirty_x1 < x + w) page->dirty_x1 = x + w;
+  if (page->dirty_y1 < y + h) page->dirty_y1 = y + h;
+}
+
+static void
+page_clear_dirty(display_page_t *page)
+{
+  page->dirty = false;
+  page->dirty_x0 = page->dirty_y0 = 0;
+  page->dirty_x1 = page->dirty_y1 = 0;
+}
+
+/* Rows y..y+h-1 of a MONO band as a bit mask */
+static uint8_t
+mono_band_mask(int band, int y, int h)
+{
+  int top = band * 8;
+  int from = (y < top) ? 0 : y - top;
+  int to = (top + 8 < y + h) ? 8 : y + h - top;
+  return (uint8_t)((0xFF << from) & (0xFF >> (8 - to)));
+}
+
+/* x, y, w and h are page-local and already clipped */
+static void
+page_fill_rect(display_page_t *page, int x, int y, int w, int h, uint32_t color)
+{
+  uint8_t *data = PAGE_DATA(page);
+  page_mark_dirty(page, x, y, w, h);
+  switch (page->pixel_format) {
+    case PIXEL_FORMAT_MONO: {
+      uint8_t on = color ? 0xFF : 0x00;
+      for (int band = y / 8; band <= (y + h - 1) / 8; band++) {
+        uint8_t mask = mono_band_mask(band, y, h);
+        uint8_t *p = data + (size_t)page->w * band + x;
+        if (mask == 0xFF) {
+          memset(p, on, w);
+        } else {
+          for (int i = 0; i < w; i++) p[i] = (p[i] & ~mask) | (on & mask);
+        }
+      }
+      break;
+    }
+    case PIXEL_FORMAT_GRAY4: {
+      uint8_t c = color & 0x0F;
+      for (int row = y; row < y + h; row++) {
+        int from = x;
+        int to = x + w;
+        if (from % 2) page_put(page, data, from++, row, c);
+        if (to % 2 && from < to) page_put(page, data, --to, row, c);
+        if (from < to) memset(data + vram_row_offset(page, from, row), c << 4 | c, (to - from) / 2);
+      }
+      break;
+    }
+    case PIXEL_FORMAT_GRAY8:
+      for (int row = y; row < y + h; row++) {
+        memset(data + vram_row_offset(page, x, row), (uint8_t)color, w);
+      }
+      break;
+    case PIXEL_FORMAT_RGB565: {
+      uint16_t pattern = rgb565_pattern(color);
+      for (int row = y; row < y + h; row++) {
+        uint8_t *p = data + vram_row_offset(page, x, row);
+        if ((uintptr_t)p % 2) {
+          for (int i = 0; i < w; i++) memcpy(p + i * 2, &pattern, 2);
+        } else {
+          for (int i = 0; i < w; i++) ((uint16_t *)p)[i] = pattern;
+        }
+      }
+      break;
+    }
+    case PIXEL_FORMAT_RGB888:
+      for (int row = y; row < y + h; row++) {
+        uint8_t *p = data + vram_row_offset(page, x, row);
+        for (int i = 0; i < w; i++, p += 3) {
+          p[0] = (uint8_t)(color >> 16);
+          p[1] = (uint8_t)(color >> 8);
+          p[2] = (uint8_t)color;
+        }
+      }
+      break;
+    case PIXEL_FORMAT_ARGB8888: {
+      uint32_t pattern = argb8888_pattern(color);
+      for (int row = y; row < y + h; row++) {
+        uint8_t *p = data + vram_row_offset(page, x, row);
+        if ((uintptr_t)p % 4) {
+          for (int i = 0; i < w; i++) memcpy(p + i * 4, &pattern, 4);
+        } else {
+          for (int i = 0; i < w; i++) ((uint32_t *)p)[i] = pattern;
+        }
+      }
+      break;
+    }
+  }
+}
+
+static void
+vram_page_fill(display_page_t *page, uint32_t color)
+{
+  page_fill_rect(page, 0, 0, page->w, page->h, color);
+}
+
+/*
+ * Intersects the rectangle with the page and makes it page-local.
+ * Returns false if they do not overlap.
+ */
+static bool
+page_clip(const display_page_t *page, int *x, int *y, int *w, int *h)
+{
+  int x0 = *x - page->x;
+  int y0 = *y - page->y;
+  int x1 = x0 + *w;
+  int y1 = y0 + *h;
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (page->w < x1) x1 = page->w;
+  if (page->h < y1) y1 = page->h;
+  if (x1 <= x0 || y1 <= y0) return false;
+  *x = x0;
+  *y = y0;
+  *w = x1 - x0;
+  *h = y1 - y0;
+  return true;
+}
+
+static display_page_t *
+vram_page_at(display_t *disp, int x, int y)
+{
+  if (x < 0 || y < 0 || disp->page_count == 0) return NULL;
+  int col = x / disp->pages[0].w;
+  int row = y / disp->pages[0].h;
+  if (disp->cols <= col || disp->rows <= row) return NULL;
+  return &disp->pages[row * disp->cols + col];
+}
+
+static void
+vram_set_pixel(display_t *disp, int x, int y, uint32_t color)
+{
+  display_page_t *page = vram_page_at(disp, x, y);
+  if (page == NULL) return;
+  page_put(page, PAGE_DATA(page), x - page->x, y - page->y, color);
+  page_mark_dirty(page, x - page->x, y - page->y, 1, 1);
+}
+
+static uint32_t
+vram_get_pixel(display_t *disp, int x, int y)
+{
+  display_page_t *page = vram_page_at(disp, x, y);
+  if (page == NULL) return 0;
+  return page_get(page, PAGE_DATA(page), x - page->x, y - page->y);
+}
+
+static void
+vram_fill_rect(display_t *disp, int x, int y, int w, int h, uint32_t color)
+{
+  if (w <= 0 || h <= 0) return;
+  for (int i = 0; i < disp->page_count; i++) {
+    display_page_t *page = &disp->pages[i];
+    int px = x, py = y, pw = w, ph = h;
+    if (page_clip(page, &px, &py, &pw, &ph)) {
+      page_fill_rect(page, px, py, pw, ph, color);
+    }
+  }
+}
+
+static void
+vram_fill(display_t *disp, uint32_t color)
+{
+  for (int i = 0; i < disp->page_count; i++) {
+    vram_page_fill(&disp->pages[i], color);
+  }
+}
+
+static void
+vram_draw_line(display_t *disp, int x0, int y0, int x1, int y1, uint32_t color)
+{
+  // Horizontal and vertical lines are spans
+  if (y0 == y1) {
+    vram_fill_rect(disp, (x0 < x1) ? x0 : x1, y0, (x0 < x1 ? x1 - x0 : x0 - x1) + 1, 1, color);
+    return;
+  }
+  if (x0 == x1) {
+    vram_fill_rect(disp, x0, (y0 < y1) ? y0 : y1, 1, (y0 < y1 ? y1 - y0 : y0 - y1) + 1, color);
+    return;
+  }
+
+  // Bresenham's line algorithm
+  int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+  int dy = y1 > y0 ? y1 - y0 : y0 - y1;
+  int sx = x0 < x1 ? 1 : -1;
+  int sy = y0 < y1 ? 1 : -1;
+  int err = dx - dy;
+
+  int x = x0;
+  int y = y0;
+
+  while (1) {
+    vram_set_pixel(disp, x, y, color);
+
+    if (x == x1 && y == y1) break;
+
+    int e2 = 2 * err;
+    if (e2 > -dy) {
+      err -= dy;
+      x += sx;
+    }
+    if (e2 < dx) {
+      err += dx;
+      y += sy;
+    }
+  }
+}
+
+/*
+ * Draws a 1-bit image: rows of stride bytes, leftmost pixel in the MSB.
+ * 1 bits become color and 0 bits become 0.
+ */
+static void
+vram_blit(display_t *disp, int x, int y, int w, int h, const uint8_t *bits, int stride, uint32_t color)
+{
+  if (w <= 0 || h <= 0) return;
+  for (int i = 0; i < disp->page_count; i++) {
+    display_page_t *page = &disp->pages[i];
+    int px = x, py = y, pw = w, ph = h;
+    if (!page_clip(page, &px, &py, &pw, &ph)) continue;
+    int sx = page->x + px - x; /* first source column and row */
+    int sy = page->y + py - y;
+    uint8_t *data = PAGE_DATA(page);
+    page_mark_dirty(page, px, py, pw, ph);
+    if (page->pixel_format == PIXEL_FORMAT_MONO) {
+      uint8_t on = color ? 0xFF : 0x00;
+      for (int band = py / 8; band <= (py + ph - 1) / 8; band++) {
+        uint8_t mask = mono_band_mask(band, py, ph);
+        uint8_t *p = data + (size_t)page->w * band + px;
+        for (int col = 0; col < pw; col++) {
+          int bit_x = sx + col;
+          uint8_t byte = 0;
+          for (int b = 0; b < 8; b++) {
+            if (!(mask & (1 << b))) continue;
+            const uint8_t *src = bits + (size_t)(sy + band * 8 + b - py) * stride;
+            if (src[bit_x / 8] & (0x80 >> (bit_x % 8))) byte |= (uint8_t)(1 << b);
+          }
+          p[col] = (p[col] & ~mask) | (byte & on);
+        }
+      }
+      continue;
+    }
+    for (int row = 0; row < ph; row++) {
+      const uint8_t *src = bits + (size_t)(sy + row) * stride;
+      for (int col = 0; col < pw; col++) {
+        int bit_x = sx + col;
+        uint32_t c = (src[bit_x / 8] & (0x80 >> (bit_x % 8))) ? color : 0;
+        page_put(page, data, px + col, py + row, c);
+      }
+    }
+  }
+}
+
+/* draw_bitmap packs rows up to this size on the stack */
+#define VRAM_BITMAP_STACK 128
+
+/* A draw_bitmap row: bit w-1 is the leftmost pixel */
+static void
+vram_pack_row(uint8_t *dst, uint64_t row, int w)
+{
+  memset(dst, 0, (w + 7) / 8);
+  for (int i = 0; i < w; i++) {
+    int shift = w - 1 - i;
+    if (shift < 64 && ((row >> shift) & 1)) dst[i / 8] |= (uint8_t)(0x80 >> (i % 8));
+  }
+}
+
 #if defined(PICORB_VM_MRUBY)
 
 #include "mruby/vram.c"